@@ -1,14 +1,18 @@
+#include <linux/atomic.h>
 #include <linux/capability.h>
 #include <linux/compiler.h>
 #include <linux/fs.h>
 #include <linux/gfp.h>
+#include <linux/hashtable.h>
 #include <linux/kernel.h>
 #include <linux/list.h>
 #include <linux/mutex.h>
 #include <linux/printk.h>
 #include <linux/slab.h>
+#include <linux/spinlock.h>
 #include <linux/task_work.h>
 #include <linux/types.h>
+#include <linux/uaccess.h>
 #include <linux/version.h>
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 11, 0)
 #include <linux/sched/task.h>
@@ -30,7 +34,19 @@
 #endif // #ifndef CONFIG_KSU_HYMOFS
 
 #define FILE_MAGIC 0x7f4b5355 // ' KSU', u32
-#define FILE_FORMAT_VERSION 3 // u32
+/*
+ * Version 3 is a snapshot: every record is a live app_profile.
+ * Version 4 is a log: records are appended per change, later records win,
+ * and a record whose version is KSU_ALLOWLIST_TOMBSTONE deletes (uid, key).
+ * Both share the record layout, so either loader can read either file;
+ * older kernels skip tombstones as invalid profiles.
+ */
+#define FILE_FORMAT_VERSION 4 // u32
+#define FILE_FORMAT_SNAPSHOT 3
+#define KSU_ALLOWLIST_TOMBSTONE 0
+
+// Rewrite the log once it holds this many records beyond the live ones
+#define ALLOWLIST_COMPACT_SLACK 64
 
 #define KSU_APP_PROFILE_PRESERVE_UID 9999 // NOBODY_UID
 #define KSU_DEFAULT_SELINUX_DOMAIN "u:r:" KERNEL_SU_DOMAIN ":s0"
@@ -45,6 +61,17 @@ static int allow_list_arr[PAGE_SIZE / sizeof(int)] __read_mostly
     __aligned(PAGE_SIZE);
 static int allow_list_pointer __read_mostly = 0;
 
+static bool uid_in_arr(uid_t uid)
+{
+	int i;
+
+	for (i = 0; i < allow_list_pointer; i++) {
+		if (allow_list_arr[i] == uid)
+			return true;
+	}
+	return false;
+}
+
 static void remove_uid_from_arr(uid_t uid)
 {
 	int *temp_arr;
@@ -93,10 +120,32 @@ static void init_default_profiles(void)
 
 struct perm_data {
 	struct list_head list;
+	struct hlist_node node; // allow_list_index, keyed by current_uid
 	struct app_profile profile;
 };
 
 static struct list_head allow_list;
+static u32 allow_list_count;
+
+#define ALLOW_LIST_HASH_BITS 8
+static DEFINE_HASHTABLE(allow_list_index, ALLOW_LIST_HASH_BITS);
+
+// Changes not yet appended to the on-disk log, drained by the init task work
+struct allowlist_delta {
+	struct list_head list;
+	struct app_profile profile;
+};
+
+static LIST_HEAD(allowlist_deltas);
+static DEFINE_SPINLOCK(allowlist_delta_lock);
+// Records in the on-disk log, 0 when it must be rewritten before appending
+static u32 allowlist_log_records;
+// Size of the log as last written or loaded; anything else means the file
+// was replaced behind our back (e.g. a backup restored by the manager)
+static loff_t allowlist_log_size;
+
+// Bumped on every allow_list change so readers can tell a cached copy is stale
+static atomic64_t allow_list_generation = ATOMIC64_INIT(1);
 
 static uint8_t allow_list_bitmap[PAGE_SIZE] __read_mostly __aligned(PAGE_SIZE);
 #define BITMAP_UID_MAX ((sizeof(allow_list_bitmap) * BITS_PER_BYTE) - 1)
@@ -105,6 +154,66 @@ static uint8_t allow_list_bitmap[PAGE_SIZE] __read_mostly __aligned(PAGE_SIZE);
 
 void persistent_allow_list(void);
 
+/*
+ * With key NULL, return the first profile added for uid, as the list walk
+ * used to. hash_add() inserts at the bucket head, so that is the last match.
+ */
+static struct perm_data *find_perm_data(uid_t uid, const char *key)
+{
+	struct perm_data *p, *found = NULL;
+
+	hash_for_each_possible (allow_list_index, p, node, uid) {
+		if (p->profile.current_uid != uid)
+			continue;
+		if (!key)
+			found = p;
+		else if (!strcmp(p->profile.key, key))
+			return p;
+	}
+	return found;
+}
+
+static void remove_perm_data(struct perm_data *np)
+{
+	uid_t uid = np->profile.current_uid;
+
+	list_del(&np->list);
+	hash_del(&np->node);
+	allow_list_count--;
+	if (likely(uid <= BITMAP_UID_MAX)) {
+		allow_list_bitmap[uid / BITS_PER_BYTE] &=
+		    ~(1 << (uid % BITS_PER_BYTE));
+	}
+	remove_uid_from_arr(uid);
+	smp_mb();
+	kfree(np);
+}
+
+// Queue one record for the on-disk log; persistent_allow_list() flushes it
+static void allowlist_log(const struct app_profile *profile, bool tombstone)
+{
+	struct allowlist_delta *d;
+
+	d = kzalloc(sizeof(*d), GFP_KERNEL);
+	if (!d) {
+		pr_err("allowlist_log: alloc failed, forcing rewrite\n");
+		allowlist_log_records = 0;
+		return;
+	}
+
+	if (tombstone) {
+		d->profile.version = KSU_ALLOWLIST_TOMBSTONE;
+		d->profile.current_uid = profile->current_uid;
+		strscpy(d->profile.key, profile->key, sizeof(d->profile.key));
+	} else {
+		memcpy(&d->profile, profile, sizeof(d->profile));
+	}
+
+	spin_lock(&allowlist_delta_lock);
+	list_add_tail(&d->list, &allowlist_deltas);
+	spin_unlock(&allowlist_delta_lock);
+}
+
 void ksu_show_allow_list(void)
 {
 	struct perm_data *p = NULL;
@@ -134,24 +243,14 @@ static void ksu_grant_root_to_shell(void)
 
 bool ksu_get_app_profile(struct app_profile *profile)
 {
-	struct perm_data *p = NULL;
-	struct list_head *pos = NULL;
-	bool found = false;
-	bool uid_match = false;
+	struct perm_data *p = find_perm_data(profile->current_uid, NULL);
 
-	list_for_each (pos, &allow_list) {
-		p = list_entry(pos, struct perm_data, list);
-		uid_match = profile->current_uid == p->profile.current_uid;
-		if (uid_match) {
-			// found it, override it with ours
-			memcpy(profile, &p->profile, sizeof(*profile));
-			found = true;
-			goto exit;
-		}
-	}
+	if (!p)
+		return false;
 
-exit:
-	return found;
+	// found it, override it with ours
+	memcpy(profile, &p->profile, sizeof(*profile));
+	return true;
 }
 
 static inline bool forbid_system_uid(uid_t uid)
@@ -188,7 +287,6 @@ static bool profile_valid(struct app_profile *profile)
 bool ksu_set_app_profile(struct app_profile *profile, bool persist)
 {
 	struct perm_data *p = NULL;
-	struct list_head *pos = NULL;
 	bool result = false;
 
 	if (!profile_valid(profile)) {
@@ -196,17 +294,14 @@ bool ksu_set_app_profile(struct app_profile *profile, bool persist)
 		return false;
 	}
 
-	list_for_each (pos, &allow_list) {
-		p = list_entry(pos, struct perm_data, list);
-		// both uid and package must match, otherwise it will break
-		// multiple package with different user id
-		if (profile->current_uid == p->profile.current_uid &&
-		    !strcmp(profile->key, p->profile.key)) {
-			// found it, just override it all!
-			memcpy(&p->profile, profile, sizeof(*profile));
-			result = true;
-			goto out;
-		}
+	// both uid and package must match, otherwise it will break
+	// multiple package with different user id
+	p = find_perm_data(profile->current_uid, profile->key);
+	if (p) {
+		// found it, just override it all!
+		memcpy(&p->profile, profile, sizeof(*profile));
+		result = true;
+		goto out;
 	}
 
 	// not found, alloc a new node!
@@ -230,8 +325,11 @@ bool ksu_set_app_profile(struct app_profile *profile, bool persist)
 		    profile->nrp_config.profile.umount_modules);
 	}
 	list_add_tail(&p->list, &allow_list);
+	hash_add(allow_list_index, &p->node, p->profile.current_uid);
+	allow_list_count++;
 
 out:
+	atomic64_inc(&allow_list_generation);
 	if (profile->current_uid <= BITMAP_UID_MAX) {
 		if (profile->allow_su)
 			allow_list_bitmap[profile->current_uid /
@@ -242,7 +340,10 @@ out:
 					  BITS_PER_BYTE] &=
 			    ~(1 << (profile->current_uid % BITS_PER_BYTE));
 	} else {
-		if (profile->allow_su) {
+		if (!profile->allow_su) {
+			remove_uid_from_arr(profile->current_uid);
+		} else if (!uid_in_arr(profile->current_uid)) {
+			// updates and log replay set an already listed uid again
 			/*
 			 * 1024 apps with uid higher than BITMAP_UID_MAX
 			 * registered to request superuser?
@@ -254,8 +355,6 @@ out:
 			}
 			allow_list_arr[allow_list_pointer++] =
 			    profile->current_uid;
-		} else {
-			remove_uid_from_arr(profile->current_uid);
 		}
 	}
 	result = true;
@@ -275,6 +374,7 @@ out:
 	}
 
 	if (persist) {
+		allowlist_log(profile, false);
 		persistent_allow_list();
 #if !defined(CONFIG_KSU_HYMOFS) && !defined(CONFIG_KSU_MANUAL_HOOK)
 		// FIXME: use a new flag
@@ -371,6 +471,37 @@ struct root_profile *ksu_get_root_profile(uid_t uid)
 	return &default_root_profile;
 }
 
+int ksu_export_app_profiles(struct app_profile __user *out, u32 start,
+			    u32 max, u32 *count, u32 *total, u64 *generation)
+{
+	struct perm_data *p = NULL;
+	u32 index = 0, written = 0;
+	int ret = 0;
+
+	mutex_lock(&allowlist_mutex);
+	*generation = atomic64_read(&allow_list_generation);
+	*total = allow_list_count;
+
+	if (max && start < allow_list_count) {
+		list_for_each_entry (p, &allow_list, list) {
+			if (index++ < start)
+				continue;
+			if (written >= max)
+				break;
+			if (copy_to_user(out + written, &p->profile,
+					 sizeof(p->profile))) {
+				ret = -EFAULT;
+				break;
+			}
+			written++;
+		}
+	}
+	mutex_unlock(&allowlist_mutex);
+
+	*count = written;
+	return ret;
+}
+
 bool ksu_get_allow_list(int *array, int *length, bool allow)
 {
 	struct perm_data *p = NULL;
@@ -389,51 +520,143 @@ bool ksu_get_allow_list(int *array, int *length, bool allow)
 	return true;
 }
 
-static void do_persistent_allow_list(struct callback_head *_cb)
+static bool write_allow_list_header(struct file *fp, loff_t *off)
 {
 	u32 magic = FILE_MAGIC;
 	u32 version = FILE_FORMAT_VERSION;
+
+	// store magic and version
+	if (ksu_kernel_write_compat(fp, &magic, sizeof(magic), off) !=
+	    sizeof(magic)) {
+		pr_err("save_allow_list write magic failed.\n");
+		return false;
+	}
+
+	if (ksu_kernel_write_compat(fp, &version, sizeof(version), off) !=
+	    sizeof(version)) {
+		pr_err("save_allow_list write version failed.\n");
+		return false;
+	}
+	return true;
+}
+
+// Rewrite the log as one record per live profile
+static void compact_allow_list(void)
+{
 	struct perm_data *p = NULL;
-	struct list_head *pos = NULL;
 	struct file *fp = NULL;
 	loff_t off = 0;
+	u32 records = 0;
 
-	mutex_lock(&allowlist_mutex);
 	fp = ksu_filp_open_compat(KERNEL_SU_ALLOWLIST,
 				  O_WRONLY | O_CREAT | O_TRUNC, 0644);
 	if (IS_ERR(fp)) {
 		pr_err("save_allow_list create file failed: %ld\n",
 		       PTR_ERR(fp));
-		goto unlock;
+		return;
 	}
 
-	// store magic and version
-	if (ksu_kernel_write_compat(fp, &magic, sizeof(magic), &off) !=
-	    sizeof(magic)) {
-		pr_err("save_allow_list write magic failed.\n");
+	if (!write_allow_list_header(fp, &off))
 		goto close_file;
+
+	list_for_each_entry (p, &allow_list, list) {
+		if (ksu_kernel_write_compat(fp, &p->profile,
+					    sizeof(p->profile),
+					    &off) != sizeof(p->profile)) {
+			pr_err("save_allow_list write profile failed.\n");
+			goto close_file;
+		}
+		records++;
 	}
 
-	if (ksu_kernel_write_compat(fp, &version, sizeof(version), &off) !=
-	    sizeof(version)) {
-		pr_err("save_allow_list write version failed.\n");
-		goto close_file;
+	allowlist_log_records = records;
+	allowlist_log_size = off;
+	pr_info("save_allow_list: compacted %u profiles\n", records);
+
+close_file:
+	filp_close(fp, 0);
+}
+
+// Whether fp is still the v4 log allowlist_log_records describes
+static bool allow_list_log_matches(struct file *fp)
+{
+	loff_t off = 0;
+	u32 header[2];
+
+	if (i_size_read(file_inode(fp)) != allowlist_log_size)
+		return false;
+
+	if (ksu_kernel_read_compat(fp, header, sizeof(header), &off) !=
+	    sizeof(header))
+		return false;
+
+	return header[0] == FILE_MAGIC && header[1] == FILE_FORMAT_VERSION;
+}
+
+// Returns false when the file has to be rewritten instead
+static bool append_allow_list(struct list_head *deltas)
+{
+	struct allowlist_delta *d = NULL;
+	struct file *fp = NULL;
+	loff_t off;
+
+	fp = ksu_filp_open_compat(KERNEL_SU_ALLOWLIST, O_RDWR | O_APPEND, 0);
+	if (IS_ERR(fp)) {
+		pr_err("save_allow_list open file failed: %ld\n",
+		       PTR_ERR(fp));
+		return false;
 	}
 
-	list_for_each (pos, &allow_list) {
-		p = list_entry(pos, struct perm_data, list);
-		pr_info("save allow list, name: %s uid :%d, allow: %d\n",
-			p->profile.key, p->profile.current_uid,
-			p->profile.allow_su);
+	if (!allow_list_log_matches(fp)) {
+		pr_info("save_allow_list: file replaced, rewriting\n");
+		filp_close(fp, 0);
+		return false;
+	}
 
-		ksu_kernel_write_compat(fp, &p->profile, sizeof(p->profile),
-					&off);
+	off = allowlist_log_size;
+	list_for_each_entry (d, deltas, list) {
+		if (ksu_kernel_write_compat(fp, &d->profile,
+					    sizeof(d->profile),
+					    &off) != sizeof(d->profile)) {
+			pr_err("save_allow_list append failed.\n");
+			// a torn tail is dropped on load; rewrite next time
+			allowlist_log_records = 0;
+			break;
+		}
+		allowlist_log_records++;
 	}
+	allowlist_log_size = off;
 
-close_file:
 	filp_close(fp, 0);
-unlock:
+	return true;
+}
+
+static void do_persistent_allow_list(struct callback_head *_cb)
+{
+	struct allowlist_delta *d, *n;
+	LIST_HEAD(deltas);
+	u32 pending = 0;
+
+	spin_lock(&allowlist_delta_lock);
+	list_splice_init(&allowlist_deltas, &deltas);
+	spin_unlock(&allowlist_delta_lock);
+
+	list_for_each_entry (d, &deltas, list)
+		pending++;
+
+	mutex_lock(&allowlist_mutex);
+	if (!allowlist_log_records ||
+	    allowlist_log_records + pending >
+		2 * allow_list_count + ALLOWLIST_COMPACT_SLACK)
+		compact_allow_list();
+	else if (pending && !append_allow_list(&deltas))
+		compact_allow_list();
 	mutex_unlock(&allowlist_mutex);
+
+	list_for_each_entry_safe (d, n, &deltas, list) {
+		list_del(&d->list);
+		kfree(d);
+	}
 	kfree(_cb);
 }
 
@@ -465,8 +688,10 @@ void ksu_load_allow_list(void)
 	loff_t off = 0;
 	ssize_t ret = 0;
 	struct file *fp = NULL;
+	struct perm_data *p = NULL;
 	u32 magic;
 	u32 version;
+	u32 records = 0;
 
 #ifdef CONFIG_KSU_DEBUG
 	// always allow adb shell by default
@@ -496,22 +721,42 @@ void ksu_load_allow_list(void)
 
 	pr_info("allowlist version: %d\n", version);
 
+	// Single pass: records are applied through the uid index as they are
+	// read, so later records and tombstones override earlier ones.
 	while (true) {
 		struct app_profile profile;
 
 		ret =
 		    ksu_kernel_read_compat(fp, &profile, sizeof(profile), &off);
 
-		if (ret <= 0) {
-			pr_info("load_allow_list read err: %zd\n", ret);
+		if (ret != sizeof(profile)) {
+			if (ret != 0)
+				pr_info("load_allow_list read err: %zd\n", ret);
 			break;
 		}
+		records++;
+
+		profile.key[KSU_MAX_PACKAGE_NAME - 1] = '\0';
+		if (version > FILE_FORMAT_SNAPSHOT &&
+		    profile.version == KSU_ALLOWLIST_TOMBSTONE) {
+			p = find_perm_data(profile.current_uid, profile.key);
+			if (p)
+				remove_perm_data(p);
+			continue;
+		}
 
+#ifdef CONFIG_KSU_DEBUG
 		pr_info("load_allow_uid, name: %s, uid: %d, allow: %d\n",
 			profile.key, profile.current_uid, profile.allow_su);
+#endif // #ifdef CONFIG_KSU_DEBUG
 		ksu_set_app_profile(&profile, false);
 	}
 
+	// Older snapshots and torn tails get rewritten by the next save
+	allowlist_log_records =
+	    (version == FILE_FORMAT_VERSION && ret == 0) ? records : 0;
+	allowlist_log_size = off;
+
 exit:
 	ksu_show_allow_list();
 	filp_close(fp, 0);
@@ -539,19 +784,14 @@ void ksu_prune_allowlist(bool (*is_uid_valid)(uid_t, char *, void *),
 		if (!is_preserved_uid && !is_uid_valid(uid, package, data)) {
 			modified = true;
 			pr_info("prune uid: %d, package: %s\n", uid, package);
-			list_del(&np->list);
-			if (likely(uid <= BITMAP_UID_MAX)) {
-				allow_list_bitmap[uid / BITS_PER_BYTE] &=
-				    ~(1 << (uid % BITS_PER_BYTE));
-			}
-			remove_uid_from_arr(uid);
-			smp_mb();
-			kfree(np);
+			allowlist_log(&np->profile, true);
+			remove_perm_data(np);
 		}
 	}
 	mutex_unlock(&allowlist_mutex);
 
 	if (modified) {
+		atomic64_inc(&allow_list_generation);
 		persistent_allow_list();
 	}
 }
@@ -575,14 +815,23 @@ void ksu_allowlist_exit(void)
 {
 	struct perm_data *np = NULL;
 	struct perm_data *n = NULL;
+	struct allowlist_delta *d, *dn;
 
 	// free allowlist
 	mutex_lock(&allowlist_mutex);
 	list_for_each_entry_safe (np, n, &allow_list, list) {
 		list_del(&np->list);
+		hash_del(&np->node);
 		kfree(np);
 	}
 	mutex_unlock(&allowlist_mutex);
+
+	spin_lock(&allowlist_delta_lock);
+	list_for_each_entry_safe (d, dn, &allowlist_deltas, list) {
+		list_del(&d->list);
+		kfree(d);
+	}
+	spin_unlock(&allowlist_delta_lock);
 }
 
 #ifdef CONFIG_KSU_MANUAL_SU
@@ -665,7 +914,8 @@ void ksu_temp_revoke_root_once(uid_t uid)
 	strcpy(profile.rp_config.profile.selinux_domain,
 	       KSU_DEFAULT_SELINUX_DOMAIN);
 
-	ksu_set_app_profile(&profile, false);
+	if (ksu_set_app_profile(&profile, false))
+		allowlist_log(&profile, false);
 	persistent_allow_list();
 	pr_info("pending_root: UID=%d removed and persist updated\n", uid);
 }
@@ -30,6 +30,11 @@ bool __ksu_is_allow_uid_for_current(uid_t uid);
 
 bool ksu_get_allow_list(int *array, int *length, bool allow);
 
+// Copy up to max profiles starting at index start; total and generation
+// describe the whole list so callers can page and cache it.
+int ksu_export_app_profiles(struct app_profile __user *out, u32 start,
+			    u32 max, u32 *count, u32 *total, u64 *generation);
+
 void ksu_prune_allowlist(bool (*is_uid_exist)(uid_t, char *, void *),
 			 void *data);
 
@@ -2,8 +2,11 @@
 #include <linux/fs.h>
 #include <linux/gfp.h>
 #include <linux/kernel.h>
+#include <linux/mutex.h>
 #include <linux/slab.h>
+#include <linux/stat.h>
 #include <linux/version.h>
+#include <linux/vmalloc.h>
 #ifdef CONFIG_KSU_DEBUG
 #include <linux/moduleparam.h>
 #endif // #ifdef CONFIG_KSU_DEBUG
@@ -15,6 +18,7 @@
 #endif // #if LINUX_VERSION_CODE >= KERNEL_VERSIO...
 
 #include "apk_sign.h"
+#include "apk_sign_core.h"
 #include "kernel_compat.h"
 #include "klog.h" // IWYU pragma: keep
 #include "manager_sign.h"
@@ -81,236 +85,155 @@ static int ksu_sha256(const unsigned char *data, unsigned int datalen,
 	return ret;
 }
 
-static bool check_block(struct file *fp, u32 *size4, loff_t *pos, u32 *offset,
-			int *matched_index)
-{
-	int i;
-	apk_sign_key_t sign_key;
-	bool signature_valid = false;
+#define CERT_MAX_LENGTH 1024
 
-	ksu_kernel_read_compat(fp, size4, 0x4, pos); // signer-sequence length
-	ksu_kernel_read_compat(fp, size4, 0x4, pos); // signer length
-	ksu_kernel_read_compat(fp, size4, 0x4, pos); // signed data length
+// Reads exactly count bytes at pos, anything shorter is a malformed APK.
+static bool apk_read_at(struct file *fp, void *buf, size_t count, loff_t pos)
+{
+	return ksu_kernel_read_compat(fp, buf, count, &pos) == (ssize_t)count;
+}
 
-	*offset += 0x4 * 3;
+static bool check_cert(const u8 *cert, u32 cert_len, int *matched_index)
+{
+	unsigned char digest[SHA256_DIGEST_SIZE];
+	char hash_str[SHA256_DIGEST_SIZE * 2 + 1];
+	bool size_known = false;
+	int i;
 
-	ksu_kernel_read_compat(fp, size4, 0x4, pos); // digests-sequence length
+	for (i = 0; i < ARRAY_SIZE(apk_sign_keys); i++) {
+		if (cert_len == apk_sign_keys[i].size) {
+			size_known = true;
+			break;
+		}
+	}
+	if (!size_known)
+		return false;
 
-	*pos += *size4;
-	*offset += 0x4 + *size4;
+	if (cert_len > CERT_MAX_LENGTH) {
+		pr_info("cert length overlimit\n");
+		return false;
+	}
+	if (ksu_sha256(cert, cert_len, digest) < 0) {
+		pr_info("sha256 error\n");
+		return false;
+	}
 
-	ksu_kernel_read_compat(fp, size4, 0x4, pos); // certificates length
-	ksu_kernel_read_compat(fp, size4, 0x4, pos); // certificate length
-	*offset += 0x4 * 2;
+	hash_str[SHA256_DIGEST_SIZE * 2] = '\0';
+	bin2hex(hash_str, digest, SHA256_DIGEST_SIZE);
 
 	for (i = 0; i < ARRAY_SIZE(apk_sign_keys); i++) {
-		sign_key = apk_sign_keys[i];
-
-		if (*size4 != sign_key.size)
+		if (cert_len != apk_sign_keys[i].size)
 			continue;
-		*offset += *size4;
-
-#define CERT_MAX_LENGTH 1024
-		char cert[CERT_MAX_LENGTH];
-		if (*size4 > CERT_MAX_LENGTH) {
-			pr_info("cert length overlimit\n");
-			return false;
-		}
-		ksu_kernel_read_compat(fp, cert, *size4, pos);
-		unsigned char digest[SHA256_DIGEST_SIZE];
-		if (ksu_sha256(cert, *size4, digest) < 0) {
-			pr_info("sha256 error\n");
-			return false;
-		}
-
-		char hash_str[SHA256_DIGEST_SIZE * 2 + 1];
-		hash_str[SHA256_DIGEST_SIZE * 2] = '\0';
-
-		bin2hex(hash_str, digest, SHA256_DIGEST_SIZE);
 		pr_info("sha256: %s, expected: %s, index: %d\n", hash_str,
-			sign_key.sha256, i);
-
-		if (strcmp(sign_key.sha256, hash_str) == 0) {
-			signature_valid = true;
-			if (matched_index) {
+			apk_sign_keys[i].sha256, i);
+		if (strcmp(apk_sign_keys[i].sha256, hash_str) == 0) {
+			if (matched_index)
 				*matched_index = i;
-			}
-			break;
+			return true;
 		}
 	}
-	return signature_valid;
+	return false;
 }
 
-struct zip_entry_header {
-	uint32_t signature;
-	uint16_t version;
-	uint16_t flags;
-	uint16_t compression;
-	uint16_t mod_time;
-	uint16_t mod_date;
-	uint32_t crc32;
-	uint32_t compressed_size;
-	uint32_t uncompressed_size;
-	uint16_t file_name_length;
-	uint16_t extra_field_length;
-} __attribute__((packed));
-
-// This is a necessary but not sufficient condition, but it is enough for us
-static bool has_v1_signature_file(struct file *fp)
+// This is a necessary but not sufficient condition, but it is enough for us.
+// Walks the central directory in buffer-sized chunks instead of every local
+// header from offset 0; a record split across a chunk boundary is re-read
+// at the start of the next chunk.
+static bool has_v1_signature_file(struct file *fp, u8 *buf, u32 cd_offset,
+				  u32 cd_size)
 {
-	struct zip_entry_header header;
-	const char MANIFEST[] = "META-INF/MANIFEST.MF";
+	loff_t pos = cd_offset, end = (loff_t)cd_offset + cd_size;
 
-	loff_t pos = 0;
+	while (pos < end) {
+		size_t n = min_t(loff_t, APK_READ_WINDOW, end - pos);
+		size_t consumed;
+		int ret;
 
-	while (ksu_kernel_read_compat(fp, &header,
-				      sizeof(struct zip_entry_header), &pos) ==
-	       sizeof(struct zip_entry_header)) {
-		if (header.signature != 0x04034b50) {
-			// ZIP magic: 'PK'
+		if (!apk_read_at(fp, buf, n, pos))
 			return false;
-		}
-		// Read the entry file name
-		if (header.file_name_length == sizeof(MANIFEST) - 1) {
-			char fileName[sizeof(MANIFEST)];
-			ksu_kernel_read_compat(fp, fileName,
-					       header.file_name_length, &pos);
-			fileName[header.file_name_length] = '\0';
-
-			// Check if the entry matches META-INF/MANIFEST.MF
-			if (strncmp(MANIFEST, fileName, sizeof(MANIFEST) - 1) ==
-			    0) {
-				return true;
-			}
-		} else {
-			// Skip the entry file name
-			pos += header.file_name_length;
-		}
 
-		// Skip to the next entry
-		pos += header.extra_field_length + header.compressed_size;
+		ret = apk_cd_find(buf, n, APK_V1_MANIFEST,
+				  sizeof(APK_V1_MANIFEST) - 1, &consumed);
+		if (ret != 0)
+			return ret > 0;
+		if (consumed == 0)
+			return false;
+		pos += consumed;
 	}
 
 	return false;
 }
 
-static __always_inline bool check_v2_signature(char *path, int *signature_index)
+static __always_inline bool check_v2_signature(struct file *fp,
+					       int *signature_index)
 {
-	unsigned char buffer[0x11] = {0};
-	u32 size4;
-	u64 size8, size_of_block;
-
-	loff_t pos;
+	u8 *buf;
+	loff_t file_size = i_size_read(file_inode(fp));
+	size_t tail_len, block_len;
+	u32 cd_offset, cd_size;
+	struct apk_sig_info info = {0};
 
 	bool v2_signing_valid = false;
-	int v2_signing_blocks = 0;
-	bool v3_signing_exist = false;
-	bool v3_1_signing_exist = false;
 	int matched_index = -1;
-	int i;
-	struct file *fp;
 
-	fp = ksu_filp_open_compat(path, O_RDONLY, 0);
-	if (IS_ERR(fp)) {
-		pr_err("open %s error.\n", path);
+	if (file_size < APK_EOCD_SIZE)
 		return false;
-	}
-
-	// disable inotify for this file
-	fp->f_mode |= FMODE_NONOTIFY;
 
-	// https://en.wikipedia.org/wiki/Zip_(file_format)#End_of_central_directory_record_(EOCD)
-	for (i = 0;; ++i) {
-		unsigned short n;
-		pos = generic_file_llseek(fp, -i - 2, SEEK_END);
-		ksu_kernel_read_compat(fp, &n, 2, &pos);
-		if (n == i) {
-			pos -= 22;
-			ksu_kernel_read_compat(fp, &size4, 4, &pos);
-			if ((size4 ^ 0xcafebabeu) == 0xccfbf1eeu) {
-				break;
-			}
-		}
-		if (i == 0xffff) {
-			pr_info("error: cannot find eocd\n");
-			goto clean;
-		}
+	buf = vmalloc(APK_READ_WINDOW);
+	if (!buf) {
+		pr_err("apk_sign: alloc read buffer failed\n");
+		return false;
 	}
 
-	pos += 12;
-	// offset
-	ksu_kernel_read_compat(fp, &size4, 0x4, &pos);
-	pos = size4 - 0x18;
+	// Read 1: the tail, which holds the EOCD and its comment.
+	tail_len = min_t(loff_t, APK_READ_WINDOW, file_size);
+	if (!apk_read_at(fp, buf, tail_len, file_size - tail_len))
+		goto clean;
 
-	ksu_kernel_read_compat(fp, &size8, 0x8, &pos);
-	ksu_kernel_read_compat(fp, buffer, 0x10, &pos);
-	if (strcmp((char *)buffer, "APK Sig Block 42")) {
+	if (!apk_find_cd(buf, tail_len, file_size, &cd_offset, &cd_size)) {
+		pr_info("error: cannot find eocd\n");
 		goto clean;
 	}
 
-	pos = size4 - (size8 + 0x8);
-	ksu_kernel_read_compat(fp, &size_of_block, 0x8, &pos);
-	if (size_of_block != size8) {
+	// Read 2: the signing block. Try a buffer-sized window ending at the
+	// central directory, which covers the footer and, for any sane APK,
+	// the whole block.
+	block_len = min_t(u32, APK_READ_WINDOW, cd_offset);
+	if (!apk_read_at(fp, buf, block_len, cd_offset - block_len))
+		goto clean;
+
+	if (!apk_scan_sig_block(buf, block_len, &info)) {
+		pr_info("apk_sign: no signing block within %zu bytes\n",
+			block_len);
 		goto clean;
 	}
 
-	int loop_count = 0;
-	while (loop_count++ < 10) {
-		uint32_t id;
-		uint32_t offset;
-		ksu_kernel_read_compat(fp, &size8, 0x8,
-				       &pos); // sequence length
-		if (size8 == size_of_block) {
-			break;
-		}
-		ksu_kernel_read_compat(fp, &id, 0x4, &pos); // id
-		offset = 4;
-		if (id == 0x7109871au) {
-			v2_signing_blocks++;
-			bool result = check_block(fp, &size4, &pos, &offset,
-						  &matched_index);
-			if (result) {
-				v2_signing_valid = true;
-			}
-		} else if (id == 0xf05368c0u) {
-			// http://aospxref.com/android-14.0.0_r2/xref/frameworks/base/core/java/android/util/apk/ApkSignatureSchemeV3Verifier.java#73
-			v3_signing_exist = true;
-		} else if (id == 0x1b93ad61u) {
-			// http://aospxref.com/android-14.0.0_r2/xref/frameworks/base/core/java/android/util/apk/ApkSignatureSchemeV3Verifier.java#74
-			v3_1_signing_exist = true;
-		} else {
+	if (info.v2_blocks != 1) {
 #ifdef CONFIG_KSU_DEBUG
-			pr_info("Unknown id: 0x%08x\n", id);
+		pr_err("Unexpected v2 signature count: %d\n", info.v2_blocks);
 #endif // #ifdef CONFIG_KSU_DEBUG
-		}
-		pos += (size8 - offset);
+		goto clean;
 	}
 
-	if (v2_signing_blocks != 1) {
+	if (info.v3_exist || info.v3_1_exist) {
 #ifdef CONFIG_KSU_DEBUG
-		pr_err("Unexpected v2 signature count: %d\n",
-		       v2_signing_blocks);
+		pr_err("Unexpected v3 signature scheme found!\n");
 #endif // #ifdef CONFIG_KSU_DEBUG
-		v2_signing_valid = false;
+		goto clean;
 	}
 
-	if (v2_signing_valid) {
-		int has_v1_signing = has_v1_signature_file(fp);
-		if (has_v1_signing) {
-			pr_err("Unexpected v1 signature scheme found!\n");
-			filp_close(fp, 0);
-			return false;
-		}
-	}
-clean:
-	filp_close(fp, 0);
+	v2_signing_valid = info.v2_cert &&
+			   check_cert(info.v2_cert, info.v2_cert_len,
+				      &matched_index);
 
-	if (v3_signing_exist || v3_1_signing_exist) {
-#ifdef CONFIG_KSU_DEBUG
-		pr_err("Unexpected v3 signature scheme found!\n");
-#endif // #ifdef CONFIG_KSU_DEBUG
-		return false;
+	// info points into buf, which is reused from here on
+	if (v2_signing_valid &&
+	    has_v1_signature_file(fp, buf, cd_offset, cd_size)) {
+		pr_err("Unexpected v1 signature scheme found!\n");
+		v2_signing_valid = false;
 	}
+clean:
+	vfree(buf);
 
 	if (v2_signing_valid) {
 		if (signature_index) {
@@ -321,6 +244,114 @@ clean:
 	return false;
 }
 
+// Verdicts keyed by file identity, so rescans of /data/app after every
+// packages.list write do not re-hash APKs that have not changed. ctime is
+// part of the key because size and mtime can be set back with touch, but
+// any write or utimes moves ctime.
+#define APK_VERDICT_CACHE_SIZE 16
+
+struct apk_verdict {
+	dev_t dev;
+	unsigned long ino;
+	loff_t size;
+	s64 mtime_sec;
+	long mtime_nsec;
+	s64 ctime_sec;
+	long ctime_nsec;
+	bool valid;
+	bool is_manager;
+	int signature_index;
+};
+
+static struct apk_verdict apk_verdicts[APK_VERDICT_CACHE_SIZE];
+static unsigned int apk_verdict_next;
+static DEFINE_MUTEX(apk_verdict_lock);
+
+static int apk_verdict_key(struct file *fp, struct apk_verdict *key)
+{
+	struct kstat stat;
+	int ret;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 11, 0)
+	ret = vfs_getattr(&fp->f_path, &stat, STATX_BASIC_STATS,
+			  AT_STATX_SYNC_AS_STAT);
+#else
+	ret = vfs_getattr(&fp->f_path, &stat);
+#endif // #if LINUX_VERSION_CODE >= KERNEL_VERSIO...
+	if (ret)
+		return ret;
+
+	key->dev = stat.dev;
+	key->ino = stat.ino;
+	key->size = stat.size;
+	key->mtime_sec = stat.mtime.tv_sec;
+	key->mtime_nsec = stat.mtime.tv_nsec;
+	key->ctime_sec = stat.ctime.tv_sec;
+	key->ctime_nsec = stat.ctime.tv_nsec;
+	return 0;
+}
+
+static bool apk_verdict_match(const struct apk_verdict *a,
+			      const struct apk_verdict *b)
+{
+	return a->valid && a->dev == b->dev && a->ino == b->ino &&
+	       a->size == b->size && a->mtime_sec == b->mtime_sec &&
+	       a->mtime_nsec == b->mtime_nsec && a->ctime_sec == b->ctime_sec &&
+	       a->ctime_nsec == b->ctime_nsec;
+}
+
+static bool check_v2_signature_cached(char *path, int *signature_index)
+{
+	struct apk_verdict key = {0};
+	bool keyed, result;
+	struct file *fp;
+	int i;
+
+	fp = ksu_filp_open_compat(path, O_RDONLY, 0);
+	if (IS_ERR(fp)) {
+		pr_err("open %s error.\n", path);
+		return false;
+	}
+
+	// disable inotify for this file
+	fp->f_mode |= FMODE_NONOTIFY;
+
+	keyed = apk_verdict_key(fp, &key) == 0;
+	if (keyed) {
+		mutex_lock(&apk_verdict_lock);
+		for (i = 0; i < APK_VERDICT_CACHE_SIZE; i++) {
+			if (!apk_verdict_match(&apk_verdicts[i], &key))
+				continue;
+			result = apk_verdicts[i].is_manager;
+			if (result && signature_index)
+				*signature_index =
+				    apk_verdicts[i].signature_index;
+			mutex_unlock(&apk_verdict_lock);
+			filp_close(fp, 0);
+			return result;
+		}
+		mutex_unlock(&apk_verdict_lock);
+	}
+
+	key.signature_index = -1;
+	result = check_v2_signature(fp, &key.signature_index);
+	filp_close(fp, 0);
+
+	if (keyed) {
+		key.valid = true;
+		key.is_manager = result;
+		mutex_lock(&apk_verdict_lock);
+		apk_verdicts[apk_verdict_next] = key;
+		apk_verdict_next =
+		    (apk_verdict_next + 1) % APK_VERDICT_CACHE_SIZE;
+		mutex_unlock(&apk_verdict_lock);
+	}
+
+	if (result && signature_index)
+		*signature_index = key.signature_index;
+	return result;
+}
+
 #ifdef CONFIG_KSU_DEBUG
 
 int ksu_debug_manager_uid = -1;
@@ -345,7 +376,7 @@ module_param_cb(ksu_debug_manager_uid, &expected_size_ops,
 
 #endif // #ifdef CONFIG_KSU_DEBUG
 
-bool is_manager_apk(char *path)
+bool is_manager_apk(char *path, int *signature_index)
 {
 #ifdef CONFIG_KSU_SUPERKEY
 	// 如果启用了 SuperKey Only 模式 (禁用签名校验)，直接返回 false
@@ -354,5 +385,5 @@ bool is_manager_apk(char *path)
 		return false;
 	}
 #endif // #ifdef CONFIG_KSU_SUPERKEY
-	return check_v2_signature(path, NULL);
+	return check_v2_signature_cached(path, signature_index);
 }
\ No newline at end of file
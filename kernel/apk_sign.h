@@ -4,6 +4,6 @@
 #include "ksu.h"
 #include <linux/types.h>
 
-bool is_manager_apk(char *path);
+bool is_manager_apk(char *path, int *signature_index);
 
 #endif // #ifndef __KSU_H_APK_V2_SIGN
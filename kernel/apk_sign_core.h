@@ -0,0 +1,212 @@
+#ifndef __KSU_H_APK_SIGN_CORE
+#define __KSU_H_APK_SIGN_CORE
+
+// Buffer-only APK parsing shared by the kernel (apk_sign.c) and ksud
+// (boot/apk_sign.cpp): the EOCD, the APK signing block and central
+// directory records. No I/O and no allocation; callers read the windows
+// described below and hash the certificate themselves. Must stay valid C
+// and C++.
+
+#ifdef __KERNEL__
+#include <linux/string.h>
+#include <linux/types.h>
+#else
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#endif // #ifdef __KERNEL__
+
+#define APK_EOCD_SIZE 22
+#define APK_EOCD_MAGIC 0x06054b50u
+#define APK_CDFH_SIZE 46
+#define APK_CDFH_MAGIC 0x02014b50u
+#define APK_SIG_BLOCK_FOOTER 24
+#define APK_SIG_BLOCK_MAGIC "APK Sig Block 42"
+#define APK_SIG_V2_ID 0x7109871au
+// http://aospxref.com/android-14.0.0_r2/xref/frameworks/base/core/java/android/util/apk/ApkSignatureSchemeV3Verifier.java#73
+#define APK_SIG_V3_ID 0xf05368c0u
+// http://aospxref.com/android-14.0.0_r2/xref/frameworks/base/core/java/android/util/apk/ApkSignatureSchemeV3Verifier.java#74
+#define APK_SIG_V3_1_ID 0x1b93ad61u
+#define APK_V1_MANIFEST "META-INF/MANIFEST.MF"
+
+// Large enough for the EOCD plus a maximal comment. Callers read the file
+// tail, and then the signing block, into windows of this size.
+#define APK_READ_WINDOW (0xffff + APK_EOCD_SIZE)
+
+struct apk_sig_info {
+	int v2_blocks;
+	bool v3_exist;
+	bool v3_1_exist;
+	// first certificate of the first signer of the last v2 block
+	const uint8_t *v2_cert;
+	uint32_t v2_cert_len;
+};
+
+static inline uint16_t apk_get_u16(const uint8_t *p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t apk_get_u32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint64_t apk_get_u64(const uint8_t *p)
+{
+	return apk_get_u32(p) | ((uint64_t)apk_get_u32(p + 4) << 32);
+}
+
+// Pulls a u32 length-prefixed field out of [*p, end), advancing *p past it.
+static inline bool apk_take_lp(const uint8_t **p, const uint8_t *end,
+			       const uint8_t **val, uint32_t *len)
+{
+	if (end - *p < 4)
+		return false;
+	*len = apk_get_u32(*p);
+	*p += 4;
+	if (*len > (size_t)(end - *p))
+		return false;
+	*val = *p;
+	*p += *len;
+	return true;
+}
+
+// Finds the EOCD in the last tail_len bytes of a file_size byte file and
+// returns the central directory's offset and size. The comment length has
+// to end the record exactly at the end of the file.
+// https://en.wikipedia.org/wiki/Zip_(file_format)#End_of_central_directory_record_(EOCD)
+static inline bool apk_find_cd(const uint8_t *tail, size_t tail_len,
+			       uint64_t file_size, uint32_t *cd_offset,
+			       uint32_t *cd_size)
+{
+	const uint8_t *eocd = NULL;
+	size_t i;
+
+	for (i = 0; i + APK_EOCD_SIZE <= tail_len; i++) {
+		const uint8_t *rec = tail + tail_len - APK_EOCD_SIZE - i;
+		if (apk_get_u16(rec + 20) == i &&
+		    apk_get_u32(rec) == APK_EOCD_MAGIC) {
+			eocd = rec;
+			break;
+		}
+	}
+	if (!eocd)
+		return false;
+
+	*cd_size = apk_get_u32(eocd + 12);
+	*cd_offset = apk_get_u32(eocd + 16);
+	return *cd_offset >= APK_SIG_BLOCK_FOOTER &&
+	       (uint64_t)*cd_offset + *cd_size <= file_size;
+}
+
+// signer-sequence -> first signer -> signed data -> first certificate
+static inline bool apk_v2_first_cert(const uint8_t *p, const uint8_t *end,
+				     const uint8_t **cert, uint32_t *cert_len)
+{
+	const uint8_t *field, *digests;
+	uint32_t len;
+	int depth;
+
+	// signers, first signer, its signed data
+	for (depth = 0; depth < 3; depth++) {
+		if (!apk_take_lp(&p, end, &field, &len))
+			return false;
+		p = field;
+		end = field + len;
+	}
+	// skip digests, then the first certificate of the sequence
+	if (!apk_take_lp(&p, end, &digests, &len) ||
+	    !apk_take_lp(&p, end, &field, &len))
+		return false;
+	p = field;
+	end = field + len;
+	return apk_take_lp(&p, end, cert, cert_len);
+}
+
+// Parses the signing block at the end of win, the win_len bytes right
+// before the central directory. Returns false when there is no complete
+// block in the window; info then only says nothing was found.
+static inline bool apk_scan_sig_block(const uint8_t *win, size_t win_len,
+				      struct apk_sig_info *info)
+{
+	const uint8_t *p, *end;
+	uint64_t block_size;
+
+	memset(info, 0, sizeof(*info));
+	if (win_len < APK_SIG_BLOCK_FOOTER)
+		return false;
+
+	end = win + win_len - APK_SIG_BLOCK_FOOTER;
+	if (memcmp(end + 8, APK_SIG_BLOCK_MAGIC, 16))
+		return false;
+
+	block_size = apk_get_u64(end);
+	if (block_size < APK_SIG_BLOCK_FOOTER || block_size + 8 > win_len)
+		return false;
+
+	p = win + win_len - (block_size + 8);
+	if (apk_get_u64(p) != block_size)
+		return false;
+
+	for (p += 8; end - p >= 12;) {
+		uint64_t pair_len = apk_get_u64(p);
+		uint32_t id;
+
+		if (pair_len < 4 || pair_len > (uint64_t)(end - p - 8))
+			break;
+		id = apk_get_u32(p + 8);
+		if (id == APK_SIG_V2_ID) {
+			const uint8_t *cert;
+			uint32_t cert_len;
+
+			info->v2_blocks++;
+			if (apk_v2_first_cert(p + 12, p + 8 + pair_len, &cert,
+					      &cert_len)) {
+				info->v2_cert = cert;
+				info->v2_cert_len = cert_len;
+			}
+		} else if (id == APK_SIG_V3_ID) {
+			info->v3_exist = true;
+		} else if (id == APK_SIG_V3_1_ID) {
+			info->v3_1_exist = true;
+		}
+		p += 8 + pair_len;
+	}
+	return true;
+}
+
+// Looks for a central directory record named name in buf, n bytes read
+// from the start of (or a record boundary inside) the central directory.
+// Returns 1 if found and -1 on a malformed record. Otherwise returns 0 and
+// sets *consumed to the bytes of whole records; a record split across the
+// end of buf should be re-read from there, and 0 consumed means give up.
+static inline int apk_cd_find(const uint8_t *buf, size_t n, const char *name,
+			      size_t name_len, size_t *consumed)
+{
+	size_t off = 0;
+
+	while (off + APK_CDFH_SIZE <= n) {
+		const uint8_t *rec = buf + off;
+		uint16_t rec_name_len;
+
+		if (apk_get_u32(rec) != APK_CDFH_MAGIC)
+			return -1;
+		rec_name_len = apk_get_u16(rec + 28);
+		if (off + APK_CDFH_SIZE + rec_name_len > n)
+			break;
+
+		if (rec_name_len == name_len &&
+		    memcmp(rec + APK_CDFH_SIZE, name, name_len) == 0)
+			return 1;
+
+		off += APK_CDFH_SIZE + rec_name_len + apk_get_u16(rec + 30) +
+		       apk_get_u16(rec + 32);
+	}
+
+	*consumed = off;
+	return 0;
+}
+
+#endif // #ifndef __KSU_H_APK_SIGN_CORE
@@ -8,6 +8,7 @@ enum ksu_feature_id {
 	KSU_FEATURE_KERNEL_UMOUNT = 1,
 	KSU_FEATURE_ENHANCED_SECURITY = 2,
 	KSU_FEATURE_SULOG = 100,
+	KSU_FEATURE_SULOG_DEDUP_WINDOW = 101,
 
 	KSU_FEATURE_MAX
 };
@@ -30,6 +30,12 @@
 
 static bool ksu_kernel_umount_enabled = true;
 
+#ifdef CONFIG_KSU_DEBUG
+#define umount_dbg(fmt, ...) pr_info(fmt, ##__VA_ARGS__)
+#else
+#define umount_dbg(fmt, ...) no_printk(fmt, ##__VA_ARGS__)
+#endif // #ifdef CONFIG_KSU_DEBUG
+
 static int kernel_umount_feature_get(u64 *value)
 {
 	*value = ksu_kernel_umount_enabled ? 1 : 0;
@@ -86,13 +92,14 @@ static void ksu_sys_umount(const char *mnt, int flags)
 
 #endif // #if LINUX_VERSION_CODE >= KERNEL_VERSIO...
 
-void try_umount(const char *mnt, int flags)
+// Unmount an entry in the current (child) namespace. The lookup has to
+// happen here because the child owns a copy of each mount.
+static void try_umount_entry(const struct mount_entry *entry)
 {
 	struct path path;
-	int err = kern_path(mnt, 0, &path);
-	if (err) {
+
+	if (kern_path(entry->umountable, 0, &path))
 		return;
-	}
 
 	if (path.dentry != path.mnt->mnt_root) {
 		// it is not root mountpoint, maybe umounted by others already.
@@ -100,7 +107,9 @@ void try_umount(const char *mnt, int flags)
 		return;
 	}
 
-	ksu_umount_mnt(mnt, &path, flags);
+	umount_dbg("%s: unmounting: %s flags 0x%x\n", __func__,
+		   entry->umountable, entry->flags);
+	ksu_umount_mnt(entry->umountable, &path, entry->flags);
 }
 
 struct umount_tw {
@@ -115,9 +124,7 @@ static void umount_tw_func(struct callback_head *cb)
 	struct mount_entry *entry;
 	down_read(&mount_list_lock);
 	list_for_each_entry (entry, &mount_list, list) {
-		pr_info("%s: unmounting: %s flags 0x%x\n", __func__,
-			entry->umountable, entry->flags);
-		try_umount(entry->umountable, entry->flags);
+		try_umount_entry(entry);
 	}
 	up_read(&mount_list_lock);
 
@@ -20,6 +20,4 @@ struct mount_entry {
 extern struct list_head mount_list;
 extern struct rw_semaphore mount_list_lock;
 
-void try_umount(const char *mnt, int flags);
-
 #endif // #ifndef __KSU_H_KERNEL_UMOUNT
@@ -1,4 +1,5 @@
 #include <linux/mm.h>
+#include <linux/percpu.h>
 #include <linux/preempt.h>
 #include <linux/printk.h>
 #include <linux/version.h>
@@ -97,6 +98,73 @@ static const char ksud_path[] = KSUD_PATH;
 
 extern bool ksu_kernel_umount_enabled;
 
+struct sucompat_pcpu_stats {
+	u64 skipped[KSU_SUCOMPAT_HOOK_MAX];
+	u64 hits[KSU_SUCOMPAT_HOOK_MAX];
+	u64 misses[KSU_SUCOMPAT_HOOK_MAX];
+};
+static DEFINE_PER_CPU(struct sucompat_pcpu_stats, sucompat_stats);
+
+void ksu_sucompat_get_stats(struct ksu_sucompat_hook_stats *stats)
+{
+	int cpu, i;
+
+	memset(stats, 0, sizeof(*stats) * KSU_SUCOMPAT_HOOK_MAX);
+	for_each_possible_cpu (cpu) {
+		struct sucompat_pcpu_stats *s = per_cpu_ptr(&sucompat_stats, cpu);
+
+		for (i = 0; i < KSU_SUCOMPAT_HOOK_MAX; i++) {
+			stats[i].skipped += READ_ONCE(s->skipped[i]);
+			stats[i].hits += READ_ONCE(s->hits[i]);
+			stats[i].misses += READ_ONCE(s->misses[i]);
+		}
+	}
+}
+
+// Allowlist gate shared by all hooks, checked before touching the path
+static __always_inline bool su_caller_allowed(enum ksu_sucompat_hook hook)
+{
+	if (likely(!ksu_is_allow_uid_for_current(current_uid().val))) {
+		this_cpu_inc(sucompat_stats.skipped[hook]);
+		return false;
+	}
+	return true;
+}
+
+// Compare a copied path with su_path: the first word rejects almost every
+// path before the byte compare of the tail.
+static __always_inline bool su_path_equal(enum ksu_sucompat_hook hook,
+					  const char *path)
+{
+	u64 word, expect;
+
+	BUILD_BUG_ON(sizeof(su_path) <= sizeof(u64));
+
+	memcpy(&word, path, sizeof(word));
+	memcpy(&expect, su_path, sizeof(expect));
+	if (likely(word != expect) ||
+	    memcmp(path + sizeof(u64), su_path + sizeof(u64),
+		   sizeof(su_path) - sizeof(u64))) {
+		this_cpu_inc(sucompat_stats.misses[hook]);
+		return false;
+	}
+
+	this_cpu_inc(sucompat_stats.hits[hook]);
+	return true;
+}
+
+// Copy at most sizeof(su_path) bytes of a user path; anything longer can't
+// match since its byte at the terminator position is not NUL.
+static __always_inline long su_path_copy_user(char *path,
+					      const char __user *fn)
+{
+#ifdef CONFIG_KSU_LKM
+	return strncpy_from_user_nofault(path, fn, sizeof(su_path));
+#else
+	return ksu_strncpy_from_user_nofault(path, fn, sizeof(su_path));
+#endif // #ifdef CONFIG_KSU_LKM
+}
+
 // the call from execve_handler_pre won't provided correct value for
 // __never_use_argument, use them after fix execve_handler_pre, keeping them for
 // consistence for manually patched code
@@ -105,7 +173,6 @@ int ksu_handle_execveat_sucompat(int *fd, struct filename **filename_ptr,
 				 int *__never_use_flags)
 {
 	struct filename *filename;
-	bool is_allowed = ksu_is_allow_uid_for_current(current_uid().val);
 
 	if (!ksu_su_compat_enabled) {
 		return 0;
@@ -114,7 +181,7 @@ int ksu_handle_execveat_sucompat(int *fd, struct filename **filename_ptr,
 	if (unlikely(!filename_ptr))
 		return 0;
 
-	if (!is_allowed)
+	if (!su_caller_allowed(KSU_SUCOMPAT_HOOK_EXECVE))
 		return 0;
 
 	filename = *filename_ptr;
@@ -122,13 +189,12 @@ int ksu_handle_execveat_sucompat(int *fd, struct filename **filename_ptr,
 		return 0;
 	}
 
-	if (likely(memcmp(filename->name, su_path, sizeof(su_path))))
+	if (!su_path_equal(KSU_SUCOMPAT_HOOK_EXECVE, filename->name))
 		return 0;
 
 #if __SULOG_GATE
 	ksu_sulog_report_syscall(current_uid().val, NULL, "execve", su_path);
-	ksu_sulog_report_su_attempt(current_uid().val, NULL, su_path,
-				    is_allowed);
+	ksu_sulog_report_su_attempt(current_uid().val, NULL, su_path, true);
 #endif // #if __SULOG_GATE
 
 	pr_info("do_execveat_common su found\n");
@@ -151,7 +217,7 @@ int ksu_handle_execve_sucompat(const char __user **filename_user,
 			       int *__never_use_flags)
 {
 	const char __user *fn;
-	char path[sizeof(su_path) + 1];
+	char path[sizeof(su_path)];
 	long ret;
 	unsigned long addr;
 
@@ -161,16 +227,16 @@ int ksu_handle_execve_sucompat(const char __user **filename_user,
 	if (unlikely(!filename_user))
 		return 0;
 
-	if (!ksu_is_allow_uid_for_current(current_uid().val))
+	if (!su_caller_allowed(KSU_SUCOMPAT_HOOK_EXECVE))
 		return 0;
 
 	addr = untagged_addr((unsigned long)*filename_user);
 	fn = (const char __user *)addr;
 	memset(path, 0, sizeof(path));
-	ret = strncpy_from_user_nofault(path, fn, sizeof(path));
+	ret = su_path_copy_user(path, fn);
 
 	if (ret < 0 && try_set_access_flag(addr)) {
-		ret = strncpy_from_user_nofault(path, fn, sizeof(path));
+		ret = su_path_copy_user(path, fn);
 	}
 
 	if (ret < 0) {
@@ -178,7 +244,7 @@ int ksu_handle_execve_sucompat(const char __user **filename_user,
 		return 0;
 	}
 
-	if (likely(memcmp(path, su_path, sizeof(su_path))))
+	if (!su_path_equal(KSU_SUCOMPAT_HOOK_EXECVE, path))
 		return 0;
 
 #if __SULOG_GATE
@@ -244,22 +310,18 @@ int ksu_handle_execveat(int *fd, struct filename **filename_ptr, void *argv,
 int ksu_handle_faccessat(int *dfd, const char __user **filename_user, int *mode,
 			 int *__unused_flags)
 {
-	char path[sizeof(su_path) + 1] = {0};
+	char path[sizeof(su_path)] = {0};
 
 	if (!ksu_su_compat_enabled) {
 		return 0;
 	}
 
-	if (!ksu_is_allow_uid_for_current(current_uid().val))
+	if (!su_caller_allowed(KSU_SUCOMPAT_HOOK_FACCESSAT))
 		return 0;
 
-#ifdef CONFIG_KSU_LKM
-	strncpy_from_user_nofault(path, *filename_user, sizeof(path));
-#else
-	ksu_strncpy_from_user_nofault(path, *filename_user, sizeof(path));
-#endif // #ifdef CONFIG_KSU_LKM
+	su_path_copy_user(path, *filename_user);
 
-	if (unlikely(!memcmp(path, su_path, sizeof(su_path)))) {
+	if (unlikely(su_path_equal(KSU_SUCOMPAT_HOOK_FACCESSAT, path))) {
 #if __SULOG_GATE
 		ksu_sulog_report_syscall(current_uid().val, NULL, "faccessat",
 					 path);
@@ -278,14 +340,14 @@ int ksu_handle_stat(int *dfd, struct filename **filename, int *flags)
 		return 0;
 	}
 
-	if (!ksu_is_allow_uid_for_current(current_uid().val))
+	if (!su_caller_allowed(KSU_SUCOMPAT_HOOK_STAT))
 		return 0;
 
 	if (unlikely(IS_ERR(*filename) || (*filename)->name == NULL)) {
 		return 0;
 	}
 
-	if (likely(memcmp((*filename)->name, su_path, sizeof(su_path)))) {
+	if (!su_path_equal(KSU_SUCOMPAT_HOOK_STAT, (*filename)->name)) {
 		return 0;
 	}
 
@@ -301,7 +363,7 @@ int ksu_handle_stat(int *dfd, struct filename **filename, int *flags)
       // defined(CONFIG_KSU_HYMOFS)
 int ksu_handle_stat(int *dfd, const char __user **filename_user, int *flags)
 {
-	char path[sizeof(su_path) + 1] = {0};
+	char path[sizeof(su_path)] = {0};
 
 	if (!ksu_su_compat_enabled) {
 		return 0;
@@ -311,16 +373,12 @@ int ksu_handle_stat(int *dfd, const char __user **filename_user, int *flags)
 		return 0;
 	}
 
-	if (!ksu_is_allow_uid_for_current(current_uid().val))
+	if (!su_caller_allowed(KSU_SUCOMPAT_HOOK_STAT))
 		return 0;
 
-#ifdef CONFIG_KSU_LKM
-	strncpy_from_user_nofault(path, *filename_user, sizeof(path));
-#else
-	ksu_strncpy_from_user_nofault(path, *filename_user, sizeof(path));
-#endif // #ifdef CONFIG_KSU_LKM
+	su_path_copy_user(path, *filename_user);
 
-	if (unlikely(!memcmp(path, su_path, sizeof(su_path)))) {
+	if (unlikely(su_path_equal(KSU_SUCOMPAT_HOOK_STAT, path))) {
 #if __SULOG_GATE
 		ksu_sulog_report_syscall(current_uid().val, NULL, "newfstatat",
 					 path);
@@ -4,6 +4,22 @@
 
 extern bool ksu_su_compat_enabled;
 
+// su path matcher counters, one slot per hooked syscall
+enum ksu_sucompat_hook {
+	KSU_SUCOMPAT_HOOK_STAT = 0,
+	KSU_SUCOMPAT_HOOK_FACCESSAT,
+	KSU_SUCOMPAT_HOOK_EXECVE,
+	KSU_SUCOMPAT_HOOK_MAX
+};
+
+struct ksu_sucompat_hook_stats {
+	__u64 skipped; // caller not in the allowlist, nothing copied
+	__u64 hits; // path was su_path
+	__u64 misses; // path copied and compared, not su_path
+};
+
+void ksu_sucompat_get_stats(struct ksu_sucompat_hook_stats *stats);
+
 void ksu_sucompat_init(void);
 void ksu_sucompat_exit(void);
 
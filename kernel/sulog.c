@@ -1,3 +1,4 @@
+#include <linux/anon_inodes.h>
 #include <linux/cred.h>
 #include <linux/fs.h>
 #include <linux/kernel.h>
@@ -17,7 +18,11 @@
 #include <linux/ktime.h>
 #include <linux/mm.h>
 #include <linux/mutex.h>
+#include <linux/poll.h>
 #include <linux/spinlock.h>
+#include <linux/vmalloc.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
 
 #include "feature.h"
 #include "kernel_compat.h"
@@ -27,11 +32,41 @@
 
 #if __SULOG_GATE
 
-struct dedup_entry dedup_tbl[SULOG_COMM_LEN];
-static DEFINE_SPINLOCK(dedup_lock);
-static LIST_HEAD(sulog_queue);
+struct dedup_shard {
+	spinlock_t lock;
+	u32 tick;
+	u64 hits;
+	u64 misses;
+	u64 evictions;
+	struct dedup_entry sets[DEDUP_SETS][DEDUP_WAYS];
+} ____cacheline_aligned_in_smp;
+
+static struct dedup_shard dedup_shards[DEDUP_SHARDS];
+static u32 dedup_window_secs __read_mostly = DEDUP_SECS;
 static bool sulog_enabled __read_mostly = true;
 
+// record ring, vmalloc_user()ed so readers can mmap it
+static struct ksu_sulog_ring_hdr *sulog_ring;
+static struct ksu_sulog_record *sulog_records;
+static DEFINE_SPINLOCK(sulog_ring_lock);
+static DECLARE_WAIT_QUEUE_HEAD(sulog_wq);
+static atomic_t sulog_readers = ATOMIC_INIT(0);
+
+// next seq to be written to SULOG_PATH, only touched by the flusher
+static u64 sulog_flushed_seq = 1;
+static unsigned long sulog_flush_pending;
+static void sulog_flush_workfn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(sulog_flush_work, sulog_flush_workfn);
+
+#define SULOG_RING_SIZE                                                        \
+	(PAGE_SIZE + SULOG_RING_RECORDS * sizeof(struct ksu_sulog_record))
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 16, 0)
+typedef __poll_t sulog_poll_t;
+#else
+typedef unsigned int sulog_poll_t;
+#endif // #if LINUX_VERSION_CODE >= KERNEL_VERSIO...
+
 static int sulog_feature_get(u64 *value)
 {
 	*value = sulog_enabled ? 1 : 0;
@@ -53,13 +88,35 @@ static const struct ksu_feature_handler sulog_handler = {
     .set_handler = sulog_feature_set,
 };
 
-static void get_timestamp(char *buf, size_t len)
+static int sulog_dedup_window_get(u64 *value)
+{
+	*value = READ_ONCE(dedup_window_secs);
+	return 0;
+}
+
+static int sulog_dedup_window_set(u64 value)
+{
+	if (value > DEDUP_MAX_SECS)
+		return -EINVAL;
+
+	WRITE_ONCE(dedup_window_secs, (u32)value);
+	pr_info("sulog: dedup window set to %llu\n", value);
+	return 0;
+}
+
+static const struct ksu_feature_handler sulog_dedup_window_handler = {
+    .feature_id = KSU_FEATURE_SULOG_DEDUP_WINDOW,
+    .name = "sulog_dedup_window",
+    .get_handler = sulog_dedup_window_get,
+    .set_handler = sulog_dedup_window_set,
+};
+
+static void format_timestamp(u64 ts_ns, char *buf, size_t len)
 {
-	struct timespec64 ts;
 	struct tm tm;
+	time64_t secs = div_u64(ts_ns, NSEC_PER_SEC);
 
-	ktime_get_real_ts64(&ts);
-	time64_to_tm(ts.tv_sec - sys_tz.tz_minuteswest * 60, 0, &tm);
+	time64_to_tm(secs - sys_tz.tz_minuteswest * 60, 0, &tm);
 
 	snprintf(buf, len, "%04ld-%02d-%02d %02d:%02d:%02d", tm.tm_year + 1900,
 		 tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
@@ -127,6 +184,12 @@ static void sanitize_string(char *str, size_t len)
 	str[write_pos] = '\0';
 }
 
+static inline bool dedup_key_equal(const struct dedup_key *a,
+				   const struct dedup_key *b)
+{
+	return a->crc == b->crc && a->uid == b->uid && a->type == b->type;
+}
+
 static bool dedup_should_print(uid_t uid, u8 type, const char *content,
 			       size_t len)
 {
@@ -135,41 +198,173 @@ static bool dedup_should_print(uid_t uid, u8 type, const char *content,
 	    .uid = uid,
 	    .type = type,
 	};
-	u64 now = ktime_get_ns();
-	u64 delta_ns = (u64)DEDUP_SECS * (u64)NSEC_PER_SEC;
+	u32 window = READ_ONCE(dedup_window_secs);
+	u64 now, delta_ns;
+	u32 hash;
+	struct dedup_shard *shard;
+	struct dedup_entry *set, *victim = NULL;
+	unsigned long flags;
+	bool print = true;
+	int i;
+
+	if (!window)
+		return true;
+
+	now = ktime_get_ns();
+	delta_ns = (u64)window * (u64)NSEC_PER_SEC;
+	hash = key.crc ^ (uid * 0x9e3779b9U);
+	shard = &dedup_shards[hash & (DEDUP_SHARDS - 1)];
+	set = shard->sets[(hash >> 4) & (DEDUP_SETS - 1)];
+
+	spin_lock_irqsave(&shard->lock, flags);
+	shard->tick++;
+
+	for (i = 0; i < DEDUP_WAYS; i++) {
+		struct dedup_entry *e = &set[i];
+
+		if (e->ts_ns && dedup_key_equal(&e->key, &key)) {
+			e->lru = shard->tick;
+			if (now - e->ts_ns < delta_ns) {
+				shard->hits++;
+				print = false;
+			} else {
+				shard->misses++;
+				e->ts_ns = now;
+			}
+			goto out;
+		}
+
+		// prefer an empty way, otherwise the least recently used one
+		if (!victim || (victim->ts_ns && (!e->ts_ns ||
+						  (s32)(e->lru - victim->lru) < 0)))
+			victim = e;
+	}
+
+	if (victim->ts_ns && now - victim->ts_ns < delta_ns)
+		shard->evictions++;
+	shard->misses++;
+	victim->key = key;
+	victim->lru = shard->tick;
+	victim->ts_ns = now;
+
+out:
+	spin_unlock_irqrestore(&shard->lock, flags);
+	return print;
+}
+
+static void dedup_get_stats(struct ksu_sulog_stats *stats)
+{
+	unsigned long flags;
+	int i;
+
+	for (i = 0; i < DEDUP_SHARDS; i++) {
+		struct dedup_shard *shard = &dedup_shards[i];
+
+		spin_lock_irqsave(&shard->lock, flags);
+		stats->dedup_hits += shard->hits;
+		stats->dedup_misses += shard->misses;
+		stats->dedup_evictions += shard->evictions;
+		spin_unlock_irqrestore(&shard->lock, flags);
+	}
+	stats->dedup_window = READ_ONCE(dedup_window_secs);
+}
+
+static inline struct ksu_sulog_record *sulog_slot(u64 seq)
+{
+	return &sulog_records[seq & (SULOG_RING_RECORDS - 1)];
+}
 
-	u32 idx = key.crc & (SULOG_COMM_LEN - 1);
-	spin_lock(&dedup_lock);
+// Copy the record for seq out of the ring. Returns false if it has been
+// overwritten (or not written yet).
+static bool sulog_read_record(u64 seq, struct ksu_sulog_record *out)
+{
+	unsigned long flags;
+	bool ok;
+
+	spin_lock_irqsave(&sulog_ring_lock, flags);
+	ok = sulog_slot(seq)->seq == seq;
+	if (ok)
+		memcpy(out, sulog_slot(seq), sizeof(*out));
+	spin_unlock_irqrestore(&sulog_ring_lock, flags);
+
+	return ok;
+}
 
-	struct dedup_entry *e = &dedup_tbl[idx];
-	if (e->key.crc == key.crc && e->key.uid == key.uid &&
-	    e->key.type == key.type && (now - e->ts_ns) < delta_ns) {
-		spin_unlock(&dedup_lock);
-		return false;
+static int sulog_format_record(const struct ksu_sulog_record *rec, char *buf,
+			       size_t len)
+{
+	char timestamp[32];
+
+	format_timestamp(rec->ts_ns, timestamp, sizeof(timestamp));
+
+	switch (rec->type) {
+	case DEDUP_SU_GRANT:
+		return snprintf(buf, len,
+				"[%s] SU_GRANT: UID=%d COMM=%s METHOD=%s "
+				"PID=%d\n",
+				timestamp, rec->uid, rec->comm, rec->name,
+				rec->pid);
+	case DEDUP_SU_ATTEMPT:
+		return snprintf(buf, len,
+				"[%s] SU_EXEC: UID=%d COMM=%s TARGET=%s "
+				"RESULT=%s PID=%d\n",
+				timestamp, rec->uid, rec->comm, rec->name,
+				rec->result ? "SUCCESS" : "DENIED", rec->pid);
+	case DEDUP_PERM_CHECK:
+		return snprintf(buf, len,
+				"[%s] PERM_CHECK: UID=%d COMM=%s RESULT=%s "
+				"PID=%d\n",
+				timestamp, rec->uid, rec->comm,
+				rec->result ? "ALLOWED" : "DENIED", rec->pid);
+	case DEDUP_MANAGER_OP:
+		return snprintf(buf, len,
+				"[%s] MANAGER_OP: OP=%s MANAGER_UID=%d "
+				"TARGET_UID=%d COMM=%s PID=%d\n",
+				timestamp, rec->name, rec->uid, rec->aux_uid,
+				rec->comm, rec->pid);
+	default:
+		return snprintf(buf, len,
+				"[%s] SYSCALL: UID=%d COMM=%s SYSCALL=%s "
+				"ARGS=%s PID=%d\n",
+				timestamp, rec->uid, rec->comm, rec->name,
+				rec->arg, rec->pid);
 	}
+}
 
-	e->key = key;
-	e->ts_ns = now;
-	spin_unlock(&dedup_lock);
-	return true;
+static void sulog_file_write(struct file *fp, const char *buf, size_t len,
+			     loff_t *pos)
+{
+#ifdef CONFIG_KSU_LKM
+	kernel_write(fp, buf, len, pos);
+#else
+	ksu_kernel_write_compat(fp, buf, len, pos);
+#endif // #ifdef CONFIG_KSU_LKM
 }
 
+// Append everything between sulog_flushed_seq and the ring head to
+// SULOG_PATH as text, with a single fsync per batch.
 static void sulog_process_queue(void)
 {
 	struct file *fp;
-	struct sulog_entry *entry, *tmp;
-	LIST_HEAD(local_queue);
+	struct ksu_sulog_record *rec;
+	char *buf;
+	size_t used = 0;
+	u64 head, seq;
 	loff_t pos = 0;
-	unsigned long flags;
 	const struct cred *old_cred;
 
-	spin_lock_irqsave(&dedup_lock, flags);
-	list_splice_init(&sulog_queue, &local_queue);
-	spin_unlock_irqrestore(&dedup_lock, flags);
+	if (!sulog_ring)
+		return;
 
-	if (list_empty(&local_queue))
+	head = smp_load_acquire(&sulog_ring->head);
+	if (sulog_flushed_seq == head)
 		return;
 
+	buf = kmalloc(PAGE_SIZE, GFP_KERNEL);
+	rec = kmalloc(sizeof(*rec), GFP_KERNEL);
+	if (!buf || !rec)
+		goto free_out;
+
 	old_cred = override_creds(ksu_cred);
 #ifdef CONFIG_KSU_LKM
 	fp = filp_open(SULOG_PATH, O_WRONLY | O_CREAT | O_APPEND, 0640);
@@ -190,28 +385,44 @@ static void sulog_process_queue(void)
 		pos = fp->f_inode->i_size;
 	}
 
-	list_for_each_entry (entry, &local_queue, list)
-#ifdef CONFIG_KSU_LKM
-		kernel_write(fp, entry->content, strlen(entry->content), &pos);
-#else
-		ksu_kernel_write_compat(fp, entry->content,
-					strlen(entry->content), &pos);
-#endif // #ifdef CONFIG_KSU_LKM
+	if (head - sulog_flushed_seq > SULOG_RING_RECORDS) {
+		used = snprintf(buf, PAGE_SIZE, "[sulog] %llu records lost\n",
+				head - sulog_flushed_seq - SULOG_RING_RECORDS);
+		sulog_flushed_seq = head - SULOG_RING_RECORDS;
+	}
+
+	for (seq = sulog_flushed_seq; seq < head; seq++) {
+		int n;
+
+		if (!sulog_read_record(seq, rec))
+			continue;
+
+		if (PAGE_SIZE - used < SULOG_ENTRY_MAX_LEN) {
+			sulog_file_write(fp, buf, used, &pos);
+			used = 0;
+		}
+
+		n = sulog_format_record(rec, buf + used, SULOG_ENTRY_MAX_LEN);
+		if (n > 0)
+			used += min_t(size_t, n, SULOG_ENTRY_MAX_LEN - 1);
+	}
+	if (used)
+		sulog_file_write(fp, buf, used, &pos);
+	sulog_flushed_seq = head;
 
 	vfs_fsync(fp, 0);
 	filp_close(fp, 0);
 
 revert_creds_out:
 	revert_creds(old_cred);
-
-	list_for_each_entry_safe (entry, tmp, &local_queue, list) {
-		list_del(&entry->list);
-		kfree(entry);
-	}
+free_out:
+	kfree(rec);
+	kfree(buf);
 }
 
 static void sulog_task_work_handler(struct callback_head *work)
 {
+	clear_bit(0, &sulog_flush_pending);
 	sulog_process_queue();
 	kfree(work);
 }
@@ -222,10 +433,14 @@ static void sulog_schedule_task_work(void)
 	struct callback_head *cb;
 	int ret;
 
+	// one flush in flight is enough, it picks up everything queued
+	if (test_and_set_bit(0, &sulog_flush_pending))
+		return;
+
 	tsk = get_pid_task(find_vpid(1), PIDTYPE_PID);
 	if (!tsk) {
 		pr_err("sulog: failed to find init task\n");
-		return;
+		goto clear_pending;
 	}
 
 	cb = kzalloc(sizeof(*cb), GFP_ATOMIC);
@@ -240,179 +455,337 @@ static void sulog_schedule_task_work(void)
 	if (ret) {
 		pr_err("sulog: failed to queue task work: %d\n", ret);
 		kfree(cb);
+		goto put_task;
 	}
 
+	put_task_struct(tsk);
+	return;
+
 put_task:
 	put_task_struct(tsk);
+clear_pending:
+	clear_bit(0, &sulog_flush_pending);
 }
 
-static void sulog_add_entry(char *log_buf, size_t len, uid_t uid, u8 dedup_type)
+static void sulog_flush_workfn(struct work_struct *work)
 {
-	struct sulog_entry *entry;
-	unsigned long flags;
+	sulog_schedule_task_work();
+}
 
-	if (!sulog_enabled || !log_buf || len == 0)
-		return;
+static void sulog_add_record(struct ksu_sulog_record *rec)
+{
+	struct ksu_sulog_record *slot;
+	unsigned long flags;
+	u64 seq;
 
-	if (!dedup_should_print(uid, dedup_type, log_buf, len))
+	if (!sulog_enabled || !sulog_ring)
 		return;
 
-	entry = kzalloc(sizeof(*entry), GFP_ATOMIC);
-	if (!entry)
+	// everything but seq/ts identifies a repeated event
+	if (!dedup_should_print(rec->uid, rec->type, (const char *)&rec->uid,
+				sizeof(*rec) -
+				    offsetof(struct ksu_sulog_record, uid)))
 		return;
 
-	KSU_STRSCPY(entry->content, log_buf, SULOG_ENTRY_MAX_LEN);
-
-	spin_lock_irqsave(&dedup_lock, flags);
-	list_add_tail(&entry->list, &sulog_queue);
-	spin_unlock_irqrestore(&dedup_lock, flags);
+	rec->ts_ns = ktime_get_real_ns();
+
+	spin_lock_irqsave(&sulog_ring_lock, flags);
+	seq = sulog_ring->head;
+	slot = sulog_slot(seq);
+	WRITE_ONCE(slot->seq, 0);
+	smp_wmb();
+	memcpy(&slot->ts_ns, &rec->ts_ns,
+	       sizeof(*rec) - offsetof(struct ksu_sulog_record, ts_ns));
+	smp_wmb();
+	WRITE_ONCE(slot->seq, seq);
+	smp_store_release(&sulog_ring->head, seq + 1);
+	spin_unlock_irqrestore(&sulog_ring_lock, flags);
+
+	wake_up_interruptible(&sulog_wq);
+
+	if (seq + 1 - READ_ONCE(sulog_flushed_seq) >= SULOG_FLUSH_BATCH)
+		sulog_schedule_task_work();
+	else
+		schedule_delayed_work(&sulog_flush_work,
+				      msecs_to_jiffies(SULOG_FLUSH_DELAY_MS));
+}
 
-	sulog_schedule_task_work();
+static void sulog_init_record(struct ksu_sulog_record *rec, u8 type, uid_t uid,
+			      const char *comm)
+{
+	memset(rec, 0, sizeof(*rec));
+	rec->type = type;
+	rec->uid = uid;
+	rec->pid = current->pid;
+	ksu_get_cmdline(rec->comm, comm, sizeof(rec->comm));
+	sanitize_string(rec->comm, sizeof(rec->comm));
 }
 
 void ksu_sulog_report_su_grant(uid_t uid, const char *comm, const char *method)
 {
-	char log_buf[SULOG_ENTRY_MAX_LEN];
-	char timestamp[32];
-	char full_comm[SULOG_COMM_LEN];
+	struct ksu_sulog_record rec;
 
 	if (!sulog_enabled)
 		return;
 
-	get_timestamp(timestamp, sizeof(timestamp));
-	ksu_get_cmdline(full_comm, comm, sizeof(full_comm));
+	sulog_init_record(&rec, DEDUP_SU_GRANT, uid, comm);
+	KSU_STRSCPY(rec.name, method ? method : "unknown", sizeof(rec.name));
 
-	sanitize_string(full_comm, sizeof(full_comm));
-
-	snprintf(log_buf, sizeof(log_buf),
-		 "[%s] SU_GRANT: UID=%d COMM=%s METHOD=%s PID=%d\n", timestamp,
-		 uid, full_comm, method ? method : "unknown", current->pid);
-
-	sulog_add_entry(log_buf, strlen(log_buf), uid, DEDUP_SU_GRANT);
+	sulog_add_record(&rec);
 }
 
 void ksu_sulog_report_su_attempt(uid_t uid, const char *comm,
 				 const char *target_path, bool success)
 {
-	char log_buf[SULOG_ENTRY_MAX_LEN];
-	char timestamp[32];
-	char full_comm[SULOG_COMM_LEN];
+	struct ksu_sulog_record rec;
 
 	if (!sulog_enabled)
 		return;
 
-	get_timestamp(timestamp, sizeof(timestamp));
-	ksu_get_cmdline(full_comm, comm, sizeof(full_comm));
-
-	sanitize_string(full_comm, sizeof(full_comm));
-
-	snprintf(log_buf, sizeof(log_buf),
-		 "[%s] SU_EXEC: UID=%d COMM=%s TARGET=%s RESULT=%s PID=%d\n",
-		 timestamp, uid, full_comm,
-		 target_path ? target_path : "unknown",
-		 success ? "SUCCESS" : "DENIED", current->pid);
+	sulog_init_record(&rec, DEDUP_SU_ATTEMPT, uid, comm);
+	KSU_STRSCPY(rec.name, target_path ? target_path : "unknown",
+		    sizeof(rec.name));
+	rec.result = success;
 
-	sulog_add_entry(log_buf, strlen(log_buf), uid, DEDUP_SU_ATTEMPT);
+	sulog_add_record(&rec);
 }
 
 void ksu_sulog_report_permission_check(uid_t uid, const char *comm,
 				       bool allowed)
 {
-	char log_buf[SULOG_ENTRY_MAX_LEN];
-	char timestamp[32];
-	char full_comm[SULOG_COMM_LEN];
+	struct ksu_sulog_record rec;
 
 	if (!sulog_enabled)
 		return;
 
-	get_timestamp(timestamp, sizeof(timestamp));
-	ksu_get_cmdline(full_comm, comm, sizeof(full_comm));
-
-	sanitize_string(full_comm, sizeof(full_comm));
+	sulog_init_record(&rec, DEDUP_PERM_CHECK, uid, comm);
+	rec.result = allowed;
 
-	snprintf(log_buf, sizeof(log_buf),
-		 "[%s] PERM_CHECK: UID=%d COMM=%s RESULT=%s PID=%d\n",
-		 timestamp, uid, full_comm, allowed ? "ALLOWED" : "DENIED",
-		 current->pid);
-
-	sulog_add_entry(log_buf, strlen(log_buf), uid, DEDUP_PERM_CHECK);
+	sulog_add_record(&rec);
 }
 
 void ksu_sulog_report_manager_operation(const char *operation,
 					uid_t manager_uid, uid_t target_uid)
 {
-	char log_buf[SULOG_ENTRY_MAX_LEN];
-	char timestamp[32];
-	char full_comm[SULOG_COMM_LEN];
+	struct ksu_sulog_record rec;
 
 	if (!sulog_enabled)
 		return;
 
-	get_timestamp(timestamp, sizeof(timestamp));
-	ksu_get_cmdline(full_comm, NULL, sizeof(full_comm));
+	sulog_init_record(&rec, DEDUP_MANAGER_OP, manager_uid, NULL);
+	KSU_STRSCPY(rec.name, operation ? operation : "unknown",
+		    sizeof(rec.name));
+	rec.aux_uid = target_uid;
 
-	sanitize_string(full_comm, sizeof(full_comm));
-
-	snprintf(log_buf, sizeof(log_buf),
-		 "[%s] MANAGER_OP: OP=%s MANAGER_UID=%d TARGET_UID=%d COMM=%s "
-		 "PID=%d\n",
-		 timestamp, operation ? operation : "unknown", manager_uid,
-		 target_uid, full_comm, current->pid);
-
-	sulog_add_entry(log_buf, strlen(log_buf), manager_uid,
-			DEDUP_MANAGER_OP);
+	sulog_add_record(&rec);
 }
 
 void ksu_sulog_report_syscall(uid_t uid, const char *comm, const char *syscall,
 			      const char *args)
 {
-	char log_buf[SULOG_ENTRY_MAX_LEN];
-	char timestamp[32];
-	char full_comm[SULOG_COMM_LEN];
+	struct ksu_sulog_record rec;
 
 	if (!sulog_enabled)
 		return;
 
-	get_timestamp(timestamp, sizeof(timestamp));
-	ksu_get_cmdline(full_comm, comm, sizeof(full_comm));
+	sulog_init_record(&rec, DEDUP_SYSCALL, uid, comm);
+	KSU_STRSCPY(rec.name, syscall ? syscall : "unknown", sizeof(rec.name));
+	KSU_STRSCPY(rec.arg, args ? args : "none", sizeof(rec.arg));
+
+	sulog_add_record(&rec);
+}
+
+// sulog fd: read() returns whole records from the reader's cursor, poll()
+// reports new records and mmap() maps the ring read-only.
+struct sulog_reader {
+	u64 next_seq;
+};
+
+static ssize_t sulog_fd_read(struct file *filp, char __user *buf, size_t count,
+			     loff_t *ppos)
+{
+	struct sulog_reader *reader = filp->private_data;
+	struct ksu_sulog_record rec;
+	ssize_t copied = 0;
+	u64 head;
+	int ret;
+
+	if (count < sizeof(rec))
+		return -EINVAL;
+
+	head = smp_load_acquire(&sulog_ring->head);
+	while (reader->next_seq == head) {
+		if (filp->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+		ret = wait_event_interruptible(
+		    sulog_wq,
+		    smp_load_acquire(&sulog_ring->head) != reader->next_seq);
+		if (ret)
+			return ret;
+		head = smp_load_acquire(&sulog_ring->head);
+	}
+
+	// skip what has already been overwritten
+	if (head - reader->next_seq > SULOG_RING_RECORDS)
+		reader->next_seq = head - SULOG_RING_RECORDS;
+
+	while (reader->next_seq < head && count - copied >= sizeof(rec)) {
+		if (sulog_read_record(reader->next_seq, &rec)) {
+			if (copy_to_user(buf + copied, &rec, sizeof(rec)))
+				return copied ? copied : -EFAULT;
+			copied += sizeof(rec);
+		}
+		reader->next_seq++;
+	}
+
+	return copied;
+}
+
+static sulog_poll_t sulog_fd_poll(struct file *filp, poll_table *wait)
+{
+	struct sulog_reader *reader = filp->private_data;
+
+	poll_wait(filp, &sulog_wq, wait);
+
+	if (smp_load_acquire(&sulog_ring->head) != reader->next_seq)
+		return POLLIN | POLLRDNORM;
+	return 0;
+}
 
-	sanitize_string(full_comm, sizeof(full_comm));
+static int sulog_fd_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
 
-	snprintf(log_buf, sizeof(log_buf),
-		 "[%s] SYSCALL: UID=%d COMM=%s SYSCALL=%s ARGS=%s PID=%d\n",
-		 timestamp, uid, full_comm, syscall ? syscall : "unknown",
-		 args ? args : "none", current->pid);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+	vm_flags_clear(vma, VM_MAYWRITE);
+#else
+	vma->vm_flags &= ~VM_MAYWRITE;
+#endif // #if LINUX_VERSION_CODE >= KERNEL_VERSIO...
 
-	sulog_add_entry(log_buf, strlen(log_buf), uid, DEDUP_SYSCALL);
+	return remap_vmalloc_range(vma, sulog_ring, vma->vm_pgoff);
+}
+
+static long sulog_fd_ioctl(struct file *filp, unsigned int cmd,
+			   unsigned long arg)
+{
+	struct ksu_sulog_stats stats = {0};
+
+	if (cmd != KSU_SULOG_IOCTL_GET_STATS)
+		return -ENOTTY;
+
+	dedup_get_stats(&stats);
+	stats.records = smp_load_acquire(&sulog_ring->head) - 1;
+
+	if (copy_to_user((void __user *)arg, &stats, sizeof(stats)))
+		return -EFAULT;
+
+	return 0;
+}
+
+static int sulog_fd_release(struct inode *inode, struct file *filp)
+{
+	kfree(filp->private_data);
+	atomic_dec(&sulog_readers);
+	return 0;
+}
+
+static const struct file_operations sulog_fops = {
+    .owner = THIS_MODULE,
+    .read = sulog_fd_read,
+    .poll = sulog_fd_poll,
+    .mmap = sulog_fd_mmap,
+    .unlocked_ioctl = sulog_fd_ioctl,
+    .compat_ioctl = sulog_fd_ioctl,
+    .release = sulog_fd_release,
+    .llseek = noop_llseek,
+};
+
+int ksu_sulog_install_fd(void)
+{
+	struct sulog_reader *reader;
+	u64 head;
+	int fd;
+
+	if (!sulog_ring)
+		return -ENODEV;
+
+	reader = kzalloc(sizeof(*reader), GFP_KERNEL);
+	if (!reader)
+		return -ENOMEM;
+
+	// start at the oldest record still in the ring
+	head = smp_load_acquire(&sulog_ring->head);
+	reader->next_seq =
+	    head > SULOG_RING_RECORDS ? head - SULOG_RING_RECORDS : 1;
+
+	atomic_inc(&sulog_readers);
+	fd = anon_inode_getfd("[ksu_sulog]", &sulog_fops, reader,
+			      O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		atomic_dec(&sulog_readers);
+		kfree(reader);
+	}
+
+	return fd;
 }
 
 int ksu_sulog_init(void)
 {
+	int i;
+
+	if (!sulog_ring) {
+		// reports only reach the dedup cache once the ring exists
+		for (i = 0; i < DEDUP_SHARDS; i++)
+			spin_lock_init(&dedup_shards[i].lock);
+
+		sulog_ring = vmalloc_user(SULOG_RING_SIZE);
+		if (!sulog_ring) {
+			pr_err("sulog: failed to allocate ring\n");
+			return -ENOMEM;
+		}
+
+		sulog_ring->magic = KSU_SULOG_RING_MAGIC;
+		sulog_ring->version = KSU_SULOG_RING_VERSION;
+		sulog_ring->record_size = sizeof(struct ksu_sulog_record);
+		sulog_ring->capacity = SULOG_RING_RECORDS;
+		sulog_ring->data_offset = PAGE_SIZE;
+		sulog_records =
+		    (struct ksu_sulog_record *)((char *)sulog_ring + PAGE_SIZE);
+		sulog_flushed_seq = 1;
+		smp_store_release(&sulog_ring->head, 1);
+	}
+
 	if (ksu_register_feature_handler(&sulog_handler)) {
 		pr_err("Failed to register sulog feature handler\n");
 	}
 
+	if (ksu_register_feature_handler(&sulog_dedup_window_handler)) {
+		pr_err("Failed to register sulog dedup window handler\n");
+	}
+
 	pr_info("sulog: initialized successfully\n");
 	return 0;
 }
 
 void ksu_sulog_exit(void)
 {
-	struct sulog_entry *entry, *tmp;
-	unsigned long flags;
+	void *ring = sulog_ring;
 
 	ksu_unregister_feature_handler(KSU_FEATURE_SULOG);
+	ksu_unregister_feature_handler(KSU_FEATURE_SULOG_DEDUP_WINDOW);
 
 	sulog_enabled = false;
 
+	cancel_delayed_work_sync(&sulog_flush_work);
 	sulog_process_queue();
 
-	spin_lock_irqsave(&dedup_lock, flags);
-	list_for_each_entry_safe (entry, tmp, &sulog_queue, list) {
-		list_del(&entry->list);
-		kfree(entry);
+	// an open or mapped sulog fd keeps using the ring, leave it alone
+	if (ring && !atomic_read(&sulog_readers)) {
+		sulog_ring = NULL;
+		sulog_records = NULL;
+		vfree(ring);
 	}
-	spin_unlock_irqrestore(&dedup_lock, flags);
 
 	pr_info("sulog: cleaned up successfully\n");
 }
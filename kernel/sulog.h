@@ -16,6 +16,18 @@ extern struct timezone sys_tz;
 #define SULOG_ENTRY_MAX_LEN 512
 #define SULOG_COMM_LEN 256
 #define DEDUP_SECS 10
+#define DEDUP_MAX_SECS 3600
+
+// dedup cache: DEDUP_SHARDS independently locked shards, each a
+// DEDUP_SETS x DEDUP_WAYS set-associative table with LRU replacement
+#define DEDUP_SHARDS 16
+#define DEDUP_SETS 16
+#define DEDUP_WAYS 4
+
+// in-memory ring of binary records, flushed to SULOG_PATH in batches
+#define SULOG_RING_RECORDS 1024 // must be a power of two
+#define SULOG_FLUSH_BATCH 64
+#define SULOG_FLUSH_DELAY_MS 5000
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 10, 0)
 static inline size_t strlcpy(char *dest, const char *src, size_t size)
@@ -60,7 +72,8 @@ struct dedup_key {
 
 struct dedup_entry {
 	struct dedup_key key;
-	u64 ts_ns;
+	u32 lru; // shard tick of the last lookup that hit this way
+	u64 ts_ns; // last time this key was logged, 0 if the way is empty
 };
 
 enum {
@@ -76,9 +89,37 @@ static inline u32 dedup_calc_hash(const char *content, size_t len)
 	return crc32(0, content, len);
 }
 
-struct sulog_entry {
-	struct list_head list;
-	char content[SULOG_ENTRY_MAX_LEN];
+#define SULOG_RECORD_COMM_LEN 128
+#define SULOG_RECORD_NAME_LEN 64
+#define SULOG_RECORD_ARG_LEN 32
+
+// One su event, 256 bytes. Shared with userspace through the sulog fd.
+struct ksu_sulog_record {
+	__u64 seq; // starts at 1, 0 while the slot is being written
+	__u64 ts_ns; // CLOCK_REALTIME
+	__u32 uid;
+	__u32 pid;
+	__u32 aux_uid; // target uid of MANAGER_OP
+	__u8 type; // DEDUP_* event type
+	__u8 result; // SU_EXEC / PERM_CHECK result
+	__u8 _pad[2];
+	char comm[SULOG_RECORD_COMM_LEN];
+	char name[SULOG_RECORD_NAME_LEN]; // method, target, op or syscall
+	char arg[SULOG_RECORD_ARG_LEN]; // syscall args
+};
+
+#define KSU_SULOG_RING_MAGIC 0x4b53554c // "KSUL"
+#define KSU_SULOG_RING_VERSION 1
+
+// First page of the mmap()ed ring; records start at data_offset and the
+// record for seq lives in slot (seq % capacity).
+struct ksu_sulog_ring_hdr {
+	__u32 magic;
+	__u32 version;
+	__u32 record_size;
+	__u32 capacity;
+	__u64 head; // seq of the next record to be written
+	__u64 data_offset;
 };
 
 void ksu_sulog_report_su_grant(uid_t uid, const char *comm, const char *method);
@@ -91,6 +132,20 @@ void ksu_sulog_report_manager_operation(const char *operation,
 void ksu_sulog_report_syscall(uid_t uid, const char *comm, const char *syscall,
 			      const char *args);
 
+// Open a read-only, pollable and mmap()able fd on the record ring
+int ksu_sulog_install_fd(void);
+
+struct ksu_sulog_stats {
+	__u64 dedup_hits; // reports suppressed as duplicates
+	__u64 dedup_misses; // reports that went to the ring
+	__u64 dedup_evictions; // live entries pushed out of a full set
+	__u64 records; // records written to the ring so far
+	__u32 dedup_window; // seconds, 0 disables dedup
+};
+
+// ioctl on the sulog fd
+#define KSU_SULOG_IOCTL_GET_STATS _IOC(_IOC_READ, 'S', 1, 0)
+
 int ksu_sulog_init(void);
 void ksu_sulog_exit(void);
 #endif // #if __SULOG_GATE
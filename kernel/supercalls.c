@@ -7,6 +7,8 @@
 #include <linux/file.h>
 #include <linux/fs.h>
 #include <linux/kprobes.h>
+#include <linux/ktime.h>
+#include <linux/percpu.h>
 #include <linux/seccomp.h>
 #include <linux/slab.h>
 #include <linux/syscalls.h>
@@ -40,6 +42,7 @@
 #include "manager.h"
 #include "seccomp_cache.h"
 #include "selinux/selinux.h"
+#include "sucompat.h"
 #include "sulog.h"
 #include "supercalls.h"
 
@@ -315,6 +318,31 @@ static int do_get_app_profile(void __user *arg)
 	return 0;
 }
 
+// 22. EXPORT_APP_PROFILES - Page through every app profile in one call
+static int do_export_app_profiles(void __user *arg)
+{
+	struct ksu_export_app_profiles_cmd cmd;
+	int ret;
+
+	if (copy_from_user(&cmd, arg, sizeof(cmd))) {
+		pr_err("export_app_profiles: copy_from_user failed\n");
+		return -EFAULT;
+	}
+
+	ret = ksu_export_app_profiles(
+	    (struct app_profile __user *)(uintptr_t)cmd.arg, cmd.start,
+	    cmd.max, &cmd.count, &cmd.total, &cmd.generation);
+	if (ret)
+		return ret;
+
+	if (copy_to_user(arg, &cmd, sizeof(cmd))) {
+		pr_err("export_app_profiles: copy_to_user failed\n");
+		return -EFAULT;
+	}
+
+	return 0;
+}
+
 static int do_set_app_profile(void __user *arg)
 {
 	struct ksu_set_app_profile_cmd cmd;
@@ -792,6 +820,29 @@ static int list_try_umount(void __user *arg)
 }
 #endif // #ifdef CONFIG_KSU_LKM
 
+#if __SULOG_GATE
+// 19. GET_SULOG_FD - Open a reader fd on the sulog record ring
+static int do_get_sulog_fd(void __user *arg)
+{
+	return ksu_sulog_install_fd();
+}
+#endif // #if __SULOG_GATE
+
+// 20. GET_SUCOMPAT_STATS - su path matcher counters per hooked syscall
+static int do_get_sucompat_stats(void __user *arg)
+{
+	struct ksu_sucompat_hook_stats stats[KSU_SUCOMPAT_HOOK_MAX];
+
+	ksu_sucompat_get_stats(stats);
+
+	if (copy_to_user(arg, stats, sizeof(stats))) {
+		pr_err("get_sucompat_stats: copy_to_user failed\n");
+		return -EFAULT;
+	}
+
+	return 0;
+}
+
 // 100. GET_FULL_VERSION - Get full version string
 static int do_get_full_version(void __user *arg)
 {
@@ -927,111 +978,192 @@ static int do_superkey_status(void __user *arg)
 }
 #endif // #ifdef CONFIG_KSU_SUPERKEY
 
-// IOCTL handlers mapping table
-static const struct ksu_ioctl_cmd_map ksu_ioctl_handlers[] = {
-    {.cmd = KSU_IOCTL_GRANT_ROOT,
-     .name = "GRANT_ROOT",
-     .handler = do_grant_root,
-     .perm_check = allowed_for_su},
-    {.cmd = KSU_IOCTL_GET_INFO,
-     .name = "GET_INFO",
-     .handler = do_get_info,
-     .perm_check = always_allow},
-    {.cmd = KSU_IOCTL_REPORT_EVENT,
-     .name = "REPORT_EVENT",
-     .handler = do_report_event,
-     .perm_check = only_root},
-    {.cmd = KSU_IOCTL_SET_SEPOLICY,
-     .name = "SET_SEPOLICY",
-     .handler = do_set_sepolicy,
-     .perm_check = only_root},
-    {.cmd = KSU_IOCTL_CHECK_SAFEMODE,
-     .name = "CHECK_SAFEMODE",
-     .handler = do_check_safemode,
-     .perm_check = always_allow},
-    {.cmd = KSU_IOCTL_GET_ALLOW_LIST,
-     .name = "GET_ALLOW_LIST",
-     .handler = do_get_allow_list,
-     .perm_check = manager_or_root},
-    {.cmd = KSU_IOCTL_GET_DENY_LIST,
-     .name = "GET_DENY_LIST",
-     .handler = do_get_deny_list,
-     .perm_check = manager_or_root},
-    {.cmd = KSU_IOCTL_UID_GRANTED_ROOT,
-     .name = "UID_GRANTED_ROOT",
-     .handler = do_uid_granted_root,
-     .perm_check = manager_or_root},
-    {.cmd = KSU_IOCTL_UID_SHOULD_UMOUNT,
-     .name = "UID_SHOULD_UMOUNT",
-     .handler = do_uid_should_umount,
-     .perm_check = manager_or_root},
-    {.cmd = KSU_IOCTL_GET_MANAGER_UID,
-     .name = "GET_MANAGER_UID",
-     .handler = do_get_manager_uid,
-     .perm_check = manager_or_root},
-    {.cmd = KSU_IOCTL_GET_APP_PROFILE,
-     .name = "GET_APP_PROFILE",
-     .handler = do_get_app_profile,
-     .perm_check = only_manager},
-    {.cmd = KSU_IOCTL_SET_APP_PROFILE,
-     .name = "SET_APP_PROFILE",
-     .handler = do_set_app_profile,
-     .perm_check = only_manager},
-    {.cmd = KSU_IOCTL_GET_FEATURE,
-     .name = "GET_FEATURE",
-     .handler = do_get_feature,
-     .perm_check = manager_or_root},
-    {.cmd = KSU_IOCTL_SET_FEATURE,
-     .name = "SET_FEATURE",
-     .handler = do_set_feature,
-     .perm_check = manager_or_root},
-    {.cmd = KSU_IOCTL_GET_WRAPPER_FD,
-     .name = "GET_WRAPPER_FD",
-     .handler = do_get_wrapper_fd,
-     .perm_check = manager_or_root},
-    {.cmd = KSU_IOCTL_MANAGE_MARK,
-     .name = "MANAGE_MARK",
-     .handler = do_manage_mark,
-     .perm_check = manager_or_root},
-    {.cmd = KSU_IOCTL_NUKE_EXT4_SYSFS,
-     .name = "NUKE_EXT4_SYSFS",
-     .handler = do_nuke_ext4_sysfs,
-     .perm_check = manager_or_root},
-    {.cmd = KSU_IOCTL_ADD_TRY_UMOUNT,
-     .name = "ADD_TRY_UMOUNT",
-     .handler = add_try_umount,
-     .perm_check = manager_or_root},
-    {.cmd = KSU_IOCTL_GET_FULL_VERSION,
-     .name = "GET_FULL_VERSION",
-     .handler = do_get_full_version,
-     .perm_check = always_allow},
-    {.cmd = KSU_IOCTL_HOOK_TYPE,
-     .name = "GET_HOOK_TYPE",
-     .handler = do_get_hook_type,
-     .perm_check = manager_or_root},
+// 21. GET_IOCTL_STATS - Per-command call counts and latency histograms
+static int do_get_ioctl_stats(void __user *arg);
+
+/*
+ * IOCTL handlers mapping table, one entry per command:
+ * X(cmd, name, handler, perm_check, flags)
+ * Handler names double as stats slot names, so each must appear once.
+ */
+#if __SULOG_GATE
+#define KSU_IOCTL_TABLE_SULOG(X)                                               \
+	X(KSU_IOCTL_GET_SULOG_FD, "GET_SULOG_FD", do_get_sulog_fd,             \
+	  manager_or_root, KSU_IOCTL_F_AUDIT)
+#else
+#define KSU_IOCTL_TABLE_SULOG(X)
+#endif // #if __SULOG_GATE
+
 #ifdef CONFIG_KSU_MANUAL_SU
-    {.cmd = KSU_IOCTL_MANUAL_SU,
-     .name = "MANUAL_SU",
-     .handler = do_manual_su,
-     .perm_check = system_uid_check},
+#define KSU_IOCTL_TABLE_MANUAL_SU(X)                                           \
+	X(KSU_IOCTL_MANUAL_SU, "MANUAL_SU", do_manual_su, system_uid_check,    \
+	  KSU_IOCTL_F_AUDIT)
+#else
+#define KSU_IOCTL_TABLE_MANUAL_SU(X)
 #endif // #ifdef CONFIG_KSU_MANUAL_SU
+
 #ifdef CONFIG_KSU_SUPERKEY
-    {.cmd = KSU_IOCTL_SUPERKEY_AUTH,
-     .name = "SUPERKEY_AUTH",
-     .handler = do_superkey_auth,
-     .perm_check = always_allow},
-    {.cmd = KSU_IOCTL_SUPERKEY_STATUS,
-     .name = "SUPERKEY_STATUS",
-     .handler = do_superkey_status,
-     .perm_check = always_allow},
+#define KSU_IOCTL_TABLE_SUPERKEY(X)                                            \
+	X(KSU_IOCTL_SUPERKEY_AUTH, "SUPERKEY_AUTH", do_superkey_auth,          \
+	  always_allow, KSU_IOCTL_F_AUDIT)                                     \
+	X(KSU_IOCTL_SUPERKEY_STATUS, "SUPERKEY_STATUS", do_superkey_status,    \
+	  always_allow, 0)
+#else
+#define KSU_IOCTL_TABLE_SUPERKEY(X)
 #endif // #ifdef CONFIG_KSU_SUPERKEY
-    {.cmd = KSU_IOCTL_LIST_TRY_UMOUNT,
-     .name = "LIST_TRY_UMOUNT",
-     .handler = list_try_umount,
-     .perm_check = manager_or_root},
-    {.cmd = 0, .name = NULL, .handler = NULL, .perm_check = NULL} // Sentinel
+
+#define KSU_IOCTL_TABLE(X)                                                     \
+	X(KSU_IOCTL_GRANT_ROOT, "GRANT_ROOT", do_grant_root, allowed_for_su,   \
+	  KSU_IOCTL_F_AUDIT)                                                   \
+	X(KSU_IOCTL_GET_INFO, "GET_INFO", do_get_info, always_allow, 0)        \
+	X(KSU_IOCTL_REPORT_EVENT, "REPORT_EVENT", do_report_event, only_root,  \
+	  KSU_IOCTL_F_AUDIT)                                                   \
+	X(KSU_IOCTL_SET_SEPOLICY, "SET_SEPOLICY", do_set_sepolicy, only_root,  \
+	  KSU_IOCTL_F_AUDIT)                                                   \
+	X(KSU_IOCTL_CHECK_SAFEMODE, "CHECK_SAFEMODE", do_check_safemode,       \
+	  always_allow, 0)                                                     \
+	X(KSU_IOCTL_GET_ALLOW_LIST, "GET_ALLOW_LIST", do_get_allow_list,       \
+	  manager_or_root, 0)                                                  \
+	X(KSU_IOCTL_GET_DENY_LIST, "GET_DENY_LIST", do_get_deny_list,          \
+	  manager_or_root, 0)                                                  \
+	X(KSU_IOCTL_UID_GRANTED_ROOT, "UID_GRANTED_ROOT", do_uid_granted_root, \
+	  manager_or_root, 0)                                                  \
+	X(KSU_IOCTL_UID_SHOULD_UMOUNT, "UID_SHOULD_UMOUNT",                    \
+	  do_uid_should_umount, manager_or_root, 0)                            \
+	X(KSU_IOCTL_GET_MANAGER_UID, "GET_MANAGER_UID", do_get_manager_uid,    \
+	  manager_or_root, 0)                                                  \
+	X(KSU_IOCTL_GET_APP_PROFILE, "GET_APP_PROFILE", do_get_app_profile,    \
+	  only_manager, 0)                                                     \
+	X(KSU_IOCTL_SET_APP_PROFILE, "SET_APP_PROFILE", do_set_app_profile,    \
+	  only_manager, KSU_IOCTL_F_AUDIT)                                     \
+	X(KSU_IOCTL_GET_FEATURE, "GET_FEATURE", do_get_feature,                \
+	  manager_or_root, 0)                                                  \
+	X(KSU_IOCTL_SET_FEATURE, "SET_FEATURE", do_set_feature,                \
+	  manager_or_root, KSU_IOCTL_F_AUDIT)                                  \
+	X(KSU_IOCTL_GET_WRAPPER_FD, "GET_WRAPPER_FD", do_get_wrapper_fd,       \
+	  manager_or_root, KSU_IOCTL_F_AUDIT)                                  \
+	X(KSU_IOCTL_MANAGE_MARK, "MANAGE_MARK", do_manage_mark,                \
+	  manager_or_root, KSU_IOCTL_F_AUDIT)                                  \
+	X(KSU_IOCTL_NUKE_EXT4_SYSFS, "NUKE_EXT4_SYSFS", do_nuke_ext4_sysfs,    \
+	  manager_or_root, KSU_IOCTL_F_AUDIT)                                  \
+	X(KSU_IOCTL_ADD_TRY_UMOUNT, "ADD_TRY_UMOUNT", add_try_umount,          \
+	  manager_or_root, KSU_IOCTL_F_AUDIT)                                  \
+	KSU_IOCTL_TABLE_SULOG(X)                                               \
+	X(KSU_IOCTL_GET_SUCOMPAT_STATS, "GET_SUCOMPAT_STATS",                  \
+	  do_get_sucompat_stats, manager_or_root, 0)                           \
+	X(KSU_IOCTL_GET_IOCTL_STATS, "GET_IOCTL_STATS", do_get_ioctl_stats,    \
+	  manager_or_root, 0)                                                  \
+	X(KSU_IOCTL_EXPORT_APP_PROFILES, "EXPORT_APP_PROFILES",                \
+	  do_export_app_profiles, only_manager, 0)                             \
+	X(KSU_IOCTL_GET_FULL_VERSION, "GET_FULL_VERSION", do_get_full_version, \
+	  always_allow, 0)                                                     \
+	X(KSU_IOCTL_HOOK_TYPE, "GET_HOOK_TYPE", do_get_hook_type,              \
+	  manager_or_root, 0)                                                  \
+	KSU_IOCTL_TABLE_MANUAL_SU(X)                                           \
+	KSU_IOCTL_TABLE_SUPERKEY(X)                                            \
+	X(KSU_IOCTL_LIST_TRY_UMOUNT, "LIST_TRY_UMOUNT", list_try_umount,       \
+	  manager_or_root, 0)
+
+#define KSU_IOCTL_SLOT(_cmd, _name, _handler, _perm, _flags)                   \
+	KSU_IOCTL_SLOT_##_handler,
+enum ksu_ioctl_slot { KSU_IOCTL_TABLE(KSU_IOCTL_SLOT) KSU_IOCTL_SLOT_COUNT };
+
+// Indexed by _IOC_NR(cmd); a number past KSU_IOCTL_NR_MAX fails the build
+#define KSU_IOCTL_ENTRY(_cmd, _name, _handler, _perm, _flags)                  \
+	[_IOC_NR(_cmd)] = {.cmd = _cmd,                                        \
+			   .name = _name,                                      \
+			   .handler = _handler,                                \
+			   .perm_check = _perm,                                \
+			   .flags = _flags,                                    \
+			   .slot = KSU_IOCTL_SLOT_##_handler},
+static const struct ksu_ioctl_cmd_map ksu_ioctl_handlers[KSU_IOCTL_NR_MAX] = {
+    KSU_IOCTL_TABLE(KSU_IOCTL_ENTRY)};
+
+// Never called: two commands sharing an _IOC_NR become duplicate case labels,
+// which fails the build instead of silently overriding a table slot.
+#define KSU_IOCTL_NR_CASE(_cmd, _name, _handler, _perm, _flags)                \
+	case _IOC_NR(_cmd):
+static void __maybe_unused ksu_ioctl_nr_collision_check(unsigned int nr)
+{
+	switch (nr) {
+		KSU_IOCTL_TABLE(KSU_IOCTL_NR_CASE)
+		break;
+	}
+}
+
+struct ksu_ioctl_pcpu_stats {
+	u64 calls[KSU_IOCTL_SLOT_COUNT];
+	u64 denied[KSU_IOCTL_SLOT_COUNT];
+	u64 errors[KSU_IOCTL_SLOT_COUNT];
+	u64 latency[KSU_IOCTL_SLOT_COUNT][KSU_IOCTL_LAT_BUCKETS];
 };
 
+static DEFINE_PER_CPU(struct ksu_ioctl_pcpu_stats, ksu_ioctl_stats);
+
+static __always_inline unsigned int ksu_ioctl_lat_bucket(u64 ns)
+{
+	// bucket 0 is < 1024ns, each next one doubles, the last is open-ended
+	unsigned int b = fls64(ns >> 10);
+
+	return min_t(unsigned int, b, KSU_IOCTL_LAT_BUCKETS - 1);
+}
+
+static int do_get_ioctl_stats(void __user *arg)
+{
+	struct ksu_get_ioctl_stats_cmd cmd;
+	struct ksu_ioctl_stat __user *out;
+	struct ksu_ioctl_stat stat;
+	u32 written = 0;
+	int nr, cpu, b;
+
+	if (copy_from_user(&cmd, arg, sizeof(cmd))) {
+		pr_err("get_ioctl_stats: copy_from_user failed\n");
+		return -EFAULT;
+	}
+	out = (struct ksu_ioctl_stat __user *)(uintptr_t)cmd.arg;
+
+	for (nr = 0; nr < KSU_IOCTL_NR_MAX; nr++) {
+		const struct ksu_ioctl_cmd_map *entry = &ksu_ioctl_handlers[nr];
+
+		if (!entry->handler)
+			continue;
+		if (written >= cmd.count) {
+			written++;
+			continue;
+		}
+
+		memset(&stat, 0, sizeof(stat));
+		strscpy(stat.name, entry->name, sizeof(stat.name));
+		stat.cmd = entry->cmd;
+		for_each_possible_cpu (cpu) {
+			struct ksu_ioctl_pcpu_stats *s =
+			    per_cpu_ptr(&ksu_ioctl_stats, cpu);
+
+			stat.calls += READ_ONCE(s->calls[entry->slot]);
+			stat.denied += READ_ONCE(s->denied[entry->slot]);
+			stat.errors += READ_ONCE(s->errors[entry->slot]);
+			for (b = 0; b < KSU_IOCTL_LAT_BUCKETS; b++)
+				stat.latency[b] +=
+				    READ_ONCE(s->latency[entry->slot][b]);
+		}
+
+		if (copy_to_user(out + written, &stat, sizeof(stat))) {
+			pr_err("get_ioctl_stats: copy_to_user failed\n");
+			return -EFAULT;
+		}
+		written++;
+	}
+
+	// report the full command count so callers can size the buffer
+	cmd.count = written;
+	if (copy_to_user(arg, &cmd, sizeof(cmd))) {
+		pr_err("get_ioctl_stats: copy_to_user failed\n");
+		return -EFAULT;
+	}
+
+	return 0;
+}
+
 #ifndef CONFIG_KSU_HYMOFS
 struct ksu_install_fd_tw {
 	struct callback_head cb;
@@ -1441,7 +1573,9 @@ void ksu_supercalls_init(void)
 	int rc;
 
 	pr_info("KernelSU IOCTL Commands:\n");
-	for (i = 0; ksu_ioctl_handlers[i].handler; i++) {
+	for (i = 0; i < KSU_IOCTL_NR_MAX; i++) {
+		if (!ksu_ioctl_handlers[i].handler)
+			continue;
 		pr_info("  %-18s = 0x%08x\n", ksu_ioctl_handlers[i].name,
 			ksu_ioctl_handlers[i].cmd);
 	}
@@ -1498,34 +1632,43 @@ static long anon_ksu_ioctl(struct file *filp, unsigned int cmd,
 			   unsigned long arg)
 {
 	void __user *argp = (void __user *)arg;
-	int i;
+	const struct ksu_ioctl_cmd_map *entry;
+	unsigned int nr = _IOC_NR(cmd);
+	u64 start;
+	int ret;
 
 #ifdef CONFIG_KSU_DEBUG
 	pr_info("ksu ioctl: cmd=0x%x from uid=%d\n", cmd, current_uid().val);
 #endif // #ifdef CONFIG_KSU_DEBUG
 
-	for (i = 0; ksu_ioctl_handlers[i].handler; i++) {
-		if (cmd == ksu_ioctl_handlers[i].cmd) {
-			// Check permission first
-			if (ksu_ioctl_handlers[i].perm_check &&
-			    !ksu_ioctl_handlers[i].perm_check()) {
-				pr_warn("ksu ioctl: permission denied for "
-					"cmd=0x%x uid=%d\n",
-					cmd, current_uid().val);
-				ksu_ioctl_audit(cmd, ksu_ioctl_handlers[i].name,
-						current_uid().val, -EPERM);
-				return -EPERM;
-			}
-			// Execute handler
-			int ret = ksu_ioctl_handlers[i].handler(argp);
-			ksu_ioctl_audit(cmd, ksu_ioctl_handlers[i].name,
-					current_uid().val, ret);
-			return ret;
-		}
-	}
-
-	pr_warn("ksu ioctl: unsupported command 0x%x\n", cmd);
-	return -ENOTTY;
+	entry = nr < KSU_IOCTL_NR_MAX ? &ksu_ioctl_handlers[nr] : NULL;
+	if (!entry || !entry->handler || entry->cmd != cmd) {
+		pr_warn("ksu ioctl: unsupported command 0x%x\n", cmd);
+		return -ENOTTY;
+	}
+
+	// Check permission first
+	if (entry->perm_check && !entry->perm_check()) {
+		pr_warn("ksu ioctl: permission denied for "
+			"cmd=0x%x uid=%d\n",
+			cmd, current_uid().val);
+		this_cpu_inc(ksu_ioctl_stats.denied[entry->slot]);
+		ksu_ioctl_audit(cmd, entry->name, current_uid().val, -EPERM);
+		return -EPERM;
+	}
+
+	// Execute handler
+	start = ktime_to_ns(ktime_get());
+	ret = entry->handler(argp);
+	this_cpu_inc(ksu_ioctl_stats.latency[entry->slot][ksu_ioctl_lat_bucket(
+	    ktime_to_ns(ktime_get()) - start)]);
+	this_cpu_inc(ksu_ioctl_stats.calls[entry->slot]);
+	if (ret < 0)
+		this_cpu_inc(ksu_ioctl_stats.errors[entry->slot]);
+
+	if (entry->flags & KSU_IOCTL_F_AUDIT)
+		ksu_ioctl_audit(cmd, entry->name, current_uid().val, ret);
+	return ret;
 }
 
 // File release handler
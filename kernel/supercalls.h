@@ -85,6 +85,15 @@ struct ksu_set_app_profile_cmd {
 	struct app_profile profile;
 };
 
+struct ksu_export_app_profiles_cmd {
+	__aligned_u64 arg; // struct app_profile[max]
+	__u64 generation; // out: changes whenever the allowlist changes
+	__u32 start; // in: index of the first profile to copy
+	__u32 max; // in: capacity of arg, 0 only queries generation/total
+	__u32 count; // out: profiles copied
+	__u32 total; // out: profiles in the allowlist
+};
+
 struct ksu_get_feature_cmd {
 	__u32 feature_id;
 	__u64 value;
@@ -131,6 +140,24 @@ struct ksu_list_try_umount_cmd {
 #define KSU_UMOUNT_ADD 1
 #define KSU_UMOUNT_DEL 2
 
+#define KSU_IOCTL_LAT_BUCKETS 12 // log2 buckets from <1us to >=1ms
+#define KSU_IOCTL_NAME_LEN 24
+
+struct ksu_ioctl_stat {
+	char name[KSU_IOCTL_NAME_LEN];
+	__u32 cmd;
+	__u32 reserved;
+	__u64 calls;
+	__u64 denied;
+	__u64 errors;
+	__u64 latency[KSU_IOCTL_LAT_BUCKETS];
+};
+
+struct ksu_get_ioctl_stats_cmd {
+	__aligned_u64 arg; // struct ksu_ioctl_stat[count]
+	__u32 count; // in: capacity of arg, out: number of commands
+};
+
 struct ksu_get_full_version_cmd {
 	char version_full[KSU_FULL_VERSION_STRING];
 };
@@ -180,6 +207,10 @@ struct ksu_superkey_status_cmd {
 #define KSU_IOCTL_MANAGE_MARK _IOC(_IOC_READ | _IOC_WRITE, 'K', 16, 0)
 #define KSU_IOCTL_NUKE_EXT4_SYSFS _IOC(_IOC_WRITE, 'K', 17, 0)
 #define KSU_IOCTL_ADD_TRY_UMOUNT _IOC(_IOC_WRITE, 'K', 18, 0)
+#define KSU_IOCTL_GET_SULOG_FD _IOC(_IOC_READ, 'K', 19, 0)
+#define KSU_IOCTL_GET_SUCOMPAT_STATS _IOC(_IOC_READ, 'K', 20, 0)
+#define KSU_IOCTL_GET_IOCTL_STATS _IOC(_IOC_READ | _IOC_WRITE, 'K', 21, 0)
+#define KSU_IOCTL_EXPORT_APP_PROFILES _IOC(_IOC_READ | _IOC_WRITE, 'K', 22, 0)
 #define KSU_IOCTL_GET_FULL_VERSION _IOC(_IOC_READ, 'K', 100, 0)
 #define KSU_IOCTL_HOOK_TYPE _IOC(_IOC_READ, 'K', 101, 0)
 #define KSU_IOCTL_LIST_TRY_UMOUNT _IOC(_IOC_READ | _IOC_WRITE, 'K', 200, 0)
@@ -197,11 +228,19 @@ struct ksu_superkey_status_cmd {
 typedef int (*ksu_ioctl_handler_t)(void __user *arg);
 typedef bool (*ksu_perm_check_t)(void);
 
+// Dispatch table size; every command's _IOC_NR must be below this
+#define KSU_IOCTL_NR_MAX 256
+
+// Report the call to sulog. Denied calls are always reported.
+#define KSU_IOCTL_F_AUDIT (1U << 0)
+
 struct ksu_ioctl_cmd_map {
 	unsigned int cmd;
 	const char *name;
 	ksu_ioctl_handler_t handler;
 	ksu_perm_check_t perm_check;
+	unsigned int flags;
+	unsigned int slot; // index into the per-command stats
 };
 
 int ksu_install_fd(void);
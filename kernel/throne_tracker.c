@@ -1,10 +1,14 @@
 #include <linux/err.h>
 #include <linux/fs.h>
+#include <linux/hashtable.h>
 #include <linux/list.h>
+#include <linux/mutex.h>
 #include <linux/namei.h>
+#include <linux/sched.h>
 #include <linux/slab.h>
 #include <linux/stat.h>
 #include <linux/string.h>
+#include <linux/task_work.h>
 #include <linux/types.h>
 #include <linux/version.h>
 #include <linux/workqueue.h>
@@ -159,7 +163,7 @@ static int get_pkg_from_apk_path(char *pkg, const char *path)
 	return 0;
 }
 
-static void crown_manager(const char *apk, struct list_head *uid_data,
+static bool crown_manager(const char *apk, struct list_head *uid_data,
 			  int signature_index)
 {
 	char pkg[KSU_MAX_PACKAGE_NAME];
@@ -167,7 +171,7 @@ static void crown_manager(const char *apk, struct list_head *uid_data,
 
 	if (get_pkg_from_apk_path(pkg, apk) < 0) {
 		pr_err("Failed to get package name from apk path: %s\n", apk);
-		return;
+		return false;
 	}
 
 	pr_info("manager pkg: %s, signature_index: %d\n", pkg, signature_index);
@@ -178,7 +182,7 @@ static void crown_manager(const char *apk, struct list_head *uid_data,
 		pr_info(
 		    "manager package is inconsistent with kernel build: %s\n",
 		    KSU_MANAGER_PACKAGE);
-		return;
+		return false;
 	}
 #endif // #ifdef KSU_MANAGER_PACKAGE
 
@@ -198,9 +202,10 @@ static void crown_manager(const char *apk, struct list_head *uid_data,
 
 			ksu_set_manager_uid(np->appid);
 			locked_manager_appid = np->appid;
-			break;
+			return true;
 		}
 	}
+	return false;
 }
 
 #define DATA_PATH_LEN 384 // 384 is enough for /data/app/<package>/base.apk
@@ -214,10 +219,177 @@ struct data_path {
 struct apk_path_hash {
 	unsigned int hash;
 	bool exists;
-	struct list_head list;
+	struct hlist_node node;
+};
+
+#define APK_PATH_HASH_BITS 8
+static DEFINE_HASHTABLE(apk_path_hash_table, APK_PATH_HASH_BITS);
+
+static void apk_path_hash_clear(bool stale_only)
+{
+	struct apk_path_hash *pos;
+	struct hlist_node *tmp;
+	int bkt;
+
+	hash_for_each_safe (apk_path_hash_table, bkt, tmp, pos, node) {
+		if (stale_only && pos->exists)
+			continue;
+		hash_del(&pos->node);
+		kfree(pos);
+	}
+}
+
+/*
+ * Where the manager was last crowned, persisted so that the next boot can
+ * verify that single APK instead of walking /data/app.
+ */
+#define KSU_MANAGER_HINT_PATH "/data/adb/ksu/.manager_hint"
+#define MANAGER_HINT_MAGIC 0x484d534b // 'KSMH', u32
+#define MANAGER_HINT_VERSION 1
+
+struct manager_hint {
+	u32 magic;
+	u32 version;
+	u64 ino;
+	s32 signature_index;
+	char path[DATA_PATH_LEN];
 };
 
-static struct list_head apk_path_hash_list = LIST_HEAD_INIT(apk_path_hash_list);
+static struct manager_hint manager_hint;
+static bool manager_hint_loaded;
+static DEFINE_MUTEX(manager_hint_mutex);
+
+static void load_manager_hint_locked(void)
+{
+	struct file *fp;
+	loff_t off = 0;
+
+	if (manager_hint_loaded)
+		return;
+
+	fp = ksu_filp_open_compat(KSU_MANAGER_HINT_PATH, O_RDONLY, 0);
+	if (IS_ERR(fp))
+		return;
+
+	manager_hint_loaded = true;
+	if (ksu_kernel_read_compat(fp, &manager_hint, sizeof(manager_hint),
+				   &off) != sizeof(manager_hint) ||
+	    manager_hint.magic != MANAGER_HINT_MAGIC ||
+	    manager_hint.version != MANAGER_HINT_VERSION) {
+		pr_info("manager_hint: ignoring invalid hint file\n");
+		memset(&manager_hint, 0, sizeof(manager_hint));
+	}
+	manager_hint.path[DATA_PATH_LEN - 1] = '\0';
+	filp_close(fp, 0);
+}
+
+static void do_save_manager_hint(struct callback_head *_cb)
+{
+	struct file *fp;
+	loff_t off = 0;
+
+	mutex_lock(&manager_hint_mutex);
+	fp = ksu_filp_open_compat(KSU_MANAGER_HINT_PATH,
+				  O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (IS_ERR(fp)) {
+		pr_err("manager_hint: create file failed: %ld\n",
+		       PTR_ERR(fp));
+		goto unlock;
+	}
+
+	if (ksu_kernel_write_compat(fp, &manager_hint, sizeof(manager_hint),
+				    &off) != sizeof(manager_hint))
+		pr_err("manager_hint: write failed\n");
+
+	filp_close(fp, 0);
+unlock:
+	mutex_unlock(&manager_hint_mutex);
+	kfree(_cb);
+}
+
+static void save_manager_hint(const char *path, u64 ino, int signature_index)
+{
+	struct task_struct *tsk;
+	struct callback_head *cb;
+
+	mutex_lock(&manager_hint_mutex);
+	if (manager_hint.magic == MANAGER_HINT_MAGIC &&
+	    manager_hint.ino == ino &&
+	    manager_hint.signature_index == signature_index &&
+	    !strncmp(manager_hint.path, path, DATA_PATH_LEN)) {
+		mutex_unlock(&manager_hint_mutex);
+		return;
+	}
+	manager_hint.magic = MANAGER_HINT_MAGIC;
+	manager_hint.version = MANAGER_HINT_VERSION;
+	manager_hint.ino = ino;
+	manager_hint.signature_index = signature_index;
+	strscpy(manager_hint.path, path, DATA_PATH_LEN);
+	manager_hint_loaded = true;
+	mutex_unlock(&manager_hint_mutex);
+
+	tsk = get_pid_task(find_vpid(1), PIDTYPE_PID);
+	if (!tsk) {
+		pr_err("manager_hint: find init task err\n");
+		return;
+	}
+
+	cb = kzalloc(sizeof(struct callback_head), GFP_KERNEL);
+	if (!cb) {
+		pr_err("manager_hint: alloc cb err\n");
+		goto put_task;
+	}
+	cb->func = do_save_manager_hint;
+	task_work_add(tsk, cb, TWA_RESUME);
+
+put_task:
+	put_task_struct(tsk);
+}
+
+// Re-verify the APK the manager was last crowned from. A reinstall moves
+// the APK to a fresh directory, so a missing path or a different inode
+// simply falls back to the full walk.
+static bool try_manager_hint(struct list_head *uid_data)
+{
+	struct manager_hint *hint;
+	struct file *fp;
+	int signature_index = -1;
+	bool same_inode;
+	bool ret = false;
+
+	// Work on a copy: save_manager_hint may rewrite the cached hint while
+	// the APK below is being verified
+	hint = kmalloc(sizeof(*hint), GFP_KERNEL);
+	if (!hint)
+		return false;
+
+	mutex_lock(&manager_hint_mutex);
+	load_manager_hint_locked();
+	memcpy(hint, &manager_hint, sizeof(*hint));
+	mutex_unlock(&manager_hint_mutex);
+
+	if (!hint->path[0])
+		goto out;
+
+	fp = ksu_filp_open_compat(hint->path, O_RDONLY, 0);
+	if (IS_ERR(fp)) {
+		pr_info("manager_hint: %s is gone\n", hint->path);
+		goto out;
+	}
+	same_inode = file_inode(fp)->i_ino == hint->ino;
+	filp_close(fp, 0);
+
+	if (!same_inode || !is_manager_apk(hint->path, &signature_index)) {
+		pr_info("manager_hint: %s no longer matches\n", hint->path);
+		goto out;
+	}
+
+	pr_info("manager_hint: hit %s\n", hint->path);
+	ret = crown_manager(hint->path, uid_data, signature_index);
+out:
+	kfree(hint);
+	return ret;
+}
 
 struct my_dir_context {
 	struct dir_context ctx;
@@ -293,7 +465,7 @@ FILLDIR_RETURN_TYPE my_actor(struct dir_context *ctx, const char *name,
 	} else {
 		if ((namelen == 8) &&
 		    (strncmp(name, "base.apk", namelen) == 0)) {
-			struct apk_path_hash *pos, *n;
+			struct apk_path_hash *pos;
 #if LINUX_VERSION_CODE < KERNEL_VERSION(4, 8, 0)
 			unsigned int hash =
 			    full_name_hash(dirpath, strlen(dirpath));
@@ -303,19 +475,25 @@ FILLDIR_RETURN_TYPE my_actor(struct dir_context *ctx, const char *name,
 #endif // #if LINUX_VERSION_CODE < KERNEL_VERSION...
 			int signature_index = -1;
 			bool is_multi_manager = false;
+			bool is_manager;
 			struct apk_path_hash *apk_data = NULL;
 
-			list_for_each_entry (pos, &apk_path_hash_list, list) {
+			hash_for_each_possible (apk_path_hash_table, pos, node,
+						hash) {
 				if (hash == pos->hash) {
 					pos->exists = true;
 					return FILLDIR_ACTOR_CONTINUE;
 				}
 			}
 
-			if (is_manager_apk(dirpath)) {
+			is_manager = is_manager_apk(dirpath, &signature_index);
+			if (is_manager) {
 				pr_info("Found manager base.apk at path: %s\n",
 					dirpath);
-				crown_manager(dirpath, my_ctx->private_data, 0);
+				if (crown_manager(dirpath, my_ctx->private_data,
+						  signature_index))
+					save_manager_hint(dirpath, ino,
+							  signature_index);
 				*my_ctx->stop = 1;
 			}
 
@@ -323,17 +501,13 @@ FILLDIR_RETURN_TYPE my_actor(struct dir_context *ctx, const char *name,
 			if (apk_data) {
 				apk_data->hash = hash;
 				apk_data->exists = true;
-				list_add_tail(&apk_data->list,
-					      &apk_path_hash_list);
+				hash_add(apk_path_hash_table, &apk_data->node,
+					 hash);
 			}
 
-			if (is_manager_apk(dirpath)) {
-				// Manager found, clear APK cache list
-				list_for_each_entry_safe (
-				    pos, n, &apk_path_hash_list, list) {
-					list_del(&pos->list);
-					kfree(pos);
-				}
+			if (is_manager) {
+				// Manager found, clear APK cache
+				apk_path_hash_clear(false);
 			}
 		}
 	}
@@ -343,17 +517,17 @@ FILLDIR_RETURN_TYPE my_actor(struct dir_context *ctx, const char *name,
 
 void search_manager(const char *path, int depth, struct list_head *uid_data)
 {
-	int i, stop = 0;
+	int i, bkt, stop = 0;
 	unsigned long data_app_magic = 0;
-	struct apk_path_hash *pos, *n;
+	struct apk_path_hash *apk;
 	struct list_head data_path_list;
 	struct data_path data;
 
 	INIT_LIST_HEAD(&data_path_list);
 
-	// Initialize APK cache list
-	list_for_each_entry (pos, &apk_path_hash_list, list) {
-		pos->exists = false;
+	// Initialize APK cache
+	hash_for_each (apk_path_hash_table, bkt, apk, node) {
+		apk->exists = false;
 	}
 
 	// First depth
@@ -423,12 +597,7 @@ void search_manager(const char *path, int depth, struct list_head *uid_data)
 	}
 
 	// Remove stale cached APK entries
-	list_for_each_entry_safe (pos, n, &apk_path_hash_list, list) {
-		if (!pos->exists) {
-			list_del(&pos->list);
-			kfree(pos);
-		}
-	}
+	apk_path_hash_clear(true);
 }
 
 static bool is_uid_exist(uid_t uid, char *package, void *data)
@@ -540,6 +709,9 @@ void track_throne(bool prune_only)
 
 	need_search = !manager_exist;
 
+	if (need_search && try_manager_hint(&uid_list))
+		need_search = false;
+
 	if (need_search) {
 		pr_info("Searching for manager(s)...\n");
 		search_manager("/data/app", 2, &uid_list);
@@ -4,7 +4,9 @@
 
 #include <android/log.h>
 #include <dirent.h>
+#include <errno.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -127,7 +129,128 @@ bool is_manager() {
   return legacy_get_info().version > 0;
 }
 
+/*
+ * uid-indexed copy of the kernel allowlist, refreshed through one bulk export
+ * whenever the kernel's generation counter moves. Rendering the superuser list
+ * then costs one O(1) generation probe per app instead of an allowlist walk.
+ */
+static pthread_mutex_t profile_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct app_profile *profile_cache;
+static uint32_t *profile_cache_index; // sorted by uid, then list order
+static uint32_t profile_cache_count;
+static uint64_t profile_cache_generation;
+static bool profile_cache_default_umount = true;
+static bool profile_cache_unsupported;
+
+static int compare_profile_index(const void *a, const void *b) {
+  uint32_t ia = *(const uint32_t *)a, ib = *(const uint32_t *)b;
+  int32_t ua = profile_cache[ia].current_uid;
+  int32_t ub = profile_cache[ib].current_uid;
+  if (ua != ub) {
+    return ua < ub ? -1 : 1;
+  }
+  return ia < ib ? -1 : (ia > ib);
+}
+
+static bool refresh_profile_cache_locked() {
+  struct ksu_export_app_profiles_cmd cmd = {};
+
+  if (profile_cache_unsupported) {
+    return false;
+  }
+  if (ksuctl(KSU_IOCTL_EXPORT_APP_PROFILES, &cmd) != 0) {
+    // Only an older kernel without the command disables the cache for good;
+    // a transient failure (no driver fd yet, EINTR, EFAULT) retries next time
+    if (errno == ENOTTY || errno == EINVAL) {
+      profile_cache_unsupported = true;
+    }
+    return false;
+  }
+  if (profile_cache && cmd.generation == profile_cache_generation) {
+    return true;
+  }
+
+  // The list may change between the probe and the copy; retry a few times.
+  for (int attempt = 0; attempt < 4; attempt++) {
+    uint32_t capacity = cmd.total + 16;
+    struct app_profile *profiles = calloc(capacity, sizeof(*profiles));
+    uint32_t *index = calloc(capacity, sizeof(*index));
+    if (!profiles || !index) {
+      free(profiles);
+      free(index);
+      return false;
+    }
+
+    cmd.arg = (uint64_t)(uintptr_t)profiles;
+    cmd.start = 0;
+    cmd.max = capacity;
+    if (ksuctl(KSU_IOCTL_EXPORT_APP_PROFILES, &cmd) != 0) {
+      free(profiles);
+      free(index);
+      return false;
+    }
+    if (cmd.count < cmd.total) {
+      free(profiles);
+      free(index);
+      continue;
+    }
+
+    free(profile_cache);
+    free(profile_cache_index);
+    profile_cache = profiles;
+    profile_cache_index = index;
+    profile_cache_count = cmd.count;
+    profile_cache_generation = cmd.generation;
+    profile_cache_default_umount = true;
+    for (uint32_t i = 0; i < cmd.count; i++) {
+      index[i] = i;
+      if (!strcmp(profiles[i].key, "$")) {
+        profile_cache_default_umount =
+            profiles[i].nrp_config.profile.umount_modules;
+      }
+    }
+    qsort(index, cmd.count, sizeof(*index), compare_profile_index);
+    return true;
+  }
+  return false;
+}
+
+// First profile for uid in allowlist order, matching ksu_get_app_profile()
+static const struct app_profile *lookup_profile_locked(int32_t uid) {
+  uint32_t lo = 0, hi = profile_cache_count;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if (profile_cache[profile_cache_index[mid]].current_uid < uid) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo < profile_cache_count &&
+      profile_cache[profile_cache_index[lo]].current_uid == uid) {
+    return &profile_cache[profile_cache_index[lo]];
+  }
+  return NULL;
+}
+
 bool uid_should_umount(int uid) {
+  // The kernel never umounts for the manager; let it decide for our own uid.
+  if (uid != (int)getuid()) {
+    pthread_mutex_lock(&profile_cache_lock);
+    if (refresh_profile_cache_locked()) {
+      const struct app_profile *p = lookup_profile_locked(uid);
+      bool umount = profile_cache_default_umount;
+      if (p && p->allow_su) {
+        umount = false;
+      } else if (p && !p->nrp_config.use_default) {
+        umount = p->nrp_config.profile.umount_modules;
+      }
+      pthread_mutex_unlock(&profile_cache_lock);
+      return umount;
+    }
+    pthread_mutex_unlock(&profile_cache_lock);
+  }
+
   struct ksu_uid_should_umount_cmd cmd = {};
   cmd.uid = uid;
   if (ksuctl(KSU_IOCTL_UID_SHOULD_UMOUNT, &cmd) == 0) {
@@ -146,6 +269,17 @@ bool set_app_profile(const struct app_profile *profile) {
 }
 
 int get_app_profile(struct app_profile *profile) {
+  pthread_mutex_lock(&profile_cache_lock);
+  if (refresh_profile_cache_locked()) {
+    const struct app_profile *p = lookup_profile_locked(profile->current_uid);
+    if (p) {
+      *profile = *p;
+    }
+    pthread_mutex_unlock(&profile_cache_lock);
+    return p ? 0 : -1;
+  }
+  pthread_mutex_unlock(&profile_cache_lock);
+
   struct ksu_get_app_profile_cmd cmd = {.profile = *profile};
   int ret = ksuctl(KSU_IOCTL_GET_APP_PROFILE, &cmd);
   if (ret == 0) {
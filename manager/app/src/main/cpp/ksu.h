@@ -159,6 +159,15 @@ struct ksu_set_app_profile_cmd {
   struct app_profile profile; // Input: app profile structure
 };
 
+struct ksu_export_app_profiles_cmd {
+  uint64_t arg;        // Input: struct app_profile[max] buffer
+  uint64_t generation; // Output: changes whenever the allowlist changes
+  uint32_t start;      // Input: index of the first profile to copy
+  uint32_t max;        // Input: capacity of arg, 0 only queries generation
+  uint32_t count;      // Output: profiles copied
+  uint32_t total;      // Output: profiles in the allowlist
+};
+
 // Su compat
 bool set_su_enabled(bool enabled);
 bool is_su_enabled();
@@ -199,6 +208,7 @@ struct ksu_hook_type_cmd {
 #define KSU_IOCTL_SET_APP_PROFILE _IOC(_IOC_WRITE, 'K', 12, 0)
 #define KSU_IOCTL_GET_FEATURE _IOC(_IOC_READ | _IOC_WRITE, 'K', 13, 0)
 #define KSU_IOCTL_SET_FEATURE _IOC(_IOC_WRITE, 'K', 14, 0)
+#define KSU_IOCTL_EXPORT_APP_PROFILES _IOC(_IOC_READ | _IOC_WRITE, 'K', 22, 0)
 
 // Other IOCTL command definitions
 #define KSU_IOCTL_GET_FULL_VERSION _IOC(_IOC_READ, 'K', 100, 0)
@@ -239,6 +239,22 @@ fun listModules(): String {
     return out.joinToString("\n").ifBlank { "[]" }
 }
 
+/**
+ * Compact module listing: {"generation", "full", "modules"}. Given the generation of
+ * an earlier listing, only modules changed since then are returned unless "full" is
+ * set. Older ksud prints the plain array of [listModules] instead.
+ */
+fun listModulesSince(generation: String?): String {
+    val shell = getRootShell()
+
+    val cmd = StringBuilder("${getKsuDaemonPath()} module list --compact")
+    if (generation != null) {
+        cmd.append(" --since $generation")
+    }
+    val out = shell.newJob().add(cmd.toString()).to(ArrayList(), null).exec().out
+    return out.joinToString("\n")
+}
+
 fun getModuleCount(): Int {
     val result = listModules()
     runCatching {
@@ -14,7 +14,7 @@ import com.dergoogler.mmrl.platform.model.ModuleConfig.Companion.asModuleConfig
 import kotlinx.coroutines.Dispatchers
 import kotlinx.coroutines.launch
 import com.anatdx.yukisu.ui.util.HanziToPinyin
-import com.anatdx.yukisu.ui.util.listModules
+import com.anatdx.yukisu.ui.util.listModulesSince
 import com.anatdx.yukisu.ui.util.getRootShell
 import kotlinx.coroutines.withContext
 import org.json.JSONArray
@@ -36,6 +36,8 @@ class ModuleViewModel : ViewModel() {
     companion object {
         private const val TAG = "ModuleViewModel"
         private var modules by mutableStateOf<List<ModuleInfo>>(emptyList())
+        // Generation of the last listing, for `ksud module list --since`
+        private var moduleGeneration: String? = null
         private const val CUSTOM_USER_AGENT = "SukiSU-Ultra/2.0"
     }
 
@@ -143,37 +145,34 @@ class ModuleViewModel : ViewModel() {
             val start = SystemClock.elapsedRealtime()
 
             kotlin.runCatching {
-                val result = listModules()
+                val result = listModulesSince(moduleGeneration).trim()
 
                 Log.i(TAG, "result: $result")
 
-                val array = JSONArray(result)
-                val moduleInfos = (0 until array.length())
-                    .asSequence()
-                    .map { array.getJSONObject(it) }
-                    .map { obj ->
-                        ModuleInfo(
-                            obj.getString("id"),
-                            obj.optString("name"),
-                            obj.optString("author", "Unknown"),
-                            obj.optString("version", "Unknown"),
-                            obj.getIntCompat("versionCode", 0),
-                            obj.optString("description"),
-                            obj.getBooleanCompat("enabled"),
-                            obj.getBooleanCompat("update"),
-                            obj.getBooleanCompat("remove"),
-                            obj.optString("updateJson"),
-                            obj.getBooleanCompat("web"),
-                            obj.getBooleanCompat("action"),
-                            obj.getBooleanCompat("metamodule"),
-                            obj.optString("dir_id", obj.getString("id"))
-                        )
-                    }.toList()
+                // Unchanged modules keep their objects (and loaded configs)
+                val changed: List<ModuleInfo>
+                val moduleInfos: List<ModuleInfo>
+                if (result.startsWith("{")) {
+                    val listing = JSONObject(result)
+                    changed = listing.getJSONArray("modules").toModuleInfos()
+                    moduleInfos = if (listing.optBoolean("full", true)) {
+                        changed
+                    } else {
+                        val byDir = changed.associateBy { it.dirId }
+                        modules.map { byDir[it.dirId] ?: it }
+                    }
+                    moduleGeneration = listing.optString("generation").ifEmpty { null }
+                } else {
+                    // ksud without the compact listing
+                    changed = JSONArray(result.ifBlank { "[]" }).toModuleInfos()
+                    moduleInfos = changed
+                    moduleGeneration = null
+                }
 
                 modules = moduleInfos
 
                 launch {
-                    modules.forEach { module ->
+                    changed.forEach { module ->
                         withContext(Dispatchers.IO) {
                             try {
                                 runCatching {
@@ -466,6 +465,30 @@ class ModuleSizeCache(context: Context) {
     }
 }
 
+private fun JSONArray.toModuleInfos(): List<ModuleViewModel.ModuleInfo> {
+    return (0 until length())
+        .asSequence()
+        .map { getJSONObject(it) }
+        .map { obj ->
+            ModuleViewModel.ModuleInfo(
+                obj.getString("id"),
+                obj.optString("name"),
+                obj.optString("author", "Unknown"),
+                obj.optString("version", "Unknown"),
+                obj.getIntCompat("versionCode", 0),
+                obj.optString("description"),
+                obj.getBooleanCompat("enabled"),
+                obj.getBooleanCompat("update"),
+                obj.getBooleanCompat("remove"),
+                obj.optString("updateJson"),
+                obj.getBooleanCompat("web"),
+                obj.getBooleanCompat("action"),
+                obj.getBooleanCompat("metamodule"),
+                obj.optString("dir_id", obj.getString("id"))
+            )
+        }.toList()
+}
+
 private fun JSONObject.getBooleanCompat(key: String, default: Boolean = false): Boolean {
     if (!has(key)) return default
     return when (val value = opt(key)) {
@@ -6,11 +6,15 @@ import android.net.Uri
 import androidx.documentfile.provider.DocumentFile
 import com.anatdx.yukisu.R
 import com.anatdx.yukisu.ui.util.rootAvailable
+import com.topjohnwu.superuser.CallbackList
 import com.topjohnwu.superuser.Shell
+import com.topjohnwu.superuser.internal.UiThreadHandler
 import kotlinx.coroutines.flow.MutableStateFlow
 import kotlinx.coroutines.flow.StateFlow
 import kotlinx.coroutines.flow.asStateFlow
 import kotlinx.coroutines.flow.update
+import org.json.JSONException
+import org.json.JSONObject
 import java.io.File
 import java.io.FileOutputStream
 
@@ -135,7 +139,7 @@ class HorizonKernelWorker(
             state.updateProgress(0.2f)
 
             // Build ksud flash command
-            val cmdBuilder = StringBuilder("ksud flash ak3 \"$zipPath\" -v")
+            val cmdBuilder = StringBuilder("ksud flash ak3 \"$zipPath\" --json-progress")
 
             // Add slot option for A/B devices
             if (slot != null) {
@@ -151,33 +155,18 @@ class HorizonKernelWorker(
             state.updateProgress(0.3f)
             state.addLog("Executing: $cmdBuilder")
 
-            // Execute ksud flash command with stderr merged
-            val result = Shell.cmd("$cmdBuilder 2>&1").exec()
-            
-            state.addLog("Exit code: ${result.code}")
-
-            // Parse output (now includes both stdout and stderr)
-            result.out.forEach { line ->
-                state.addLog(line)
-
-                // Update progress based on output
-                when {
-                    line.contains("Extracting", ignoreCase = true) -> {
-                        state.updateProgress(0.5f)
-                        state.updateStep("Extracting...")
-                    }
-                    line.contains("Installing", ignoreCase = true) ||
-                    line.contains("Flashing", ignoreCase = true) -> {
-                        state.updateProgress(0.7f)
-                        state.updateStep("Flashing kernel...")
-                    }
-                    line.contains("complete", ignoreCase = true) ||
-                    line.contains("Done", ignoreCase = true) -> {
-                        state.updateProgress(0.9f)
-                        state.updateStep("Completing...")
-                    }
+            // ksud prints one JSON event per line; apply them as they arrive. runAndWait
+            // finishes each callback before the next line is read, so every event,
+            // including the final result, has been handled once exec() returns.
+            var flashError = ""
+            val events = object : CallbackList<String>(UiThreadHandler::runAndWait) {
+                override fun onAddElement(line: String) {
+                    flashError = handleFlashEvent(line) ?: flashError
                 }
             }
+            val result = Shell.cmd(cmdBuilder.toString()).to(events, events).exec()
+
+            state.addLog("Exit code: ${result.code}")
 
             // Check result
             if (result.isSuccess) {
@@ -188,7 +177,7 @@ class HorizonKernelWorker(
                     onFlashComplete?.invoke()
                 }
             } else {
-                val errorMsg = result.err.joinToString("\n").ifEmpty {
+                val errorMsg = flashError.ifEmpty {
                     context.getString(R.string.flash_failed_message)
                 }
                 state.setError(errorMsg)
@@ -203,4 +192,31 @@ class HorizonKernelWorker(
             } catch (_: Exception) {}
         }
     }
-}
\ No newline at end of file
+
+    /**
+     * Apply one line of `ksud flash ak3 --json-progress` output to the state.
+     * Returns the error message of a failed result event, null otherwise.
+     */
+    private fun handleFlashEvent(line: String): String? {
+        val event = try {
+            JSONObject(line)
+        } catch (_: JSONException) {
+            // stderr and anything else that is not an event
+            state.addLog(line)
+            return null
+        }
+        when (event.optString("type")) {
+            "progress" -> {
+                // ksud's percent covers the whole flash; map it after our 0.3 of copying
+                val percent = event.optDouble("percent", 0.0).toFloat()
+                state.updateProgress(0.3f + percent * 0.7f)
+                state.updateStep(event.optString("message"))
+            }
+            "log" -> state.addLog(event.optString("message"))
+            "result" -> if (!event.optBoolean("success")) {
+                return event.optString("error")
+            }
+        }
+        return null
+    }
+}
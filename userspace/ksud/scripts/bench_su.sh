@@ -0,0 +1,64 @@
+#!/system/bin/sh
+# Compare su startup cost of the full ksud binary and the lean ksud-su build.
+#
+# usage: bench_su.sh <ksud> <ksud-su> [runs]
+#
+# ksud-su is not part of the default build; make it with
+# "cmake --build <dir> --target ksud-su".
+#
+# Each binary is run as "su -v" through a symlink, which parses arguments and
+# exits before touching the driver, so the numbers are exec + load + startup.
+
+set -u
+
+if [ $# -lt 2 ]; then
+    echo "usage: $0 <ksud> <ksud-su> [runs]" >&2
+    exit 1
+fi
+
+FULL=$1
+LEAN=$2
+RUNS=${3:-200}
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+now_us() {
+    t=$(date +%s%N)
+    echo $((t / 1000))
+}
+
+# Peak RSS in KiB of one run, from toybox or GNU time
+max_rss() {
+    if time -v true >/dev/null 2>&1; then
+        time -v "$1" -v 2>&1 >/dev/null | sed -n \
+            -e 's/.*Maximum resident set size (kbytes): *\([0-9]*\).*/\1/p' \
+            -e 's/.*Max RSS: *\([0-9]*\).*/\1/p' | head -n 1
+    else
+        echo "?"
+    fi
+}
+
+bench() {
+    name=$1
+    mkdir -p "$TMP/$name"
+    ln -sf "$(realpath "$2")" "$TMP/$name/su"
+    su_bin="$TMP/$name/su"
+
+    # Warm the page cache so the first run does not skew the average
+    "$su_bin" -v >/dev/null
+
+    start=$(now_us)
+    i=0
+    while [ $i -lt "$RUNS" ]; do
+        "$su_bin" -v >/dev/null
+        i=$((i + 1))
+    done
+    end=$(now_us)
+
+    size=$(wc -c <"$2")
+    printf '%-8s size=%9d B  startup=%6d us/run  max_rss=%s KiB\n' \
+        "$name" "$size" $(((end - start) / RUNS)) "$(max_rss "$su_bin")"
+}
+
+bench full "$FULL"
+bench lean "$LEAN"
@@ -1,9 +1,12 @@
 #!/usr/bin/env python3
 """
 Generate C++ source file containing embedded binary assets.
-Compresses binaries with zlib for efficient storage.
+Compresses binaries as raw deflate streams, inflated straight into the output
+file at runtime, and records a SHA-256 of each asset so unchanged files on
+disk can be left alone.
 """
 
+import hashlib
 import sys
 import zlib
 from pathlib import Path
@@ -15,37 +18,40 @@ def to_c_identifier(name: str) -> str:
         result = '_' + result
     return result
 
-def generate_asset_array(filepath: Path) -> tuple[str, str, int, int]:
+def generate_asset_array(filepath: Path) -> tuple[str, str, int, int, str]:
     """Generate C array for a single file."""
     name = to_c_identifier(filepath.name)
-    
+
     with open(filepath, 'rb') as f:
         data = f.read()
-    
+
     original_size = len(data)
-    compressed_data = zlib.compress(data, level=9)
+    # Raw deflate (no zlib header/trailer); integrity is covered by the SHA-256
+    compressor = zlib.compressobj(level=9, wbits=-15, memLevel=9)
+    compressed_data = compressor.compress(data) + compressor.flush()
     compressed_size = len(compressed_data)
-    
+    digest = hashlib.sha256(data).hexdigest()
+
     # Generate hex array
     hex_data = ', '.join(f'0x{b:02x}' for b in compressed_data)
-    
-    return name, hex_data, compressed_size, original_size
+
+    return name, hex_data, compressed_size, original_size, digest
 
 def main():
     if len(sys.argv) < 3:
         print(f"Usage: {sys.argv[0]} <assets_dir> <output.cpp>")
         sys.exit(1)
-    
+
     assets_dir = Path(sys.argv[1])
     output_file = Path(sys.argv[2])
-    
+
     # Collect all files in assets directory
     assets = []
     if assets_dir.exists():
         for f in sorted(assets_dir.iterdir()):
             if f.is_file() and not f.name.startswith('.'):
                 assets.append(f)
-    
+
     # Generate C++ source
     output = '''// Auto-generated file - DO NOT EDIT
 // Generated by embed_assets.py
@@ -54,9 +60,11 @@ def main():
 #include "defs.hpp"
 #include "utils.hpp"
 #include "log.hpp"
+#include "picosha2.h"
 #include <cstring>
-#include <map>
+#include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/xattr.h>
 #include <cerrno>
 #include <unistd.h>
 #include <vector>
@@ -65,25 +73,25 @@ def main():
 namespace ksud {
 
 '''
-    
+
     # Generate arrays for each asset
     asset_infos = []
     for filepath in assets:
-        name, hex_data, size, original_size = generate_asset_array(filepath)
+        name, hex_data, size, original_size, digest = generate_asset_array(filepath)
         output += f'// Asset: {filepath.name}\n'
         output += f'static const unsigned char asset_{name}[] = {{\n'
-        
+
         # Split into lines of 16 bytes
-        bytes_list = hex_data.split(', ')
+        bytes_list = hex_data.split(', ') if hex_data else []
         for i in range(0, len(bytes_list), 16):
             output += '    ' + ', '.join(bytes_list[i:i+16]) + ',\n'
-        
+
         output += f'}};\n'
         output += f'static const size_t asset_{name}_size = {size};\n'
         output += f'static const size_t asset_{name}_original_size = {original_size};\n\n'
-        
-        asset_infos.append((filepath.name, name, size, original_size))
-    
+
+        asset_infos.append((filepath.name, name, size, original_size, digest))
+
     # Generate asset registry
     output += '''
 struct AssetEntry {
@@ -91,17 +99,145 @@ struct AssetEntry {
     const unsigned char* data;
     size_t size;
     size_t original_size;
+    const char* sha256;
 };
 
 static const AssetEntry asset_registry[] = {
 '''
-    
-    for filename, name, size, original_size in asset_infos:
-        output += f'    {{"{filename}", asset_{name}, asset_{name}_size, asset_{name}_original_size}},\n'
-    
-    output += '''    {nullptr, nullptr, 0, 0}  // sentinel
+
+    for filename, name, size, original_size, digest in asset_infos:
+        output += (f'    {{"{filename}", asset_{name}, asset_{name}_size, '
+                   f'asset_{name}_original_size,\n     "{digest}"}},\n')
+
+    output += '''    {nullptr, nullptr, 0, 0, nullptr}  // sentinel
 };
 
+// Stamp left on extracted files: "<sha256> <size> <mtime sec>.<nsec>".
+// Size and mtime catch later edits to the file, which keep the xattr.
+static constexpr const char* ASSET_HASH_XATTR = "user.ksu.asset";
+static constexpr size_t ASSET_CHUNK_SIZE = 64 * 1024;
+
+static const AssetEntry* find_asset(const std::string& name) {
+    for (const auto* e = asset_registry; e->name != nullptr; ++e) {
+        if (name == e->name) {
+            return e;
+        }
+    }
+    return nullptr;
+}
+
+static std::string asset_stamp(const AssetEntry& entry, const struct stat& st) {
+    char buf[128];
+    snprintf(buf, sizeof(buf), "%s %lld %lld.%09ld", entry.sha256,
+             static_cast<long long>(st.st_size), static_cast<long long>(st.st_mtim.tv_sec),
+             static_cast<long>(st.st_mtim.tv_nsec));
+    return buf;
+}
+
+static bool asset_up_to_date(const AssetEntry& entry, const std::string& path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || static_cast<size_t>(st.st_size) != entry.original_size) {
+        return false;
+    }
+    char value[128];
+    ssize_t len = getxattr(path.c_str(), ASSET_HASH_XATTR, value, sizeof(value) - 1);
+    if (len <= 0) {
+        return false;
+    }
+    value[len] = '\\0';
+    return asset_stamp(entry, st) == value;
+}
+
+static bool write_fully(int fd, const unsigned char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        data += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Inflates the asset into a temp file beside dest_path through one fixed
+// buffer, checks its SHA-256, stamps it and renames it into place
+static bool extract_asset(const AssetEntry& entry, const std::string& dest_path, mode_t mode) {
+    std::string tmp_path = dest_path + ".tmp";
+    int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, mode);
+    if (fd < 0) {
+        LOGE("Failed to open file for writing: %s (errno=%d: %s)", tmp_path.c_str(), errno,
+             strerror(errno));
+        return false;
+    }
+    fchmod(fd, mode);
+
+    z_stream zs = {};
+    if (inflateInit2(&zs, -MAX_WBITS) != Z_OK) {
+        close(fd);
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    zs.next_in = const_cast<Bytef*>(entry.data);
+    zs.avail_in = static_cast<uInt>(entry.size);
+
+    std::vector<unsigned char> chunk(ASSET_CHUNK_SIZE);
+    picosha2::hash256_one_by_one hasher;
+    size_t total = 0;
+    int ret = Z_OK;
+    bool ok = true;
+    while (ok && ret != Z_STREAM_END) {
+        zs.next_out = chunk.data();
+        zs.avail_out = static_cast<uInt>(chunk.size());
+        ret = inflate(&zs, Z_NO_FLUSH);
+        if (ret != Z_OK && ret != Z_STREAM_END) {
+            LOGE("Decompression failed for %s: %d", entry.name, ret);
+            ok = false;
+            break;
+        }
+        size_t produced = chunk.size() - zs.avail_out;
+        hasher.process(chunk.begin(), chunk.begin() + produced);
+        total += produced;
+        if (!write_fully(fd, chunk.data(), produced)) {
+            LOGE("Failed to write asset %s to %s: %s", entry.name, tmp_path.c_str(),
+                 strerror(errno));
+            ok = false;
+        }
+    }
+    inflateEnd(&zs);
+
+    if (ok) {
+        hasher.finish();
+        std::string digest;
+        picosha2::get_hash_hex_string(hasher, digest);
+        if (total != entry.original_size || digest != entry.sha256) {
+            LOGE("Asset %s is corrupt (%zu bytes, sha256 %s)", entry.name, total, digest.c_str());
+            ok = false;
+        }
+    }
+
+    struct stat st;
+    if (ok && fstat(fd, &st) == 0) {
+        // Best effort: without xattr support the asset is just rewritten next time
+        std::string stamp = asset_stamp(entry, st);
+        fsetxattr(fd, ASSET_HASH_XATTR, stamp.c_str(), stamp.size(), 0);
+    }
+    if (close(fd) != 0) {
+        ok = false;
+    }
+    // rename() also replaces a busy executable, where writing in place would
+    // fail with ETXTBSY
+    if (!ok || rename(tmp_path.c_str(), dest_path.c_str()) != 0) {
+        if (ok) {
+            LOGE("Failed to rename %s: %s", tmp_path.c_str(), strerror(errno));
+        }
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
 const std::vector<std::string>& list_assets() {
     static std::vector<std::string> names;
     static bool initialized = false;
@@ -115,53 +251,22 @@ const std::vector<std::string>& list_assets() {
 }
 
 bool get_asset(const std::string& name, const uint8_t*& data, size_t& size) {
-    for (const auto* entry = asset_registry; entry->name != nullptr; ++entry) {
-        if (name == entry->name) {
-            data = entry->data;
-            size = entry->size;
-            return true;
-        }
+    const AssetEntry* entry = find_asset(name);
+    if (!entry) {
+        return false;
     }
-    return false;
+    data = entry->data;
+    size = entry->size;
+    return true;
 }
 
 bool copy_asset_to_file(const std::string& name, const std::string& dest_path) {
-    const AssetEntry* entry = nullptr;
-    for (const auto* e = asset_registry; e->name != nullptr; ++e) {
-        if (name == e->name) {
-            entry = e;
-            break;
-        }
-    }
-    
+    const AssetEntry* entry = find_asset(name);
     if (!entry) {
         LOGE("Asset not found: %s", name.c_str());
         return false;
     }
-    
-    // Remove existing file first
-    unlink(dest_path.c_str());
-    
-    // Decompress
-    std::vector<uint8_t> buffer(entry->original_size);
-    uLongf destLen = entry->original_size;
-    int ret = uncompress(buffer.data(), &destLen, entry->data, entry->size);
-    if (ret != Z_OK) {
-        LOGE("Decompression failed for %s: %d", name.c_str(), ret);
-        return false;
-    }
-    
-    std::ofstream ofs(dest_path, std::ios::binary);
-    if (!ofs) {
-        LOGE("Failed to open file for writing: %s (errno=%d: %s)", dest_path.c_str(), errno, strerror(errno));
-        return false;
-    }
-    ofs.write(reinterpret_cast<const char*>(buffer.data()), destLen);
-    if (!ofs.good()) {
-        LOGE("Failed to write asset %s to %s", name.c_str(), dest_path.c_str());
-        return false;
-    }
-    return true;
+    return extract_asset(*entry, dest_path, 0644);
 }
 
 std::vector<std::string> list_supported_kmi() {
@@ -170,7 +275,7 @@ std::vector<std::string> list_supported_kmi() {
         // Format: android15-6.6_kernelsu.ko
         const char* suffix = "_kernelsu.ko";
         size_t suffix_len = strlen(suffix);
-        if (name.size() > suffix_len && 
+        if (name.size() > suffix_len &&
             name.compare(name.size() - suffix_len, suffix_len, suffix) == 0) {
             result.push_back(name.substr(0, name.size() - suffix_len));
         }
@@ -183,29 +288,37 @@ int ensure_binaries(bool ignore_if_exist) {
         LOGE("Failed to create binary directory: %s", BINARY_DIR);
         return 1;
     }
-    
-    for (const auto& name : list_assets()) {
+
+    int extracted = 0;
+    int skipped = 0;
+    for (const auto* entry = asset_registry; entry->name != nullptr; ++entry) {
+        std::string name = entry->name;
         // Skip ksuinit and kernel modules - they are extracted on demand
         if (name == "ksuinit" || name.find("_kernelsu.ko") != std::string::npos) {
             continue;
         }
-        
+
         std::string dest = std::string(BINARY_DIR) + name;
-        
+
         if (ignore_if_exist) {
             struct stat st;
             if (stat(dest.c_str(), &st) == 0) {
+                skipped++;
                 continue;
             }
+        } else if (asset_up_to_date(*entry, dest)) {
+            skipped++;
+            continue;
         }
-        
-        if (!copy_asset_to_file(name, dest)) {
+
+        if (!extract_asset(*entry, dest, 0755)) {
             LOGE("Failed to extract binary: %s", name.c_str());
             return 1;
         }
-        chmod(dest.c_str(), 0755);
+        extracted++;
     }
-    
+    LOGI("Binary assets: %d extracted, %d up to date", extracted, skipped);
+
     // Ensure ksud symlink exists (like Rust version's link_ksud_to_bin)
     struct stat st;
     if (stat(DAEMON_PATH, &st) == 0 && stat(DAEMON_LINK_PATH, &st) != 0) {
@@ -216,21 +329,21 @@ int ensure_binaries(bool ignore_if_exist) {
             LOGI("Created ksud symlink: %s -> %s", DAEMON_LINK_PATH, DAEMON_PATH);
         }
     }
-    
+
     return 0;
 }
 
 } // namespace ksud
 '''
-    
+
     # Write output
     output_file.parent.mkdir(parents=True, exist_ok=True)
     with open(output_file, 'w') as f:
         f.write(output)
-    
+
     print(f"Generated {output_file} with {len(assets)} assets")
-    for filename, name, size, original_size in asset_infos:
-        print(f"  - {filename}: {size} bytes (original: {original_size})")
+    for filename, name, size, original_size, digest in asset_infos:
+        print(f"  - {filename}: {size} bytes (original: {original_size}, sha256: {digest[:16]})")
 
 if __name__ == '__main__':
     main()
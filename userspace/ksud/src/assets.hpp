@@ -10,7 +10,7 @@ namespace ksud {
 // List all embedded asset names
 const std::vector<std::string>& list_assets();
 
-// Get asset data by name
+// Get the embedded (raw deflate) asset data by name
 bool get_asset(const std::string& name, const uint8_t*& data, size_t& size);
 
 // Copy asset to file
@@ -19,7 +19,8 @@ bool copy_asset_to_file(const std::string& name, const std::string& dest_path);
 // List supported KMI versions (extracted from embedded LKM names)
 std::vector<std::string> list_supported_kmi();
 
-// Ensure binary assets are extracted
+// Ensure binary assets are extracted; unchanged ones are skipped via their
+// content stamp xattr unless ignore_if_exist, which skips any existing file
 int ensure_binaries(bool ignore_if_exist);
 
 }  // namespace ksud
@@ -0,0 +1,280 @@
+#include "block_image.hpp"
+#include "../log.hpp"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace ksud {
+
+// 1 MiB chunks; offsets and lengths stay multiples of the alignment so
+// O_DIRECT transfers are valid
+static constexpr size_t IMAGE_CHUNK = 1 << 20;
+static constexpr size_t IMAGE_ALIGN = 4096;
+
+static inline uint32_t rol32(uint32_t x, int n) {
+    return (x << n) | (x >> (32 - n));
+}
+
+Sha1::Sha1() : state_{0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0} {}
+
+void Sha1::transform(const uint8_t* block) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; i++) {
+        w[i] = (uint32_t(block[i * 4]) << 24) | (uint32_t(block[i * 4 + 1]) << 16) |
+               (uint32_t(block[i * 4 + 2]) << 8) | uint32_t(block[i * 4 + 3]);
+    }
+    for (int i = 16; i < 80; i++)
+        w[i] = rol32(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+    uint32_t a = state_[0], b = state_[1], c = state_[2], d = state_[3], e = state_[4];
+    for (int i = 0; i < 80; i++) {
+        uint32_t f, k;
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+        uint32_t t = rol32(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = rol32(b, 30);
+        b = a;
+        a = t;
+    }
+
+    state_[0] += a;
+    state_[1] += b;
+    state_[2] += c;
+    state_[3] += d;
+    state_[4] += e;
+}
+
+void Sha1::update(const void* data, size_t len) {
+    auto* p = static_cast<const uint8_t*>(data);
+    total_ += len;
+
+    if (buffered_ > 0) {
+        size_t n = std::min(len, sizeof(buffer_) - buffered_);
+        memcpy(buffer_ + buffered_, p, n);
+        buffered_ += n;
+        p += n;
+        len -= n;
+        if (buffered_ < sizeof(buffer_))
+            return;
+        transform(buffer_);
+        buffered_ = 0;
+    }
+    for (; len >= 64; p += 64, len -= 64)
+        transform(p);
+    memcpy(buffer_, p, len);
+    buffered_ = len;
+}
+
+std::string Sha1::hex_digest() {
+    uint64_t bits = total_ * 8;
+    uint8_t pad = 0x80;
+    update(&pad, 1);
+    uint8_t zero = 0;
+    while (buffered_ != 56)
+        update(&zero, 1);
+    uint8_t len_be[8];
+    for (int i = 0; i < 8; i++)
+        len_be[i] = static_cast<uint8_t>(bits >> (56 - i * 8));
+    update(len_be, 8);
+
+    char hex[41];
+    for (int i = 0; i < 5; i++)
+        snprintf(hex + i * 8, 9, "%08x", state_[i]);
+    return std::string(hex, 40);
+}
+
+// Open with O_DIRECT if possible; tmpfs and some filesystems refuse it
+static int open_image(const std::string& path, int flags, bool* direct) {
+    int fd = open(path.c_str(), flags | O_DIRECT | O_CLOEXEC, 0644);
+    if (fd >= 0) {
+        *direct = true;
+        return fd;
+    }
+    *direct = false;
+    return open(path.c_str(), flags | O_CLOEXEC, 0644);
+}
+
+static void drop_direct(int fd, bool* direct) {
+    if (*direct) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+        *direct = false;
+    }
+}
+
+static ssize_t pread_full(int fd, uint8_t* buf, size_t len, off_t off, bool* direct) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = pread(fd, buf + done, len - done, off + done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && errno == EINVAL && *direct) {
+            // Unaligned tail, retry through the page cache
+            drop_direct(fd, direct);
+            continue;
+        }
+        if (n < 0)
+            return -1;
+        if (n == 0)
+            break;
+        done += static_cast<size_t>(n);
+    }
+    return static_cast<ssize_t>(done);
+}
+
+static bool pwrite_full(int fd, const uint8_t* buf, size_t len, off_t off, bool* direct) {
+    // O_DIRECT needs an aligned length; the last chunk may not have one
+    if (*direct && len % IMAGE_ALIGN != 0)
+        drop_direct(fd, direct);
+
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = pwrite(fd, buf + done, len - done, off + done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && errno == EINVAL && *direct) {
+            drop_direct(fd, direct);
+            continue;
+        }
+        if (n <= 0)
+            return false;
+        done += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+struct AlignedBuffer {
+    explicit AlignedBuffer(size_t size) {
+        if (posix_memalign(reinterpret_cast<void**>(&data), IMAGE_ALIGN, size) != 0)
+            data = nullptr;
+    }
+    ~AlignedBuffer() { free(data); }
+    AlignedBuffer(const AlignedBuffer&) = delete;
+    AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+
+    uint8_t* data = nullptr;
+};
+
+static std::string hash_range(int fd, uint64_t len, bool* direct, uint8_t* buf) {
+    Sha1 sha1;
+    for (uint64_t off = 0; off < len;) {
+        size_t want = static_cast<size_t>(std::min<uint64_t>(IMAGE_CHUNK, len - off));
+        ssize_t n = pread_full(fd, buf, want, static_cast<off_t>(off), direct);
+        if (n != static_cast<ssize_t>(want))
+            return "";
+        sha1.update(buf, want);
+        off += want;
+    }
+    return sha1.hex_digest();
+}
+
+bool image_copy(const std::string& src, const std::string& dst, const ImageCopyOptions& options,
+                ImageCopyResult* result) {
+    bool src_direct = false;
+    int in = open_image(src, O_RDONLY, &src_direct);
+    if (in < 0) {
+        LOGE("image: cannot open %s: %s", src.c_str(), strerror(errno));
+        return false;
+    }
+
+    // Block devices are written in place; regular files are replaced
+    bool dst_direct = false;
+    struct stat st;
+    bool dst_is_blk = stat(dst.c_str(), &st) == 0 && S_ISBLK(st.st_mode);
+    int out_flags = dst_is_blk ? O_RDWR : (O_RDWR | O_CREAT | O_TRUNC);
+    int out = open_image(dst, out_flags, &dst_direct);
+    if (out < 0) {
+        LOGE("image: cannot open %s: %s", dst.c_str(), strerror(errno));
+        close(in);
+        return false;
+    }
+
+    AlignedBuffer buf(IMAGE_CHUNK);
+    AlignedBuffer cmp(options.skip_identical || options.verify ? IMAGE_CHUNK : 0);
+    if (!buf.data || ((options.skip_identical || options.verify) && !cmp.data)) {
+        close(in);
+        close(out);
+        return false;
+    }
+
+    Sha1 sha1;
+    uint64_t offset = 0;
+    uint64_t skipped = 0;
+    bool ok = true;
+    for (;;) {
+        ssize_t n = pread_full(in, buf.data, IMAGE_CHUNK, static_cast<off_t>(offset), &src_direct);
+        if (n < 0) {
+            LOGE("image: read %s failed: %s", src.c_str(), strerror(errno));
+            ok = false;
+            break;
+        }
+        if (n == 0)
+            break;
+
+        size_t len = static_cast<size_t>(n);
+        sha1.update(buf.data, len);
+
+        bool identical = false;
+        if (options.skip_identical) {
+            ssize_t m = pread_full(out, cmp.data, len, static_cast<off_t>(offset), &dst_direct);
+            identical = m == n && memcmp(buf.data, cmp.data, len) == 0;
+        }
+        if (identical) {
+            skipped += len;
+        } else if (!pwrite_full(out, buf.data, len, static_cast<off_t>(offset), &dst_direct)) {
+            LOGE("image: write %s failed: %s", dst.c_str(), strerror(errno));
+            ok = false;
+            break;
+        }
+
+        offset += len;
+        if (len < IMAGE_CHUNK)
+            break;
+    }
+    close(in);
+
+    std::string digest = sha1.hex_digest();
+    if (ok && fsync(out) != 0) {
+        LOGE("image: sync %s failed: %s", dst.c_str(), strerror(errno));
+        ok = false;
+    }
+
+    if (ok && options.verify) {
+        // Make the read-back come from the device, not the page cache
+        posix_fadvise(out, 0, 0, POSIX_FADV_DONTNEED);
+        std::string readback = hash_range(out, offset, &dst_direct, cmp.data);
+        if (readback != digest) {
+            LOGE("image: verify %s failed (%s != %s)", dst.c_str(), readback.c_str(),
+                 digest.c_str());
+            ok = false;
+        }
+    }
+    close(out);
+
+    if (ok && result) {
+        result->bytes = offset;
+        result->skipped_bytes = skipped;
+        result->sha1 = digest;
+    }
+    return ok;
+}
+
+}  // namespace ksud
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace ksud {
+
+// Incremental SHA-1, used for stock boot image backup names
+class Sha1 {
+public:
+    Sha1();
+    void update(const void* data, size_t len);
+    std::string hex_digest();
+
+private:
+    void transform(const uint8_t* block);
+
+    uint32_t state_[5];
+    uint64_t total_ = 0;
+    uint8_t buffer_[64];
+    size_t buffered_ = 0;
+};
+
+struct ImageCopyOptions {
+    // Read the destination first and only write chunks that differ
+    bool skip_identical = false;
+    // After writing, drop the cache and compare a re-read SHA-1
+    bool verify = false;
+};
+
+struct ImageCopyResult {
+    uint64_t bytes = 0;
+    uint64_t skipped_bytes = 0;
+    std::string sha1;  // of the source data
+};
+
+/**
+ * Copy src to dst (files or block devices) with large aligned buffers,
+ * using O_DIRECT where the kernel and filesystem allow it. The source
+ * SHA-1 is computed during the same read.
+ */
+bool image_copy(const std::string& src, const std::string& dst, const ImageCopyOptions& options,
+                ImageCopyResult* result = nullptr);
+
+}  // namespace ksud
@@ -1,4 +1,6 @@
 #include "boot_patch.hpp"
+#include "block_image.hpp"
+#include "cpio.hpp"
 #include "../assets.hpp"
 #include "../defs.hpp"
 #include "../log.hpp"
@@ -141,30 +143,30 @@ static bool inject_lkm_priority_to_lkm(const std::string& lkm_path, bool enabled
     return true;
 }
 
-// Execute magiskboot cpio command (runs in workdir for relative path resolution)
-static bool do_cpio_cmd(const std::string& magiskboot, const std::string& workdir,
-                        const std::string& cpio_path, const std::string& cmd) {
-    auto result = exec_command({magiskboot, "cpio", cpio_path, cmd}, workdir);
-    if (result.exit_code != 0) {
-        LOGE("magiskboot cpio %s failed", cmd.c_str());
+// Load the ramdisk into memory. magiskboot unpack normally leaves it
+// uncompressed; otherwise decompress it with magiskboot first. The edited
+// archive is written back raw and repack recompresses it in the original
+// format.
+static bool load_ramdisk(const std::string& magiskboot, const std::string& workdir,
+                         const std::string& cpio_path, Cpio& cpio) {
+    auto content = read_file(cpio_path);
+    if (!content) {
+        LOGE("Failed to read ramdisk %s", cpio_path.c_str());
         return false;
     }
-    return true;
-}
 
-// Check if boot image is patched by Magisk
-static bool is_magisk_patched(const std::string& magiskboot, const std::string& workdir,
-                              const std::string& cpio_path) {
-    auto result = exec_command({magiskboot, "cpio", cpio_path, "test"}, workdir);
-    // 0: stock, 1: magisk
-    return result.exit_code == 1;
-}
+    if (!is_newc_cpio(*content)) {
+        std::string raw = cpio_path + ".raw";
+        auto result = exec_command({magiskboot, "decompress", cpio_path, raw}, workdir);
+        content = read_file(raw);
+        unlink(raw.c_str());
+        if (result.exit_code != 0 || !content) {
+            LOGE("Failed to decompress ramdisk %s", cpio_path.c_str());
+            return false;
+        }
+    }
 
-// Check if boot image is patched by KernelSU
-static bool is_kernelsu_patched(const std::string& magiskboot, const std::string& workdir,
-                                const std::string& cpio_path) {
-    auto result = exec_command({magiskboot, "cpio", cpio_path, "exists kernelsu.ko"}, workdir);
-    return result.exit_code == 0;
+    return cpio.parse(*content);
 }
 
 // Find magiskboot binary
@@ -244,10 +246,9 @@ static std::string find_magiskboot(const std::string& specified_path, const std:
     return "";
 }
 
-// DD command
+// Copy an image between files and block devices (replaces dd)
 static bool dd(const std::string& input, const std::string& output) {
-    auto result = exec_command({"dd", "if=" + input, "of=" + output});
-    return result.exit_code == 0;
+    return image_copy(input, output, ImageCopyOptions{});
 }
 
 // Flash boot image
@@ -264,63 +265,46 @@ static bool flash_boot(const std::string& bootdevice, const std::string& new_boo
         return false;
     }
 
-    if (!dd(new_boot, bootdevice)) {
+    // Only rewrite chunks that changed, then verify by reading back
+    ImageCopyOptions options;
+    options.skip_identical = true;
+    options.verify = true;
+    ImageCopyResult copied;
+    if (!image_copy(new_boot, bootdevice, options, &copied)) {
         LOGE("Failed to flash boot image");
         return false;
     }
+    printf("- Flashed %llu bytes (%llu unchanged, skipped)\n",
+           static_cast<unsigned long long>(copied.bytes),
+           static_cast<unsigned long long>(copied.skipped_bytes));
 
     return true;
 }
 
-// Calculate SHA1 hash
-static std::string calculate_sha1(const std::string& file_path) {
-    // Use sha1sum command
-    auto result = exec_command({"sha1sum", file_path});
-    if (result.exit_code != 0) {
-        return "";
-    }
-    // Output format: "hash  filename"
-    size_t space = result.stdout_str.find(' ');
-    if (space != std::string::npos) {
-        return result.stdout_str.substr(0, space);
-    }
-    return trim(result.stdout_str);
-}
-
 // Backup stock boot image
-static bool do_backup(const std::string& magiskboot, const std::string& workdir,
-                      const std::string& cpio_path, const std::string& image) {
-    std::string sha1 = calculate_sha1(image);
-    if (sha1.empty()) {
-        LOGE("Failed to calculate SHA1 of boot image");
+static bool do_backup(Cpio& cpio, const std::string& image) {
+    printf("- Backup stock boot image\n");
+
+    // Copy and hash in one pass; the name depends on the hash
+    std::string tmp = std::string(KSU_BACKUP_DIR) + "." + KSU_BACKUP_FILE_PREFIX + "tmp";
+    ImageCopyResult copied;
+    if (!image_copy(image, tmp, ImageCopyOptions{}, &copied) || copied.sha1.empty()) {
+        LOGE("Failed to backup boot image");
+        unlink(tmp.c_str());
         return false;
     }
 
+    std::string sha1 = copied.sha1;
     std::string filename = std::string(KSU_BACKUP_FILE_PREFIX) + sha1;
-    printf("- Backup stock boot image\n");
-
     std::string target = std::string(KSU_BACKUP_DIR) + filename;
-
-    // Copy image to backup location
-    std::ifstream src(image, std::ios::binary);
-    std::ofstream dst(target, std::ios::binary);
-    if (!src || !dst) {
+    if (rename(tmp.c_str(), target.c_str()) != 0) {
         LOGE("Failed to backup boot image to %s", target.c_str());
+        unlink(tmp.c_str());
         return false;
     }
-    dst << src.rdbuf();
-    src.close();
-    dst.close();
-
-    // Write sha1 to workdir
-    std::string sha1_file = workdir + "/" + BACKUP_FILENAME;
-    write_file(sha1_file, sha1);
 
     // Add backup info to ramdisk
-    if (!do_cpio_cmd(magiskboot, workdir, cpio_path,
-                     "add 0755 " + std::string(BACKUP_FILENAME) + " " + sha1_file)) {
-        return false;
-    }
+    cpio.add_data(0755, BACKUP_FILENAME, sha1);
 
     printf("- Stock image has been backup to\n");
     printf("- %s\n", target.c_str());
@@ -709,42 +693,52 @@ int boot_patch(const std::vector<std::string>& args) {
         }
     }
 
+    // All ramdisk edits happen in memory and are written back once
+    Cpio cpio;
     if (ramdisk.empty()) {
         printf("- No ramdisk found, creating default\n");
         ramdisk = workdir + "/ramdisk.cpio";
-        // Create empty ramdisk
-        exec_command({magiskboot, "cpio", ramdisk, "mkdir 0755 ."}, workdir);
+    } else if (!load_ramdisk(magiskboot, workdir, ramdisk, cpio)) {
+        cleanup();
+        return 1;
     }
 
     // Check for Magisk
-    if (is_magisk_patched(magiskboot, workdir, ramdisk)) {
+    if (cpio.patch_state() == CPIO_MAGISK_PATCHED) {
         LOGE("Cannot work with Magisk patched image");
         cleanup();
         return 1;
     }
 
     printf("- Adding KernelSU LKM\n");
-    bool already_patched = is_kernelsu_patched(magiskboot, workdir, ramdisk);
+    bool already_patched = cpio.exists("kernelsu.ko");
 
     if (!already_patched) {
         // Backup init if it exists
-        auto init_exists = exec_command({magiskboot, "cpio", ramdisk, "exists init"}, workdir);
-        if (init_exists.exit_code == 0) {
-            do_cpio_cmd(magiskboot, workdir, ramdisk, "mv init init.real");
+        if (cpio.exists("init")) {
+            cpio.mv("init", "init.real");
         }
     }
 
-    // Add init and kernelsu.ko (use workdir for relative paths in cpio add)
-    do_cpio_cmd(magiskboot, workdir, ramdisk, "add 0755 init init");
-    do_cpio_cmd(magiskboot, workdir, ramdisk, "add 0755 kernelsu.ko kernelsu.ko");
+    // Add init and kernelsu.ko
+    if (!cpio.add(0755, "init", workdir + "/init") ||
+        !cpio.add(0755, "kernelsu.ko", workdir + "/kernelsu.ko")) {
+        cleanup();
+        return 1;
+    }
 
     // Backup if flashing and not already patched
     if (!already_patched && parsed.flash) {
-        if (!do_backup(magiskboot, workdir, ramdisk, bootimage)) {
+        if (!do_backup(cpio, bootimage)) {
             printf("- Warning: Backup stock image failed\n");
         }
     }
 
+    if (!cpio.save(ramdisk)) {
+        cleanup();
+        return 1;
+    }
+
     // Repack boot image (must run in workdir where unpack output files are)
     printf("- Repacking boot image\n");
     auto repack_result = exec_command({magiskboot, "repack", bootimage}, workdir);
@@ -913,8 +907,14 @@ int boot_restore(const std::vector<std::string>& args) {
         return 1;
     }
 
+    Cpio cpio;
+    if (!load_ramdisk(magiskboot, workdir, ramdisk, cpio)) {
+        cleanup();
+        return 1;
+    }
+
     // Check if patched by KernelSU
-    if (!is_kernelsu_patched(magiskboot, workdir, ramdisk)) {
+    if (!cpio.exists("kernelsu.ko")) {
         LOGE("Boot image is not patched by KernelSU");
         cleanup();
         return 1;
@@ -924,27 +924,16 @@ int boot_restore(const std::vector<std::string>& args) {
     bool from_backup = false;
 
     // Try to find backup
-    auto backup_exists = exec_command(
-        {magiskboot, "cpio", ramdisk, "exists " + std::string(BACKUP_FILENAME)}, workdir);
-    if (backup_exists.exit_code == 0) {
-        // Extract backup sha1
-        std::string backup_file = workdir + "/" + BACKUP_FILENAME;
-        exec_command({magiskboot, "cpio", ramdisk,
-                      "extract " + std::string(BACKUP_FILENAME) + " " + backup_file},
-                     workdir);
-
-        auto sha_content = read_file(backup_file);
-        if (sha_content) {
-            std::string sha = trim(*sha_content);
-            std::string backup_path = std::string(KSU_BACKUP_DIR) + KSU_BACKUP_FILE_PREFIX + sha;
-
-            if (access(backup_path.c_str(), R_OK) == 0) {
-                new_boot = backup_path;
-                from_backup = true;
-                clean_backup(sha);
-            } else {
-                printf("- Warning: no backup %s found!\n", backup_path.c_str());
-            }
+    if (auto sha_content = cpio.extract(BACKUP_FILENAME)) {
+        std::string sha = trim(*sha_content);
+        std::string backup_path = std::string(KSU_BACKUP_DIR) + KSU_BACKUP_FILE_PREFIX + sha;
+
+        if (access(backup_path.c_str(), R_OK) == 0) {
+            new_boot = backup_path;
+            from_backup = true;
+            clean_backup(sha);
+        } else {
+            printf("- Warning: no backup %s found!\n", backup_path.c_str());
         }
     } else {
         printf("- Backup info is absent!\n");
@@ -953,13 +942,16 @@ int boot_restore(const std::vector<std::string>& args) {
     // If no backup, manually remove KernelSU
     if (!from_backup) {
         // Remove kernelsu.ko
-        do_cpio_cmd(magiskboot, workdir, ramdisk, "rm kernelsu.ko");
+        cpio.rm("kernelsu.ko");
 
         // Restore init if init.real exists
-        auto init_real_exists =
-            exec_command({magiskboot, "cpio", ramdisk, "exists init.real"}, workdir);
-        if (init_real_exists.exit_code == 0) {
-            do_cpio_cmd(magiskboot, workdir, ramdisk, "mv init.real init");
+        if (cpio.exists("init.real")) {
+            cpio.mv("init.real", "init");
+        }
+
+        if (!cpio.save(ramdisk)) {
+            cleanup();
+            return 1;
         }
 
         // Repack (must run in workdir where unpack output files are)
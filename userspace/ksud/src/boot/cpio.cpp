@@ -0,0 +1,249 @@
+#include "cpio.hpp"
+#include "../log.hpp"
+#include "../utils.hpp"
+
+#include <sys/stat.h>
+#include <cstdio>
+#include <cstring>
+
+namespace ksud {
+
+static constexpr const char* NEWC_MAGIC = "070701";
+static constexpr size_t NEWC_HEADER_SIZE = 110;
+static constexpr const char* TRAILER = "TRAILER!!!";
+
+static size_t align4(size_t n) {
+    return (n + 3) & ~size_t(3);
+}
+
+static bool parse_hex(std::string_view field, uint32_t& out) {
+    uint32_t value = 0;
+    for (char c : field) {
+        value <<= 4;
+        if (c >= '0' && c <= '9')
+            value |= c - '0';
+        else if (c >= 'a' && c <= 'f')
+            value |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            value |= c - 'A' + 10;
+        else
+            return false;
+    }
+    out = value;
+    return true;
+}
+
+// Paths are stored without leading "./" or "/" and without trailing "/"
+static std::string norm_path(const std::string& path) {
+    if (!path.empty() && path[0] != '/' && path[0] != '.' && path.back() != '/' &&
+        path.find("//") == std::string::npos && path.find("/.") == std::string::npos)
+        return path;
+
+    std::string out;
+    for (const auto& part : split(path, '/')) {
+        if (part.empty() || part == ".")
+            continue;
+        if (!out.empty())
+            out += '/';
+        out += part;
+    }
+    return out;
+}
+
+bool is_newc_cpio(std::string_view data) {
+    return data.size() >= 6 && data.compare(0, 6, NEWC_MAGIC) == 0;
+}
+
+bool Cpio::parse(std::string_view data) {
+    entries_.clear();
+
+    size_t pos = 0;
+    while (pos < data.size()) {
+        if (data.size() - pos < NEWC_HEADER_SIZE || !is_newc_cpio(data.substr(pos))) {
+            LOGE("cpio: invalid header at offset %zu", pos);
+            return false;
+        }
+
+        // 13 fields of 8 hex digits after the magic
+        uint32_t fields[13];
+        for (int i = 0; i < 13; i++) {
+            if (!parse_hex(data.substr(pos + 6 + i * 8, 8), fields[i])) {
+                LOGE("cpio: bad header field at offset %zu", pos);
+                return false;
+            }
+        }
+        uint32_t mode = fields[1];
+        uint32_t filesize = fields[6];
+        uint32_t namesize = fields[11];
+
+        size_t name_off = pos + NEWC_HEADER_SIZE;
+        size_t data_off = align4(name_off + namesize);
+        if (namesize == 0 || name_off + namesize > data.size() || data_off > data.size() ||
+            filesize > data.size() - data_off) {
+            LOGE("cpio: truncated entry at offset %zu", pos);
+            return false;
+        }
+
+        std::string name(data.substr(name_off, namesize - 1).data(),
+                         strnlen(data.data() + name_off, namesize - 1));
+        pos = align4(data_off + filesize);
+
+        if (name == TRAILER) {
+            // Another archive may follow after padding
+            size_t next = data.find(NEWC_MAGIC, pos);
+            if (next == std::string_view::npos)
+                break;
+            pos = next;
+            continue;
+        }
+        if (name == "." || name == "..")
+            continue;
+
+        CpioEntry entry;
+        entry.mode = mode;
+        entry.uid = fields[2];
+        entry.gid = fields[3];
+        entry.rdevmajor = fields[9];
+        entry.rdevminor = fields[10];
+        entry.data.assign(data.data() + data_off, filesize);
+        entries_[norm_path(name)] = std::move(entry);
+    }
+
+    return true;
+}
+
+bool Cpio::load(const std::string& path) {
+    auto content = read_file(path);
+    if (!content) {
+        LOGE("cpio: cannot read %s", path.c_str());
+        return false;
+    }
+    return parse(*content);
+}
+
+static void dump_entry(std::string& out, uint32_t ino, const std::string& name,
+                       const CpioEntry& entry) {
+    char header[NEWC_HEADER_SIZE + 1];
+    snprintf(header, sizeof(header),
+             "070701%08x%08x%08x%08x%08x%08x%08x%08x%08x%08x%08x%08x%08x", ino, entry.mode,
+             entry.uid, entry.gid, 1, 0, static_cast<uint32_t>(entry.data.size()), 0, 0,
+             entry.rdevmajor, entry.rdevminor, static_cast<uint32_t>(name.size() + 1), 0);
+    out.append(header, NEWC_HEADER_SIZE);
+    out += name;
+    out += '\0';
+    out.resize(align4(out.size()), '\0');
+    out += entry.data;
+    out.resize(align4(out.size()), '\0');
+}
+
+std::string Cpio::dump() const {
+    size_t total = NEWC_HEADER_SIZE + 16;
+    for (const auto& [name, entry] : entries_)
+        total += align4(NEWC_HEADER_SIZE + name.size() + 1) + align4(entry.data.size());
+
+    std::string out;
+    out.reserve(total);
+    // Inode numbers follow magiskboot
+    uint32_t ino = 300000;
+    for (const auto& [name, entry] : entries_)
+        dump_entry(out, ino++, name, entry);
+    dump_entry(out, ino, TRAILER, CpioEntry{0755, 0, 0, 0, 0, {}});
+    return out;
+}
+
+bool Cpio::save(const std::string& path) const {
+    if (!write_file(path, dump())) {
+        LOGE("cpio: cannot write %s", path.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool Cpio::exists(const std::string& name) const {
+    return entries_.count(norm_path(name)) > 0;
+}
+
+bool Cpio::rm(const std::string& name, bool recursive) {
+    std::string path = norm_path(name);
+    bool removed = entries_.erase(path) > 0;
+    if (recursive) {
+        std::string prefix = path + "/";
+        auto it = entries_.lower_bound(prefix);
+        while (it != entries_.end() && starts_with(it->first, prefix)) {
+            it = entries_.erase(it);
+            removed = true;
+        }
+    }
+    return removed;
+}
+
+bool Cpio::mv(const std::string& from, const std::string& to) {
+    auto it = entries_.find(norm_path(from));
+    if (it == entries_.end()) {
+        LOGE("cpio: no such entry %s", from.c_str());
+        return false;
+    }
+    CpioEntry entry = std::move(it->second);
+    entries_.erase(it);
+    entries_[norm_path(to)] = std::move(entry);
+    return true;
+}
+
+bool Cpio::add(uint32_t perm, const std::string& name, const std::string& file_path) {
+    auto content = read_file(file_path);
+    if (!content) {
+        LOGE("cpio: cannot read %s", file_path.c_str());
+        return false;
+    }
+    add_data(perm, name, std::move(*content));
+    return true;
+}
+
+void Cpio::add_data(uint32_t perm, const std::string& name, std::string data) {
+    CpioEntry entry;
+    entry.mode = S_IFREG | (perm & 07777);
+    entry.data = std::move(data);
+    entries_[norm_path(name)] = std::move(entry);
+}
+
+void Cpio::mkdir(uint32_t perm, const std::string& name) {
+    std::string path = norm_path(name);
+    if (path.empty())
+        return;
+    CpioEntry entry;
+    entry.mode = S_IFDIR | (perm & 07777);
+    entries_[path] = std::move(entry);
+}
+
+std::optional<std::string> Cpio::extract(const std::string& name) const {
+    auto it = entries_.find(norm_path(name));
+    if (it == entries_.end())
+        return std::nullopt;
+    return it->second.data;
+}
+
+int Cpio::patch_state() const {
+    static const char* const UNSUPPORTED_FILES[] = {
+        "sbin/launch_daemonsu.sh",
+        "sbin/su",
+        "init.xposed.rc",
+        "boot/sbin/launch_daemonsu.sh",
+    };
+    static const char* const MAGISK_FILES[] = {
+        ".backup/.magisk",
+        "init.magisk.rc",
+        "overlay/init.magisk.rc",
+    };
+
+    for (const char* file : UNSUPPORTED_FILES) {
+        if (entries_.count(file))
+            return CPIO_UNSUPPORTED;
+    }
+    for (const char* file : MAGISK_FILES) {
+        if (entries_.count(file))
+            return CPIO_MAGISK_PATCHED;
+    }
+    return CPIO_STOCK;
+}
+
+}  // namespace ksud
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace ksud {
+
+// Entry of a newc cpio archive; file data is held in memory
+struct CpioEntry {
+    uint32_t mode = 0;
+    uint32_t uid = 0;
+    uint32_t gid = 0;
+    uint32_t rdevmajor = 0;
+    uint32_t rdevminor = 0;
+    std::string data;
+};
+
+// Result of Cpio::patch_state(), same codes as `magiskboot cpio test`
+constexpr int CPIO_STOCK = 0;
+constexpr int CPIO_MAGISK_PATCHED = 1;
+constexpr int CPIO_UNSUPPORTED = 2;
+
+/**
+ * In-memory newc cpio archive, a stand-in for the `magiskboot cpio`
+ * commands used by boot patching: load once, apply every edit to the
+ * entry table, write once.
+ *
+ * Entries are kept sorted by path and written the way magiskboot does, so
+ * parents always precede their children. Only file I/O is done here, so it
+ * works the same on a host.
+ */
+class Cpio {
+public:
+    // Parse a raw (uncompressed) newc archive; concatenated archives are merged
+    bool parse(std::string_view data);
+    bool load(const std::string& path);
+
+    std::string dump() const;
+    bool save(const std::string& path) const;
+
+    bool exists(const std::string& name) const;
+    // Like `magiskboot cpio rm [-r]`
+    bool rm(const std::string& name, bool recursive = false);
+    // Like `magiskboot cpio mv`; replaces an existing target
+    bool mv(const std::string& from, const std::string& to);
+    // Like `magiskboot cpio add <mode> <name> <file>`
+    bool add(uint32_t perm, const std::string& name, const std::string& file_path);
+    void add_data(uint32_t perm, const std::string& name, std::string data);
+    void mkdir(uint32_t perm, const std::string& name);
+    std::optional<std::string> extract(const std::string& name) const;
+
+    // Like `magiskboot cpio test`
+    int patch_state() const;
+
+    const std::map<std::string, CpioEntry>& entries() const { return entries_; }
+
+private:
+    std::map<std::string, CpioEntry> entries_;
+};
+
+// True if data starts with the newc magic, i.e. is not compressed
+bool is_newc_cpio(std::string_view data);
+
+}  // namespace ksud
@@ -16,6 +16,8 @@
 #include "profile/profile.hpp"
 #include "sepolicy/sepolicy.hpp"
 #include "su.hpp"
+#include "su_broker.hpp"
+#include "sulog.hpp"
 #include "umount.hpp"
 #include "utils.hpp"
 
@@ -139,6 +141,7 @@ static void print_usage() {
     printf("  flash          Flash kernel packages (AK3)\n");
     printf("  umount         Manage umount paths\n");
     printf("  kernel         Kernel interface\n");
+    printf("  sulog          Read su event log\n");
     printf("  debug          For developers\n");
     printf("  hymo           HymoFS module manager\n");
     printf("  help           Show this help\n");
@@ -160,6 +163,7 @@ static int cmd_module(const std::vector<std::string>& args) {
         printf("  disable <ID>      Disable module\n");
         printf("  action <ID>       Run module action\n");
         printf("  list              List all modules\n");
+        printf("      [--fields <a,b,..>] [--since <generation>] [--compact]\n");
         printf("  config            Manage module config\n");
         return 1;
     }
@@ -185,11 +189,26 @@ static int cmd_module(const std::vector<std::string>& args) {
     } else if (subcmd == "action" && args.size() > 1) {
         return module_run_action(args[1]);
     } else if (subcmd == "list") {
-        return module_list();
+        if (args.size() == 1)
+            return module_list();
+        std::vector<std::string> fields;
+        std::string since;
+        for (size_t i = 1; i < args.size(); i++) {
+            if (args[i] == "--fields" && i + 1 < args.size()) {
+                fields = split(args[++i], ',');
+            } else if (args[i] == "--since" && i + 1 < args.size()) {
+                since = args[++i];
+            } else if (args[i] != "--compact") {
+                printf("Unknown option: %s\n", args[i].c_str());
+                return 1;
+            }
+        }
+        return module_list_fields(fields, since);
     } else if (subcmd == "config") {
         // Handle module config subcommands
         if (args.size() < 2) {
-            printf("USAGE: ksud module config <get|set|list|delete|clear> ...\n");
+            printf("USAGE: ksud module config "
+                   "<get|get-many|set|set-many|list|dump|delete|clear> ...\n");
             return 1;
         }
         return module_config_handle(std::vector<std::string>(args.begin() + 1, args.end()));
@@ -268,8 +287,12 @@ static int cmd_debug(const std::vector<std::string>& args) {
         printf("  set-manager [PKG]  Set manager app\n");
         printf("  get-sign <APK>     Get APK signature\n");
         printf("  su [-g]            Root shell\n");
+        printf("  su-broker          Run the su broker in the foreground\n");
         printf("  version            Get kernel version\n");
         printf("  mark <get|mark|unmark|refresh> [PID]\n");
+        printf("  sucompat-stats     Show su path matcher counters\n");
+        printf("  ioctl-stats        Show driver ioctl call counts and latencies\n");
+        printf("  driver-fd-bench [N]  Time driver fd discovery methods\n");
         return 1;
     }
 
@@ -286,8 +309,17 @@ static int cmd_debug(const std::vector<std::string>& args) {
     } else if (subcmd == "su") {
         bool global_mnt = args.size() > 1 && args[1] == "-g";
         return grant_root_shell(global_mnt);
+    } else if (subcmd == "su-broker") {
+        return su_broker_main();
     } else if (subcmd == "mark" && args.size() > 1) {
         return debug_mark(std::vector<std::string>(args.begin() + 1, args.end()));
+    } else if (subcmd == "sucompat-stats") {
+        return debug_sucompat_stats();
+    } else if (subcmd == "ioctl-stats") {
+        return debug_ioctl_stats();
+    } else if (subcmd == "driver-fd-bench") {
+        int rounds = args.size() > 1 ? atoi(args[1].c_str()) : 1000;
+        return debug_driver_fd_bench(rounds > 0 ? rounds : 1000);
     }
 
     printf("Unknown debug subcommand: %s\n", subcmd.c_str());
@@ -370,6 +402,29 @@ static int cmd_kernel(const std::vector<std::string>& args) {
     return 1;
 }
 
+// Sulog subcommand handlers
+static int cmd_sulog(const std::vector<std::string>& args) {
+    if (args.empty()) {
+        printf("USAGE: ksud sulog <SUBCOMMAND>\n\n");
+        printf("SUBCOMMANDS:\n");
+        printf("  tail [-f]  Print buffered su events, -f keeps following\n");
+        printf("  stats      Show dedup and ring counters\n");
+        return 1;
+    }
+
+    const std::string& subcmd = args[0];
+
+    if (subcmd == "tail") {
+        bool follow = args.size() > 1 && (args[1] == "-f" || args[1] == "--follow");
+        return sulog_tail(follow);
+    } else if (subcmd == "stats") {
+        return sulog_stats();
+    }
+
+    printf("Unknown sulog subcommand: %s\n", subcmd.c_str());
+    return 1;
+}
+
 // Sepolicy subcommand handlers
 static int cmd_sepolicy(const std::vector<std::string>& args) {
     if (args.empty()) {
@@ -480,24 +535,7 @@ int cli_run(int argc, char* argv[]) {
     // If invoked as "sh", forward to busybox sh with all arguments
     // This handles the case where /system/bin/sh is a hardlink to ksud
     if (basename == "sh") {
-        // Use busybox to handle shell operations
-        const char* busybox = "/data/adb/ksu/bin/busybox";
-
-        // Build argv for busybox: busybox sh [original args...]
-        std::vector<char*> new_argv;
-        new_argv.push_back(const_cast<char*>("sh"));
-        for (int i = 1; i < argc; i++) {
-            new_argv.push_back(argv[i]);
-        }
-        new_argv.push_back(nullptr);
-
-        // Set ASH_STANDALONE to make busybox ash work properly
-        setenv("ASH_STANDALONE", "1", 1);
-
-        execv(busybox, new_argv.data());
-        // If busybox fails, try system sh as fallback
-        execv("/system/bin/toybox", new_argv.data());
-        _exit(127);
+        sh_main(argc, argv);
     }
 
     if (argc < 2) {
@@ -562,6 +600,8 @@ int cli_run(int argc, char* argv[]) {
         return cmd_umount(args);
     } else if (cmd == "kernel") {
         return cmd_kernel(args);
+    } else if (cmd == "sulog") {
+        return cmd_sulog(args);
     } else if (cmd == "debug") {
         return cmd_debug(args);
     } else if (cmd == "hymo") {
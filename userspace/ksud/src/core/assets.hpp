@@ -4,7 +4,8 @@
 
 namespace ksud {
 
-// Ensure all binary assets are extracted
-bool ensure_binaries(bool ignore_if_exist);
+// Ensure all binary assets are extracted, returns 0 on success. Assets whose
+// on-disk copy still carries a matching content stamp are not rewritten.
+int ensure_binaries(bool ignore_if_exist);
 
 }  // namespace ksud
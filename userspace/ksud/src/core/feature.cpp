@@ -27,6 +27,7 @@ static const std::map<std::string, uint32_t> FEATURE_MAP = {
     {"kernel_umount", static_cast<uint32_t>(FeatureId::KernelUmount)},
     {"enhanced_security", static_cast<uint32_t>(FeatureId::EnhancedSecurity)},
     {"sulog", static_cast<uint32_t>(FeatureId::SuLog)},
+    {"sulog_dedup_window", static_cast<uint32_t>(FeatureId::SuLogDedupWindow)},
 };
 
 static const std::map<uint32_t, const char*> FEATURE_DESCRIPTIONS = {
@@ -38,6 +39,9 @@ static const std::map<uint32_t, const char*> FEATURE_DESCRIPTIONS = {
      "Enhanced Security - disable non-KSU root elevation and unauthorized UID downgrades"},
     {static_cast<uint32_t>(FeatureId::SuLog),
      "SU Log - enables logging of SU command usage to kernel log for auditing purposes"},
+    {static_cast<uint32_t>(FeatureId::SuLogDedupWindow),
+     "SU Log Dedup Window - seconds during which identical SU log events are logged once, "
+     "0 disables deduplication"},
 };
 
 // Returns {feature_id, valid}. Use pair because SuCompat ID is 0
@@ -2,6 +2,7 @@
 #include "../defs.hpp"
 #include "../log.hpp"
 #include "../utils.hpp"
+#include "props.hpp"
 
 #include <sys/wait.h>
 #include <unistd.h>
@@ -55,75 +56,31 @@ static const struct {
 };
 
 /**
- * Get property value using getprop
+ * Queue a reset if the prop exists and doesn't match expected
  */
-static std::string get_prop(const char* name) {
-    char cmd[256];
-    snprintf(cmd, sizeof(cmd), "getprop %s 2>/dev/null", name);
-
-    FILE* fp = popen(cmd, "r");
-    if (!fp)
-        return "";
-
-    char buf[256] = {0};
-    if (fgets(buf, sizeof(buf), fp)) {
-        // Remove trailing newline
-        size_t len = strlen(buf);
-        if (len > 0 && buf[len - 1] == '\n') {
-            buf[len - 1] = '\0';
-        }
-    }
-    pclose(fp);
-    return std::string(buf);
-}
-
-/**
- * Set property value using resetprop
- * Uses -n to skip init trigger (like Shamiko)
- */
-static bool reset_prop(const char* name, const char* value) {
-    pid_t pid = fork();
-    if (pid < 0) {
-        LOGW("hide_bl: fork failed: %s", strerror(errno));
-        return false;
-    }
-
-    if (pid == 0) {
-        // Child process
-        execl(RESETPROP_PATH, "resetprop", "-n", name, value, nullptr);
-        _exit(127);
-    }
-
-    // Parent: wait for child
-    int status;
-    waitpid(pid, &status, 0);
-    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
-}
-
-/**
- * Check and reset prop if value doesn't match expected
- */
-static void check_reset_prop(const char* name, const char* expected) {
-    std::string value = get_prop(name);
+static void check_reset_prop(const PropSnapshot& snapshot, PropBatch& batch, const char* name,
+                             const char* expected) {
+    auto value = snapshot.get(name);
 
     // Skip if empty (property doesn't exist) or already matches
-    if (value.empty() || value == expected) {
+    if (!value || value->empty() || *value == expected) {
         return;
     }
 
-    LOGI("hide_bl: resetting %s from '%s' to '%s'", name, value.c_str(), expected);
-    reset_prop(name, expected);
+    LOGI("hide_bl: resetting %s from '%s' to '%s'", name, value->c_str(), expected);
+    batch.set(name, expected);
 }
 
 /**
- * Check if prop contains substring and reset if so
+ * Queue a reset if the prop contains substring
  */
-static void contains_reset_prop(const char* name, const char* contains, const char* newval) {
-    std::string value = get_prop(name);
+static void contains_reset_prop(const PropSnapshot& snapshot, PropBatch& batch, const char* name,
+                                const char* contains, const char* newval) {
+    auto value = snapshot.get(name);
 
-    if (value.find(contains) != std::string::npos) {
+    if (value && value->find(contains) != std::string::npos) {
         LOGI("hide_bl: resetting %s (contains '%s') to '%s'", name, contains, newval);
-        reset_prop(name, newval);
+        batch.set(name, newval);
     }
 }
 
@@ -156,6 +113,7 @@ static void do_hide_bootloader() {
 
     pid_t wait_pid = fork();
     if (wait_pid == 0) {
+        log_flush();
         execl(RESETPROP_PATH, "resetprop", "-w", "sys.boot_completed", "0", nullptr);
         _exit(127);
     }
@@ -166,13 +124,20 @@ static void do_hide_bootloader() {
 
     LOGI("hide_bl: starting bootloader status hiding...");
 
-    // Reset standard properties
+    // Read all props once, then reset the mismatching ones in one batch
+    PropSnapshot snapshot;
+    PropBatch batch;
     for (const auto& prop : PROPS_TO_HIDE) {
         if (prop.expected != nullptr) {
-            check_reset_prop(prop.name, prop.expected);
+            check_reset_prop(snapshot, batch, prop.name, prop.expected);
         }
     }
 
+    size_t failed = batch.apply();
+    if (failed > 0) {
+        LOGW("hide_bl: failed to reset %zu properties", failed);
+    }
+
     LOGI("hide_bl: bootloader status hiding completed");
 }
 
@@ -200,6 +165,7 @@ void hide_bootloader_status() {
         // Child process - run in background
         setsid();  // Detach from parent
         do_hide_bootloader();
+        log_flush();
         _exit(0);
     }
 
@@ -8,6 +8,8 @@
 #include <sys/prctl.h>
 #include <sys/syscall.h>
 #include <unistd.h>
+#include <climits>
+#include <cstdlib>
 #include <cstring>
 
 namespace ksud {
@@ -31,7 +33,34 @@ struct PrctlGetFdCmd {
     int32_t fd;
 };
 
-static int scan_driver_fd() {
+// One readlink: every anon inode file shares a single inode, so fstat can't
+// tell the driver apart from an eventfd or epoll fd
+static bool is_driver_fd(int fd) {
+    char link_path[32];
+    char target[64];
+    snprintf(link_path, sizeof(link_path), "/proc/self/fd/%d", fd);
+
+    ssize_t len = readlink(link_path, target, sizeof(target) - 1);
+    if (len <= 0)
+        return false;
+    target[len] = '\0';
+    return strstr(target, "[ksu_driver]") != nullptr;
+}
+
+int driver_fd_from_env() {
+    const char* value = getenv(KSU_DRIVER_FD_ENV);
+    if (!value || value[0] == '\0')
+        return -1;
+
+    char* end;
+    long fd = strtol(value, &end, 10);
+    if (*end != '\0' || fd < 0 || fd > INT_MAX)
+        return -1;
+    // A stale value (fd closed or reused further up the tree) falls through
+    return is_driver_fd(static_cast<int>(fd)) ? static_cast<int>(fd) : -1;
+}
+
+int scan_driver_fd() {
     DIR* dir = opendir("/proc/self/fd");
     if (!dir)
         return -1;
@@ -62,15 +91,8 @@ static int scan_driver_fd() {
     return found_fd;
 }
 
-static int init_driver_fd() {
-    // Method 1: Check if we already have an inherited fd
-    int fd = scan_driver_fd();
-    if (fd >= 0) {
-        LOGD("Found inherited driver fd: %d", fd);
-        return fd;
-    }
-
-    // Method 2: Try prctl to get fd (SECCOMP-safe)
+int driver_fd_from_kernel() {
+    // Try prctl to get fd (SECCOMP-safe)
     PrctlGetFdCmd prctl_cmd = {-1, -1};
     prctl(KSU_PRCTL_GET_FD, &prctl_cmd, 0, 0, 0);
     if (prctl_cmd.result == 0 && prctl_cmd.fd >= 0) {
@@ -78,18 +100,73 @@ static int init_driver_fd() {
         return prctl_cmd.fd;
     }
 
-    // Method 3: Fallback to reboot syscall (may be blocked by SECCOMP)
-    fd = -1;
+    // Fallback to reboot syscall (may be blocked by SECCOMP)
+    int fd = -1;
     syscall(SYS_reboot, KSU_INSTALL_MAGIC1, KSU_INSTALL_MAGIC2, 0, &fd);
     if (fd >= 0) {
         LOGD("Got driver fd via reboot syscall: %d", fd);
         return fd;
     }
-
-    LOGE("Failed to get driver fd");
     return -1;
 }
 
+static void set_cloexec(int fd) {
+    int flags = fcntl(fd, F_GETFD);
+    if (flags >= 0 && !(flags & FD_CLOEXEC)) {
+        fcntl(fd, F_SETFD, flags | FD_CLOEXEC);
+    }
+}
+
+void pass_driver_fd_to_child() {
+    if (g_driver_fd < 0)
+        return;
+    // Unlike the original, the dup is not close-on-exec: every descendant of
+    // the script inherits it, not only the ksud/su it runs
+    int fd = dup(g_driver_fd);
+    if (fd < 0)
+        return;
+    char value[16];
+    snprintf(value, sizeof(value), "%d", fd);
+    setenv(KSU_DRIVER_FD_ENV, value, 1);
+}
+
+void hide_driver_fd_from_exec() {
+    int fd = driver_fd_from_env();
+    if (fd >= 0)
+        set_cloexec(fd);
+    unsetenv(KSU_DRIVER_FD_ENV);
+    if (g_driver_fd >= 0)
+        set_cloexec(g_driver_fd);
+}
+
+static int init_driver_fd() {
+    // Method 1: Published by the parent
+    int fd = driver_fd_from_env();
+    if (fd >= 0) {
+        LOGD("Found published driver fd: %d", fd);
+        // Ours now: don't pass it on to whatever we exec next
+        set_cloexec(fd);
+        unsetenv(KSU_DRIVER_FD_ENV);
+        return fd;
+    }
+
+    // Method 2: Check if we already have an inherited fd
+    fd = scan_driver_fd();
+    if (fd < 0) {
+        // Method 3: Ask the kernel for a new one
+        fd = driver_fd_from_kernel();
+    } else {
+        LOGD("Found inherited driver fd: %d", fd);
+        set_cloexec(fd);
+    }
+
+    if (fd < 0) {
+        LOGE("Failed to get driver fd");
+        return -1;
+    }
+    return fd;
+}
+
 static int get_driver_fd() {
     if (!g_driver_fd_init) {
         g_driver_fd = init_driver_fd();
@@ -158,6 +235,14 @@ bool check_kernel_safemode() {
     return cmd.in_safe_mode != 0;
 }
 
+bool uid_granted_root(uint32_t uid) {
+    UidGrantedRootCmd cmd = {uid, 0};
+    if (ksuctl(KSU_IOCTL_UID_GRANTED_ROOT, &cmd) < 0) {
+        return false;
+    }
+    return cmd.granted != 0;
+}
+
 int set_sepolicy(const SetSepolicyCmd& cmd) {
     SetSepolicyCmd ioctl_cmd = cmd;
     return ksuctl(KSU_IOCTL_SET_SEPOLICY, &ioctl_cmd);
@@ -182,6 +267,30 @@ int get_wrapped_fd(int fd) {
     return ksuctl(KSU_IOCTL_GET_WRAPPER_FD, &cmd);
 }
 
+int get_sulog_fd() {
+    return ksuctl(KSU_IOCTL_GET_SULOG_FD, nullptr);
+}
+
+int get_sucompat_stats(SucompatHookStats (&stats)[SUCOMPAT_HOOK_COUNT]) {
+    return ksuctl(KSU_IOCTL_GET_SUCOMPAT_STATS, stats);
+}
+
+std::vector<IoctlStat> get_ioctl_stats() {
+    std::vector<IoctlStat> stats(32);
+    for (;;) {
+        GetIoctlStatsCmd cmd = {reinterpret_cast<uint64_t>(stats.data()),
+                                static_cast<uint32_t>(stats.size())};
+        if (ksuctl(KSU_IOCTL_GET_IOCTL_STATS, &cmd) < 0) {
+            return {};
+        }
+        if (cmd.count <= stats.size()) {
+            stats.resize(cmd.count);
+            return stats;
+        }
+        stats.resize(cmd.count);
+    }
+}
+
 uint32_t mark_get(int32_t pid) {
     ManageMarkCmd cmd = {KSU_MARK_GET, pid, 0};
     ksuctl(KSU_IOCTL_MANAGE_MARK, &cmd);
@@ -4,6 +4,7 @@
 #include <optional>
 #include <string>
 #include <utility>
+#include <vector>
 
 namespace ksud {
 
@@ -24,12 +25,16 @@ constexpr uint32_t KSU_IOCTL_GET_INFO = _IOR(K, 2, uint64_t);
 constexpr uint32_t KSU_IOCTL_REPORT_EVENT = _IOW(K, 3, uint64_t);
 constexpr uint32_t KSU_IOCTL_SET_SEPOLICY = _IOWR(K, 4, uint64_t);
 constexpr uint32_t KSU_IOCTL_CHECK_SAFEMODE = _IOR(K, 5, uint64_t);
+constexpr uint32_t KSU_IOCTL_UID_GRANTED_ROOT = _IOWR(K, 8, uint64_t);
 constexpr uint32_t KSU_IOCTL_GET_FEATURE = _IOWR(K, 13, uint64_t);
 constexpr uint32_t KSU_IOCTL_SET_FEATURE = _IOW(K, 14, uint64_t);
 constexpr uint32_t KSU_IOCTL_GET_WRAPPER_FD = _IOW(K, 15, uint64_t);
 constexpr uint32_t KSU_IOCTL_MANAGE_MARK = _IOWR(K, 16, uint64_t);
 constexpr uint32_t KSU_IOCTL_NUKE_EXT4_SYSFS = _IOW(K, 17, uint64_t);
 constexpr uint32_t KSU_IOCTL_ADD_TRY_UMOUNT = _IOW(K, 18, uint64_t);
+constexpr uint32_t KSU_IOCTL_GET_SULOG_FD = _IOR(K, 19, uint64_t);
+constexpr uint32_t KSU_IOCTL_GET_SUCOMPAT_STATS = _IOR(K, 20, uint64_t);
+constexpr uint32_t KSU_IOCTL_GET_IOCTL_STATS = _IOWR(K, 21, uint64_t);
 constexpr uint32_t KSU_IOCTL_LIST_TRY_UMOUNT = _IOWR(K, 200, uint64_t);
 
 // Structures for ioctl - use natural C alignment (matching kernel and Rust repr(C))
@@ -54,6 +59,11 @@ struct CheckSafemodeCmd {
     uint8_t in_safe_mode;
 };
 
+struct UidGrantedRootCmd {
+    uint32_t uid;
+    uint8_t granted;
+};
+
 struct GetFeatureCmd {
     uint32_t feature_id;
     uint64_t value;
@@ -91,9 +101,86 @@ struct ListTryUmountCmd {
     uint32_t buf_size;
 };
 
+// su path matcher counters, indexed stat / faccessat / execve
+struct SucompatHookStats {
+    uint64_t skipped;
+    uint64_t hits;
+    uint64_t misses;
+};
+constexpr size_t SUCOMPAT_HOOK_COUNT = 3;
+
+// Per-command driver stats, must match struct ksu_ioctl_stat in kernel/supercalls.h
+constexpr size_t IOCTL_LAT_BUCKETS = 12;  // bucket 0 is <1us, each next doubles
+struct IoctlStat {
+    char name[24];
+    uint32_t cmd;
+    uint32_t reserved;
+    uint64_t calls;
+    uint64_t denied;
+    uint64_t errors;
+    uint64_t latency[IOCTL_LAT_BUCKETS];
+};
+
+struct GetIoctlStatsCmd {
+    uint64_t arg;
+    uint32_t count;
+};
+
+// sulog ring record, must match struct ksu_sulog_record in kernel/sulog.h
+struct SulogRecord {
+    uint64_t seq;
+    uint64_t ts_ns;
+    uint32_t uid;
+    uint32_t pid;
+    uint32_t aux_uid;
+    uint8_t type;
+    uint8_t result;
+    uint8_t pad[2];
+    char comm[128];
+    char name[64];
+    char arg[32];
+};
+static_assert(sizeof(SulogRecord) == 256, "SulogRecord must match the kernel layout");
+
+// Returned by KSU_SULOG_IOCTL_GET_STATS on the sulog fd
+struct SulogStats {
+    uint64_t dedup_hits;
+    uint64_t dedup_misses;
+    uint64_t dedup_evictions;
+    uint64_t records;
+    uint32_t dedup_window;
+};
+
+constexpr uint32_t KSU_SULOG_IOCTL_GET_STATS = _IOR('S', 1, uint64_t);
+
+enum SulogType : uint8_t {
+    SULOG_SU_GRANT = 0,
+    SULOG_SU_ATTEMPT = 1,
+    SULOG_PERM_CHECK = 2,
+    SULOG_MANAGER_OP = 3,
+    SULOG_SYSCALL = 4,
+};
+
 // API functions
 int ksuctl(int request, void* arg);
 
+// Driver fd discovery, cheapest first; the first ksuctl() tries them in this
+// order. Each returns -1 if the method finds nothing.
+constexpr const char* KSU_DRIVER_FD_ENV = "KSU_DRIVER_FD";
+int driver_fd_from_env();
+int scan_driver_fd();
+int driver_fd_from_kernel();  // installs a new fd, caller owns it
+
+// The driver fd stays close-on-exec. Between fork and exec of a module
+// script, pass_driver_fd_to_child() hands it an inheritable dup through
+// KSU_DRIVER_FD_ENV so the ksud and su it runs skip the lookup. The dup is
+// not confined to those: the script's shell and everything it starts keep
+// it, including daemons that service.sh leaves running, until a ksud or su
+// adopts it (and sets close-on-exec again) or calls hide_driver_fd_from_exec().
+// Each ioctl still checks the caller, so holding the fd grants nothing.
+void pass_driver_fd_to_child();
+void hide_driver_fd_from_exec();
+
 int32_t get_version();
 uint32_t get_flags();
 
@@ -103,6 +190,9 @@ void report_boot_complete();
 void report_module_mounted();
 bool check_kernel_safemode();
 
+// Whether the allowlist grants root to uid (manager or root only)
+bool uid_granted_root(uint32_t uid);
+
 int set_sepolicy(const SetSepolicyCmd& cmd);
 
 // Feature management
@@ -112,6 +202,12 @@ int set_feature(uint32_t feature_id, uint64_t value);
 
 int get_wrapped_fd(int fd);
 
+// Reader fd on the kernel sulog ring, caller owns it
+int get_sulog_fd();
+
+int get_sucompat_stats(SucompatHookStats (&stats)[SUCOMPAT_HOOK_COUNT]);
+std::vector<IoctlStat> get_ioctl_stats();
+
 // Mark management
 uint32_t mark_get(int32_t pid);
 int mark_set(int32_t pid);
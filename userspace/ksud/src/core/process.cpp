@@ -0,0 +1,82 @@
+#include "process.hpp"
+#include "../log.hpp"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <sched.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#ifdef __ANDROID__
+#include <sys/system_properties.h>
+#endif // #ifdef __ANDROID__
+
+namespace ksud {
+
+bool switch_mnt_ns(pid_t pid) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/ns/mnt", pid);
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        LOGE("Failed to open %s: %s", path, strerror(errno));
+        return false;
+    }
+
+    // Save current directory
+    char cwd[PATH_MAX];
+    char* cwd_result = getcwd(cwd, sizeof(cwd));
+
+    // Switch namespace
+    if (setns(fd, CLONE_NEWNS) != 0) {
+        LOGE("Failed to setns: %s", strerror(errno));
+        close(fd);
+        return false;
+    }
+    close(fd);
+
+    // Restore current directory
+    if (cwd_result) {
+        chdir(cwd);
+    }
+
+    return true;
+}
+
+static void switch_cgroup(const char* grp, const char* pid, size_t pid_len) {
+    char path[64];
+    snprintf(path, sizeof(path), "%s/cgroup.procs", grp);
+
+    int fd = open(path, O_WRONLY | O_APPEND | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    write(fd, pid, pid_len);
+    close(fd);
+}
+
+static bool per_app_memcg_enabled() {
+#ifdef __ANDROID__
+    char value[PROP_VALUE_MAX] = {0};
+    if (__system_property_get("ro.config.per_app_memcg", value) > 0) {
+        return strcmp(value, "false") != 0;
+    }
+#endif // #ifdef __ANDROID__
+    return true;
+}
+
+void switch_cgroups() {
+    char pid[16];
+    int len = snprintf(pid, sizeof(pid), "%d", getpid());
+    switch_cgroup("/acct", pid, len);
+    switch_cgroup("/dev/cg2_bpf", pid, len);
+    switch_cgroup("/sys/fs/cgroup", pid, len);
+
+    if (per_app_memcg_enabled()) {
+        switch_cgroup("/dev/memcg/apps", pid, len);
+    }
+}
+
+}  // namespace ksud
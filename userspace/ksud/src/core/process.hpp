@@ -0,0 +1,12 @@
+#pragma once
+
+#include <sys/types.h>
+
+namespace ksud {
+
+// Process setup shared by su and the daemon; kept free of std::filesystem and
+// iostreams so the lean su binary can link it
+bool switch_mnt_ns(pid_t pid);
+void switch_cgroups();
+
+}  // namespace ksud
@@ -0,0 +1,127 @@
+#include "props.hpp"
+#include "../defs.hpp"
+#include "../log.hpp"
+
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#ifdef __ANDROID__
+#include <sys/system_properties.h>
+#endif // #ifdef __ANDROID__
+
+namespace ksud {
+
+static int run_resetprop(const char* const argv[]) {
+    pid_t pid = fork();
+    if (pid < 0) {
+        LOGW("props: fork failed: %s", strerror(errno));
+        return -1;
+    }
+    if (pid == 0) {
+        log_flush();
+        execv(RESETPROP_PATH, const_cast<char* const*>(argv));
+        _exit(127);
+    }
+
+    int status;
+    if (waitpid(pid, &status, 0) < 0)
+        return -1;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+void PropBatch::set(const std::string& key, const std::string& value) {
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+        props_[it->second].second = value;
+        return;
+    }
+    index_.emplace(key, props_.size());
+    props_.emplace_back(key, value);
+}
+
+size_t PropBatch::apply() {
+    if (props_.empty())
+        return 0;
+
+    auto props = std::move(props_);
+    props_.clear();
+    index_.clear();
+
+    // resetprop -f reads "key=value" lines, the same format as system.prop
+    std::string path = std::string(WORKING_DIR) + ".props.XXXXXX";
+    int fd = mkstemp(path.data());
+    if (fd >= 0) {
+        std::string content;
+        for (const auto& [key, value] : props) {
+            content += key;
+            content += '=';
+            content += value;
+            content += '\n';
+        }
+
+        bool written = true;
+        size_t off = 0;
+        while (off < content.size()) {
+            ssize_t n = write(fd, content.data() + off, content.size() - off);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0) {
+                written = false;
+                break;
+            }
+            off += static_cast<size_t>(n);
+        }
+        close(fd);
+
+        int ret = -1;
+        if (written) {
+            const char* argv[] = {"resetprop", "-n", "-f", path.c_str(), nullptr};
+            ret = run_resetprop(argv);
+        }
+        unlink(path.c_str());
+
+        if (ret == 0) {
+            LOGD("props: applied %zu properties in one batch", props.size());
+            return 0;
+        }
+        LOGW("props: batch resetprop failed (%d), setting one by one", ret);
+    } else {
+        LOGW("props: cannot create batch file: %s", strerror(errno));
+    }
+
+    size_t failed = 0;
+    for (const auto& [key, value] : props) {
+        const char* argv[] = {"resetprop", "-n", key.c_str(), value.c_str(), nullptr};
+        if (run_resetprop(argv) != 0)
+            failed++;
+    }
+    return failed;
+}
+
+PropSnapshot::PropSnapshot() {
+#ifdef __ANDROID__
+    __system_property_foreach(
+        [](const prop_info* pi, void* cookie) {
+            __system_property_read_callback(
+                pi,
+                [](void* cookie, const char* name, const char* value, uint32_t) {
+                    static_cast<PropSnapshot*>(cookie)->props_.emplace(name, value);
+                },
+                cookie);
+        },
+        this);
+#endif // #ifdef __ANDROID__
+}
+
+std::optional<std::string> PropSnapshot::get(const std::string& key) const {
+    auto it = props_.find(key);
+    if (it == props_.end())
+        return std::nullopt;
+    return it->second;
+}
+
+}  // namespace ksud
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace ksud {
+
+/**
+ * Collects property writes and applies them with a single resetprop run
+ *
+ * Setting the same key twice keeps the last value, in the position of the
+ * first set, matching what sequential resetprop calls would leave behind.
+ */
+class PropBatch {
+public:
+    void set(const std::string& key, const std::string& value);
+    size_t size() const { return props_.size(); }
+    bool empty() const { return props_.empty(); }
+
+    /**
+     * Apply all queued writes with `resetprop -n -f`; falls back to one
+     * resetprop per key if the batch run fails. Clears the batch.
+     *
+     * @return Number of properties that could not be set
+     */
+    size_t apply();
+
+private:
+    std::vector<std::pair<std::string, std::string>> props_;
+    std::unordered_map<std::string, size_t> index_;
+};
+
+/**
+ * Point-in-time copy of the whole property area, read in-process
+ */
+class PropSnapshot {
+public:
+    PropSnapshot();
+
+    std::optional<std::string> get(const std::string& key) const;
+    size_t size() const { return props_.size(); }
+
+private:
+    std::unordered_map<std::string, std::string> props_;
+};
+
+}  // namespace ksud
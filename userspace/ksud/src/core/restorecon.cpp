@@ -1,10 +1,26 @@
 #include "restorecon.hpp"
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
 #include <sys/xattr.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
 #include <cstring>
+#include <deque>
 #include <filesystem>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 #include "../defs.hpp"
 #include "../log.hpp"
+#include "../utils.hpp"
 
 namespace fs = std::filesystem;
 
@@ -12,6 +28,10 @@ namespace ksud {
 
 static constexpr const char* SELINUX_XATTR = "security.selinux";
 
+static constexpr unsigned RESTORECON_MAX_THREADS = 4;
+static constexpr const char* CHECKPOINT_MAGIC = "ksu-restorecon-v2";
+static constexpr const char* CHECKPOINT_END = "end";
+
 bool lsetfilecon(const fs::path& path, const std::string& con) {
     int ret = lsetxattr(path.c_str(), SELINUX_XATTR, con.c_str(), con.length() + 1, 0);
     if (ret != 0) {
@@ -35,43 +55,329 @@ bool setsyscon(const fs::path& path) {
     return lsetfilecon(path, SYSTEM_CON);
 }
 
-bool restore_syscon(const fs::path& dir) {
-    if (!fs::exists(dir)) {
-        return true;
+// State of a directory after a clean pass. While mtime and ctime are unchanged
+// no entry was added, removed or renamed in it, so its non-directory entries
+// keep the labels they were checked with. Subdirectories carry their own stamp.
+struct DirStamp {
+    int64_t mtime_ns;
+    int64_t ctime_ns;
+    std::string label;
+
+    bool operator==(const DirStamp& o) const {
+        return mtime_ns == o.mtime_ns && ctime_ns == o.ctime_ns && label == o.label;
     }
+};
+
+using Checkpoint = std::unordered_map<std::string, DirStamp>;
+
+// The checkpoint is only trusted on the build that wrote it, since an OTA can
+// change the policy and leave labels invalid without touching any directory
+static std::string checkpoint_identity() {
+    return getprop("ro.build.fingerprint").value_or("unknown");
+}
+
+// The checkpoint sits inside /data/adb, which may itself be the tree being
+// walked. It is created and locked before the walk and rewritten in place
+// afterwards, so its directory looks the same at stamp time and after the
+// save; replacing it by rename would change that directory's mtime and
+// invalidate its stamp on every pass. A torn write has no end line and is
+// ignored as a whole.
+static int open_checkpoint() {
+    int fd = open(RESTORECON_CHECKPOINT_PATH, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        LOGW("Failed to open %s: %s", RESTORECON_CHECKPOINT_PATH, strerror(errno));
+        return -1;
+    }
+    if (flock(fd, LOCK_EX) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
 
-    try {
-        for (const auto& entry : fs::recursive_directory_iterator(dir)) {
-            if (!setsyscon(entry.path())) {
-                LOGW("Failed to restore context for %s", entry.path().c_str());
-            }
+static Checkpoint load_checkpoint() {
+    Checkpoint checkpoint;
+    std::istringstream in(read_file(RESTORECON_CHECKPOINT_PATH).value_or(""));
+    std::string line;
+    if (!std::getline(in, line) || line != std::string(CHECKPOINT_MAGIC) + " " +
+                                               checkpoint_identity()) {
+        return checkpoint;
+    }
+
+    // "<mtime_ns> <ctime_ns> <label> <path>"; the path may contain spaces
+    while (std::getline(in, line)) {
+        if (line == CHECKPOINT_END)
+            return checkpoint;
+        long long mtime_ns, ctime_ns;
+        int label_start, label_end;
+        if (sscanf(line.c_str(), "%lld %lld %n%*s%n", &mtime_ns, &ctime_ns, &label_start,
+                   &label_end) != 2) {
+            continue;
         }
-        return true;
-    } catch (const fs::filesystem_error& e) {
-        LOGE("Error walking directory %s: %s", dir.c_str(), e.what());
+        if (static_cast<size_t>(label_end) + 1 >= line.size()) {
+            continue;
+        }
+        checkpoint[line.substr(label_end + 1)] = {
+            mtime_ns, ctime_ns, line.substr(label_start, label_end - label_start)};
+    }
+    return {};
+}
+
+static void save_checkpoint(int fd, const Checkpoint& checkpoint) {
+    std::string out = std::string(CHECKPOINT_MAGIC) + " " + checkpoint_identity() + "\n";
+    for (const auto& [path, stamp] : checkpoint) {
+        if (path.find('\n') != std::string::npos)
+            continue;
+        out += std::to_string(stamp.mtime_ns) + " " + std::to_string(stamp.ctime_ns) + " " +
+               stamp.label + " " + path + "\n";
+    }
+    out += CHECKPOINT_END;
+    out += "\n";
+
+    size_t done = 0;
+    while (done < out.size()) {
+        ssize_t n = pwrite(fd, out.data() + done, out.size() - done, done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            LOGW("Failed to write %s: %s", RESTORECON_CHECKPOINT_PATH, strerror(errno));
+            ftruncate(fd, 0);
+            return;
+        }
+        done += static_cast<size_t>(n);
+    }
+    ftruncate(fd, static_cast<off_t>(out.size()));
+}
+
+static std::string fd_getfilecon(int fd) {
+    char buf[256];
+    ssize_t len = fgetxattr(fd, SELINUX_XATTR, buf, sizeof(buf) - 1);
+    if (len < 0) {
+        return "";
+    }
+    buf[len] = '\0';
+    return std::string(buf);
+}
+
+static bool is_unlabeled(const std::string& con) {
+    return con.empty() || con == UNLABEL_CON;
+}
+
+// Shared state of one labeling pass. Directories are the unit of work: the
+// top-level subtrees seed the queue and every worker pushes the subdirectories
+// it finds, so one large subtree (usually modules/) still spreads out.
+struct LabelPass {
+    bool force;                   // Relabel everything, not only unlabeled entries
+    const Checkpoint* previous;   // Read-only while workers run
+    std::mutex lock;
+    std::condition_variable cond;
+    std::deque<std::string> queue;
+    size_t pending = 0;           // Queued plus in progress
+    Checkpoint stamps;            // Directories that finished clean, under lock
+    std::atomic<uint64_t> visited{0};
+    std::atomic<uint64_t> relabeled{0};
+    std::atomic<uint64_t> skipped{0};
+    std::atomic<uint64_t> failed{0};
+
+    void push(std::string path) {
+        std::lock_guard<std::mutex> guard(lock);
+        queue.push_back(std::move(path));
+        pending++;
+        cond.notify_one();
+    }
+};
+
+// Label one entry of an open directory. Non-directories have no fd of their
+// own, so they are reached through the directory's /proc/self/fd link, which
+// resolves only the last component instead of the whole path.
+static bool label_entry(LabelPass& pass, int dirfd, const char* name) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "/proc/self/fd/%d/%s", dirfd, name);
+    if (!pass.force) {
+        char buf[256];
+        ssize_t len = lgetxattr(path, SELINUX_XATTR, buf, sizeof(buf) - 1);
+        if (len > 0) {
+            buf[len] = '\0';
+            if (!is_unlabeled(buf))
+                return true;
+        }
+    }
+    if (lsetxattr(path, SELINUX_XATTR, SYSTEM_CON, strlen(SYSTEM_CON) + 1, 0) != 0) {
         return false;
     }
+    pass.relabeled.fetch_add(1, std::memory_order_relaxed);
+    return true;
 }
 
-bool restore_syscon_if_unlabeled(const fs::path& dir) {
-    if (!fs::exists(dir)) {
-        return true;
+static void label_dir(LabelPass& pass, const std::string& dir_path, bool is_root) {
+    int fd = open(dir_path.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) {
+        LOGW("Failed to open %s: %s", dir_path.c_str(), strerror(errno));
+        pass.failed.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    // The root itself is not relabeled, like restorecon's -R on its entries
+    std::string label = fd_getfilecon(fd);
+    if (!is_root && (pass.force || is_unlabeled(label))) {
+        if (fsetxattr(fd, SELINUX_XATTR, SYSTEM_CON, strlen(SYSTEM_CON) + 1, 0) == 0) {
+            pass.relabeled.fetch_add(1, std::memory_order_relaxed);
+            label = SYSTEM_CON;
+        } else {
+            LOGW("Failed to restore context for %s: %s", dir_path.c_str(), strerror(errno));
+            pass.failed.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // Stamp after our own relabel, which moves the ctime
+    struct stat st;
+    bool have_stamp = fstat(fd, &st) == 0;
+    DirStamp stamp{};
+    if (have_stamp) {
+        stamp = {static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec,
+                 static_cast<int64_t>(st.st_ctim.tv_sec) * 1000000000 + st.st_ctim.tv_nsec,
+                 label};
+    }
+    bool unchanged = false;
+    if (have_stamp && !pass.force && pass.previous) {
+        auto it = pass.previous->find(dir_path);
+        unchanged = it != pass.previous->end() && it->second == stamp;
     }
 
-    try {
-        for (const auto& entry : fs::recursive_directory_iterator(dir)) {
-            std::string con = lgetfilecon(entry.path());
-            if (con.empty() || con == UNLABEL_CON) {
-                if (!lsetfilecon(entry.path(), SYSTEM_CON)) {
-                    LOGW("Failed to restore context for %s", entry.path().c_str());
-                }
-            }
+    DIR* dir = fdopendir(fd);
+    if (!dir) {
+        close(fd);
+        pass.failed.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    bool clean = have_stamp;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        const char* name = entry->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+            continue;
+        pass.visited.fetch_add(1, std::memory_order_relaxed);
+
+        unsigned char type = entry->d_type;
+        if (type == DT_UNKNOWN) {
+            struct stat est;
+            if (fstatat(fd, name, &est, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(est.st_mode))
+                type = DT_DIR;
         }
+        if (type == DT_DIR) {
+            pass.push(dir_path + "/" + name);
+            continue;
+        }
+
+        if (unchanged) {
+            pass.skipped.fetch_add(1, std::memory_order_relaxed);
+        } else if (!label_entry(pass, fd, name)) {
+            LOGW("Failed to restore context for %s/%s: %s", dir_path.c_str(), name,
+                 strerror(errno));
+            pass.failed.fetch_add(1, std::memory_order_relaxed);
+            clean = false;
+        }
+    }
+    closedir(dir);
+
+    if (clean && !is_unlabeled(stamp.label)) {
+        std::lock_guard<std::mutex> guard(pass.lock);
+        pass.stamps[dir_path] = std::move(stamp);
+    }
+}
+
+static void label_worker(LabelPass& pass) {
+    std::unique_lock<std::mutex> guard(pass.lock);
+    for (;;) {
+        pass.cond.wait(guard, [&] { return !pass.queue.empty() || pass.pending == 0; });
+        if (pass.queue.empty())
+            return;
+        std::string path = std::move(pass.queue.front());
+        pass.queue.pop_front();
+
+        guard.unlock();
+        label_dir(pass, path, false);
+        guard.lock();
+
+        if (--pass.pending == 0)
+            pass.cond.notify_all();
+    }
+}
+
+// Label everything below dir in parallel. With force every entry gets
+// SYSTEM_CON, otherwise only unlabeled ones do, and directories whose stamp
+// matches the checkpoint have their files skipped.
+static bool label_tree(const fs::path& dir, bool force) {
+    struct stat st;
+    if (lstat(dir.c_str(), &st) != 0) {
         return true;
-    } catch (const fs::filesystem_error& e) {
-        LOGE("Error walking directory %s: %s", dir.c_str(), e.what());
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        LOGE("Error walking directory %s: not a directory", dir.c_str());
         return false;
     }
+
+    auto start = std::chrono::steady_clock::now();
+    std::string root = dir.string();
+    while (root.size() > 1 && root.back() == '/')
+        root.pop_back();
+
+    // Before the walk, so the checkpoint's own directory is stamped with it
+    int checkpoint_fd = force ? -1 : open_checkpoint();
+    Checkpoint previous;
+    if (checkpoint_fd >= 0)
+        previous = load_checkpoint();
+
+    LabelPass pass;
+    pass.force = force;
+    pass.previous = &previous;
+
+    // The root's own entries are labeled here; its subdirectories become the
+    // initial shards
+    label_dir(pass, root, true);
+
+    unsigned threads = std::max(1u, std::min(std::thread::hardware_concurrency(),
+                                             RESTORECON_MAX_THREADS));
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < threads; i++)
+        workers.emplace_back(label_worker, std::ref(pass));
+    for (auto& worker : workers)
+        worker.join();
+
+    if (checkpoint_fd >= 0) {
+        // Keep stamps for directories outside this pass, replace the rest
+        std::string prefix = root + "/";
+        for (auto it = previous.begin(); it != previous.end();) {
+            if (it->first == root || it->first.compare(0, prefix.size(), prefix) == 0)
+                it = previous.erase(it);
+            else
+                ++it;
+        }
+        previous.merge(pass.stamps);
+        save_checkpoint(checkpoint_fd, previous);
+        close(checkpoint_fd);  // releases the lock
+    }
+
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+    LOGI("restorecon %s: %llu visited, %llu relabeled, %llu skipped by checkpoint, "
+         "%llu failed, %u threads, %lld ms",
+         root.c_str(), static_cast<unsigned long long>(pass.visited.load()),
+         static_cast<unsigned long long>(pass.relabeled.load()),
+         static_cast<unsigned long long>(pass.skipped.load()),
+         static_cast<unsigned long long>(pass.failed.load()), threads,
+         static_cast<long long>(ms));
+    return true;
+}
+
+bool restore_syscon(const fs::path& dir) {
+    return label_tree(dir, true);
+}
+
+bool restore_syscon_if_unlabeled(const fs::path& dir) {
+    return label_tree(dir, false);
 }
 
 bool restorecon() {
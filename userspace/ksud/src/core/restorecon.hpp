@@ -22,7 +22,9 @@ bool setsyscon(const std::filesystem::path& path);
 // Restore system context for directory recursively
 bool restore_syscon(const std::filesystem::path& dir);
 
-// Restore system context if unlabeled
+// Restore system context if unlabeled. Walks the tree with several threads and
+// skips the files of directories unchanged since the checkpoint of the last
+// pass (RESTORECON_CHECKPOINT_PATH).
 bool restore_syscon_if_unlabeled(const std::filesystem::path& dir);
 
 // Restore contexts for KSU files
@@ -0,0 +1,118 @@
+#include "task_graph.hpp"
+#include "../log.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace ksud {
+
+size_t TaskGraph::add(const char* name, std::function<void()> fn,
+                      const std::vector<size_t>& deps) {
+    size_t id = tasks_.size();
+    Task task;
+    task.name = name;
+    task.fn = std::move(fn);
+    task.deps = deps;
+    tasks_.push_back(std::move(task));
+    for (size_t dep : deps)
+        tasks_[dep].dependents.push_back(id);
+    return id;
+}
+
+void TaskGraph::run(unsigned max_threads) {
+    if (tasks_.empty())
+        return;
+
+    std::mutex lock;
+    std::condition_variable cond;
+    std::deque<size_t> ready;
+    size_t remaining = tasks_.size();
+
+    for (size_t i = 0; i < tasks_.size(); i++) {
+        tasks_[i].waiting = tasks_[i].deps.size();
+        if (tasks_[i].waiting == 0)
+            ready.push_back(i);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    auto now_us = [&]() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                   std::chrono::steady_clock::now() - start)
+            .count();
+    };
+
+    auto worker = [&]() {
+        std::unique_lock<std::mutex> guard(lock);
+        for (;;) {
+            cond.wait(guard, [&] { return !ready.empty() || remaining == 0; });
+            if (ready.empty())
+                return;
+            size_t id = ready.front();
+            ready.pop_front();
+            Task& task = tasks_[id];
+
+            guard.unlock();
+            task.start_us = now_us();
+            task.fn();
+            task.end_us = now_us();
+            guard.lock();
+
+            remaining--;
+            for (size_t next : task.dependents) {
+                if (--tasks_[next].waiting == 0)
+                    ready.push_back(next);
+            }
+            cond.notify_all();
+        }
+    };
+
+    unsigned threads = std::max(1u, std::min<unsigned>(max_threads, tasks_.size()));
+    std::vector<std::thread> helpers;
+    for (unsigned i = 1; i < threads; i++)
+        helpers.emplace_back(worker);
+    worker();
+    for (auto& helper : helpers)
+        helper.join();
+
+    log_critical_path(now_us());
+}
+
+// The critical path ends at the task that finished last and follows, at each
+// step, the dependency that finished last: the chain the wall time waited on
+void TaskGraph::log_critical_path(long long wall_us) const {
+    long long serial_us = 0;
+    size_t last = 0;
+    for (size_t i = 0; i < tasks_.size(); i++) {
+        serial_us += tasks_[i].end_us - tasks_[i].start_us;
+        if (tasks_[i].end_us > tasks_[last].end_us)
+            last = i;
+        LOGD("%s: %s ran %lld-%lld ms", name_.c_str(), tasks_[i].name,
+             tasks_[i].start_us / 1000, tasks_[i].end_us / 1000);
+    }
+
+    std::vector<size_t> path{last};
+    while (!tasks_[path.back()].deps.empty()) {
+        const auto& deps = tasks_[path.back()].deps;
+        path.push_back(*std::max_element(deps.begin(), deps.end(), [&](size_t a, size_t b) {
+            return tasks_[a].end_us < tasks_[b].end_us;
+        }));
+    }
+
+    std::string chain;
+    for (auto it = path.rbegin(); it != path.rend(); ++it) {
+        if (!chain.empty())
+            chain += " -> ";
+        chain += tasks_[*it].name;
+        chain += " ";
+        chain += std::to_string((tasks_[*it].end_us - tasks_[*it].start_us) / 1000);
+        chain += "ms";
+    }
+    LOGI("%s: critical path %s; wall %lld ms, serial %lld ms", name_.c_str(), chain.c_str(),
+         wall_us / 1000, serial_us / 1000);
+}
+
+}  // namespace ksud
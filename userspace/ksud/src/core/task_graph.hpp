@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace ksud {
+
+// A fixed set of tasks with explicit dependencies, run on a bounded number of
+// threads. Used to overlap independent boot steps.
+class TaskGraph {
+public:
+    explicit TaskGraph(std::string name) : name_(std::move(name)) {}
+
+    // Adds a task that starts once every task in deps has finished. deps must
+    // be ids returned by earlier calls, so the graph can't have cycles.
+    size_t add(const char* name, std::function<void()> fn, const std::vector<size_t>& deps = {});
+
+    // Runs every task on up to max_threads threads, the caller included, and
+    // returns once all of them finished. Logs the critical path.
+    void run(unsigned max_threads);
+
+private:
+    struct Task {
+        const char* name;
+        std::function<void()> fn;
+        std::vector<size_t> deps;
+        std::vector<size_t> dependents;
+        size_t waiting = 0;      // Unfinished deps while running
+        long long start_us = 0;  // Relative to the start of run()
+        long long end_us = 0;
+    };
+
+    void log_critical_path(long long wall_us) const;
+
+    std::string name_;
+    std::vector<Task> tasks_;
+};
+
+}  // namespace ksud
@@ -4,10 +4,15 @@
 #include "log.hpp"
 #include "utils.hpp"
 
+#include <sys/ioctl.h>
 #include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
 #include <cerrno>
+#include <cinttypes>
 #include <cstdio>
 #include <cstring>
+#include <ctime>
 #include <filesystem>
 #include <fstream>
 
@@ -140,4 +145,94 @@ int debug_mark(const std::vector<std::string>& args) {
     return 1;
 }
 
+int debug_sucompat_stats() {
+    SucompatHookStats stats[SUCOMPAT_HOOK_COUNT] = {};
+    if (get_sucompat_stats(stats) < 0) {
+        printf("Failed to get sucompat stats\n");
+        return 1;
+    }
+
+    static const char* const names[SUCOMPAT_HOOK_COUNT] = {"newfstatat", "faccessat", "execve"};
+    printf("%-12s %12s %12s %12s\n", "syscall", "skipped", "hits", "misses");
+    for (size_t i = 0; i < SUCOMPAT_HOOK_COUNT; i++) {
+        printf("%-12s %12" PRIu64 " %12" PRIu64 " %12" PRIu64 "\n", names[i], stats[i].skipped,
+               stats[i].hits, stats[i].misses);
+    }
+    return 0;
+}
+
+int debug_ioctl_stats() {
+    auto stats = get_ioctl_stats();
+    if (stats.empty()) {
+        printf("Failed to get ioctl stats\n");
+        return 1;
+    }
+
+    printf("%-20s %10s %8s %8s  latency (<1us <2us <4us ... >=1ms)\n", "command", "calls",
+           "denied", "errors");
+    for (const auto& s : stats) {
+        printf("%-20.*s %10" PRIu64 " %8" PRIu64 " %8" PRIu64 " ", static_cast<int>(sizeof(s.name)),
+               s.name, s.calls, s.denied, s.errors);
+        for (size_t i = 0; i < IOCTL_LAT_BUCKETS; i++) {
+            printf(" %" PRIu64, s.latency[i]);
+        }
+        printf("\n");
+    }
+    return 0;
+}
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+int debug_driver_fd_bench(int rounds) {
+    // Make sure the fd is discovered and published the way a module script
+    // sees it, so every method has something to find
+    if (get_version() <= 0) {
+        printf("Driver not available\n");
+        return 1;
+    }
+    pass_driver_fd_to_child();
+
+    struct Method {
+        const char* name;
+        int (*discover)();
+        bool owns_fd;
+    };
+    static const Method methods[] = {
+        {"env", driver_fd_from_env, false},
+        {"scan", scan_driver_fd, false},
+        {"kernel", driver_fd_from_kernel, true},
+    };
+
+    printf("%-8s %8s %12s %12s  (discovery + first GET_INFO ioctl, %d rounds)\n", "method",
+           "ok", "avg ns", "min ns", rounds);
+    for (const auto& m : methods) {
+        uint64_t total = 0;
+        uint64_t best = UINT64_MAX;
+        int ok = 0;
+        for (int i = 0; i < rounds; i++) {
+            uint64_t start = now_ns();
+            int fd = m.discover();
+            GetInfoCmd info = {};
+            bool success = fd >= 0 && ioctl(fd, KSU_IOCTL_GET_INFO, &info) == 0;
+            uint64_t elapsed = now_ns() - start;
+            if (m.owns_fd && fd >= 0) {
+                close(fd);
+            }
+            if (!success) {
+                continue;
+            }
+            ok++;
+            total += elapsed;
+            best = std::min(best, elapsed);
+        }
+        printf("%-8s %8d %12" PRIu64 " %12" PRIu64 "\n", m.name, ok, ok ? total / ok : 0,
+               ok ? best : 0);
+    }
+    return 0;
+}
+
 }  // namespace ksud
@@ -8,5 +8,10 @@ namespace ksud {
 int debug_set_manager(const std::string& pkg);
 int debug_get_sign(const std::string& apk);
 int debug_mark(const std::vector<std::string>& args);
+int debug_sucompat_stats();
+int debug_ioctl_stats();
+
+// Time each driver fd discovery method plus its first ioctl
+int debug_driver_fd_bench(int rounds);
 
 }  // namespace ksud
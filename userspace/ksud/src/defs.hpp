@@ -27,6 +27,10 @@ constexpr const char* PROFILE_SELINUX_DIR = "/data/adb/ksu/profile/selinux/";
 constexpr const char* PROFILE_TEMPLATE_DIR = "/data/adb/ksu/profile/templates/";
 
 constexpr const char* KSURC_PATH = "/data/adb/ksu/.ksurc";
+// Directory stamps from the last restorecon pass over /data/adb
+constexpr const char* RESTORECON_CHECKPOINT_PATH = "/data/adb/ksu/.restorecon";
+// Change stamps behind `module list --since` generation tokens
+constexpr const char* MODULE_STAMP_PATH = "/data/adb/ksu/.module_stamps";
 constexpr const char* DAEMON_PATH = "/data/adb/ksud";
 constexpr const char* MAGISKBOOT_PATH = "/data/adb/ksu/bin/magiskboot";
 constexpr const char* DAEMON_LINK_PATH = "/data/adb/ksu/bin/ksud";
@@ -45,6 +49,9 @@ constexpr const char* REMOVE_FILE_NAME = "remove";
 constexpr const char* MODULE_CONFIG_DIR = "/data/adb/ksu/module_configs/";
 constexpr const char* PERSIST_CONFIG_NAME = "persist.config";
 constexpr const char* TEMP_CONFIG_NAME = "tmp.config";
+// Unified store shared by all modules: snapshot + append log
+constexpr const char* MODULE_CONFIG_STORE_NAME = ".store";
+constexpr const char* MODULE_CONFIG_LOG_NAME = ".store.log";
 
 // Metamodule support
 constexpr const char* METAMODULE_MOUNT_SCRIPT = "metamount.sh";
@@ -57,12 +64,17 @@ constexpr const char* KSU_BACKUP_FILE_PREFIX = "ksu_backup_";
 constexpr const char* BACKUP_FILENAME = "stock_image.sha1";
 constexpr const char* UMOUNT_CONFIG_PATH = "/data/adb/ksu/.umount";
 
+// su broker: opt-in flag file and abstract socket name (no leading NUL)
+constexpr const char* SU_BROKER_FLAG_PATH = "/data/adb/ksu/.su_broker";
+constexpr const char* SU_BROKER_SOCKET_NAME = "ksu_su_broker";
+
 // Feature IDs - must match kernel definitions
 enum class FeatureId : uint32_t {
     SuCompat = 0,
     KernelUmount = 1,
     EnhancedSecurity = 2,
     SuLog = 100,
+    SuLogDedupWindow = 101,
 };
 
 // ioctl constants
@@ -3,15 +3,28 @@
 #include "../log.hpp"
 #include "../utils.hpp"
 
+#include "miniz.h"
+
 #include <fcntl.h>
+#include <sys/mount.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
 #include <cstdio>
 #include <cstring>
 #include <filesystem>
 #include <fstream>
+#include <mutex>
 #include <regex>
+#include <set>
+#include <sstream>
+#include <thread>
 
 namespace fs = std::filesystem;
 
@@ -20,6 +33,89 @@ namespace ksud {
 // Work directory for AK3 flash operations
 static constexpr const char* AK3_WORK_DIR = "/data/adb/ksu/tmp/ak3_flash";
 
+// Pre-extracted package and the unzip shim, inside the work directory
+static constexpr const char* AK3_TREE_SUBDIR = "/tree";
+static constexpr const char* AK3_SHIM_SUBDIR = "/bin";
+
+static constexpr const char* AK3_UPDATE_BINARY = "META-INF/com/google/android/update-binary";
+static constexpr const char* AK3_SCRIPT = "anykernel.sh";
+
+static constexpr unsigned AK3_MAX_EXTRACT_THREADS = 4;
+
+// MemAvailable left over after the package and AK3's boot image work files
+// before the work directory is put on tmpfs
+static constexpr uint64_t AK3_TMPFS_HEADROOM = 512ull * 1024 * 1024;
+
+// Overall progress at which each stage starts
+static constexpr float AK3_EXTRACT_START = 0.05f;
+static constexpr float AK3_FLASH_START = 0.3f;
+static constexpr float AK3_RESTORE_START = 0.95f;
+
+// Served in place of unzip to the AK3 script. update-binary wipes $AKHOME and
+// runs `unzip -o "$ZIPFILE"` in it; that exact call is satisfied with
+// hardlinks from the tree ksud already extracted, anything else goes to the
+// real unzip.
+static constexpr const char* AK3_UNZIP_SHIM = R"(#!/system/bin/sh
+if [ $# -eq 2 ] && [ "$1" = "-o" ] && [ "$2" = "$KSU_AK3_ZIP" ] && [ -d "$KSU_AK3_TREE" ]; then
+    cp -alf "$KSU_AK3_TREE/." . 2>/dev/null || cp -af "$KSU_AK3_TREE/." .
+    exit $?
+fi
+if [ -z "$KSU_AK3_UNZIP" ]; then
+    echo "unzip: not available" >&2
+    exit 127
+fi
+exec $KSU_AK3_UNZIP "$@"
+)";
+
+const char* ak3_stage_name(Ak3Stage stage) {
+    switch (stage) {
+    case Ak3Stage::Prepare:
+        return "prepare";
+    case Ak3Stage::Extract:
+        return "extract";
+    case Ak3Stage::Flash:
+        return "flash";
+    case Ak3Stage::Restore:
+        return "restore";
+    case Ak3Stage::Done:
+        return "done";
+    }
+    return "unknown";
+}
+
+static std::string json_escape(const std::string& s) {
+    std::string out;
+    out.reserve(s.size() + 2);
+    for (char c : s) {
+        switch (c) {
+        case '"':
+            out += "\\\"";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        case '\n':
+            out += "\\n";
+            break;
+        case '\r':
+            out += "\\r";
+            break;
+        case '\t':
+            out += "\\t";
+            break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                char buf[8];
+                snprintf(buf, sizeof(buf), "\\u%04x", c);
+                out += buf;
+            } else {
+                out += c;
+            }
+        }
+    }
+    return out;
+}
+
 /**
  * Check if device is A/B partitioned
  */
@@ -57,50 +153,359 @@ static bool set_slot_suffix(const std::string& slot) {
 }
 
 /**
- * Clean up work directory
+ * Clean up work directory, including a tmpfs left mounted on it
  */
 static void cleanup_workdir() {
+    umount2(AK3_WORK_DIR, MNT_DETACH);
     std::error_code ec;
     fs::remove_all(AK3_WORK_DIR, ec);
 }
 
 /**
- * Extract update-binary from AK3 zip
+ * MemAvailable from /proc/meminfo in bytes, 0 if unknown
  */
-static bool extract_update_binary(const std::string& zip_path, const std::string& workdir) {
-    std::string binary_path = workdir + "/META-INF/com/google/android/update-binary";
+static uint64_t mem_available() {
+    std::ifstream meminfo("/proc/meminfo");
+    std::string line;
+    while (std::getline(meminfo, line)) {
+        unsigned long long kb;
+        if (sscanf(line.c_str(), "MemAvailable: %llu kB", &kb) == 1)
+            return static_cast<uint64_t>(kb) * 1024;
+    }
+    return 0;
+}
 
-    // Create parent directories
-    fs::create_directories(workdir + "/META-INF/com/google/android");
+/**
+ * Create the work directory, on tmpfs if the package fits in memory with room
+ * to spare. Returns true if tmpfs was mounted.
+ */
+static bool setup_workdir(uint64_t package_bytes) {
+    cleanup_workdir();
+    fs::create_directories(AK3_WORK_DIR);
 
-    // Use unzip to extract update-binary
-    auto result =
-        exec_command({"unzip", "-o", "-j", zip_path, "META-INF/com/google/android/update-binary",
-                      "-d", workdir + "/META-INF/com/google/android"});
+    uint64_t avail = mem_available();
+    if (avail < package_bytes + AK3_TMPFS_HEADROOM) {
+        LOGI("AK3: %llu bytes available, extracting to disk",
+             static_cast<unsigned long long>(avail));
+        return false;
+    }
+    if (mount("tmpfs", AK3_WORK_DIR, "tmpfs", MS_NOSUID | MS_NODEV, "mode=0700") != 0) {
+        LOGW("AK3: failed to mount tmpfs on %s: %s", AK3_WORK_DIR, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+// Owns one miniz reader; each extraction thread opens its own
+struct ZipReader {
+    mz_zip_archive zip{};
+    bool ok = false;
+
+    explicit ZipReader(const std::string& path) {
+        ok = mz_zip_reader_init_file(&zip, path.c_str(), 0);
+    }
+    ~ZipReader() {
+        if (ok)
+            mz_zip_reader_end(&zip);
+    }
+    ZipReader(const ZipReader&) = delete;
+    ZipReader& operator=(const ZipReader&) = delete;
 
-    if (result.exit_code != 0) {
-        LOGE("Failed to extract update-binary: %s", result.stderr_str.c_str());
+    std::string error() { return mz_zip_get_error_string(mz_zip_get_last_error(&zip)); }
+};
+
+/**
+ * Read one entry of the zip into memory
+ */
+static bool read_zip_entry(ZipReader& reader, mz_uint index, std::string& out) {
+    size_t size = 0;
+    void* data = mz_zip_reader_extract_to_heap(&reader.zip, index, &size, 0);
+    if (!data)
         return false;
+    out.assign(static_cast<const char*>(data), size);
+    mz_free(data);
+    return true;
+}
+
+struct Ak3Entry {
+    mz_uint index;
+    std::string path;
+    uint64_t size;
+    mode_t mode;
+    bool is_dir;
+    bool is_symlink;
+};
+
+// Rejects absolute paths and ".." components, so nothing lands outside the tree
+static bool is_safe_entry_path(const std::string& path) {
+    if (path.empty() || path[0] == '/')
+        return false;
+    size_t pos = 0;
+    while (pos <= path.size()) {
+        size_t next = path.find('/', pos);
+        if (next == std::string::npos)
+            next = path.size();
+        if (path.compare(pos, next - pos, "..") == 0 && next - pos == 2)
+            return false;
+        pos = next + 1;
     }
+    return true;
+}
 
-    // Make it executable
-    chmod(binary_path.c_str(), 0755);
+/**
+ * List the entries of the package, largest first
+ */
+static bool plan_extraction(ZipReader& reader, std::vector<Ak3Entry>& entries, uint64_t& total,
+                            std::string& error) {
+    mz_uint count = mz_zip_reader_get_num_files(&reader.zip);
+    entries.reserve(count);
+    total = 0;
+
+    for (mz_uint i = 0; i < count; i++) {
+        mz_zip_archive_file_stat st;
+        if (!mz_zip_reader_file_stat(&reader.zip, i, &st)) {
+            error = "Failed to read zip entry " + std::to_string(i) + ": " + reader.error();
+            return false;
+        }
+
+        Ak3Entry entry;
+        entry.index = i;
+        entry.path = st.m_filename;
+        entry.size = st.m_uncomp_size;
+        entry.is_dir = st.m_is_directory;
+        while (!entry.path.empty() && entry.path.back() == '/')
+            entry.path.pop_back();
+        if (entry.path.empty())
+            continue;
+        if (!is_safe_entry_path(entry.path)) {
+            error = "Unsafe path in zip: " + entry.path;
+            return false;
+        }
+        if (!entry.is_dir && (st.m_is_encrypted || !st.m_is_supported)) {
+            error = "Unsupported zip entry: " + entry.path;
+            return false;
+        }
+
+        // Unix permissions live in the top half of the external attributes
+        mode_t unix_mode = 0;
+        if ((st.m_version_made_by >> 8) == 3)
+            unix_mode = static_cast<mode_t>(st.m_external_attr >> 16);
+        entry.is_symlink = !entry.is_dir && S_ISLNK(unix_mode);
+        entry.mode = unix_mode & 0777;
+        if (entry.mode == 0)
+            entry.mode = entry.is_dir ? 0755 : 0644;
+
+        if (!entry.is_dir && !entry.is_symlink)
+            total += entry.size;
+        entries.push_back(std::move(entry));
+    }
+
+    // Biggest files first so the threads finish at about the same time
+    std::stable_sort(entries.begin(), entries.end(),
+                     [](const Ak3Entry& a, const Ak3Entry& b) { return a.size > b.size; });
+    return true;
+}
+
+struct Ak3WriteSink {
+    int fd;
+    std::atomic<uint64_t>* bytes;
+};
+
+static size_t ak3_write_sink(void* opaque, mz_uint64 /*file_ofs*/, const void* buf, size_t n) {
+    auto* sink = static_cast<Ak3WriteSink*>(opaque);
+    const char* p = static_cast<const char*>(buf);
+    size_t left = n;
+    while (left > 0) {
+        ssize_t written = write(sink->fd, p, left);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return 0;
+        p += written;
+        left -= static_cast<size_t>(written);
+    }
+    sink->bytes->fetch_add(n, std::memory_order_relaxed);
+    return n;
+}
+
+// Shared between the extraction threads and the thread reporting progress
+struct Ak3ExtractJob {
+    std::string zip_path;
+    std::string dest;
+    const std::vector<Ak3Entry>* files;
+    std::atomic<size_t> next{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<bool> failed{false};
+
+    std::mutex lock;
+    std::condition_variable cond;
+    unsigned running = 0;
+    std::string error;
+
+    void fail(const std::string& msg) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!failed.exchange(true))
+            error = msg;
+    }
+};
+
+static void extract_worker(Ak3ExtractJob& job) {
+    ZipReader reader(job.zip_path);
+    if (!reader.ok) {
+        job.fail("Failed to open zip: " + reader.error());
+    }
+
+    while (reader.ok && !job.failed.load(std::memory_order_relaxed)) {
+        size_t i = job.next.fetch_add(1, std::memory_order_relaxed);
+        if (i >= job.files->size())
+            break;
+        const Ak3Entry& entry = (*job.files)[i];
+
+        std::string path = job.dest + "/" + entry.path;
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC,
+                      entry.mode);
+        if (fd < 0) {
+            job.fail("Failed to create " + path + ": " + strerror(errno));
+            break;
+        }
+        Ak3WriteSink sink{fd, &job.bytes};
+        bool ok = mz_zip_reader_extract_to_callback(&reader.zip, entry.index, ak3_write_sink,
+                                                    &sink, 0);
+        std::string error = ok ? "" : reader.error();
+        if (close(fd) != 0 && ok) {
+            ok = false;
+            error = strerror(errno);
+        }
+        if (!ok) {
+            job.fail("Failed to extract " + entry.path + ": " + error);
+            break;
+        }
+    }
 
-    return fs::exists(binary_path);
+    std::lock_guard<std::mutex> guard(job.lock);
+    job.running--;
+    job.cond.notify_all();
+}
+
+/**
+ * Extract the whole package into dest with a few threads, each on its own
+ * reader. Directories are created up front and symlinks last, so a symlink in
+ * the zip can never redirect where another entry is written.
+ */
+static bool extract_package(ZipReader& reader, const std::string& zip_path,
+                            const std::string& dest, const std::vector<Ak3Entry>& entries,
+                            const std::function<void(uint64_t)>& on_bytes, std::string& error) {
+    std::vector<Ak3Entry> files;
+    std::vector<const Ak3Entry*> links;
+    std::set<std::string> dirs;
+    dirs.insert(dest);
+    for (const auto& entry : entries) {
+        std::string path = dest + "/" + entry.path;
+        if (entry.is_dir) {
+            dirs.insert(path);
+            continue;
+        }
+        dirs.insert(path.substr(0, path.rfind('/')));
+        if (entry.is_symlink)
+            links.push_back(&entry);
+        else
+            files.push_back(entry);
+    }
+
+    for (const auto& dir : dirs) {
+        std::error_code ec;
+        fs::create_directories(dir, ec);
+        if (ec) {
+            error = "Failed to create " + dir + ": " + ec.message();
+            return false;
+        }
+    }
+
+    Ak3ExtractJob job;
+    job.zip_path = zip_path;
+    job.dest = dest;
+    job.files = &files;
+
+    unsigned threads = std::max(1u, std::min(std::thread::hardware_concurrency(),
+                                             AK3_MAX_EXTRACT_THREADS));
+    threads = std::max<unsigned>(1, std::min<size_t>(threads, files.size()));
+    job.running = threads;
+
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < threads; i++)
+        workers.emplace_back(extract_worker, std::ref(job));
+
+    // Report progress from this thread so callbacks never run concurrently
+    uint64_t reported = 0;
+    {
+        std::unique_lock<std::mutex> guard(job.lock);
+        while (job.running > 0) {
+            job.cond.wait_for(guard, std::chrono::milliseconds(100));
+            uint64_t bytes = job.bytes.load(std::memory_order_relaxed);
+            if (bytes != reported && job.running > 0) {
+                reported = bytes;
+                guard.unlock();
+                on_bytes(bytes);
+                guard.lock();
+            }
+        }
+    }
+    for (auto& worker : workers)
+        worker.join();
+
+    if (job.failed) {
+        error = job.error;
+        return false;
+    }
+
+    for (const Ak3Entry* entry : links) {
+        std::string target;
+        std::string path = dest + "/" + entry->path;
+        if (!read_zip_entry(reader, entry->index, target) ||
+            symlink(target.c_str(), path.c_str()) != 0) {
+            error = "Failed to create symlink " + entry->path;
+            return false;
+        }
+    }
+
+    on_bytes(job.bytes.load());
+    return true;
+}
+
+/**
+ * Real unzip for the shim to hand other calls to, empty if there is none
+ */
+static std::string find_real_unzip() {
+    if (access("/system/bin/unzip", X_OK) == 0)
+        return "/system/bin/unzip";
+    if (access(BUSYBOX_PATH, X_OK) == 0)
+        return std::string(BUSYBOX_PATH) + " unzip";
+    return "";
+}
+
+static bool write_unzip_shim(const std::string& dir) {
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+    std::string path = dir + "/unzip";
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0755);
+    if (fd < 0)
+        return false;
+    size_t len = strlen(AK3_UNZIP_SHIM);
+    bool ok = write(fd, AK3_UNZIP_SHIM, len) == static_cast<ssize_t>(len);
+    return close(fd) == 0 && ok;
 }
 
 /**
  * Check if zip contains AK3 structure
  */
 bool is_ak3_package(const std::string& zip_path) {
-    // Check for update-binary and anykernel.sh
-    auto result = exec_command({"unzip", "-l", zip_path});
-
-    if (result.exit_code != 0)
+    ZipReader reader(zip_path);
+    if (!reader.ok)
         return false;
 
-    bool has_binary = result.stdout_str.find("update-binary") != std::string::npos;
-    bool has_script = result.stdout_str.find("anykernel.sh") != std::string::npos;
+    // Check for update-binary and anykernel.sh
+    bool has_binary = mz_zip_reader_locate_file(&reader.zip, AK3_UPDATE_BINARY, nullptr, 0) >= 0;
+    bool has_script = mz_zip_reader_locate_file(&reader.zip, AK3_SCRIPT, nullptr, 0) >= 0;
 
     return has_binary && has_script;
 }
@@ -109,45 +514,44 @@ bool is_ak3_package(const std::string& zip_path) {
  * Get AK3 package info
  */
 std::string get_ak3_info(const std::string& zip_path) {
-    if (!is_ak3_package(zip_path)) {
+    ZipReader reader(zip_path);
+    if (!reader.ok)
         return "";
-    }
 
-    // Try to extract anykernel.sh and parse kernel info
-    std::string temp_dir = "/data/local/tmp/ak3_info_" + std::to_string(getpid());
-    fs::create_directories(temp_dir);
-
-    auto result = exec_command({"unzip", "-o", "-j", zip_path, "anykernel.sh", "-d", temp_dir});
+    // Parse kernel info out of anykernel.sh, read straight from the zip
+    int index = mz_zip_reader_locate_file(&reader.zip, AK3_SCRIPT, nullptr, 0);
+    std::string content;
+    if (index < 0 ||
+        mz_zip_reader_locate_file(&reader.zip, AK3_UPDATE_BINARY, nullptr, 0) < 0 ||
+        !read_zip_entry(reader, static_cast<mz_uint>(index), content)) {
+        return "";
+    }
 
-    std::string info;
-    if (result.exit_code == 0) {
-        std::ifstream script(temp_dir + "/anykernel.sh");
-        std::string line;
-        std::regex name_regex(R"(kernel\.string=(.+))");
-        std::regex device_regex(R"(device\.name\d*=(.+))");
-
-        std::smatch match;
-        std::string kernel_name, devices;
-
-        while (std::getline(script, line)) {
-            if (std::regex_search(line, match, name_regex)) {
-                kernel_name = match[1].str();
-            } else if (std::regex_search(line, match, device_regex)) {
-                if (!devices.empty())
-                    devices += ", ";
-                devices += match[1].str();
-            }
+    std::istringstream script(content);
+    std::string line;
+    std::regex name_regex(R"(kernel\.string=(.+))");
+    std::regex device_regex(R"(device\.name\d*=(.+))");
+
+    std::smatch match;
+    std::string kernel_name, devices;
+
+    while (std::getline(script, line)) {
+        if (std::regex_search(line, match, name_regex)) {
+            kernel_name = match[1].str();
+        } else if (std::regex_search(line, match, device_regex)) {
+            if (!devices.empty())
+                devices += ", ";
+            devices += match[1].str();
         }
+    }
 
-        if (!kernel_name.empty()) {
-            info = kernel_name;
-            if (!devices.empty()) {
-                info += " (devices: " + devices + ")";
-            }
+    std::string info;
+    if (!kernel_name.empty()) {
+        info = kernel_name;
+        if (!devices.empty()) {
+            info += " (devices: " + devices + ")";
         }
     }
-
-    fs::remove_all(temp_dir);
     return info;
 }
 
@@ -157,81 +561,105 @@ std::string get_ak3_info(const std::string& zip_path) {
 Ak3FlashResult flash_ak3(const Ak3FlashConfig& config, Ak3LogCallback log_callback,
                          Ak3ProgressCallback progress_callback) {
     Ak3FlashResult result;
+    uint64_t total_bytes = 0;
 
     auto log = [&](const std::string& msg) {
         result.logs.push_back(msg);
         if (log_callback) {
             log_callback(msg);
         }
-        if (config.verbose) {
+        if (config.json_progress) {
+            printf("{\"type\":\"log\",\"message\":\"%s\"}\n", json_escape(msg).c_str());
+            fflush(stdout);
+        } else if (config.verbose) {
             printf("%s\n", msg.c_str());
             fflush(stdout);
         }
     };
 
-    auto progress = [&](float p, const std::string& step) {
+    auto progress = [&](Ak3Stage stage, float p, const std::string& step, uint64_t bytes = 0) {
+        Ak3Progress event;
+        event.stage = stage;
+        event.percent = p;
+        event.bytes = bytes;
+        event.total_bytes = total_bytes;
+        event.message = step;
         if (progress_callback) {
-            progress_callback(p, step);
+            progress_callback(event);
         }
-        if (config.verbose) {
+        if (config.json_progress) {
+            printf("{\"type\":\"progress\",\"stage\":\"%s\",\"percent\":%.3f,\"bytes\":%llu,"
+                   "\"total\":%llu,\"message\":\"%s\"}\n",
+                   ak3_stage_name(stage), p, static_cast<unsigned long long>(bytes),
+                   static_cast<unsigned long long>(total_bytes), json_escape(step).c_str());
+            fflush(stdout);
+        } else if (config.verbose) {
             printf("[%3.0f%%] %s\n", p * 100, step.c_str());
             fflush(stdout);
         }
     };
 
     // Validate input
-    if (!fs::exists(config.zip_path)) {
+    char zip_realpath[PATH_MAX];
+    if (!realpath(config.zip_path.c_str(), zip_realpath)) {
         result.error = "Zip file not found: " + config.zip_path;
         return result;
     }
+    std::string zip_path = zip_realpath;
+
+    progress(Ak3Stage::Prepare, 0.0f, "Preparing...");
 
-    if (!is_ak3_package(config.zip_path)) {
+    ZipReader reader(zip_path);
+    if (!reader.ok || mz_zip_reader_locate_file(&reader.zip, AK3_UPDATE_BINARY, nullptr, 0) < 0 ||
+        mz_zip_reader_locate_file(&reader.zip, AK3_SCRIPT, nullptr, 0) < 0) {
         result.error = "Not a valid AnyKernel3 package";
         return result;
     }
 
-    progress(0.05f, "Preparing...");
-    log("Starting AnyKernel3 flash");
-    log("Package: " + config.zip_path);
-
-    // Clean up work directory
-    cleanup_workdir();
-    fs::create_directories(AK3_WORK_DIR);
-
-    progress(0.1f, "Copying zip file...");
-
-    // Copy zip to work directory
-    std::string work_zip = std::string(AK3_WORK_DIR) + "/kernel.zip";
-    {
-        std::ifstream src(config.zip_path, std::ios::binary);
-        std::ofstream dst(work_zip, std::ios::binary);
-        dst << src.rdbuf();
-    }
-
-    if (!fs::exists(work_zip)) {
-        result.error = "Failed to copy zip file";
-        cleanup_workdir();
+    std::vector<Ak3Entry> entries;
+    if (!plan_extraction(reader, entries, total_bytes, result.error)) {
         return result;
     }
 
-    progress(0.2f, "Extracting update-binary...");
-
-    // Extract update-binary
-    if (!extract_update_binary(work_zip, AK3_WORK_DIR)) {
-        result.error = "Failed to extract update-binary";
+    log("Starting AnyKernel3 flash");
+    log("Package: " + zip_path);
+
+    bool on_tmpfs = setup_workdir(total_bytes);
+    log(std::string("Work directory: ") + AK3_WORK_DIR + (on_tmpfs ? " (tmpfs)" : ""));
+
+    // Extract everything once; the script's own unzip is served from this tree
+    std::string tree_dir = std::string(AK3_WORK_DIR) + AK3_TREE_SUBDIR;
+    std::string shim_dir = std::string(AK3_WORK_DIR) + AK3_SHIM_SUBDIR;
+    progress(Ak3Stage::Extract, AK3_EXTRACT_START, "Extracting package...");
+    auto on_bytes = [&](uint64_t bytes) {
+        float frac = total_bytes > 0 ? static_cast<float>(bytes) / total_bytes : 1.0f;
+        progress(Ak3Stage::Extract,
+                 AK3_EXTRACT_START + frac * (AK3_FLASH_START - AK3_EXTRACT_START),
+                 "Extracting package...", bytes);
+    };
+    auto extract_start = std::chrono::steady_clock::now();
+    if (!extract_package(reader, zip_path, tree_dir, entries, on_bytes, result.error) ||
+        !write_unzip_shim(shim_dir)) {
+        if (result.error.empty())
+            result.error = "Failed to write unzip shim";
+        log(result.error);
         cleanup_workdir();
         return result;
     }
+    auto extract_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                          std::chrono::steady_clock::now() - extract_start)
+                          .count();
+    log("Extracted " + std::to_string(entries.size()) + " entries (" +
+        std::to_string(total_bytes) + " bytes) in " + std::to_string(extract_ms) + " ms");
 
-    std::string binary_path =
-        std::string(AK3_WORK_DIR) + "/META-INF/com/google/android/update-binary";
+    std::string binary_path = tree_dir + "/" + AK3_UPDATE_BINARY;
 
     // Handle A/B slot selection
     std::string original_slot;
     bool need_restore_slot = false;
 
     if (is_ab_device() && config.slot.has_value()) {
-        progress(0.25f, "Setting target slot...");
+        progress(Ak3Stage::Prepare, AK3_FLASH_START, "Setting target slot...");
         original_slot = get_current_slot();
 
         std::string target_slot = config.slot.value();
@@ -251,7 +679,7 @@ Ak3FlashResult flash_ak3(const Ak3FlashConfig& config, Ak3LogCallback log_callba
         }
     }
 
-    progress(0.3f, "Flashing kernel...");
+    progress(Ak3Stage::Flash, AK3_FLASH_START, "Flashing kernel...");
     log("Executing update-binary...");
 
     // Execute update-binary
@@ -265,6 +693,11 @@ Ak3FlashResult flash_ak3(const Ak3FlashConfig& config, Ak3LogCallback log_callba
         return result;
     }
 
+    std::string real_unzip = find_real_unzip();
+    const char* old_path = getenv("PATH");
+    std::string path_env = shim_dir + ":" + (old_path ? old_path : "/system/bin");
+
+    log_flush();
     pid_t pid = fork();
     if (pid == -1) {
         result.error = "Failed to fork";
@@ -280,8 +713,12 @@ Ak3FlashResult flash_ak3(const Ak3FlashConfig& config, Ak3LogCallback log_callba
 
         // Set environment variables
         setenv("POSTINSTALL", AK3_WORK_DIR, 1);
-        setenv("ZIPFILE", work_zip.c_str(), 1);
+        setenv("ZIPFILE", zip_path.c_str(), 1);
         setenv("OUTFD", std::to_string(pipefd[1]).c_str(), 1);
+        setenv("PATH", path_env.c_str(), 1);
+        setenv("KSU_AK3_ZIP", zip_path.c_str(), 1);
+        setenv("KSU_AK3_TREE", tree_dir.c_str(), 1);
+        setenv("KSU_AK3_UNZIP", real_unzip.c_str(), 1);
 
         // Write slot to file if specified
         if (config.slot.has_value()) {
@@ -291,8 +728,9 @@ Ak3FlashResult flash_ak3(const Ak3FlashConfig& config, Ak3LogCallback log_callba
 
         // Execute update-binary
         // Args: update-binary <api_version> <output_fd> <zip_path>
+        log_flush();
         execl("/system/bin/sh", "sh", binary_path.c_str(), "3", std::to_string(pipefd[1]).c_str(),
-              work_zip.c_str(), nullptr);
+              zip_path.c_str(), nullptr);
 
         _exit(127);
     }
@@ -326,15 +764,15 @@ Ak3FlashResult flash_ak3(const Ak3FlashConfig& config, Ak3LogCallback log_callba
                 // Update progress based on keywords
                 if (msg.find("extracting") != std::string::npos ||
                     msg.find("Extracting") != std::string::npos) {
-                    progress(0.5f, "Extracting...");
+                    progress(Ak3Stage::Flash, 0.5f, "Extracting...");
                 } else if (msg.find("installing") != std::string::npos ||
                            msg.find("Installing") != std::string::npos ||
                            msg.find("Flashing") != std::string::npos) {
-                    progress(0.7f, "Installing...");
+                    progress(Ak3Stage::Flash, 0.7f, "Installing...");
                 } else if (msg.find("complete") != std::string::npos ||
                            msg.find("Complete") != std::string::npos ||
                            msg.find("Done") != std::string::npos) {
-                    progress(0.9f, "Completing...");
+                    progress(Ak3Stage::Flash, 0.9f, "Completing...");
                 }
             }
         }
@@ -348,7 +786,7 @@ Ak3FlashResult flash_ak3(const Ak3FlashConfig& config, Ak3LogCallback log_callba
 
     // Restore original slot if needed
     if (need_restore_slot && !original_slot.empty()) {
-        progress(0.95f, "Restoring original slot...");
+        progress(Ak3Stage::Restore, AK3_RESTORE_START, "Restoring original slot...");
         set_slot_suffix(original_slot);
         log("Restored slot to: " + original_slot);
     }
@@ -357,7 +795,7 @@ Ak3FlashResult flash_ak3(const Ak3FlashConfig& config, Ak3LogCallback log_callba
     int exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
 
     if (exit_code == 0) {
-        progress(1.0f, "Flash complete!");
+        progress(Ak3Stage::Done, 1.0f, "Flash complete!");
         log("Flash completed successfully");
         result.success = true;
         result.exit_code = 0;
@@ -397,6 +835,7 @@ int cmd_flash(const std::vector<std::string>& args) {
         printf("  --slot <a|b>         Target slot for A/B devices\n");
         printf("  --log <file>         Save flash log to file\n");
         printf("  -v, --verbose        Verbose output\n");
+        printf("  --json-progress      Print progress and log lines as JSON, one per line\n");
         return 1;
     }
 
@@ -404,7 +843,8 @@ int cmd_flash(const std::vector<std::string>& args) {
 
     if (subcmd == "ak3") {
         if (args.size() < 2) {
-            printf("Usage: ksud flash ak3 <zip> [--slot a|b] [--log <file>] [-v]\n");
+            printf("Usage: ksud flash ak3 <zip> [--slot a|b] [--log <file>] [-v] "
+                   "[--json-progress]\n");
             return 1;
         }
 
@@ -419,9 +859,21 @@ int cmd_flash(const std::vector<std::string>& args) {
                 config.log_file = args[++i];
             } else if (args[i] == "-v" || args[i] == "--verbose") {
                 config.verbose = true;
+            } else if (args[i] == "--json-progress") {
+                config.json_progress = true;
             }
         }
 
+        if (config.json_progress) {
+            auto result = flash_ak3(config);
+            printf("{\"type\":\"result\",\"success\":%s,\"exit_code\":%d,"
+                   "\"error\":\"%s\"}\n",
+                   result.success ? "true" : "false", result.exit_code,
+                   json_escape(result.error).c_str());
+            fflush(stdout);
+            return result.success ? 0 : 1;
+        }
+
         printf("Flashing AnyKernel3 package: %s\n", config.zip_path.c_str());
         fflush(stdout);
 
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <functional>
 #include <optional>
 #include <string>
@@ -13,6 +14,7 @@ struct Ak3FlashConfig {
     std::optional<std::string> slot;      // Target slot (a/b), empty for current
     bool verbose = false;                 // Verbose output
     std::optional<std::string> log_file;  // Log output to file
+    bool json_progress = false;           // Print progress and log lines as JSON
 };
 
 // Flash result
@@ -23,8 +25,29 @@ struct Ak3FlashResult {
     std::vector<std::string> logs;
 };
 
+// Flash pipeline stages, in the order they run
+enum class Ak3Stage {
+    Prepare,  // Validating the package and setting up the work directory
+    Extract,  // Unpacking the zip into the work directory
+    Flash,    // Running the AnyKernel3 script
+    Restore,  // Putting back the original slot suffix
+    Done,
+};
+
+// One progress event
+struct Ak3Progress {
+    Ak3Stage stage = Ak3Stage::Prepare;
+    float percent = 0.0f;      // Overall progress, 0.0 - 1.0
+    uint64_t bytes = 0;        // Bytes extracted so far
+    uint64_t total_bytes = 0;  // Uncompressed size of the package
+    std::string message;
+};
+
+// Stable lowercase name of a stage, as used in the JSON output
+const char* ak3_stage_name(Ak3Stage stage);
+
 // Progress callback
-using Ak3ProgressCallback = std::function<void(float progress, const std::string& step)>;
+using Ak3ProgressCallback = std::function<void(const Ak3Progress& progress)>;
 
 // Log callback
 using Ak3LogCallback = std::function<void(const std::string& line)>;
@@ -32,8 +55,10 @@ using Ak3LogCallback = std::function<void(const std::string& line)>;
 /**
  * Flash AnyKernel3 zip package
  *
- * This extracts the update-binary from the zip and executes it with proper
- * environment variables set for AnyKernel3 operation.
+ * This extracts the zip in-process (on tmpfs when there is enough memory) and
+ * executes its update-binary with proper environment variables set for
+ * AnyKernel3 operation. The script's own unzip of the package is served from
+ * the already extracted tree.
  *
  * @param config Flash configuration
  * @param log_callback Optional callback for log output
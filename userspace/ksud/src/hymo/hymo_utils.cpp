@@ -8,6 +8,7 @@
 #include <sys/syscall.h>
 #include <sys/xattr.h>
 #include <unistd.h>
+#include <algorithm>
 #include <cstring>
 #include <ctime>
 #include <fstream>
@@ -26,32 +27,57 @@ Logger& Logger::getInstance() {
 void Logger::init(bool verbose, const fs::path& log_path) {
     verbose_ = verbose;
 
+    // Called again once the config is loaded, usually with the same file
+    if (log_fd_ >= 0 && log_path == log_path_)
+        return;
+
+    // Lines still queued reference the old fd; if the writer didn't drain
+    // them, leave it open rather than let them hit a reused fd number
+    if (log_fd_ >= 0) {
+        if (ksud::log_flush())
+            close(log_fd_);
+        log_fd_ = -1;
+    }
+
+    log_path_ = log_path;
     if (!log_path.empty()) {
         if (log_path.has_parent_path()) {
-            fs::create_directories(log_path.parent_path());
+            std::error_code ec;
+            fs::create_directories(log_path.parent_path(), ec);
         }
-        log_file_ = std::make_unique<std::ofstream>(log_path, std::ios::app);
+        log_fd_ = open(log_path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
     }
 }
 
-void Logger::log(const std::string& level, const std::string& message) {
+void Logger::log(const char* level, const std::string& message) {
     // Skip DEBUG messages if not in verbose mode
-    if (level == "DEBUG" && !verbose_) {
+    if (!verbose_ && strcmp(level, "DEBUG") == 0) {
         return;
     }
 
-    auto now = std::time(nullptr);
-    char time_buf[64];
-    std::strftime(time_buf, sizeof(time_buf), "%Y-%m-%d %H:%M:%S", std::localtime(&now));
+    // Per-thread line buffer; the timestamp is only reformatted once a second
+    thread_local char line[1024];
+    thread_local time_t last_time = 0;
+    thread_local char time_buf[32];
+
+    time_t now = std::time(nullptr);
+    if (now != last_time) {
+        struct tm tm_info;
+        localtime_r(&now, &tm_info);
+        std::strftime(time_buf, sizeof(time_buf), "%Y-%m-%d %H:%M:%S", &tm_info);
+        last_time = now;
+    }
 
-    std::string log_line = std::string("[") + time_buf + "] [" + level + "] " + message + "\n";
+    int n = snprintf(line, sizeof(line) - 1, "[%s] [%s] %.*s", time_buf, level,
+                     static_cast<int>(message.size()), message.c_str());
+    size_t len = std::min(static_cast<size_t>(n > 0 ? n : 0), sizeof(line) - 2);
+    line[len++] = '\n';
 
-    if (log_file_ && log_file_->is_open()) {
-        *log_file_ << log_line;
-        log_file_->flush();
+    if (log_fd_ >= 0) {
+        ksud::log_submit(log_fd_, STDERR_FILENO, line, len);
+    } else {
+        ksud::log_submit(STDERR_FILENO, -1, line, len);
     }
-
-    std::cerr << log_line;
 }
 
 // File system utilities
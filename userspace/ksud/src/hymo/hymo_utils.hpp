@@ -4,6 +4,7 @@
 #include <filesystem>
 #include <memory>
 #include <string>
+#include "../log.hpp"
 
 namespace fs = std::filesystem;
 
@@ -14,18 +15,30 @@ class Logger {
 public:
     static Logger& getInstance();
     void init(bool verbose, const fs::path& log_path);
-    void log(const std::string& level, const std::string& message);
+    void log(const char* level, const std::string& message);
+    bool verbose() const { return verbose_; }
 
 private:
     Logger() = default;
     bool verbose_ = false;
-    std::unique_ptr<std::ofstream> log_file_;
+    int log_fd_ = -1;
+    fs::path log_path_;
 };
 
+// Lines go through the ksud log backend (async, file kept open). Disabled
+// levels skip building the message; KSUD_LOG_MIN_LEVEL compiles them out.
 #define LOG_INFO(msg) Logger::getInstance().log("INFO", msg)
 #define LOG_WARN(msg) Logger::getInstance().log("WARN", msg)
 #define LOG_ERROR(msg) Logger::getInstance().log("ERROR", msg)
-#define LOG_DEBUG(msg) Logger::getInstance().log("DEBUG", msg)
+#if KSUD_LOG_MIN_LEVEL <= 1
+#define LOG_DEBUG(msg)                                  \
+    do {                                                \
+        if (Logger::getInstance().verbose())            \
+            Logger::getInstance().log("DEBUG", msg);    \
+    } while (0)
+#else
+#define LOG_DEBUG(msg) ((void)0)
+#endif // #if KSUD_LOG_MIN_LEVEL <= 1
 
 // File system utilities
 bool ensure_dir_exists(const fs::path& path);
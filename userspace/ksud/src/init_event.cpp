@@ -4,12 +4,14 @@
 #include "core/hide_bootloader.hpp"
 #include "core/ksucalls.hpp"
 #include "core/restorecon.hpp"
+#include "core/task_graph.hpp"
 #include "defs.hpp"
 #include "log.hpp"
 #include "module/metamodule.hpp"
 #include "module/module.hpp"
 #include "module/module_config.hpp"
 #include "profile/profile.hpp"
+#include "su_broker.hpp"
 #include "umount.hpp"
 #include "utils.hpp"
 
@@ -17,10 +19,14 @@
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <unistd.h>
+#include <chrono>
 #include <cstring>
 
 namespace ksud {
 
+// Threads for the post-fs-data task graph, the main thread included
+static constexpr unsigned POST_FS_DATA_THREADS = 3;
+
 // Catch boot logs (logcat/dmesg) to file
 static void catch_bootlog(const char* logname, const std::vector<const char*>& command) {
     ensure_dir_exists(LOG_DIR);
@@ -51,6 +57,7 @@ static void catch_bootlog(const char* logname, const std::vector<const char*>& c
         // Open log file for stdout
         int fd = open(bootlog.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
         if (fd < 0) {
+            log_flush();
             _exit(1);
         }
         dup2(fd, STDOUT_FILENO);
@@ -67,6 +74,7 @@ static void catch_bootlog(const char* logname, const std::vector<const char*>& c
         }
         argv.push_back(nullptr);
 
+        log_flush();
         execvp("timeout", const_cast<char* const*>(argv.data()));
         _exit(127);
     }
@@ -101,6 +109,7 @@ static void run_stage(const std::string& stage, bool block) {
 
 int on_post_data_fs() {
     LOGI("post-fs-data triggered");
+    auto start = std::chrono::steady_clock::now();
 
     // Report to kernel first
     report_post_fs_data();
@@ -148,23 +157,22 @@ int on_post_data_fs() {
         return 0;
     }
 
-    // Handle updated modules
-    handle_updated_modules();
-
-    // Prune modules marked for removal
-    prune_modules();
-
-    // Restorecon
-    restorecon("/data/adb", true);
-
-    // Load sepolicy rules from modules
-    load_sepolicy_rule();
-
-    // Apply profile sepolicies
-    apply_profile_sepolies();
-
-    // Load feature config (with init_features handling managed features)
-    init_features();
+    // Module housekeeping, labels, sepolicy and features, overlapped where
+    // they don't depend on each other. Everything here finishes before any
+    // module script runs. The driver fd was already opened by
+    // report_post_fs_data(), so tasks don't race to open it.
+    TaskGraph graph("post-fs-data");
+    size_t update = graph.add("handle_updated_modules", [] { handle_updated_modules(); });
+    size_t prune = graph.add("prune_modules", [] { prune_modules(); }, {update});
+    // Labels the module files installed or kept by the two steps above
+    graph.add("restorecon", [] { restorecon("/data/adb", true); }, {prune});
+    // Only reads sepolicy.rule of the final module set; no need for labels
+    size_t rules = graph.add("load_sepolicy_rule", [] { load_sepolicy_rule(); }, {prune});
+    // Patches the same live policy, so kept after the module rules
+    graph.add("apply_profile_sepolies", [] { apply_profile_sepolies(); }, {rules});
+    // Needs the managed features of the final module set
+    graph.add("init_features", [] { init_features(); }, {prune});
+    graph.run(POST_FS_DATA_THREADS);
 
     // Execute metamodule post-fs-data script first (priority)
     metamodule_exec_stage_script("post-fs-data", true);
@@ -186,7 +194,10 @@ int on_post_data_fs() {
 
     chdir("/");
 
-    LOGI("post-fs-data completed");
+    LOGI("post-fs-data completed in %lld ms",
+         static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                    std::chrono::steady_clock::now() - start)
+                                    .count()));
     return 0;
 }
 
@@ -198,6 +209,10 @@ void on_services() {
     hide_bootloader_status();
 
     run_stage("service", false);
+
+    // Opt-in root broker for high-frequency `su -c` callers
+    su_broker_start_if_enabled();
+
     LOGI("services completed");
 }
 
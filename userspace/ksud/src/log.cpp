@@ -1,6 +1,13 @@
 #include "log.hpp"
+#include <fcntl.h>
+#include <pthread.h>
+#include <semaphore.h>
 #include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <ctime>
 #ifdef __ANDROID__
@@ -12,66 +19,299 @@ namespace ksud {
 static LogLevel g_log_level = LogLevel::INFO;
 static char g_log_tag[32] = "KernelSU";
 
+// Opened once on first use and kept for the life of the process; -1 if
+// unavailable
+static int g_log_main_fd = -1;
+static pthread_once_t g_main_fd_once = PTHREAD_ONCE_INIT;
+
+// Bounded MPMC ring (Vyukov): producers claim a slot with one CAS, the
+// writer thread is the only consumer. A full ring makes the producer wait
+// for the writer; only a writer stuck for LOG_FULL_WAIT_SEC makes it write
+// the line itself, so no line is ever dropped.
+static constexpr size_t RING_SLOTS = 128;
+static constexpr size_t LOG_LINE_MAX = 1152;
+static constexpr time_t LOG_FULL_WAIT_SEC = 1;
+
+struct LogSlot {
+    std::atomic<size_t> seq;
+    int fd;
+    int extra_fd;
+    uint16_t len;
+    uint16_t extra_offset;
+    char line[LOG_LINE_MAX];
+};
+
+static LogSlot g_ring[RING_SLOTS];
+static std::atomic<size_t> g_enqueue_pos{0};
+static size_t g_dequeue_pos = 0;  // writer thread only
+static std::atomic<bool> g_async{false};
+static bool g_forked_child = false;
+static bool g_sync_only = false;
+
+static pthread_once_t g_writer_once = PTHREAD_ONCE_INIT;
+static sem_t g_writer_sem;
+// Flush and full-ring waiters: g_written is the count of lines the writer
+// has handled
+static pthread_mutex_t g_flush_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_flush_cond = PTHREAD_COND_INITIALIZER;
+static size_t g_written = 0;
+
 void log_init(const char* tag) {
     strncpy(g_log_tag, tag, sizeof(g_log_tag) - 1);
     g_log_tag[sizeof(g_log_tag) - 1] = '\0';
 }
 
+void log_set_sync() {
+    g_sync_only = true;
+}
+
 void log_set_level(LogLevel level) {
     g_log_level = level;
 }
 
+static void write_fully(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return;
+        data += n;
+        len -= static_cast<size_t>(n);
+    }
+}
+
+static void write_line(int fd, int extra_fd, const char* line, size_t len, size_t extra_offset) {
+    write_fully(fd, line, len);
+    if (extra_fd >= 0 && extra_offset < len)
+        write_fully(extra_fd, line + extra_offset, len - extra_offset);
+}
+
+static void* log_writer_main(void*) {
+    // Lines for the same fd are coalesced into one write
+    char batch[16384];
+    size_t batch_len = 0;
+    int batch_fd = -1;
+
+    auto flush_batch = [&]() {
+        if (batch_len > 0)
+            write_fully(batch_fd, batch, batch_len);
+        batch_len = 0;
+    };
+
+    for (;;) {
+        while (sem_wait(&g_writer_sem) != 0 && errno == EINTR) {
+        }
+
+        size_t handled = 0;
+        for (;;) {
+            LogSlot& slot = g_ring[g_dequeue_pos % RING_SLOTS];
+            if (slot.seq.load(std::memory_order_acquire) != g_dequeue_pos + 1)
+                break;
+
+            if (slot.fd != batch_fd || batch_len + slot.len > sizeof(batch)) {
+                flush_batch();
+                batch_fd = slot.fd;
+            }
+            memcpy(batch + batch_len, slot.line, slot.len);
+            batch_len += slot.len;
+            if (slot.extra_fd >= 0 && slot.extra_offset < slot.len) {
+                write_fully(slot.extra_fd, slot.line + slot.extra_offset,
+                            slot.len - slot.extra_offset);
+            }
+
+            slot.seq.store(g_dequeue_pos + RING_SLOTS, std::memory_order_release);
+            g_dequeue_pos++;
+            handled++;
+        }
+        flush_batch();
+
+        if (handled > 0) {
+            pthread_mutex_lock(&g_flush_lock);
+            g_written += handled;
+            pthread_cond_broadcast(&g_flush_cond);
+            pthread_mutex_unlock(&g_flush_lock);
+        }
+    }
+    return nullptr;
+}
+
+static void log_atfork_child() {
+    // The writer thread doesn't exist in the child; write directly there.
+    // Children mostly end in exec or _exit, which would lose anything queued,
+    // so they never start a writer of their own either.
+    g_async.store(false, std::memory_order_relaxed);
+    g_forked_child = true;
+}
+
+// Registered before main, so a child forked before the first log line is
+// covered too
+[[maybe_unused]] static const int g_atfork_registered =
+    pthread_atfork(nullptr, nullptr, log_atfork_child);
+
+static void log_exit_flush() {
+    log_flush();
+}
+
+static void log_start_writer() {
+    if (g_forked_child || g_sync_only)
+        return;
+
+    for (size_t i = 0; i < RING_SLOTS; i++)
+        g_ring[i].seq.store(i, std::memory_order_relaxed);
+
+    if (sem_init(&g_writer_sem, 0, 0) != 0)
+        return;
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_t thread;
+    int ret = pthread_create(&thread, &attr, log_writer_main, nullptr);
+    pthread_attr_destroy(&attr);
+    if (ret != 0)
+        return;
+
+    atexit(log_exit_flush);
+    g_async.store(true, std::memory_order_release);
+}
+
+// Waits until the writer has freed the slot for pos; false if it made no
+// progress before deadline. The writer publishes freed slots before it
+// takes g_flush_lock to broadcast, so the check under the lock can't miss it.
+static bool wait_for_slot(const LogSlot& slot, size_t pos, const struct timespec& deadline) {
+    sem_post(&g_writer_sem);
+    pthread_mutex_lock(&g_flush_lock);
+    int ret = 0;
+    while (static_cast<intptr_t>(slot.seq.load(std::memory_order_acquire) - pos) < 0 &&
+           ret != ETIMEDOUT) {
+        ret = pthread_cond_timedwait(&g_flush_cond, &g_flush_lock, &deadline);
+    }
+    pthread_mutex_unlock(&g_flush_lock);
+    return ret != ETIMEDOUT;
+}
+
+void log_submit(int fd, int extra_fd, const char* line, size_t len, size_t extra_offset) {
+    pthread_once(&g_writer_once, log_start_writer);
+
+    if (len > LOG_LINE_MAX)
+        len = LOG_LINE_MAX;
+    if (!g_async.load(std::memory_order_acquire)) {
+        write_line(fd, extra_fd, line, len, extra_offset);
+        return;
+    }
+
+    size_t pos = g_enqueue_pos.load(std::memory_order_relaxed);
+    LogSlot* slot;
+    struct timespec deadline = {0, 0};
+    for (;;) {
+        slot = &g_ring[pos % RING_SLOTS];
+        size_t seq = slot->seq.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+        if (diff == 0) {
+            if (g_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            // Full: wait for the writer; a stuck sink must not hang us, so
+            // after a while write the line directly, out of order
+            if (deadline.tv_sec == 0) {
+                clock_gettime(CLOCK_REALTIME, &deadline);
+                deadline.tv_sec += LOG_FULL_WAIT_SEC;
+            }
+            if (!wait_for_slot(*slot, pos, deadline)) {
+                write_line(fd, extra_fd, line, len, extra_offset);
+                return;
+            }
+            pos = g_enqueue_pos.load(std::memory_order_relaxed);
+        } else {
+            pos = g_enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->fd = fd;
+    slot->extra_fd = extra_fd;
+    slot->len = static_cast<uint16_t>(len);
+    slot->extra_offset = static_cast<uint16_t>(extra_offset);
+    memcpy(slot->line, line, len);
+    slot->seq.store(pos + 1, std::memory_order_release);
+    sem_post(&g_writer_sem);
+}
+
+bool log_flush() {
+    if (!g_async.load(std::memory_order_acquire))
+        return true;
+
+    size_t target = g_enqueue_pos.load(std::memory_order_acquire);
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += 1;
+
+    pthread_mutex_lock(&g_flush_lock);
+    // Bounded wait, so a stuck sink can't hang process exit
+    while (g_written < target) {
+        if (pthread_cond_timedwait(&g_flush_cond, &g_flush_lock, &deadline) == ETIMEDOUT)
+            break;
+    }
+    bool drained = g_written >= target;
+    pthread_mutex_unlock(&g_flush_lock);
+    return drained;
+}
+
+static void open_main_fd() {
+    g_log_main_fd = open("/dev/log/main", O_WRONLY | O_CLOEXEC);
+}
+
 static void log_write(LogLevel level, const char* fmt, va_list args) {
     if (level < g_log_level)
         return;
 
-    const char* level_str;
-    int android_level;
+    char level_char;
     switch (level) {
     case LogLevel::VERBOSE:
-        level_str = "V";
-        android_level = 2;
+        level_char = 'V';
         break;
     case LogLevel::DEBUG:
-        level_str = "D";
-        android_level = 3;
+        level_char = 'D';
         break;
     case LogLevel::INFO:
-        level_str = "I";
-        android_level = 4;
+        level_char = 'I';
         break;
     case LogLevel::WARN:
-        level_str = "W";
-        android_level = 5;
+        level_char = 'W';
         break;
     case LogLevel::ERROR:
-        level_str = "E";
-        android_level = 6;
+        level_char = 'E';
         break;
     default:
-        level_str = "?";
-        android_level = 4;
+        level_char = '?';
         break;
     }
 
-    char msg[1024];
-    vsnprintf(msg, sizeof(msg), fmt, args);
+    pthread_once(&g_main_fd_once, open_main_fd);
 
-    // Try Android log first
-    FILE* log_file = fopen("/dev/log/main", "w");
-    if (log_file) {
-        // Android log format: priority, tag, message
-        fprintf(log_file, "%c/%s: %s\n", level_str[0], g_log_tag, msg);
-        fclose(log_file);
-    }
+    // Per-thread buffer; the timestamp is only reformatted once a second
+    thread_local char line[LOG_LINE_MAX];
+    thread_local time_t last_time = 0;
+    thread_local char time_buf[32];
 
-    // Also write to stderr for debugging
     time_t now = time(nullptr);
-    struct tm* tm_info = localtime(&now);
-    char time_buf[32];
-    strftime(time_buf, sizeof(time_buf), "%m-%d %H:%M:%S", tm_info);
+    if (now != last_time) {
+        struct tm tm_info;
+        localtime_r(&now, &tm_info);
+        strftime(time_buf, sizeof(time_buf), "%m-%d %H:%M:%S", &tm_info);
+        last_time = now;
+    }
+
+    // stderr gets "<time> L/tag: msg", /dev/log/main the part after the time
+    int prefix = snprintf(line, sizeof(line), "%s ", time_buf);
+    int head = snprintf(line + prefix, sizeof(line) - prefix, "%c/%s: ", level_char, g_log_tag);
+    size_t len = static_cast<size_t>(prefix + head);
+    int n = vsnprintf(line + len, sizeof(line) - len - 1, fmt, args);
+    if (n > 0)
+        len += std::min(static_cast<size_t>(n), sizeof(line) - len - 2);
+    line[len++] = '\n';
 
-    fprintf(stderr, "%s %s/%s: %s\n", time_buf, level_str, g_log_tag, msg);
+    log_submit(STDERR_FILENO, g_log_main_fd, line, len, static_cast<size_t>(prefix));
 }
 
 void log_v(const char* fmt, ...) {
@@ -1,8 +1,15 @@
 #pragma once
 
 #include <cstdarg>
+#include <cstddef>
 #include <string>
 
+// Levels below this are compiled out at the call site
+// (0 = VERBOSE, 1 = DEBUG, 2 = INFO, 3 = WARN, 4 = ERROR)
+#ifndef KSUD_LOG_MIN_LEVEL
+#define KSUD_LOG_MIN_LEVEL 0
+#endif // #ifndef KSUD_LOG_MIN_LEVEL
+
 namespace ksud {
 
 enum class LogLevel {
@@ -15,17 +22,46 @@ enum class LogLevel {
 
 void log_init(const char* tag);
 void log_set_level(LogLevel level);
+// Write every line directly instead of starting the writer thread; for
+// short-lived processes, call before the first log line
+void log_set_sync();
 void log_v(const char* fmt, ...);
 void log_d(const char* fmt, ...);
 void log_i(const char* fmt, ...);
 void log_w(const char* fmt, ...);
 void log_e(const char* fmt, ...);
 
+// Backend shared with the hymo logger. The line is copied into a ring and
+// written by a background thread to fd, and from extra_offset on to
+// extra_fd (if >= 0). Falls back to a direct write when the ring is
+// unavailable, e.g. in a forked child.
+void log_submit(int fd, int extra_fd, const char* line, size_t len, size_t extra_offset = 0);
+
+// Wait until everything submitted so far has been written; false if the
+// writer didn't get there within the timeout
+bool log_flush();
+
 // Helper macros
+#if KSUD_LOG_MIN_LEVEL <= 0
 #define LOGV(...) ksud::log_v(__VA_ARGS__)
+#else
+#define LOGV(...) ((void)0)
+#endif // #if KSUD_LOG_MIN_LEVEL <= 0
+#if KSUD_LOG_MIN_LEVEL <= 1
 #define LOGD(...) ksud::log_d(__VA_ARGS__)
+#else
+#define LOGD(...) ((void)0)
+#endif // #if KSUD_LOG_MIN_LEVEL <= 1
+#if KSUD_LOG_MIN_LEVEL <= 2
 #define LOGI(...) ksud::log_i(__VA_ARGS__)
+#else
+#define LOGI(...) ((void)0)
+#endif // #if KSUD_LOG_MIN_LEVEL <= 2
+#if KSUD_LOG_MIN_LEVEL <= 3
 #define LOGW(...) ksud::log_w(__VA_ARGS__)
+#else
+#define LOGW(...) ((void)0)
+#endif // #if KSUD_LOG_MIN_LEVEL <= 3
 #define LOGE(...) ksud::log_e(__VA_ARGS__)
 
 }  // namespace ksud
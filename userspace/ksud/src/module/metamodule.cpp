@@ -1,4 +1,5 @@
 #include "metamodule.hpp"
+#include "../core/ksucalls.hpp"
 #include "../defs.hpp"
 #include "../hymo/hymo_cli.hpp"
 #include "../log.hpp"
@@ -44,6 +45,8 @@ static int run_script(const std::string& script, bool block) {
         setenv("KSU_VER", KSUD_VERSION, 1);
         setenv("PATH", "/data/adb/ksu/bin:/data/adb/ap/bin:/system/bin:/vendor/bin", 1);
 
+        pass_driver_fd_to_child();
+        log_flush();
         execl(busybox_path, "sh", script_path, nullptr);
         _exit(127);
     }
@@ -112,6 +115,8 @@ int metamodule_exec_mount_script() {
             setenv("MODULE_DIR", MODULE_DIR, 1);
             setenv("PATH", "/data/adb/ksu/bin:/data/adb/ap/bin:/system/bin:/vendor/bin", 1);
 
+            pass_driver_fd_to_child();
+            log_flush();
             execl(busybox_path, "sh", script_path, nullptr);
             _exit(127);
         }
@@ -1,21 +1,30 @@
 #include "module.hpp"
 #include "../assets.hpp"
 #include "../core/ksucalls.hpp"
+#include "../core/props.hpp"
 #include "../defs.hpp"
 #include "../log.hpp"
 #include "../sepolicy/sepolicy.hpp"
 #include "../utils.hpp"
+#include "module_config.hpp"
 
 #include <dirent.h>
+#include <fcntl.h>
+#include <sys/file.h>
 #include <sys/stat.h>
 #include <sys/sysmacros.h>
 #include <sys/wait.h>
 #include <unistd.h>
+#include <cerrno>
 #include <climits>
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <ctime>
 #include <fstream>
 #include <map>
+#include <optional>
+#include <set>
 #include <sstream>
 #include <vector>
 
@@ -407,6 +416,8 @@ export API ARCH ABI ABI32 IS64BIT
         setenv("NVBASE", "/data/adb", 1);
         setenv("BOOTMODE", "true", 1);
 
+        pass_driver_fd_to_child();
+        log_flush();
         execl(busybox.c_str(), "sh", wrapper.c_str(), nullptr);
         _exit(127);
     }
@@ -820,6 +831,445 @@ int module_list() {
     return 0;
 }
 
+// Fields of module_list_fields; the ones up to PROP_FIELDS need module.prop
+enum ModuleField : uint32_t {
+    FIELD_ID = 1u << 0,
+    FIELD_NAME = 1u << 1,
+    FIELD_VERSION = 1u << 2,
+    FIELD_VERSION_CODE = 1u << 3,
+    FIELD_AUTHOR = 1u << 4,
+    FIELD_DESCRIPTION = 1u << 5,
+    FIELD_UPDATE_JSON = 1u << 6,
+    FIELD_METAMODULE = 1u << 7,
+    FIELD_DIR_ID = 1u << 8,
+    FIELD_ENABLED = 1u << 9,
+    FIELD_UPDATE = 1u << 10,
+    FIELD_REMOVE = 1u << 11,
+    FIELD_WEB = 1u << 12,
+    FIELD_ACTION = 1u << 13,
+    FIELD_MOUNT = 1u << 14,
+};
+static constexpr uint32_t PROP_FIELDS = FIELD_DIR_ID - 1;
+
+struct ModuleFieldName {
+    const char* name;
+    ModuleField field;
+};
+
+// In output order
+static constexpr ModuleFieldName MODULE_FIELDS[] = {
+    {"id", FIELD_ID},
+    {"dir_id", FIELD_DIR_ID},
+    {"name", FIELD_NAME},
+    {"version", FIELD_VERSION},
+    {"versionCode", FIELD_VERSION_CODE},
+    {"author", FIELD_AUTHOR},
+    {"description", FIELD_DESCRIPTION},
+    {"updateJson", FIELD_UPDATE_JSON},
+    {"enabled", FIELD_ENABLED},
+    {"update", FIELD_UPDATE},
+    {"remove", FIELD_REMOVE},
+    {"web", FIELD_WEB},
+    {"action", FIELD_ACTION},
+    {"mount", FIELD_MOUNT},
+    {"metamodule", FIELD_METAMODULE},
+};
+
+static bool exists_at(int dirfd, const char* name) {
+    struct stat st;
+    return fstatat(dirfd, name, &st, 0) == 0;
+}
+
+static uint64_t ctime_ns(const struct stat& st) {
+    return static_cast<uint64_t>(st.st_ctim.tv_sec) * 1000000000ull +
+           static_cast<uint64_t>(st.st_ctim.tv_nsec);
+}
+
+// Identity and change time of a module dir and its module.prop. Only ever
+// compared for equality, so a wall clock set back cannot hide a change.
+static std::string module_fingerprint(const struct stat& dir_st, const struct stat& prop_st) {
+    char buf[96];
+    snprintf(buf, sizeof(buf), "%llx.%llx.%llx.%llx.%llx",
+             static_cast<unsigned long long>(dir_st.st_ino),
+             static_cast<unsigned long long>(ctime_ns(dir_st)),
+             static_cast<unsigned long long>(prop_st.st_ino),
+             static_cast<unsigned long long>(ctime_ns(prop_st)),
+             static_cast<unsigned long long>(prop_st.st_size));
+    return buf;
+}
+
+/**
+ * Change stamps behind the module_list_fields generation token
+ *
+ * A counter that only grows, and per module the counter value of its last
+ * change: a new fingerprint seen by a listing, or a module_stamp_bump()
+ * from a config write, which does not touch the module dir. The counter is
+ * tied to the boot id and to an epoch taken from CLOCK_MONOTONIC whenever
+ * the file is (re)created, so a token from another boot or from before a
+ * lost or torn file never matches and the caller gets a full list.
+ *
+ * File: "<boot_id> <epoch> <counter> <set_stamp>" then one
+ * "<stamp> <fingerprint> <dir name>" line per module. The file is locked
+ * for the lifetime of the object.
+ */
+class ModuleStamps {
+public:
+    struct Module {
+        uint64_t stamp = 0;
+        std::string fingerprint;
+    };
+
+    ModuleStamps() {
+        fd_ = open(MODULE_STAMP_PATH, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+        if (fd_ < 0)
+            return;
+        if (flock(fd_, LOCK_EX) != 0) {
+            close(fd_);
+            fd_ = -1;
+            return;
+        }
+        load();
+    }
+
+    ~ModuleStamps() {
+        if (fd_ >= 0)
+            close(fd_);  // releases the lock
+    }
+
+    ModuleStamps(const ModuleStamps&) = delete;
+    ModuleStamps& operator=(const ModuleStamps&) = delete;
+
+    bool ok() const { return fd_ >= 0; }
+    // Nothing usable was on disk; save() even if no module changed
+    bool fresh() const { return fresh_; }
+
+    std::string token() const {
+        return boot_id_ + ":" + std::to_string(epoch_) + ":" + std::to_string(counter);
+    }
+
+    // Counter value of a token from this boot and epoch
+    std::optional<uint64_t> parse_token(const std::string& token) const {
+        auto parts = split(token, ':');
+        if (parts.size() != 3 || parts[0] != boot_id_ || parts[1] != std::to_string(epoch_))
+            return std::nullopt;
+        char* end = nullptr;
+        uint64_t value = strtoull(parts[2].c_str(), &end, 10);
+        if (parts[2].empty() || *end != '\0' || value > counter)
+            return std::nullopt;
+        return value;
+    }
+
+    bool save() {
+        std::string out = boot_id_ + " " + std::to_string(epoch_) + " " +
+                          std::to_string(counter) + " " + std::to_string(set_stamp) + "\n";
+        for (const auto& [name, m] : modules)
+            out += std::to_string(m.stamp) + " " + m.fingerprint + " " + name + "\n";
+
+        size_t done = 0;
+        while (done < out.size()) {
+            ssize_t n = pwrite(fd_, out.data() + done, out.size() - done, done);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0) {
+                LOGW("module stamps: write failed: %s", strerror(errno));
+                return false;
+            }
+            done += static_cast<size_t>(n);
+        }
+        return ftruncate(fd_, static_cast<off_t>(out.size())) == 0;
+    }
+
+    uint64_t counter = 0;
+    // Counter value when a module was last added or removed
+    uint64_t set_stamp = 0;
+    std::map<std::string, Module> modules;
+
+private:
+    void load() {
+        std::string boot_id = trim(read_file("/proc/sys/kernel/random/boot_id").value_or(""));
+        std::istringstream in(read_file(MODULE_STAMP_PATH).value_or(""));
+        std::string line;
+        bool valid = false;
+        if (std::getline(in, line)) {
+            std::istringstream header(line);
+            valid = static_cast<bool>(header >> boot_id_ >> epoch_ >> counter >> set_stamp) &&
+                    !boot_id.empty() && boot_id_ == boot_id && set_stamp <= counter;
+        }
+        while (valid && std::getline(in, line)) {
+            std::istringstream entry(line);
+            Module m;
+            std::string name;
+            valid = entry >> m.stamp >> m.fingerprint && entry.get() == ' ' &&
+                    std::getline(entry, name) && !name.empty() && m.stamp <= counter;
+            if (valid)
+                modules[name] = std::move(m);
+        }
+        if (valid)
+            return;
+
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        boot_id_ = boot_id.empty() ? "-" : boot_id;
+        epoch_ = static_cast<uint64_t>(now.tv_sec) * 1000000000ull +
+                 static_cast<uint64_t>(now.tv_nsec);
+        counter = 0;
+        set_stamp = 0;
+        modules.clear();
+        fresh_ = true;
+    }
+
+    int fd_ = -1;
+    bool fresh_ = false;
+    std::string boot_id_;
+    uint64_t epoch_ = 0;
+};
+
+void module_stamp_bump(const std::string& id) {
+    ModuleStamps stamps;
+    if (!stamps.ok())
+        return;
+    // A module no listing has seen yet is new to every token anyway
+    auto it = stamps.modules.find(id);
+    if (it == stamps.modules.end())
+        return;
+    it->second.stamp = ++stamps.counter;
+    stamps.save();
+}
+
+// module.prop relative to an open module directory
+static std::map<std::string, std::string> parse_module_prop_at(int dirfd) {
+    std::map<std::string, std::string> props;
+    int fd = openat(dirfd, "module.prop", O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return props;
+
+    std::string content;
+    char buf[4096];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0 || (n < 0 && errno == EINTR)) {
+        if (n > 0)
+            content.append(buf, static_cast<size_t>(n));
+    }
+    close(fd);
+
+    size_t pos = 0;
+    while (pos < content.size()) {
+        size_t end = content.find('\n', pos);
+        if (end == std::string::npos)
+            end = content.size();
+        size_t eq = content.find('=', pos);
+        if (eq < end) {
+            props[trim(content.substr(pos, eq - pos))] =
+                trim(content.substr(eq + 1, end - eq - 1));
+        }
+        pos = end + 1;
+    }
+    return props;
+}
+
+static void append_json_string(std::string& out, const char* key, const std::string& value) {
+    out += '"';
+    out += key;
+    out += "\":\"";
+    out += escape_json(value);
+    out += '"';
+}
+
+static void append_json_bool(std::string& out, const char* key, bool value) {
+    out += '"';
+    out += key;
+    out += "\":";
+    out += value ? "true" : "false";
+}
+
+int module_list_fields(const std::vector<std::string>& fields, const std::string& since) {
+    uint32_t mask = 0;
+    for (const auto& field : fields) {
+        bool known = false;
+        for (const auto& f : MODULE_FIELDS) {
+            if (field == f.name) {
+                mask |= f.field;
+                known = true;
+            }
+        }
+        if (!known) {
+            fprintf(stderr, "Unknown module field: %s\n", field.c_str());
+            return 1;
+        }
+    }
+    if (mask == 0) {
+        for (const auto& f : MODULE_FIELDS)
+            mask |= f.field;
+    }
+
+    int modules_fd = open(MODULE_DIR, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    DIR* dir = modules_fd >= 0 ? fdopendir(modules_fd) : nullptr;
+    if (!dir && modules_fd >= 0)
+        close(modules_fd);
+
+    // Open every module and settle the stamps before printing anything; a
+    // change after its fingerprint was taken is reported by the next listing
+    struct ModuleDir {
+        std::string name;
+        int fd;
+        uint64_t stamp;
+    };
+    std::vector<ModuleDir> module_dirs;
+    std::vector<std::string> fingerprints;
+    struct dirent* entry;
+    while (dir && (entry = readdir(dir)) != nullptr) {
+        if (entry->d_name[0] == '.')
+            continue;
+        if (entry->d_type != DT_DIR && entry->d_type != DT_UNKNOWN)
+            continue;
+
+        int mod_fd = openat(modules_fd, entry->d_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (mod_fd < 0)
+            continue;
+
+        struct stat dir_st, prop_st;
+        if (fstat(mod_fd, &dir_st) != 0 || fstatat(mod_fd, "module.prop", &prop_st, 0) != 0) {
+            close(mod_fd);
+            continue;
+        }
+        module_dirs.push_back({entry->d_name, mod_fd, 0});
+        fingerprints.push_back(module_fingerprint(dir_st, prop_st));
+    }
+    if (dir)
+        closedir(dir);
+
+    ModuleStamps stamps;
+    uint64_t next = stamps.counter + 1;
+    bool changed = false;
+    std::set<std::string> present;
+    for (size_t i = 0; i < module_dirs.size(); i++) {
+        auto [it, added] = stamps.modules.try_emplace(module_dirs[i].name);
+        if (added)
+            stamps.set_stamp = next;
+        if (added || it->second.fingerprint != fingerprints[i]) {
+            it->second = {next, fingerprints[i]};
+            changed = true;
+        }
+        module_dirs[i].stamp = it->second.stamp;
+        present.insert(module_dirs[i].name);
+    }
+    for (auto it = stamps.modules.begin(); it != stamps.modules.end();) {
+        if (present.count(it->first)) {
+            ++it;
+            continue;
+        }
+        it = stamps.modules.erase(it);
+        stamps.set_stamp = next;
+        changed = true;
+    }
+    if (changed)
+        stamps.counter = next;
+    if (stamps.ok() && (changed || stamps.fresh()))
+        stamps.save();
+
+    // Without the stamp file there is no token and every listing is full.
+    // A module added or removed since the token means the caller has to
+    // replace its list rather than patch it.
+    std::optional<uint64_t> since_counter;
+    if (stamps.ok() && !since.empty())
+        since_counter = stamps.parse_token(since);
+    bool incremental = since_counter && stamps.set_stamp <= *since_counter;
+
+    std::string out = "{\"generation\":\"";
+    if (stamps.ok())
+        out += escape_json(stamps.token());
+    out += "\",\"full\":";
+    out += incremental ? "false" : "true";
+    out += ",\"modules\":[";
+
+    bool first = true;
+    for (const auto& module : module_dirs) {
+        int mod_fd = module.fd;
+        if (incremental && module.stamp <= *since_counter) {
+            close(mod_fd);
+            continue;
+        }
+        const char* dir_name = module.name.c_str();
+
+        std::map<std::string, std::string> props;
+        if (mask & PROP_FIELDS)
+            props = parse_module_prop_at(mod_fd);
+        auto prop = [&](const char* key, const std::string& fallback) {
+            auto it = props.find(key);
+            return it != props.end() ? it->second : fallback;
+        };
+        std::string id = prop("id", dir_name);
+
+        out += first ? "{" : ",{";
+        first = false;
+        bool first_field = true;
+        for (const auto& f : MODULE_FIELDS) {
+            if (!(mask & f.field))
+                continue;
+            if (!first_field)
+                out += ',';
+            first_field = false;
+
+            switch (f.field) {
+            case FIELD_ID:
+                append_json_string(out, f.name, id);
+                break;
+            case FIELD_DIR_ID:
+                append_json_string(out, f.name, dir_name);
+                break;
+            case FIELD_NAME:
+                append_json_string(out, f.name, prop("name", id));
+                break;
+            case FIELD_VERSION:
+                append_json_string(out, f.name, prop("version", ""));
+                break;
+            case FIELD_VERSION_CODE:
+                append_json_string(out, f.name, prop("versionCode", ""));
+                break;
+            case FIELD_AUTHOR:
+                append_json_string(out, f.name, prop("author", ""));
+                break;
+            case FIELD_DESCRIPTION:
+                append_json_string(out, f.name, prop("description", ""));
+                break;
+            case FIELD_UPDATE_JSON:
+                append_json_string(out, f.name, prop("updateJson", ""));
+                break;
+            case FIELD_METAMODULE: {
+                std::string value = prop("metamodule", "");
+                append_json_bool(out, f.name, value == "1" || value == "true" || value == "TRUE");
+                break;
+            }
+            case FIELD_ENABLED:
+                append_json_bool(out, f.name, !exists_at(mod_fd, DISABLE_FILE_NAME));
+                break;
+            case FIELD_UPDATE:
+                append_json_bool(out, f.name, exists_at(mod_fd, UPDATE_FILE_NAME));
+                break;
+            case FIELD_REMOVE:
+                append_json_bool(out, f.name, exists_at(mod_fd, REMOVE_FILE_NAME));
+                break;
+            case FIELD_WEB:
+                append_json_bool(out, f.name, exists_at(mod_fd, MODULE_WEB_DIR));
+                break;
+            case FIELD_ACTION:
+                append_json_bool(out, f.name, exists_at(mod_fd, MODULE_ACTION_SH));
+                break;
+            case FIELD_MOUNT:
+                append_json_bool(out, f.name,
+                                 exists_at(mod_fd, "system") && !exists_at(mod_fd, "skip_mount"));
+                break;
+            }
+        }
+        out += '}';
+        close(mod_fd);
+    }
+
+    out += "]}\n";
+    fwrite(out.data(), 1, out.size(), stdout);
+    return 0;
+}
+
 int uninstall_all_modules() {
     DIR* dir = opendir(MODULE_DIR);
     if (!dir)
@@ -992,6 +1442,8 @@ static int run_script(const std::string& script, bool block, const std::string&
         setenv("PATH", path_env, 1);
 
         // Execute with busybox sh
+        pass_driver_fd_to_child();
+        log_flush();
         execl(busybox_path, "sh", script_path, nullptr);
         _exit(127);
     }
@@ -1126,6 +1578,8 @@ int load_system_prop() {
         return 0;
     }
 
+    // Collect every module's properties, then set them with one resetprop
+    PropBatch props;
     struct dirent* entry;
     while ((entry = readdir(dir)) != nullptr) {
         if (entry->d_name[0] == '.')
@@ -1145,7 +1599,7 @@ int load_system_prop() {
 
         LOGI("Loading system.prop from %s", entry->d_name);
 
-        // Read and set properties
+        // Read properties
         std::ifstream ifs(prop_file);
         std::string line;
         while (std::getline(ifs, line)) {
@@ -1160,117 +1614,44 @@ int load_system_prop() {
             std::string key = trim(line.substr(0, eq));
             std::string value = trim(line.substr(eq + 1));
 
-            // Execute resetprop with full path
-            pid_t pid = fork();
-            if (pid == 0) {
-                execl(RESETPROP_PATH, "resetprop", "-n", key.c_str(), value.c_str(), nullptr);
-                _exit(127);
-            }
-            if (pid > 0) {
-                int status;
-                waitpid(pid, &status, 0);
-            }
+            props.set(key, value);
         }
     }
 
     closedir(dir);
-    return 0;
-}
 
-// Parse bool config value (true, yes, 1, on -> true)
-static bool parse_bool_config(const std::string& value) {
-    std::string lower = value;
-    for (char& c : lower)
-        c = tolower(c);
-    return lower == "true" || lower == "yes" || lower == "1" || lower == "on";
-}
-
-// Merge module configs (persist + temp, temp takes priority)
-static std::map<std::string, std::string> merge_module_configs(const std::string& module_id) {
-    std::map<std::string, std::string> config;
-
-    std::string config_dir = std::string(MODULE_CONFIG_DIR) + module_id + "/";
-    std::string persist_path = config_dir + PERSIST_CONFIG_NAME;
-    std::string temp_path = config_dir + TEMP_CONFIG_NAME;
-
-    // Load persist config first
-    auto persist_content = read_file(persist_path);
-    if (persist_content) {
-        std::istringstream iss(*persist_content);
-        std::string line;
-        while (std::getline(iss, line)) {
-            size_t eq = line.find('=');
-            if (eq != std::string::npos) {
-                std::string key = line.substr(0, eq);
-                std::string value = line.substr(eq + 1);
-                config[key] = value;
-            }
-        }
-    }
-
-    // Load temp config (overrides persist)
-    auto temp_content = read_file(temp_path);
-    if (temp_content) {
-        std::istringstream iss(*temp_content);
-        std::string line;
-        while (std::getline(iss, line)) {
-            size_t eq = line.find('=');
-            if (eq != std::string::npos) {
-                std::string key = line.substr(0, eq);
-                std::string value = line.substr(eq + 1);
-                config[key] = value;
-            }
-        }
+    if (!props.empty()) {
+        size_t total = props.size();
+        size_t failed = props.apply();
+        LOGI("Set %zu module properties (%zu failed)", total - failed, failed);
     }
-
-    return config;
+    return 0;
 }
 
 std::map<std::string, std::vector<std::string>> get_managed_features() {
     std::map<std::string, std::vector<std::string>> managed_features_map;
 
-    DIR* dir = opendir(MODULE_DIR);
-    if (!dir) {
-        return managed_features_map;
-    }
-
-    struct dirent* entry;
-    while ((entry = readdir(dir)) != nullptr) {
-        if (entry->d_name[0] == '.')
-            continue;
-        if (entry->d_type != DT_DIR)
-            continue;
-
-        std::string module_id = entry->d_name;
-        std::string module_path = std::string(MODULE_DIR) + module_id;
-
-        // Check if module is active (not disabled/removed)
-        if (file_exists(module_path + "/disable"))
-            continue;
-        if (file_exists(module_path + "/remove"))
-            continue;
-
-        // Read module config
-        auto config = merge_module_configs(module_id);
-
-        // Extract manage.* config entries
-        std::vector<std::string> feature_list;
-        for (const auto& [key, value] : config) {
-            // Check if key starts with "manage."
-            if (key.size() > 7 && key.substr(0, 7) == "manage.") {
-                std::string feature_name = key.substr(7);
-                if (parse_bool_config(value)) {
-                    feature_list.push_back(feature_name);
-                }
+    // The config store keeps a feature -> modules index, so only modules
+    // that actually manage something are looked at here
+    std::map<std::string, bool> active;
+    for (const auto& [feature_name, modules] : module_config_feature_index()) {
+        for (const auto& module_id : modules) {
+            auto it = active.find(module_id);
+            if (it == active.end()) {
+                std::string module_path = std::string(MODULE_DIR) + module_id;
+
+                // Check if module is active (not disabled/removed)
+                bool is_active = file_exists(module_path) &&
+                                 !file_exists(module_path + "/disable") &&
+                                 !file_exists(module_path + "/remove");
+                it = active.emplace(module_id, is_active).first;
+            }
+            if (it->second) {
+                managed_features_map[module_id].push_back(feature_name);
             }
-        }
-
-        if (!feature_list.empty()) {
-            managed_features_map[module_id] = feature_list;
         }
     }
 
-    closedir(dir);
     return managed_features_map;
 }
 
@@ -14,6 +14,13 @@ int module_enable(const std::string& id);
 int module_disable(const std::string& id);
 int module_run_action(const std::string& id);
 int module_list();
+// Compact JSON listing with only the given fields (all if empty). With a
+// generation token from an earlier listing, only modules changed since then
+// are included, unless "full" in the output says the list was rebuilt.
+int module_list_fields(const std::vector<std::string>& fields, const std::string& since);
+// Mark a module changed for the next incremental listing, for writes that
+// do not touch its directory (module config)
+void module_stamp_bump(const std::string& id);
 
 // Internal functions
 int uninstall_all_modules();
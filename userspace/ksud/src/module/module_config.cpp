@@ -2,123 +2,593 @@
 #include "../defs.hpp"
 #include "../log.hpp"
 #include "../utils.hpp"
+#include "module.hpp"
 
 #include <dirent.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
 #include <unistd.h>
+#include <cerrno>
 #include <cstdlib>
-#include <fstream>
+#include <cstring>
 #include <map>
+#include <set>
 #include <sstream>
 
 namespace ksud {
 
-static std::string get_module_id() {
-    const char* id = getenv("KSU_MODULE");
-    return id ? std::string(id) : "";
+// All module configs live in one store under MODULE_CONFIG_DIR:
+//   .store      snapshot, rewritten atomically on compaction
+//   .store.log  append log of record groups, each terminated by a commit
+// The log file doubles as the lock file for readers and writers.
+static constexpr uint32_t STORE_MAGIC = 0x434d534b;  // "KSMC"
+static constexpr uint32_t STORE_VERSION = 1;
+static constexpr size_t LOG_COMPACT_RECORDS = 256;
+
+enum : uint8_t {
+    OP_SET = 1,
+    OP_DELETE = 2,
+    OP_CLEAR = 3,  // drop every key of (module, scope)
+    OP_COMMIT = 0x7f,
+};
+
+enum : uint8_t {
+    SCOPE_PERSIST = 0,
+    SCOPE_TEMP = 1,
+};
+
+struct StoreHeader {
+    uint32_t magic;
+    uint32_t version;
+};
+
+struct RecordHeader {
+    uint8_t op;
+    uint8_t scope;
+    uint16_t module_len;
+    uint16_t key_len;
+    uint16_t reserved;
+    uint32_t value_len;
+};
+static_assert(sizeof(RecordHeader) == 12, "RecordHeader layout");
+
+struct ConfigRecord {
+    uint8_t op;
+    uint8_t scope;
+    std::string module;
+    std::string key;
+    std::string value;
+};
+
+struct ModuleEntries {
+    std::map<std::string, std::string> scopes[2];
+};
+
+struct ConfigStore {
+    std::map<std::string, ModuleEntries> modules;
+    // feature -> modules with a true "manage.<feature>" entry
+    std::map<std::string, std::set<std::string>> features;
+    size_t log_records = 0;
+    size_t log_valid_end = 0;
+};
+
+static constexpr const char* MANAGE_PREFIX = "manage.";
+
+// true, yes, 1, on -> true
+static bool config_value_is_true(const std::string& value) {
+    std::string lower = value;
+    for (char& c : lower)
+        c = tolower(c);
+    return lower == "true" || lower == "yes" || lower == "1" || lower == "on";
+}
+
+static const std::string* effective_value(const ModuleEntries& entries, const std::string& key) {
+    for (int scope : {SCOPE_TEMP, SCOPE_PERSIST}) {
+        auto it = entries.scopes[scope].find(key);
+        if (it != entries.scopes[scope].end())
+            return &it->second;
+    }
+    return nullptr;
+}
+
+static void update_feature_index(ConfigStore& store, const std::string& module,
+                                 const std::string& key) {
+    if (!starts_with(key, MANAGE_PREFIX) || key.size() == strlen(MANAGE_PREFIX))
+        return;
+
+    std::string feature = key.substr(strlen(MANAGE_PREFIX));
+    const std::string* value = nullptr;
+    auto mod = store.modules.find(module);
+    if (mod != store.modules.end())
+        value = effective_value(mod->second, key);
+
+    if (value && config_value_is_true(*value)) {
+        store.features[feature].insert(module);
+        return;
+    }
+
+    auto it = store.features.find(feature);
+    if (it != store.features.end()) {
+        it->second.erase(module);
+        if (it->second.empty())
+            store.features.erase(it);
+    }
+}
+
+static void apply_record(ConfigStore& store, const ConfigRecord& r) {
+    if (r.scope > SCOPE_TEMP)
+        return;
+
+    switch (r.op) {
+    case OP_SET:
+        store.modules[r.module].scopes[r.scope][r.key] = r.value;
+        update_feature_index(store, r.module, r.key);
+        break;
+    case OP_DELETE: {
+        auto mod = store.modules.find(r.module);
+        if (mod == store.modules.end())
+            break;
+        mod->second.scopes[r.scope].erase(r.key);
+        update_feature_index(store, r.module, r.key);
+        break;
+    }
+    case OP_CLEAR: {
+        auto mod = store.modules.find(r.module);
+        if (mod == store.modules.end())
+            break;
+        std::map<std::string, std::string> dropped;
+        dropped.swap(mod->second.scopes[r.scope]);
+        for (const auto& [key, value] : dropped)
+            update_feature_index(store, r.module, key);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+static void encode_record(std::string& out, const ConfigRecord& r) {
+    RecordHeader hdr{};
+    hdr.op = r.op;
+    hdr.scope = r.scope;
+    hdr.module_len = static_cast<uint16_t>(r.module.size());
+    hdr.key_len = static_cast<uint16_t>(r.key.size());
+    hdr.value_len = static_cast<uint32_t>(r.value.size());
+    out.append(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+    out += r.module;
+    out += r.key;
+    out += r.value;
 }
 
-static std::string get_config_dir(const std::string& module_id) {
-    return std::string(MODULE_CONFIG_DIR) + module_id + "/";
+static void encode_header(std::string& out) {
+    StoreHeader hdr{STORE_MAGIC, STORE_VERSION};
+    out.append(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
 }
 
-static std::map<std::string, std::string> load_config(const std::string& path) {
-    std::map<std::string, std::string> config;
-    auto content = read_file(path);
-    if (!content)
-        return config;
+/**
+ * Replay records from data into store.
+ * With need_commit, records only take effect once their commit record is
+ * seen, so a torn tail from an interrupted append is ignored.
+ * Returns the offset just past the last complete (committed) record.
+ */
+static size_t replay(ConfigStore& store, const std::string& data, bool need_commit,
+                     size_t* records) {
+    StoreHeader hdr;
+    if (data.size() < sizeof(hdr))
+        return 0;
+    memcpy(&hdr, data.data(), sizeof(hdr));
+    if (hdr.magic != STORE_MAGIC || hdr.version != STORE_VERSION) {
+        LOGW("module config store: bad header, ignoring");
+        return 0;
+    }
 
-    std::istringstream iss(*content);
-    std::string line;
-    while (std::getline(iss, line)) {
-        size_t eq = line.find('=');
-        if (eq != std::string::npos) {
-            std::string key = line.substr(0, eq);
-            std::string value = line.substr(eq + 1);
-            config[key] = value;
+    size_t off = sizeof(hdr);
+    size_t valid_end = off;
+    std::vector<ConfigRecord> pending;
+    while (data.size() - off >= sizeof(RecordHeader)) {
+        RecordHeader rh;
+        memcpy(&rh, data.data() + off, sizeof(rh));
+        size_t body = size_t(rh.module_len) + rh.key_len + rh.value_len;
+        if (data.size() - off - sizeof(rh) < body)
+            break;
+
+        const char* p = data.data() + off + sizeof(rh);
+        off += sizeof(rh) + body;
+
+        if (rh.op == OP_COMMIT) {
+            for (const auto& r : pending)
+                apply_record(store, r);
+            if (records)
+                *records += pending.size();
+            pending.clear();
+            valid_end = off;
+            continue;
+        }
+
+        ConfigRecord r{rh.op, rh.scope, std::string(p, rh.module_len),
+                       std::string(p + rh.module_len, rh.key_len),
+                       std::string(p + rh.module_len + rh.key_len, rh.value_len)};
+        if (!need_commit) {
+            apply_record(store, r);
+            valid_end = off;
+        } else {
+            pending.push_back(std::move(r));
         }
     }
 
-    return config;
+    return valid_end;
 }
 
-static bool save_config(const std::string& path, const std::map<std::string, std::string>& config) {
-    std::ofstream ofs(path);
-    if (!ofs)
-        return false;
+static bool read_fd(int fd, std::string& out) {
+    out.clear();
+    char buf[16384];
+    off_t off = 0;
+    for (;;) {
+        ssize_t n = pread(fd, buf, sizeof(buf), off);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return false;
+        if (n == 0)
+            return true;
+        out.append(buf, static_cast<size_t>(n));
+        off += n;
+    }
+}
+
+static bool write_all(int fd, const std::string& data, off_t off) {
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t n = pwrite(fd, data.data() + done, data.size() - done, off + done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        done += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+static std::string store_file(const char* name) {
+    return std::string(MODULE_CONFIG_DIR) + name;
+}
 
-    for (const auto& [key, value] : config) {
-        ofs << key << "=" << value << "\n";
+/**
+ * Write the whole store as a new snapshot and reset the log
+ */
+static bool compact_store(ConfigStore& store, int log_fd) {
+    std::string data;
+    encode_header(data);
+    for (const auto& [module, entries] : store.modules) {
+        for (uint8_t scope : {SCOPE_PERSIST, SCOPE_TEMP}) {
+            for (const auto& [key, value] : entries.scopes[scope])
+                encode_record(data, ConfigRecord{OP_SET, scope, module, key, value});
+        }
     }
 
+    std::string path = store_file(MODULE_CONFIG_STORE_NAME);
+    std::string tmp = path + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        LOGE("module config store: cannot create %s: %s", tmp.c_str(), strerror(errno));
+        return false;
+    }
+    bool ok = write_all(fd, data, 0) && fsync(fd) == 0;
+    close(fd);
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+        LOGE("module config store: cannot write snapshot: %s", strerror(errno));
+        unlink(tmp.c_str());
+        return false;
+    }
+
+    // A crash before this truncate replays the old log over the new
+    // snapshot. That is harmless only because every change in the snapshot
+    // was committed to the log first, so the replay ends in the same state;
+    // never snapshot a change the log doesn't carry.
+    if (ftruncate(log_fd, 0) != 0)
+        return false;
+    store.log_records = 0;
+    store.log_valid_end = 0;
     return true;
 }
 
+/**
+ * Import the per-module persist.config/tmp.config files of older versions
+ */
+static void import_legacy_configs(ConfigStore& store) {
+    DIR* dir = opendir(MODULE_CONFIG_DIR);
+    if (!dir)
+        return;
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        if (entry->d_name[0] == '.')
+            continue;
+        if (entry->d_type != DT_DIR)
+            continue;
+
+        std::string module = entry->d_name;
+        std::string config_dir = std::string(MODULE_CONFIG_DIR) + module + "/";
+        const char* names[] = {PERSIST_CONFIG_NAME, TEMP_CONFIG_NAME};
+        for (uint8_t scope : {SCOPE_PERSIST, SCOPE_TEMP}) {
+            auto content = read_file(config_dir + names[scope]);
+            if (!content)
+                continue;
+
+            std::istringstream iss(*content);
+            std::string line;
+            while (std::getline(iss, line)) {
+                size_t eq = line.find('=');
+                if (eq != std::string::npos) {
+                    apply_record(store, ConfigRecord{OP_SET, scope, module, line.substr(0, eq),
+                                                     line.substr(eq + 1)});
+                }
+            }
+        }
+        LOGI("module config store: imported legacy config of %s", module.c_str());
+    }
+
+    closedir(dir);
+}
+
+/**
+ * Opened and locked store; the lock is held until destruction
+ */
+class StoreHandle {
+public:
+    explicit StoreHandle(bool exclusive) {
+        ensure_dir_exists(MODULE_CONFIG_DIR);
+        std::string log_path = store_file(MODULE_CONFIG_LOG_NAME);
+        fd_ = open(log_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+        if (fd_ < 0) {
+            LOGE("module config store: cannot open %s: %s", log_path.c_str(), strerror(errno));
+            return;
+        }
+        if (flock(fd_, exclusive ? LOCK_EX : LOCK_SH) != 0) {
+            close(fd_);
+            fd_ = -1;
+            return;
+        }
+        exclusive_ = exclusive;
+        load();
+    }
+
+    ~StoreHandle() {
+        if (fd_ >= 0)
+            close(fd_);  // releases the lock
+    }
+
+    StoreHandle(const StoreHandle&) = delete;
+    StoreHandle& operator=(const StoreHandle&) = delete;
+
+    bool ok() const { return fd_ >= 0; }
+    ConfigStore& store() { return store_; }
+
+    /**
+     * Apply records and append them to the log as one atomic group
+     */
+    bool commit(const std::vector<ConfigRecord>& records) {
+        if (fd_ < 0 || !exclusive_)
+            return false;
+
+        for (const auto& r : records)
+            apply_record(store_, r);
+
+        std::string data;
+        if (store_.log_valid_end == 0)
+            encode_header(data);
+        for (const auto& r : records)
+            encode_record(data, r);
+        encode_record(data, ConfigRecord{OP_COMMIT, 0, "", "", ""});
+
+        // Drop any torn tail so the new group follows the last committed one
+        struct stat st;
+        if (fstat(fd_, &st) == 0 && static_cast<size_t>(st.st_size) != store_.log_valid_end)
+            ftruncate(fd_, store_.log_valid_end);
+
+        if (!write_all(fd_, data, store_.log_valid_end)) {
+            LOGE("module config store: append failed: %s", strerror(errno));
+            ftruncate(fd_, store_.log_valid_end);
+            return false;
+        }
+        store_.log_valid_end += data.size();
+        store_.log_records += records.size();
+
+        // Only once the log carries the change: see compact_store()
+        if (store_.log_records > LOG_COMPACT_RECORDS)
+            compact_store(store_, fd_);
+        return true;
+    }
+
+    bool compact() {
+        return fd_ >= 0 && exclusive_ && compact_store(store_, fd_);
+    }
+
+private:
+    void load() {
+        std::string snapshot;
+        bool have_snapshot = false;
+        if (auto content = read_file(store_file(MODULE_CONFIG_STORE_NAME))) {
+            snapshot = std::move(*content);
+            have_snapshot = true;
+        }
+
+        std::string log;
+        read_fd(fd_, log);
+
+        if (!have_snapshot && log.empty()) {
+            // First use: upgrade the lock and import configs of older versions
+            if (!exclusive_) {
+                if (flock(fd_, LOCK_EX) != 0)
+                    return;
+                exclusive_ = true;
+                // Another process may have migrated while we waited
+                if (auto content = read_file(store_file(MODULE_CONFIG_STORE_NAME))) {
+                    snapshot = std::move(*content);
+                    have_snapshot = true;
+                }
+                read_fd(fd_, log);
+            }
+            if (!have_snapshot && log.empty()) {
+                import_legacy_configs(store_);
+                compact_store(store_, fd_);
+                return;
+            }
+        }
+
+        replay(store_, snapshot, false, nullptr);
+        store_.log_valid_end = replay(store_, log, true, &store_.log_records);
+    }
+
+    int fd_ = -1;
+    bool exclusive_ = false;
+    ConfigStore store_;
+};
+
+static std::string get_module_id() {
+    const char* id = getenv("KSU_MODULE");
+    return id ? std::string(id) : "";
+}
+
+static bool is_temp_flag(const std::string& arg) {
+    return arg == "-t" || arg == "--temp";
+}
+
+static bool valid_key(const std::string& key) {
+    return !key.empty() && key.size() <= UINT16_MAX &&
+           key.find_first_of("=\n") == std::string::npos;
+}
+
+static std::map<std::string, std::string> merged_entries(const ConfigStore& store,
+                                                         const std::string& module_id) {
+    auto it = store.modules.find(module_id);
+    if (it == store.modules.end())
+        return {};
+
+    // Merge configs (temp overrides persist)
+    std::map<std::string, std::string> config = it->second.scopes[SCOPE_PERSIST];
+    for (const auto& [key, value] : it->second.scopes[SCOPE_TEMP])
+        config[key] = value;
+    return config;
+}
+
 int module_config_handle(const std::vector<std::string>& args) {
     if (args.empty()) {
-        printf("USAGE: ksud module config <get|set|list|delete|clear> ...\n");
+        printf("USAGE: ksud module config "
+               "<get|get-many|set|set-many|list|dump|delete|clear> ...\n");
         return 1;
     }
 
+    const std::string& cmd = args[0];
+
+    // dump covers every module and doesn't need KSU_MODULE
+    if (cmd == "dump") {
+        StoreHandle handle(false);
+        if (!handle.ok())
+            return 1;
+        for (const auto& [module, entries] : handle.store().modules) {
+            for (const auto& [key, value] : merged_entries(handle.store(), module))
+                printf("%s:%s=%s\n", module.c_str(), key.c_str(), value.c_str());
+        }
+        return 0;
+    }
+
     std::string module_id = get_module_id();
     if (module_id.empty()) {
         printf("Error: KSU_MODULE environment variable not set\n");
         return 1;
     }
-
-    std::string config_dir = get_config_dir(module_id);
-    ensure_dir_exists(config_dir);
-
-    std::string persist_path = config_dir + PERSIST_CONFIG_NAME;
-    std::string temp_path = config_dir + TEMP_CONFIG_NAME;
-
-    const std::string& cmd = args[0];
+    if (module_id.size() > UINT16_MAX || module_id.find('/') != std::string::npos) {
+        printf("Error: invalid module id\n");
+        return 1;
+    }
 
     if (cmd == "get" && args.size() > 1) {
         const std::string& key = args[1];
 
-        // Temp config takes priority
-        auto temp_config = load_config(temp_path);
-        if (temp_config.count(key)) {
-            printf("%s\n", temp_config[key].c_str());
-            return 0;
-        }
-
-        auto persist_config = load_config(persist_path);
-        if (persist_config.count(key)) {
-            printf("%s\n", persist_config[key].c_str());
-            return 0;
+        StoreHandle handle(false);
+        auto mod = handle.store().modules.find(module_id);
+        if (mod != handle.store().modules.end()) {
+            // Temp config takes priority
+            if (const std::string* value = effective_value(mod->second, key)) {
+                printf("%s\n", value->c_str());
+                return 0;
+            }
         }
 
         printf("Key '%s' not found\n", key.c_str());
         return 1;
+    } else if (cmd == "get-many" && args.size() > 1) {
+        StoreHandle handle(false);
+        auto config = merged_entries(handle.store(), module_id);
+
+        int ret = 0;
+        for (size_t i = 1; i < args.size(); i++) {
+            auto it = config.find(args[i]);
+            if (it == config.end()) {
+                ret = 1;
+                continue;
+            }
+            printf("%s=%s\n", it->first.c_str(), it->second.c_str());
+        }
+        return ret;
     } else if (cmd == "set" && args.size() > 2) {
         const std::string& key = args[1];
         const std::string& value = args[2];
-        bool is_temp = args.size() > 3 && (args[3] == "-t" || args[3] == "--temp");
+        bool is_temp = args.size() > 3 && is_temp_flag(args[3]);
 
-        std::string path = is_temp ? temp_path : persist_path;
-        auto config = load_config(path);
-        config[key] = value;
+        if (!valid_key(key)) {
+            printf("Invalid key '%s'\n", key.c_str());
+            return 1;
+        }
 
-        if (!save_config(path, config)) {
+        StoreHandle handle(true);
+        if (!handle.commit({ConfigRecord{OP_SET, is_temp ? SCOPE_TEMP : SCOPE_PERSIST, module_id,
+                                         key, value}})) {
             printf("Failed to save config\n");
             return 1;
         }
+        module_stamp_bump(module_id);
 
         return 0;
-    } else if (cmd == "list") {
-        auto persist_config = load_config(persist_path);
-        auto temp_config = load_config(temp_path);
+    } else if (cmd == "set-many" && args.size() > 1) {
+        // set-many [-t] key=value... ; all pairs are committed together
+        size_t first = 1;
+        bool is_temp = is_temp_flag(args[1]);
+        if (is_temp)
+            first++;
+
+        std::vector<ConfigRecord> records;
+        for (size_t i = first; i < args.size(); i++) {
+            size_t eq = args[i].find('=');
+            std::string key = eq == std::string::npos ? "" : args[i].substr(0, eq);
+            if (!valid_key(key)) {
+                printf("Invalid entry '%s', expected key=value\n", args[i].c_str());
+                return 1;
+            }
+            records.push_back(ConfigRecord{OP_SET, is_temp ? SCOPE_TEMP : SCOPE_PERSIST,
+                                           module_id, key, args[i].substr(eq + 1)});
+        }
+        if (records.empty())
+            return 0;
 
-        // Merge configs (temp overrides persist)
-        for (const auto& [key, value] : temp_config) {
-            persist_config[key] = value;
+        StoreHandle handle(true);
+        if (!handle.commit(records)) {
+            printf("Failed to save config\n");
+            return 1;
         }
+        module_stamp_bump(module_id);
+
+        return 0;
+    } else if (cmd == "list") {
+        StoreHandle handle(false);
+        auto config = merged_entries(handle.store(), module_id);
 
-        if (persist_config.empty()) {
+        if (config.empty()) {
             printf("No config entries found\n");
         } else {
-            for (const auto& [key, value] : persist_config) {
+            for (const auto& [key, value] : config) {
                 printf("%s=%s\n", key.c_str(), value.c_str());
             }
         }
@@ -126,23 +596,27 @@ int module_config_handle(const std::vector<std::string>& args) {
         return 0;
     } else if (cmd == "delete" && args.size() > 1) {
         const std::string& key = args[1];
-        bool is_temp = args.size() > 2 && (args[2] == "-t" || args[2] == "--temp");
-
-        std::string path = is_temp ? temp_path : persist_path;
-        auto config = load_config(path);
-        config.erase(key);
+        bool is_temp = args.size() > 2 && is_temp_flag(args[2]);
 
-        if (!save_config(path, config)) {
+        StoreHandle handle(true);
+        if (!handle.commit({ConfigRecord{OP_DELETE, is_temp ? SCOPE_TEMP : SCOPE_PERSIST,
+                                         module_id, key, ""}})) {
             printf("Failed to save config\n");
             return 1;
         }
+        module_stamp_bump(module_id);
 
         return 0;
     } else if (cmd == "clear") {
-        bool is_temp = args.size() > 1 && (args[1] == "-t" || args[1] == "--temp");
+        bool is_temp = args.size() > 1 && is_temp_flag(args[1]);
 
-        std::string path = is_temp ? temp_path : persist_path;
-        unlink(path.c_str());
+        StoreHandle handle(true);
+        if (!handle.commit({ConfigRecord{OP_CLEAR, is_temp ? SCOPE_TEMP : SCOPE_PERSIST,
+                                         module_id, "", ""}})) {
+            printf("Failed to save config\n");
+            return 1;
+        }
+        module_stamp_bump(module_id);
 
         return 0;
     }
@@ -154,26 +628,36 @@ int module_config_handle(const std::vector<std::string>& args) {
 void clear_all_temp_configs() {
     // Clear all temporary module configs
     // This is called during post-fs-data to clean up temp configs from previous boot
-    DIR* dir = opendir(MODULE_CONFIG_DIR);
-    if (!dir) {
+    StoreHandle handle(true);
+    if (!handle.ok())
         return;
+
+    // Log the clears before compacting, or a crash between the snapshot
+    // rename and the log truncate would replay last boot's temp values
+    std::vector<ConfigRecord> clears;
+    for (const auto& [module, entries] : handle.store().modules) {
+        if (!entries.scopes[SCOPE_TEMP].empty())
+            clears.push_back(ConfigRecord{OP_CLEAR, SCOPE_TEMP, module, "", ""});
     }
+    if (!clears.empty() && !handle.commit(clears))
+        return;
 
-    struct dirent* entry;
-    while ((entry = readdir(dir)) != nullptr) {
-        if (entry->d_name[0] == '.')
-            continue;
-        if (entry->d_type != DT_DIR)
-            continue;
+    // Rewriting the snapshot here also keeps the log short across boots
+    if (handle.store().log_records > 0)
+        handle.compact();
+}
 
-        std::string temp_config =
-            std::string(MODULE_CONFIG_DIR) + entry->d_name + "/" + TEMP_CONFIG_NAME;
-        if (access(temp_config.c_str(), F_OK) == 0) {
-            unlink(temp_config.c_str());
-        }
-    }
+std::map<std::string, std::string> module_config_get_all(const std::string& module_id) {
+    StoreHandle handle(false);
+    return merged_entries(handle.store(), module_id);
+}
 
-    closedir(dir);
+std::map<std::string, std::vector<std::string>> module_config_feature_index() {
+    std::map<std::string, std::vector<std::string>> index;
+    StoreHandle handle(false);
+    for (const auto& [feature, modules] : handle.store().features)
+        index[feature].assign(modules.begin(), modules.end());
+    return index;
 }
 
 }  // namespace ksud
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <map>
 #include <string>
 #include <vector>
 
@@ -11,4 +12,10 @@ int module_config_handle(const std::vector<std::string>& args);
 // Clear all temporary configs (called during post-fs-data)
 void clear_all_temp_configs();
 
+// Merged config of one module (temp entries override persist ones)
+std::map<std::string, std::string> module_config_get_all(const std::string& module_id);
+
+// Reverse index of enabled "manage.<feature>" entries: feature -> modules
+std::map<std::string, std::vector<std::string>> module_config_feature_index();
+
 }  // namespace ksud
@@ -7,8 +7,10 @@
 #include <algorithm>
 #include <cctype>
 #include <cstring>
-#include <fstream>
+#include <memory>
 #include <sstream>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 namespace ksud {
@@ -58,12 +60,62 @@ struct FfiPolicy {
     const char* sepol7;
 };
 
-// PolicyObject - holds a sepolicy string or represents "all" (*)
+// SymbolTable - interns identifiers for one parse session. Strings live in
+// fixed-size arena blocks so the C pointers handed to the kernel stay valid
+// while the table grows; statements refer to them by id.
+class SymbolTable {
+public:
+    static constexpr uint32_t INVALID_ID = 0;
+
+    SymbolTable() { ptrs_.push_back(nullptr); }
+    SymbolTable(const SymbolTable&) = delete;
+    SymbolTable& operator=(const SymbolTable&) = delete;
+
+    // s must be shorter than SEPOLICY_MAX_LEN
+    uint32_t intern(std::string_view s) {
+        auto it = index_.find(s);
+        if (it != index_.end()) {
+            return it->second;
+        }
+
+        char* dst = alloc(s.size() + 1);
+        memcpy(dst, s.data(), s.size());
+        dst[s.size()] = '\0';
+
+        uint32_t id = static_cast<uint32_t>(ptrs_.size());
+        ptrs_.push_back(dst);
+        index_.emplace(std::string_view(dst, s.size()), id);
+        return id;
+    }
+
+    const char* c_str(uint32_t id) const { return ptrs_[id]; }
+
+private:
+    static constexpr size_t BLOCK_SIZE = 4096;
+    static_assert(SEPOLICY_MAX_LEN <= BLOCK_SIZE, "identifier must fit in one arena block");
+
+    char* alloc(size_t n) {
+        if (blocks_.empty() || used_ + n > BLOCK_SIZE) {
+            blocks_.emplace_back(new char[BLOCK_SIZE]);
+            used_ = 0;
+        }
+        char* p = blocks_.back().get() + used_;
+        used_ += n;
+        return p;
+    }
+
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    size_t used_ = 0;
+    std::unordered_map<std::string_view, uint32_t> index_;
+    std::vector<const char*> ptrs_;
+};
+
+// PolicyObject - an interned sepolicy string id or "all" (*)
 class PolicyObject {
 public:
-    enum Type { NONE, ALL, ONE };
+    enum Type : uint8_t { NONE, ALL, ONE };
 
-    PolicyObject() : type_(NONE) { memset(buf_, 0, sizeof(buf_)); }
+    PolicyObject() = default;
 
     static PolicyObject none() { return PolicyObject(); }
 
@@ -73,21 +125,20 @@ public:
         return obj;
     }
 
-    static PolicyObject from_str(const std::string& s) {
+    static PolicyObject from_str(SymbolTable& syms, std::string_view s) {
         PolicyObject obj;
         if (s == "*") {
             obj.type_ = ALL;
         } else if (s.length() < SEPOLICY_MAX_LEN) {
             obj.type_ = ONE;
-            strncpy(obj.buf_, s.c_str(), SEPOLICY_MAX_LEN - 1);
-            obj.buf_[SEPOLICY_MAX_LEN - 1] = '\0';
+            obj.id_ = syms.intern(s);
         }
         return obj;
     }
 
-    const char* c_ptr() const {
+    const char* c_ptr(const SymbolTable& syms) const {
         if (type_ == ONE) {
-            return buf_;
+            return syms.c_str(id_);
         }
         return nullptr;  // NULL for NONE and ALL
     }
@@ -95,14 +146,14 @@ public:
     Type type() const { return type_; }
 
 private:
-    Type type_;
-    char buf_[SEPOLICY_MAX_LEN];
+    Type type_ = NONE;
+    uint32_t id_ = SymbolTable::INVALID_ID;
 };
 
 // AtomicStatement - a single sepolicy operation to send to kernel
 struct AtomicStatement {
-    uint32_t cmd;
-    uint32_t subcmd;
+    uint32_t cmd = 0;
+    uint32_t subcmd = 0;
     PolicyObject sepol1;
     PolicyObject sepol2;
     PolicyObject sepol3;
@@ -111,16 +162,16 @@ struct AtomicStatement {
     PolicyObject sepol6;
     PolicyObject sepol7;
 
-    FfiPolicy to_ffi() const {
+    FfiPolicy to_ffi(const SymbolTable& syms) const {
         return FfiPolicy{cmd,
                          subcmd,
-                         sepol1.c_ptr(),
-                         sepol2.c_ptr(),
-                         sepol3.c_ptr(),
-                         sepol4.c_ptr(),
-                         sepol5.c_ptr(),
-                         sepol6.c_ptr(),
-                         sepol7.c_ptr()};
+                         sepol1.c_ptr(syms),
+                         sepol2.c_ptr(syms),
+                         sepol3.c_ptr(syms),
+                         sepol4.c_ptr(syms),
+                         sepol5.c_ptr(syms),
+                         sepol6.c_ptr(syms),
+                         sepol7.c_ptr(syms)};
     }
 };
 
@@ -136,37 +187,50 @@ static const char* skip_space(const char* p) {
     return p;
 }
 
-// Helper: parse a single word
-static const char* parse_word(const char* p, std::string& out) {
-    out.clear();
-    while (*p && is_sepolicy_char(*p)) {
-        out += *p++;
-    }
+// Helper: parse a single word as a view into the rule text
+static const char* parse_word(const char* p, std::string_view& out) {
+    const char* start = p;
+    while (*p && is_sepolicy_char(*p))
+        p++;
+    out = std::string_view(start, p - start);
+    return p;
+}
+
+// Helper: parse a quoted string, p points at the opening quote
+static const char* parse_quoted(const char* p, std::string_view& out) {
+    const char* start = ++p;
+    while (*p && *p != '"')
+        p++;
+    out = std::string_view(start, p - start);
+    if (*p == '"')
+        p++;
     return p;
 }
 
-// Helper: parse objects (single word, {word1 word2 ...}, or *)
-static const char* parse_seobj(const char* p, std::vector<std::string>& out) {
+// Helper: parse objects (single word, {word1 word2 ...}, or *) into interned ids
+static const char* parse_seobj(const char* p, SymbolTable& syms, std::vector<PolicyObject>& out) {
     out.clear();
     p = skip_space(p);
 
     if (*p == '*') {
-        out.push_back("*");
+        out.push_back(PolicyObject::all());
         return p + 1;
     }
 
+    std::string_view word;
     if (*p == '{') {
         p++;  // skip '{'
         while (*p && *p != '}') {
             p = skip_space(p);
             if (*p == '}')
                 break;
-            std::string word;
-            p = parse_word(p, word);
+            const char* next = parse_word(p, word);
             if (!word.empty()) {
-                out.push_back(word);
+                out.push_back(PolicyObject::from_str(syms, word));
+            } else if (next == p && *p) {
+                next++;  // skip a stray character instead of spinning on it
             }
-            p = skip_space(p);
+            p = skip_space(next);
         }
         if (*p == '}')
             p++;
@@ -174,24 +238,34 @@ static const char* parse_seobj(const char* p, std::vector<std::string>& out) {
     }
 
     // Single word
-    std::string word;
     p = parse_word(p, word);
     if (!word.empty()) {
-        out.push_back(word);
+        out.push_back(PolicyObject::from_str(syms, word));
     }
     return p;
 }
 
-// Parse and expand a single rule into AtomicStatements
-static bool parse_rule(const std::string& rule, std::vector<AtomicStatement>& statements) {
-    const char* p = rule.c_str();
-    p = skip_space(p);
+// Helper: split "target:class" into its parts
+static void split_target_class(std::string_view& target, std::string_view& tclass) {
+    size_t colon = target.find(':');
+    if (colon != std::string_view::npos) {
+        tclass = target.substr(colon + 1);
+        target = target.substr(0, colon);
+    }
+}
+
+// Parse and expand a single rule into AtomicStatements. Expansion of set
+// syntax only copies interned ids, so statements stay small regardless of
+// identifier length.
+static bool parse_rule(const char* rule, SymbolTable& syms,
+                       std::vector<AtomicStatement>& statements) {
+    const char* p = skip_space(rule);
 
     if (*p == '\0' || *p == '#') {
         return true;  // Empty or comment
     }
 
-    std::string cmd_str;
+    std::string_view cmd_str;
     p = parse_word(p, cmd_str);
 
     // allow/deny/auditallow/dontaudit source target:class perm
@@ -207,33 +281,22 @@ static bool parse_rule(const std::string& rule, std::vector<AtomicStatement>& st
         else if (cmd_str == "dontaudit")
             subcmd = SUBCMD_DONTAUDIT;
 
-        std::vector<std::string> sources, targets, classes, perms;
+        std::vector<PolicyObject> sources, targets, classes, perms;
 
-        p = parse_seobj(p, sources);
-        p = parse_seobj(p, targets);
+        p = parse_seobj(p, syms, sources);
+        p = parse_seobj(p, syms, targets);
 
-        // Parse class (may be target:class format or separate)
+        // Parse class (target:class format or separate)
         p = skip_space(p);
         if (*p == ':') {
             p++;
-            p = parse_seobj(p, classes);
-        } else {
-            // Check if last target contains ':'
-            if (!targets.empty()) {
-                std::string& last = targets.back();
-                size_t colon = last.find(':');
-                if (colon != std::string::npos) {
-                    classes.push_back(last.substr(colon + 1));
-                    last = last.substr(0, colon);
-                } else {
-                    p = parse_seobj(p, classes);
-                }
-            }
         }
-
-        p = parse_seobj(p, perms);
+        p = parse_seobj(p, syms, classes);
+        p = parse_seobj(p, syms, perms);
 
         // Expand to atomic statements
+        statements.reserve(statements.size() +
+                           sources.size() * targets.size() * classes.size() * perms.size());
         for (const auto& s : sources) {
             for (const auto& t : targets) {
                 for (const auto& c : classes) {
@@ -241,10 +304,10 @@ static bool parse_rule(const std::string& rule, std::vector<AtomicStatement>& st
                         AtomicStatement stmt;
                         stmt.cmd = CMD_NORMAL_PERM;
                         stmt.subcmd = subcmd;
-                        stmt.sepol1 = PolicyObject::from_str(s);
-                        stmt.sepol2 = PolicyObject::from_str(t);
-                        stmt.sepol3 = PolicyObject::from_str(c);
-                        stmt.sepol4 = PolicyObject::from_str(perm);
+                        stmt.sepol1 = s;
+                        stmt.sepol2 = t;
+                        stmt.sepol3 = c;
+                        stmt.sepol4 = perm;
                         statements.push_back(stmt);
                     }
                 }
@@ -263,26 +326,17 @@ static bool parse_rule(const std::string& rule, std::vector<AtomicStatement>& st
         else if (cmd_str == "dontauditxperm")
             subcmd = SUBCMD_DONTAUDITXPERM;
 
-        std::vector<std::string> sources, targets, classes;
-        std::string operation, perm_set;
+        std::vector<PolicyObject> sources, targets, classes;
+        std::string_view operation, perm_set;
 
-        p = parse_seobj(p, sources);
-        p = parse_seobj(p, targets);
+        p = parse_seobj(p, syms, sources);
+        p = parse_seobj(p, syms, targets);
 
         p = skip_space(p);
         if (*p == ':') {
             p++;
-            p = parse_seobj(p, classes);
-        } else if (!targets.empty()) {
-            std::string& last = targets.back();
-            size_t colon = last.find(':');
-            if (colon != std::string::npos) {
-                classes.push_back(last.substr(colon + 1));
-                last = last.substr(0, colon);
-            } else {
-                p = parse_seobj(p, classes);
-            }
         }
+        p = parse_seobj(p, syms, classes);
 
         p = skip_space(p);
         p = parse_word(p, operation);
@@ -295,22 +349,25 @@ static bool parse_rule(const std::string& rule, std::vector<AtomicStatement>& st
                 p++;
             if (*p == '}')
                 p++;
-            perm_set = std::string(start, p);
+            perm_set = std::string_view(start, p - start);
         } else {
             p = parse_word(p, perm_set);
         }
 
+        PolicyObject op_obj = PolicyObject::from_str(syms, operation);
+        PolicyObject perm_obj = PolicyObject::from_str(syms, perm_set);
+
         for (const auto& s : sources) {
             for (const auto& t : targets) {
                 for (const auto& c : classes) {
                     AtomicStatement stmt;
                     stmt.cmd = CMD_XPERM;
                     stmt.subcmd = subcmd;
-                    stmt.sepol1 = PolicyObject::from_str(s);
-                    stmt.sepol2 = PolicyObject::from_str(t);
-                    stmt.sepol3 = PolicyObject::from_str(c);
-                    stmt.sepol4 = PolicyObject::from_str(operation);
-                    stmt.sepol5 = PolicyObject::from_str(perm_set);
+                    stmt.sepol1 = s;
+                    stmt.sepol2 = t;
+                    stmt.sepol3 = c;
+                    stmt.sepol4 = op_obj;
+                    stmt.sepol5 = perm_obj;
                     statements.push_back(stmt);
                 }
             }
@@ -322,14 +379,14 @@ static bool parse_rule(const std::string& rule, std::vector<AtomicStatement>& st
     if (cmd_str == "permissive" || cmd_str == "enforce") {
         uint32_t subcmd = (cmd_str == "permissive") ? SUBCMD_PERMISSIVE : SUBCMD_ENFORCING;
 
-        std::vector<std::string> types;
-        p = parse_seobj(p, types);
+        std::vector<PolicyObject> types;
+        p = parse_seobj(p, syms, types);
 
         for (const auto& t : types) {
             AtomicStatement stmt;
             stmt.cmd = CMD_TYPE_STATE;
             stmt.subcmd = subcmd;
-            stmt.sepol1 = PolicyObject::from_str(t);
+            stmt.sepol1 = t;
             statements.push_back(stmt);
         }
         return true;
@@ -337,27 +394,28 @@ static bool parse_rule(const std::string& rule, std::vector<AtomicStatement>& st
 
     // type type_name attr1 attr2 ...
     if (cmd_str == "type") {
-        std::string type_name;
+        std::string_view type_name;
         p = skip_space(p);
         p = parse_word(p, type_name);
+        PolicyObject type_obj = PolicyObject::from_str(syms, type_name);
 
-        std::vector<std::string> attrs;
-        p = parse_seobj(p, attrs);
+        std::vector<PolicyObject> attrs;
+        p = parse_seobj(p, syms, attrs);
 
         if (attrs.empty()) {
             // Type with no attributes
             AtomicStatement stmt;
             stmt.cmd = CMD_TYPE;
             stmt.subcmd = 0;
-            stmt.sepol1 = PolicyObject::from_str(type_name);
+            stmt.sepol1 = type_obj;
             statements.push_back(stmt);
         } else {
             for (const auto& attr : attrs) {
                 AtomicStatement stmt;
                 stmt.cmd = CMD_TYPE;
                 stmt.subcmd = 0;
-                stmt.sepol1 = PolicyObject::from_str(type_name);
-                stmt.sepol2 = PolicyObject::from_str(attr);
+                stmt.sepol1 = type_obj;
+                stmt.sepol2 = attr;
                 statements.push_back(stmt);
             }
         }
@@ -366,17 +424,17 @@ static bool parse_rule(const std::string& rule, std::vector<AtomicStatement>& st
 
     // typeattribute type attr1 attr2 ...
     if (cmd_str == "typeattribute") {
-        std::vector<std::string> types, attrs;
-        p = parse_seobj(p, types);
-        p = parse_seobj(p, attrs);
+        std::vector<PolicyObject> types, attrs;
+        p = parse_seobj(p, syms, types);
+        p = parse_seobj(p, syms, attrs);
 
         for (const auto& t : types) {
             for (const auto& attr : attrs) {
                 AtomicStatement stmt;
                 stmt.cmd = CMD_TYPE_ATTR;
                 stmt.subcmd = 0;
-                stmt.sepol1 = PolicyObject::from_str(t);
-                stmt.sepol2 = PolicyObject::from_str(attr);
+                stmt.sepol1 = t;
+                stmt.sepol2 = attr;
                 statements.push_back(stmt);
             }
         }
@@ -385,21 +443,21 @@ static bool parse_rule(const std::string& rule, std::vector<AtomicStatement>& st
 
     // attribute attr_name
     if (cmd_str == "attribute") {
-        std::string attr_name;
+        std::string_view attr_name;
         p = skip_space(p);
         p = parse_word(p, attr_name);
 
         AtomicStatement stmt;
         stmt.cmd = CMD_ATTR;
         stmt.subcmd = 0;
-        stmt.sepol1 = PolicyObject::from_str(attr_name);
+        stmt.sepol1 = PolicyObject::from_str(syms, attr_name);
         statements.push_back(stmt);
         return true;
     }
 
     // type_transition source target:class default_type [object_name]
     if (cmd_str == "type_transition") {
-        std::string source, target, tclass, default_type, object_name;
+        std::string_view source, target, tclass, default_type, object_name;
 
         p = skip_space(p);
         p = parse_word(p, source);
@@ -407,18 +465,13 @@ static bool parse_rule(const std::string& rule, std::vector<AtomicStatement>& st
         p = parse_word(p, target);
 
         // Handle target:class format
-        size_t colon = target.find(':');
-        if (colon != std::string::npos) {
-            tclass = target.substr(colon + 1);
-            target = target.substr(0, colon);
-        } else {
+        split_target_class(target, tclass);
+        if (tclass.empty()) {
             p = skip_space(p);
             if (*p == ':') {
                 p++;
-                p = parse_word(p, tclass);
-            } else {
-                p = parse_word(p, tclass);
             }
+            p = parse_word(p, tclass);
         }
 
         p = skip_space(p);
@@ -428,12 +481,7 @@ static bool parse_rule(const std::string& rule, std::vector<AtomicStatement>& st
         if (*p) {
             // Optional object_name (may be quoted)
             if (*p == '"') {
-                p++;
-                while (*p && *p != '"') {
-                    object_name += *p++;
-                }
-                if (*p == '"')
-                    p++;
+                p = parse_quoted(p, object_name);
             } else {
                 p = parse_word(p, object_name);
             }
@@ -442,12 +490,12 @@ static bool parse_rule(const std::string& rule, std::vector<AtomicStatement>& st
         AtomicStatement stmt;
         stmt.cmd = CMD_TYPE_TRANSITION;
         stmt.subcmd = 0;
-        stmt.sepol1 = PolicyObject::from_str(source);
-        stmt.sepol2 = PolicyObject::from_str(target);
-        stmt.sepol3 = PolicyObject::from_str(tclass);
-        stmt.sepol4 = PolicyObject::from_str(default_type);
+        stmt.sepol1 = PolicyObject::from_str(syms, source);
+        stmt.sepol2 = PolicyObject::from_str(syms, target);
+        stmt.sepol3 = PolicyObject::from_str(syms, tclass);
+        stmt.sepol4 = PolicyObject::from_str(syms, default_type);
         if (!object_name.empty()) {
-            stmt.sepol5 = PolicyObject::from_str(object_name);
+            stmt.sepol5 = PolicyObject::from_str(syms, object_name);
         }
         statements.push_back(stmt);
         return true;
@@ -457,25 +505,20 @@ static bool parse_rule(const std::string& rule, std::vector<AtomicStatement>& st
     if (cmd_str == "type_change" || cmd_str == "type_member") {
         uint32_t subcmd = (cmd_str == "type_change") ? SUBCMD_TYPE_CHANGE : SUBCMD_TYPE_MEMBER;
 
-        std::string source, target, tclass, default_type;
+        std::string_view source, target, tclass, default_type;
 
         p = skip_space(p);
         p = parse_word(p, source);
         p = skip_space(p);
         p = parse_word(p, target);
 
-        size_t colon = target.find(':');
-        if (colon != std::string::npos) {
-            tclass = target.substr(colon + 1);
-            target = target.substr(0, colon);
-        } else {
+        split_target_class(target, tclass);
+        if (tclass.empty()) {
             p = skip_space(p);
             if (*p == ':') {
                 p++;
-                p = parse_word(p, tclass);
-            } else {
-                p = parse_word(p, tclass);
             }
+            p = parse_word(p, tclass);
         }
 
         p = skip_space(p);
@@ -484,17 +527,17 @@ static bool parse_rule(const std::string& rule, std::vector<AtomicStatement>& st
         AtomicStatement stmt;
         stmt.cmd = CMD_TYPE_CHANGE;
         stmt.subcmd = subcmd;
-        stmt.sepol1 = PolicyObject::from_str(source);
-        stmt.sepol2 = PolicyObject::from_str(target);
-        stmt.sepol3 = PolicyObject::from_str(tclass);
-        stmt.sepol4 = PolicyObject::from_str(default_type);
+        stmt.sepol1 = PolicyObject::from_str(syms, source);
+        stmt.sepol2 = PolicyObject::from_str(syms, target);
+        stmt.sepol3 = PolicyObject::from_str(syms, tclass);
+        stmt.sepol4 = PolicyObject::from_str(syms, default_type);
         statements.push_back(stmt);
         return true;
     }
 
     // genfscon fs_name partial_path fs_context
     if (cmd_str == "genfscon") {
-        std::string fs_name, partial_path, fs_context;
+        std::string_view fs_name, partial_path, fs_context;
 
         p = skip_space(p);
         p = parse_word(p, fs_name);
@@ -502,12 +545,7 @@ static bool parse_rule(const std::string& rule, std::vector<AtomicStatement>& st
 
         // partial_path might be quoted or not
         if (*p == '"') {
-            p++;
-            while (*p && *p != '"') {
-                partial_path += *p++;
-            }
-            if (*p == '"')
-                p++;
+            p = parse_quoted(p, partial_path);
         } else {
             p = parse_word(p, partial_path);
         }
@@ -518,20 +556,20 @@ static bool parse_rule(const std::string& rule, std::vector<AtomicStatement>& st
         AtomicStatement stmt;
         stmt.cmd = CMD_GENFSCON;
         stmt.subcmd = 0;
-        stmt.sepol1 = PolicyObject::from_str(fs_name);
-        stmt.sepol2 = PolicyObject::from_str(partial_path);
-        stmt.sepol3 = PolicyObject::from_str(fs_context);
+        stmt.sepol1 = PolicyObject::from_str(syms, fs_name);
+        stmt.sepol2 = PolicyObject::from_str(syms, partial_path);
+        stmt.sepol3 = PolicyObject::from_str(syms, fs_context);
         statements.push_back(stmt);
         return true;
     }
 
-    LOGW("Unknown sepolicy command: %s", cmd_str.c_str());
+    LOGW("Unknown sepolicy command: %.*s", static_cast<int>(cmd_str.size()), cmd_str.data());
     return false;
 }
 
 // Apply a single atomic statement to kernel
-static int apply_statement(const AtomicStatement& stmt) {
-    FfiPolicy ffi = stmt.to_ffi();
+static int apply_statement(const AtomicStatement& stmt, const SymbolTable& syms) {
+    FfiPolicy ffi = stmt.to_ffi(syms);
 
     SetSepolicyCmd cmd;
     cmd.cmd = 0;
@@ -544,42 +582,77 @@ static int apply_statement(const AtomicStatement& stmt) {
     return ret;
 }
 
-int sepolicy_live_patch(const std::string& policy) {
-    std::vector<AtomicStatement> statements;
+// Splits policy into rules (by newline and semicolon), parses each and hands
+// its statements to apply(stmt, syms), which returns < 0 on failure.
+// Returns the number of rules that failed to parse plus failed statements.
+template <typename Apply>
+static int for_each_statement(const std::string& policy, SepolicyParseStats* stats,
+                              Apply&& apply) {
+    // One mutable copy of the whole policy; rules are NUL-terminated in
+    // place so the parser can hand out views without per-rule strings.
+    std::vector<char> buf(policy.begin(), policy.end());
+    buf.push_back('\0');
+
+    SymbolTable syms;
+    std::vector<AtomicStatement> rule_stmts;
     int errors = 0;
 
-    // Split by newline and semicolon
-    std::istringstream iss(policy);
-    std::string line;
+    char* p = buf.data();
+    char* const end = p + policy.size();
+    while (p < end) {
+        char* rule_end = p;
+        while (rule_end < end && *rule_end != '\n' && *rule_end != ';')
+            rule_end++;
+        *rule_end = '\0';
+
+        char* rule = const_cast<char*>(skip_space(p));
+        char* last = rule_end;
+        while (last > rule && std::isspace(static_cast<unsigned char>(last[-1])))
+            *--last = '\0';
+        p = rule_end + 1;
+
+        if (*rule == '\0' || *rule == '#') {
+            continue;
+        }
 
-    while (std::getline(iss, line)) {
-        // Handle semicolon-separated rules
-        std::istringstream line_iss(line);
-        std::string rule;
-        while (std::getline(line_iss, rule, ';')) {
-            std::string trimmed = trim(rule);
-            if (trimmed.empty() || trimmed[0] == '#') {
-                continue;
-            }
+        rule_stmts.clear();
+        if (stats) {
+            stats->rules++;
+        }
+        if (!parse_rule(rule, syms, rule_stmts)) {
+            LOGW("Failed to parse rule: %s", rule);
+            errors++;
+            continue;
+        }
 
-            std::vector<AtomicStatement> rule_stmts;
-            if (!parse_rule(trimmed, rule_stmts)) {
-                LOGW("Failed to parse rule: %s", trimmed.c_str());
+        for (const auto& stmt : rule_stmts) {
+            if (apply(stmt, syms) < 0) {
                 errors++;
-                continue;
-            }
-
-            for (const auto& stmt : rule_stmts) {
-                if (apply_statement(stmt) < 0) {
-                    errors++;
-                }
             }
         }
+        if (stats) {
+            stats->statements += rule_stmts.size();
+        }
+    }
+
+    if (stats) {
+        stats->errors = static_cast<size_t>(errors);
     }
+    return errors;
+}
 
+int sepolicy_live_patch(const std::string& policy) {
+    int errors = for_each_statement(policy, nullptr, apply_statement);
     return errors > 0 ? 1 : 0;
 }
 
+SepolicyParseStats sepolicy_parse(const std::string& policy) {
+    SepolicyParseStats stats;
+    for_each_statement(policy, &stats,
+                       [](const AtomicStatement&, const SymbolTable&) { return 0; });
+    return stats;
+}
+
 int sepolicy_apply_file(const std::string& file) {
     auto content = read_file(file);
     if (!content) {
@@ -1,10 +1,20 @@
 #pragma once
 
+#include <cstddef>
 #include <string>
 
 namespace ksud {
 
 int sepolicy_live_patch(const std::string& policy);
+
+// Parses policy exactly as sepolicy_live_patch does without applying
+// anything to the kernel (for benchmarks and checks)
+struct SepolicyParseStats {
+    size_t rules = 0;
+    size_t statements = 0;
+    size_t errors = 0;
+};
+SepolicyParseStats sepolicy_parse(const std::string& policy);
 int sepolicy_apply_file(const std::string& file);
 int sepolicy_check_rule(const std::string& policy);
 
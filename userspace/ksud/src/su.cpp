@@ -1,8 +1,9 @@
 #include "su.hpp"
 #include "core/ksucalls.hpp"
+#include "core/process.hpp"
 #include "defs.hpp"
 #include "log.hpp"
-#include "utils.hpp"
+#include "su_broker.hpp"
 
 #include <fcntl.h>
 #include <getopt.h>
@@ -44,7 +45,7 @@ static void set_identity(uid_t uid, gid_t gid, const std::vector<gid_t>& groups)
     setresuid(uid, uid, uid);
 }
 
-static void wrap_tty(int fd) {
+void wrap_tty(int fd) {
     if (isatty(fd) != 1) {
         return;
     }
@@ -60,16 +61,6 @@ static void wrap_tty(int fd) {
 }
 
 int su_main(int argc, char* argv[]) {
-    // Grant root first
-    if (grant_root() < 0) {
-        LOGE("Failed to grant root");
-        return 1;
-    }
-
-    // Set UID/GID to 0 temporarily
-    setgid(0);
-    setuid(0);
-
     // Parse options
     std::string command;
     std::string shell = "/system/bin/sh";  // Use system shell by default (like Rust version)
@@ -208,6 +199,36 @@ int su_main(int argc, char* argv[]) {
         }
     }
 
+    // One-shot commands go to the su broker when it runs; it already holds
+    // the caller's profile and the driver fd, so nothing below is needed
+    if (!command.empty() && !is_login) {
+        SuBrokerCommand broker_cmd;
+        broker_cmd.uid = target_uid;
+        broker_cmd.gid = target_gid;
+        broker_cmd.groups = groups;
+        broker_cmd.mount_master = mount_master;
+        broker_cmd.wrap_tty = use_fd_wrapper;
+        broker_cmd.preserve_env = preserve_env;
+        broker_cmd.shell = shell;
+        broker_cmd.command = command;
+        for (char** e = environ; *e; e++) {
+            broker_cmd.env.emplace_back(*e);
+        }
+        int exit_code;
+        if (su_broker_exec(broker_cmd, &exit_code)) {
+            return exit_code;
+        }
+    }
+
+    if (grant_root() < 0) {
+        LOGE("Failed to grant root");
+        return 1;
+    }
+
+    // Set UID/GID to 0 temporarily
+    setgid(0);
+    setuid(0);
+
     // Switch to global mount namespace if requested
     if (mount_master) {
         if (!switch_mnt_ns(1)) {
@@ -275,13 +296,38 @@ int su_main(int argc, char* argv[]) {
 
     shell_argv.push_back(nullptr);
 
-    // Execute shell
+    // Execute shell; queued log lines would be lost across exec
+    hide_driver_fd_from_exec();
+    log_flush();
     execv(shell.c_str(), const_cast<char* const*>(shell_argv.data()));
 
     LOGE("Failed to exec shell %s: %s", shell.c_str(), strerror(errno));
     return 127;
 }
 
+void sh_main(int argc, char* argv[]) {
+    // Use busybox to handle shell operations
+    const char* busybox = BUSYBOX_PATH;
+
+    // Build argv for busybox: busybox sh [original args...]
+    std::vector<char*> new_argv;
+    new_argv.push_back(const_cast<char*>("sh"));
+    for (int i = 1; i < argc; i++) {
+        new_argv.push_back(argv[i]);
+    }
+    new_argv.push_back(nullptr);
+
+    // Set ASH_STANDALONE to make busybox ash work properly
+    setenv("ASH_STANDALONE", "1", 1);
+    hide_driver_fd_from_exec();
+    log_flush();
+
+    execv(busybox, new_argv.data());
+    // If busybox fails, try system sh as fallback
+    execv("/system/bin/toybox", new_argv.data());
+    _exit(127);
+}
+
 // Legacy functions for backward compatibility
 int root_shell() {
     char* argv[] = {const_cast<char*>("su"), nullptr};
@@ -324,6 +370,8 @@ int grant_root_shell(bool global_mnt) {
     // Exec to sh immediately (matching Rust behavior)
     // This avoids any complex operations that might trigger SECCOMP
     char* shell_argv[] = {const_cast<char*>("sh"), nullptr};
+    hide_driver_fd_from_exec();
+    log_flush();
     execv("/system/bin/sh", shell_argv);
 
     LOGE("Failed to exec shell: %s", strerror(errno));
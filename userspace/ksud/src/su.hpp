@@ -5,6 +5,12 @@ namespace ksud {
 // Main su entry point - handles all command line arguments
 int su_main(int argc, char* argv[]);
 
+// "sh" personality: forwards to busybox sh
+[[noreturn]] void sh_main(int argc, char* argv[]);
+
+// Swap a tty fd for the kernel's ksu fd wrapper; other fds are left alone
+void wrap_tty(int fd);
+
 // Legacy functions for backward compatibility
 int root_shell();
 int grant_root_shell(bool global_mnt);
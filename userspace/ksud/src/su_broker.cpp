@@ -0,0 +1,538 @@
+#include "su_broker.hpp"
+#include "core/ksucalls.hpp"
+#include "core/process.hpp"
+#include "defs.hpp"
+#include "log.hpp"
+#include "sepolicy/sepolicy.hpp"
+#include "su.hpp"
+#include "su_broker_protocol.hpp"
+
+#include <fcntl.h>
+#include <grp.h>
+#include <poll.h>
+#include <pwd.h>
+#include <signal.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+
+namespace ksud {
+
+// Daemon -> worker: one accepted connection, passed as SCM_RIGHTS
+struct BrokerDispatch {
+    uint32_t caller_uid;
+    int32_t caller_pid;
+};
+
+// Unbound workers kept forked and ready for a new caller uid
+static constexpr size_t BROKER_SPARE_WORKERS = 2;
+// A bound worker carries the profile it was granted; retire it when idle or
+// old so profile edits in the manager are picked up
+static constexpr time_t BROKER_IDLE_TIMEOUT = 30;
+static constexpr time_t BROKER_MAX_AGE = 300;
+
+static void send_reply(int conn, BrokerReplyKind kind, int32_t status) {
+    BrokerReply reply = {BROKER_MAGIC, kind, status};
+    send(conn, &reply, sizeof(reply), MSG_NOSIGNAL);
+}
+
+// ---------------------------------------------------------------------------
+// Worker: bound to one caller uid, runs that caller's commands
+
+struct BrokerJob {
+    int conn;
+    pid_t pid;  // -1 while waiting for the request
+    pid_t caller_pid;
+    bool hung_up;
+};
+
+// Start from the caller's environment, then adjust it exactly as su_main
+// does for an in-process command
+static void setup_env(const BrokerRequest& req, const std::string& shell, const std::string& env) {
+    clearenv();
+    for (size_t pos = 0; pos < env.size();) {
+        size_t end = env.find('\0', pos);
+        if (end == std::string::npos)
+            end = env.size();
+        std::string entry = env.substr(pos, end - pos);
+        pos = end + 1;
+
+        size_t eq = entry.find('=');
+        if (eq == 0 || eq == std::string::npos)
+            continue;
+        entry[eq] = '\0';
+        // The caller's driver fd number means nothing here
+        if (strcmp(entry.c_str(), KSU_DRIVER_FD_ENV) == 0)
+            continue;
+        setenv(entry.c_str(), entry.c_str() + eq + 1, 1);
+    }
+
+    setenv("ASH_STANDALONE", "1", 1);
+    const char* old_path = getenv("PATH");
+    std::string new_path = "/data/adb/ksu/bin";
+    if (old_path && old_path[0] != '\0') {
+        new_path = new_path + ":" + old_path;
+    }
+    setenv("PATH", new_path.c_str(), 1);
+    if (access(KSURC_PATH, F_OK) == 0 && getenv("ENV") == nullptr) {
+        setenv("ENV", KSURC_PATH, 1);
+    }
+    if (!(req.flags & BROKER_FLAG_PRESERVE_ENV)) {
+        struct passwd* pw = getpwuid(req.uid);
+        setenv("HOME", pw ? pw->pw_dir : "/data", 1);
+        setenv("USER", pw ? pw->pw_name : "root", 1);
+        setenv("LOGNAME", pw ? pw->pw_name : "root", 1);
+        setenv("SHELL", shell.c_str(), 1);
+    }
+}
+
+[[noreturn]] static void run_command(const BrokerRequest& req, const std::string& shell,
+                                     const std::string& command, const std::string& env,
+                                     const int* fds, pid_t caller_pid) {
+    setpgid(0, 0);
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigprocmask(SIG_SETMASK, &mask, nullptr);
+    signal(SIGPIPE, SIG_DFL);
+    signal(SIGCHLD, SIG_DFL);
+
+    // Same mount namespace the in-process su would have run in
+    if (!switch_mnt_ns((req.flags & BROKER_FLAG_MOUNT_MASTER) ? 1 : caller_pid)) {
+        LOGW("broker: keeping the broker mount namespace");
+    }
+
+    for (int i = 0; i < 3; i++) {
+        dup2(fds[i], i);
+    }
+    if (fchdir(fds[3]) != 0) {
+        chdir("/");
+    }
+    for (int i = 0; i < BROKER_PASSED_FDS; i++) {
+        if (fds[i] > 2)
+            close(fds[i]);
+    }
+    if (req.flags & BROKER_FLAG_WRAP_TTY) {
+        wrap_tty(0);
+        wrap_tty(1);
+        wrap_tty(2);
+    }
+
+    setup_env(req, shell, env);
+
+    ::umask(022);
+    if (req.groups_count > 0) {
+        std::vector<gid_t> groups(req.groups, req.groups + req.groups_count);
+        setgroups(groups.size(), groups.data());
+    }
+    setresgid(req.gid, req.gid, req.gid);
+    setresuid(req.uid, req.uid, req.uid);
+
+    const char* argv[] = {shell.c_str(), "-c", command.c_str(), nullptr};
+    log_flush();
+    execv(shell.c_str(), const_cast<char* const*>(argv));
+    LOGE("broker: failed to exec %s: %s", shell.c_str(), strerror(errno));
+    log_flush();
+    _exit(127);
+}
+
+// Reads the request off a freshly dispatched connection and forks the command
+static pid_t start_job(int conn, pid_t caller_pid) {
+    std::vector<char> buf(sizeof(BrokerRequest) + BROKER_MAX_PAYLOAD);
+    int fds[BROKER_PASSED_FDS];
+    ssize_t n = recv_with_fds(conn, buf.data(), buf.size(), fds, BROKER_PASSED_FDS);
+
+    BrokerRequest req;
+    bool valid = n >= static_cast<ssize_t>(sizeof(req));
+    if (valid) {
+        memcpy(&req, buf.data(), sizeof(req));
+        valid = req.magic == BROKER_MAGIC && req.groups_count <= BROKER_MAX_GROUPS &&
+                req.shell_len > 0 &&
+                sizeof(req) + req.shell_len + req.command_len + req.env_len ==
+                    static_cast<size_t>(n);
+    }
+    for (int i = 0; valid && i < BROKER_PASSED_FDS; i++) {
+        valid = fds[i] >= 0;
+    }
+    if (!valid) {
+        LOGW("broker: malformed request");
+        for (int fd : fds) {
+            if (fd >= 0)
+                close(fd);
+        }
+        return -1;
+    }
+
+    const char* payload = buf.data() + sizeof(req);
+    std::string shell(payload, req.shell_len);
+    std::string command(payload + req.shell_len, req.command_len);
+    std::string env(payload + req.shell_len + req.command_len, req.env_len);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        run_command(req, shell, command, env, fds, caller_pid);
+    }
+    for (int fd : fds) {
+        close(fd);
+    }
+    if (pid > 0) {
+        // Also done in the child; whichever runs first, kill(-pid) works
+        setpgid(pid, pid);
+    }
+    if (pid < 0) {
+        LOGE("broker: fork failed: %s", strerror(errno));
+        return -1;
+    }
+    send_reply(conn, BROKER_REPLY_STARTED, 0);
+    return pid;
+}
+
+// Takes on the caller's root profile: drop to its uid, then let the kernel
+// escalate exactly as it would for `su` run by that uid
+static bool bind_worker(uid_t caller_uid) {
+    if (caller_uid != 0 && setresuid(caller_uid, caller_uid, caller_uid) != 0) {
+        LOGE("broker: setresuid(%u) failed: %s", caller_uid, strerror(errno));
+        return false;
+    }
+    if (grant_root() < 0) {
+        LOGE("broker: grant_root for uid %u failed", caller_uid);
+        return false;
+    }
+    return true;
+}
+
+[[noreturn]] static void worker_main(int channel) {
+    signal(SIGCHLD, SIG_DFL);
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, nullptr);
+    int sig_fd = signalfd(-1, &mask, SFD_CLOEXEC);
+    if (sig_fd < 0) {
+        LOGE("broker: signalfd failed: %s", strerror(errno));
+        log_flush();
+        _exit(1);
+    }
+
+    switch_cgroups();
+
+    bool bound = false;
+    bool channel_open = true;
+    std::vector<BrokerJob> jobs;
+
+    while (channel_open || !jobs.empty()) {
+        std::vector<struct pollfd> pfds;
+        pfds.push_back({sig_fd, POLLIN, 0});
+        pfds.push_back({channel_open ? channel : -1, POLLIN, 0});
+        for (const auto& job : jobs) {
+            pfds.push_back({job.hung_up ? -1 : job.conn, POLLIN, 0});
+        }
+        if (poll(pfds.data(), pfds.size(), -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        auto job_done = [&](std::vector<BrokerJob>::iterator it) {
+            close(it->conn);
+            jobs.erase(it);
+            char done = 0;
+            send(channel, &done, 1, MSG_NOSIGNAL);
+        };
+
+        if (pfds[0].revents & POLLIN) {
+            struct signalfd_siginfo info;
+            read(sig_fd, &info, sizeof(info));
+            int status;
+            pid_t pid;
+            while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+                auto it = std::find_if(jobs.begin(), jobs.end(),
+                                       [pid](const BrokerJob& j) { return j.pid == pid; });
+                if (it == jobs.end())
+                    continue;
+                send_reply(it->conn, BROKER_REPLY_EXITED, status);
+                job_done(it);
+            }
+        }
+
+        // Connections: the request on a new one, hangup on a running one
+        for (size_t i = 2; i < pfds.size(); i++) {
+            if (pfds[i].fd < 0 || !pfds[i].revents)
+                continue;
+            auto it = std::find_if(jobs.begin(), jobs.end(),
+                                   [&](const BrokerJob& j) { return j.conn == pfds[i].fd; });
+            if (it == jobs.end())
+                continue;
+            if (it->pid < 0) {
+                it->pid = start_job(it->conn, it->caller_pid);
+                if (it->pid < 0) {
+                    send_reply(it->conn, BROKER_REPLY_DENIED, 0);
+                    job_done(it);
+                }
+            } else {
+                // Client went away: stop its command, reap it via SIGCHLD
+                kill(-it->pid, SIGHUP);
+                it->hung_up = true;
+            }
+        }
+
+        if (channel_open && pfds[1].revents) {
+            BrokerDispatch dispatch;
+            int conn;
+            ssize_t n = recv_with_fds(channel, &dispatch, sizeof(dispatch), &conn, 1);
+            if (n <= 0) {
+                // Daemon retired us: finish running jobs, then exit
+                channel_open = false;
+                continue;
+            }
+            if (n != sizeof(dispatch) || conn < 0) {
+                if (conn >= 0)
+                    close(conn);
+                continue;
+            }
+            if (!bound) {
+                if (!bind_worker(dispatch.caller_uid)) {
+                    send_reply(conn, BROKER_REPLY_DENIED, 0);
+                    log_flush();
+                    _exit(1);
+                }
+                bound = true;
+            }
+            jobs.push_back({conn, -1, dispatch.caller_pid, false});
+        }
+    }
+    log_flush();
+    _exit(0);
+}
+
+// ---------------------------------------------------------------------------
+// Daemon: accepts, authenticates and routes connections to workers
+
+struct BrokerWorker {
+    pid_t pid;
+    int channel;
+    bool bound;
+    uid_t uid;
+    size_t running;
+    time_t started;
+    time_t last_used;
+};
+
+static bool spawn_worker(std::vector<BrokerWorker>& workers, int listen_fd) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) != 0) {
+        LOGE("broker: socketpair failed: %s", strerror(errno));
+        return false;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        LOGE("broker: fork failed: %s", strerror(errno));
+        close(sv[0]);
+        close(sv[1]);
+        return false;
+    }
+    if (pid == 0) {
+        close(listen_fd);
+        close(sv[0]);
+        for (const auto& w : workers) {
+            close(w.channel);
+        }
+        worker_main(sv[1]);
+    }
+
+    close(sv[1]);
+    time_t now = time(nullptr);
+    workers.push_back({pid, sv[0], false, 0, 0, now, now});
+    return true;
+}
+
+static BrokerWorker* pick_worker(std::vector<BrokerWorker>& workers, uid_t uid) {
+    for (auto& w : workers) {
+        if (w.bound && w.uid == uid)
+            return &w;
+    }
+    for (auto& w : workers) {
+        if (!w.bound)
+            return &w;
+    }
+    return nullptr;
+}
+
+static void handle_connection(std::vector<BrokerWorker>& workers, int listen_fd, int conn) {
+    struct ucred cred;
+    socklen_t cred_len = sizeof(cred);
+    if (getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) != 0) {
+        close(conn);
+        return;
+    }
+
+    // Checked per connection, so revoking root in the manager takes effect
+    // on the next su even while a worker for that uid is still alive
+    if (cred.uid != 0 && !uid_granted_root(cred.uid)) {
+        LOGW("broker: uid %u (pid %d) is not granted root", cred.uid, cred.pid);
+        send_reply(conn, BROKER_REPLY_DENIED, 0);
+        close(conn);
+        return;
+    }
+
+    BrokerWorker* worker = pick_worker(workers, cred.uid);
+    if (!worker) {
+        if (!spawn_worker(workers, listen_fd)) {
+            send_reply(conn, BROKER_REPLY_DENIED, 0);
+            close(conn);
+            return;
+        }
+        worker = &workers.back();
+    }
+
+    BrokerDispatch dispatch = {cred.uid, cred.pid};
+    if (!send_with_fds(worker->channel, &dispatch, sizeof(dispatch), &conn, 1)) {
+        send_reply(conn, BROKER_REPLY_DENIED, 0);
+    } else {
+        if (!worker->bound) {
+            LOGI("broker: worker %d bound to uid %u", worker->pid, cred.uid);
+        }
+        worker->bound = true;
+        worker->uid = cred.uid;
+        worker->running++;
+        worker->last_used = time(nullptr);
+    }
+    close(conn);
+}
+
+int su_broker_main() {
+    // Exited workers are reaped by the kernel; workers restore SIGCHLD
+    signal(SIGCHLD, SIG_IGN);
+    signal(SIGPIPE, SIG_IGN);
+
+    // Callers run in their app domain (or as adb shell); let exactly those
+    // reach the broker socket. One rule per line, so a domain missing from
+    // an older policy doesn't take the others down with it.
+    if (sepolicy_live_patch("allow untrusted_app_all su unix_stream_socket connectto\n"
+                            "allow priv_app su unix_stream_socket connectto\n"
+                            "allow platform_app su unix_stream_socket connectto\n"
+                            "allow system_app su unix_stream_socket connectto\n"
+                            "allow shell su unix_stream_socket connectto") != 0) {
+        LOGW("broker: failed to patch sepolicy, app callers may be denied");
+    }
+
+    int listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        LOGE("broker: socket failed: %s", strerror(errno));
+        return 1;
+    }
+    struct sockaddr_un addr;
+    socklen_t addr_len = broker_address(&addr);
+    if (bind(listen_fd, reinterpret_cast<struct sockaddr*>(&addr), addr_len) != 0 ||
+        listen(listen_fd, 64) != 0) {
+        LOGE("broker: bind/listen failed: %s", strerror(errno));
+        close(listen_fd);
+        return 1;
+    }
+
+    // Open the driver fd now, so every worker inherits it instead of
+    // probing for it on its first request
+    get_version();
+
+    LOGI("su broker listening on @%s", SU_BROKER_SOCKET_NAME);
+
+    std::vector<BrokerWorker> workers;
+    for (;;) {
+        size_t spares = std::count_if(workers.begin(), workers.end(),
+                                      [](const BrokerWorker& w) { return !w.bound; });
+        for (; spares < BROKER_SPARE_WORKERS; spares++) {
+            if (!spawn_worker(workers, listen_fd))
+                break;
+        }
+
+        std::vector<struct pollfd> pfds;
+        pfds.push_back({listen_fd, POLLIN, 0});
+        for (const auto& w : workers) {
+            pfds.push_back({w.channel, POLLIN, 0});
+        }
+        int ret = poll(pfds.data(), pfds.size(), BROKER_IDLE_TIMEOUT * 1000 / 2);
+        if (ret < 0 && errno != EINTR) {
+            LOGE("broker: poll failed: %s", strerror(errno));
+            break;
+        }
+
+        // Worker messages: one byte per finished job, hangup when it exits
+        std::vector<pid_t> dead;
+        for (size_t i = 1; i < pfds.size(); i++) {
+            if (!pfds[i].revents)
+                continue;
+            BrokerWorker& w = workers[i - 1];
+            char done;
+            ssize_t n = recv(w.channel, &done, 1, MSG_DONTWAIT);
+            if (n == 1) {
+                if (w.running > 0)
+                    w.running--;
+                w.last_used = time(nullptr);
+            } else if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+                dead.push_back(w.pid);
+            }
+        }
+
+        // Retire idle or old bound workers; closing the channel tells the
+        // worker to exit once its running commands finish
+        time_t now = time(nullptr);
+        for (auto it = workers.begin(); it != workers.end();) {
+            bool is_dead = std::find(dead.begin(), dead.end(), it->pid) != dead.end();
+            bool retire = it->bound && it->running == 0 &&
+                          (now - it->last_used >= BROKER_IDLE_TIMEOUT ||
+                           now - it->started >= BROKER_MAX_AGE);
+            if (is_dead || retire) {
+                close(it->channel);
+                it = workers.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        if (ret > 0 && (pfds[0].revents & POLLIN)) {
+            int conn = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (conn >= 0) {
+                handle_connection(workers, listen_fd, conn);
+            }
+        }
+    }
+
+    close(listen_fd);
+    return 1;
+}
+
+void su_broker_start_if_enabled() {
+    if (access(SU_BROKER_FLAG_PATH, F_OK) != 0) {
+        return;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        LOGE("Failed to fork su broker: %s", strerror(errno));
+        return;
+    }
+    if (pid == 0) {
+        setsid();
+        int null_fd = open("/dev/null", O_RDWR);
+        if (null_fd >= 0) {
+            dup2(null_fd, STDIN_FILENO);
+            dup2(null_fd, STDOUT_FILENO);
+            dup2(null_fd, STDERR_FILENO);
+            if (null_fd > STDERR_FILENO)
+                close(null_fd);
+        }
+        log_flush();
+        _exit(su_broker_main());
+    }
+    LOGI("su broker started, pid %d", pid);
+}
+
+}  // namespace ksud
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <sys/types.h>
+#include <string>
+#include <vector>
+
+namespace ksud {
+
+// One `su -c` invocation as forwarded to the broker
+struct SuBrokerCommand {
+    uid_t uid = 0;
+    gid_t gid = 0;
+    std::vector<gid_t> groups;
+    bool mount_master = false;
+    bool wrap_tty = true;
+    bool preserve_env = false;
+    std::string shell;
+    std::string command;
+    // The caller's environment; the command starts from it as it would in
+    // the in-process path
+    std::vector<std::string> env;
+};
+
+// Run the broker in the foreground; only returns on a fatal error
+int su_broker_main();
+
+// Fork the broker into the background if SU_BROKER_FLAG_PATH exists
+void su_broker_start_if_enabled();
+
+// Client side of `su -c`. Returns false if no broker is listening or it refused
+// the caller, in which case su falls back to the in-process path. On true,
+// exit_code holds the command's exit code (128 + signal if it was killed).
+bool su_broker_exec(const SuBrokerCommand& cmd, int* exit_code);
+
+}  // namespace ksud
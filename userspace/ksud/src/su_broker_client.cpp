@@ -0,0 +1,193 @@
+#include "su_broker.hpp"
+#include "defs.hpp"
+#include "log.hpp"
+#include "su_broker_protocol.hpp"
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+namespace ksud {
+
+socklen_t broker_address(struct sockaddr_un* addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    size_t len = strlen(SU_BROKER_SOCKET_NAME);
+    // Abstract namespace: leading NUL, no trailing NUL
+    memcpy(addr->sun_path + 1, SU_BROKER_SOCKET_NAME, len);
+    return static_cast<socklen_t>(offsetof(struct sockaddr_un, sun_path) + 1 + len);
+}
+
+bool send_with_fds(int sock, const void* data, size_t len, const int* fds, int nfds) {
+    struct iovec iov = {const_cast<void*>(data), len};
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int) * BROKER_PASSED_FDS)];
+    if (nfds > 0) {
+        msg.msg_control = control;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * nfds);
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * nfds);
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * nfds);
+    }
+
+    ssize_t n;
+    do {
+        n = sendmsg(sock, &msg, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+    return n == static_cast<ssize_t>(len);
+}
+
+ssize_t recv_with_fds(int sock, void* data, size_t len, int* fds, int max_fds) {
+    struct iovec iov = {data, len};
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int) * BROKER_PASSED_FDS)];
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    for (int i = 0; i < max_fds; i++)
+        fds[i] = -1;
+
+    ssize_t n;
+    do {
+        n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0)
+        return n;
+
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+        int count = static_cast<int>((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+        const int* in = reinterpret_cast<const int*>(CMSG_DATA(cmsg));
+        for (int i = 0; i < count; i++) {
+            if (i < max_fds)
+                fds[i] = in[i];
+            else
+                close(in[i]);
+        }
+    }
+    // A truncated message may have dropped some of the fds; callers reject it
+    if (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) {
+        for (int i = 0; i < max_fds; i++) {
+            if (fds[i] >= 0)
+                close(fds[i]);
+            fds[i] = -1;
+        }
+        errno = EMSGSIZE;
+        return -1;
+    }
+    return n;
+}
+
+bool su_broker_exec(const SuBrokerCommand& cmd, int* exit_code) {
+    std::string env;
+    for (const auto& entry : cmd.env) {
+        env += entry;
+        env += '\0';
+    }
+    if (cmd.groups.size() > BROKER_MAX_GROUPS ||
+        cmd.shell.size() + cmd.command.size() + env.size() > BROKER_MAX_PAYLOAD) {
+        return false;
+    }
+
+    int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        return false;
+    }
+    struct sockaddr_un addr;
+    socklen_t addr_len = broker_address(&addr);
+    if (connect(sock, reinterpret_cast<struct sockaddr*>(&addr), addr_len) != 0) {
+        close(sock);
+        return false;
+    }
+
+    // Abstract names are first come, first served: any app can bind this one
+    // while the broker is off. Only talk to a listener that is root, or the
+    // command and our terminal fds would go to whoever squatted the name.
+    struct ucred peer = {0, static_cast<uid_t>(-1), static_cast<gid_t>(-1)};
+    socklen_t peer_len = sizeof(peer);
+    if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &peer, &peer_len) != 0 || peer.uid != 0) {
+        LOGW("su broker socket is held by uid %d, ignoring it", static_cast<int>(peer.uid));
+        close(sock);
+        return false;
+    }
+
+    BrokerRequest req = {};
+    req.magic = BROKER_MAGIC;
+    req.uid = cmd.uid;
+    req.gid = cmd.gid;
+    req.flags = (cmd.mount_master ? BROKER_FLAG_MOUNT_MASTER : 0) |
+                (cmd.wrap_tty ? BROKER_FLAG_WRAP_TTY : 0) |
+                (cmd.preserve_env ? BROKER_FLAG_PRESERVE_ENV : 0);
+    req.groups_count = static_cast<uint32_t>(cmd.groups.size());
+    req.shell_len = static_cast<uint32_t>(cmd.shell.size());
+    req.command_len = static_cast<uint32_t>(cmd.command.size());
+    req.env_len = static_cast<uint32_t>(env.size());
+    std::copy(cmd.groups.begin(), cmd.groups.end(), req.groups);
+
+    std::string msg(reinterpret_cast<const char*>(&req), sizeof(req));
+    msg += cmd.shell;
+    msg += cmd.command;
+    msg += env;
+
+    int cwd_fd = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (cwd_fd < 0) {
+        cwd_fd = open("/", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    }
+    int fds[BROKER_PASSED_FDS] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO, cwd_fd};
+    bool sent = cwd_fd >= 0 && send_with_fds(sock, msg.data(), msg.size(), fds, BROKER_PASSED_FDS);
+    if (cwd_fd >= 0) {
+        close(cwd_fd);
+    }
+    if (!sent) {
+        close(sock);
+        return false;
+    }
+
+    // Until STARTED arrives nothing has run, so any failure falls back
+    bool started = false;
+    for (;;) {
+        BrokerReply reply;
+        ssize_t n = recv(sock, &reply, sizeof(reply), 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n != sizeof(reply) || reply.magic != BROKER_MAGIC ||
+            reply.kind == BROKER_REPLY_DENIED) {
+            break;
+        }
+        if (reply.kind == BROKER_REPLY_STARTED) {
+            started = true;
+            continue;
+        }
+        int status = reply.status;
+        if (WIFEXITED(status)) {
+            *exit_code = WEXITSTATUS(status);
+        } else if (WIFSIGNALED(status)) {
+            *exit_code = 128 + WTERMSIG(status);
+        } else {
+            *exit_code = 1;
+        }
+        close(sock);
+        return true;
+    }
+
+    close(sock);
+    if (started) {
+        LOGE("su broker went away while the command was running");
+        *exit_code = 1;
+    }
+    return started;
+}
+
+}  // namespace ksud
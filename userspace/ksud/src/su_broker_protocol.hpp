@@ -0,0 +1,61 @@
+#pragma once
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <cstddef>
+#include <cstdint>
+
+namespace ksud {
+
+// Wire protocol. su and the broker are built from the same tree, so the
+// structs are sent as-is over SOCK_SEQPACKET, one message per struct.
+constexpr uint32_t BROKER_MAGIC = 0x5242534b;  // "KSBR"
+constexpr size_t BROKER_MAX_GROUPS = 32;
+// shell + command + the caller's environment; well below the default
+// SEQPACKET send buffer
+constexpr size_t BROKER_MAX_PAYLOAD = 65536;
+constexpr uint32_t BROKER_FLAG_MOUNT_MASTER = 1;
+constexpr uint32_t BROKER_FLAG_WRAP_TTY = 2;       // su without -W
+constexpr uint32_t BROKER_FLAG_PRESERVE_ENV = 4;  // su -p
+
+// The client's stdin, stdout, stderr and cwd ride along with the request, so
+// the command writes straight to the caller's pipes or tty
+constexpr int BROKER_PASSED_FDS = 4;
+
+struct BrokerRequest {
+    uint32_t magic;
+    uint32_t uid;
+    uint32_t gid;
+    uint32_t flags;
+    uint32_t groups_count;
+    uint32_t shell_len;
+    uint32_t command_len;
+    uint32_t env_len;
+    uint32_t groups[BROKER_MAX_GROUPS];
+    // followed by shell_len + command_len + env_len bytes; the environment
+    // is a sequence of NUL-terminated "NAME=value" strings
+};
+
+enum BrokerReplyKind : uint32_t {
+    BROKER_REPLY_DENIED = 0,
+    BROKER_REPLY_STARTED = 1,
+    BROKER_REPLY_EXITED = 2,
+};
+
+struct BrokerReply {
+    uint32_t magic;
+    uint32_t kind;
+    int32_t status;  // raw wait status for BROKER_REPLY_EXITED
+};
+
+// Fills in the abstract address of the broker socket
+socklen_t broker_address(struct sockaddr_un* addr);
+
+// One SEQPACKET message with up to BROKER_PASSED_FDS descriptors attached
+bool send_with_fds(int sock, const void* data, size_t len, const int* fds, int nfds);
+
+// Returns the message length; received fds are stored in fds, the rest set to -1
+ssize_t recv_with_fds(int sock, void* data, size_t len, int* fds, int max_fds);
+
+}  // namespace ksud
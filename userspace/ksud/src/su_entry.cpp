@@ -0,0 +1,20 @@
+#include "log.hpp"
+#include "su.hpp"
+
+#include <cstring>
+
+// Entry point of the lean su binary: only the su and sh personalities of
+// cli_run, without the embedded assets and the module/boot/hymo stacks
+int main(int argc, char* argv[]) {
+    ksud::log_init("KernelSU");
+    // su logs a handful of lines and then execs; a writer thread would only
+    // add startup cost and lose whatever is still queued at exec
+    ksud::log_set_sync();
+
+    const char* slash = strrchr(argv[0], '/');
+    const char* basename = slash ? slash + 1 : argv[0];
+    if (strcmp(basename, "sh") == 0) {
+        ksud::sh_main(argc, argv);
+    }
+    return ksud::su_main(argc, argv);
+}
@@ -0,0 +1,105 @@
+#include "sulog.hpp"
+#include "core/ksucalls.hpp"
+#include "log.hpp"
+
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+namespace ksud {
+
+static void print_record(const SulogRecord& rec) {
+    char time_buf[32];
+    time_t secs = static_cast<time_t>(rec.ts_ns / 1000000000ULL);
+    struct tm tm_info;
+    localtime_r(&secs, &tm_info);
+    strftime(time_buf, sizeof(time_buf), "%Y-%m-%d %H:%M:%S", &tm_info);
+
+    switch (rec.type) {
+    case SULOG_SU_GRANT:
+        printf("[%s] SU_GRANT: UID=%u COMM=%s METHOD=%s PID=%u\n", time_buf, rec.uid, rec.comm,
+               rec.name, rec.pid);
+        break;
+    case SULOG_SU_ATTEMPT:
+        printf("[%s] SU_EXEC: UID=%u COMM=%s TARGET=%s RESULT=%s PID=%u\n", time_buf, rec.uid,
+               rec.comm, rec.name, rec.result ? "SUCCESS" : "DENIED", rec.pid);
+        break;
+    case SULOG_PERM_CHECK:
+        printf("[%s] PERM_CHECK: UID=%u COMM=%s RESULT=%s PID=%u\n", time_buf, rec.uid, rec.comm,
+               rec.result ? "ALLOWED" : "DENIED", rec.pid);
+        break;
+    case SULOG_MANAGER_OP:
+        printf("[%s] MANAGER_OP: OP=%s MANAGER_UID=%u TARGET_UID=%u COMM=%s PID=%u\n", time_buf,
+               rec.name, rec.uid, rec.aux_uid, rec.comm, rec.pid);
+        break;
+    default:
+        printf("[%s] SYSCALL: UID=%u COMM=%s SYSCALL=%s ARGS=%s PID=%u\n", time_buf, rec.uid,
+               rec.comm, rec.name, rec.arg, rec.pid);
+        break;
+    }
+}
+
+int sulog_tail(bool follow) {
+    int fd = get_sulog_fd();
+    if (fd < 0) {
+        LOGE("Failed to open sulog fd");
+        return 1;
+    }
+
+    SulogRecord recs[16];
+    while (true) {
+        if (!follow) {
+            // Drain what is buffered without blocking
+            struct pollfd pfd = {fd, POLLIN, 0};
+            if (poll(&pfd, 1, 0) <= 0)
+                break;
+        }
+
+        ssize_t n = read(fd, recs, sizeof(recs));
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            LOGE("Failed to read sulog: %s", strerror(errno));
+            close(fd);
+            return 1;
+        }
+
+        for (size_t i = 0; i < static_cast<size_t>(n) / sizeof(SulogRecord); i++) {
+            print_record(recs[i]);
+        }
+        fflush(stdout);
+    }
+
+    close(fd);
+    return 0;
+}
+
+int sulog_stats() {
+    int fd = get_sulog_fd();
+    if (fd < 0) {
+        LOGE("Failed to open sulog fd");
+        return 1;
+    }
+
+    SulogStats stats = {};
+    int ret = ioctl(fd, KSU_SULOG_IOCTL_GET_STATS, &stats);
+    close(fd);
+    if (ret < 0) {
+        LOGE("Failed to get sulog stats: %s", strerror(errno));
+        return 1;
+    }
+
+    printf("records:         %" PRIu64 "\n", stats.records);
+    printf("dedup window:    %us\n", stats.dedup_window);
+    printf("dedup hits:      %" PRIu64 "\n", stats.dedup_hits);
+    printf("dedup misses:    %" PRIu64 "\n", stats.dedup_misses);
+    printf("dedup evictions: %" PRIu64 "\n", stats.dedup_evictions);
+    return 0;
+}
+
+}  // namespace ksud
@@ -0,0 +1,11 @@
+#pragma once
+
+namespace ksud {
+
+// Print su events from the kernel sulog ring, optionally waiting for more
+int sulog_tail(bool follow);
+
+// Print dedup cache and ring counters
+int sulog_stats();
+
+}  // namespace ksud
@@ -158,62 +158,6 @@ bool is_safe_mode() {
     return false;
 }
 
-bool switch_mnt_ns(pid_t pid) {
-    char path[64];
-    snprintf(path, sizeof(path), "/proc/%d/ns/mnt", pid);
-
-    int fd = open(path, O_RDONLY);
-    if (fd < 0) {
-        LOGE("Failed to open %s: %s", path, strerror(errno));
-        return false;
-    }
-
-    // Save current directory
-    char cwd[PATH_MAX];
-    char* cwd_result = getcwd(cwd, sizeof(cwd));
-
-    // Switch namespace
-    if (setns(fd, CLONE_NEWNS) != 0) {
-        LOGE("Failed to setns: %s", strerror(errno));
-        close(fd);
-        return false;
-    }
-    close(fd);
-
-    // Restore current directory
-    if (cwd_result) {
-        chdir(cwd);
-    }
-
-    return true;
-}
-
-static void switch_cgroup(const char* grp, pid_t pid) {
-    std::string path = std::string(grp) + "/cgroup.procs";
-
-    struct stat st;
-    if (stat(path.c_str(), &st) != 0) {
-        return;
-    }
-
-    std::ofstream ofs(path, std::ios::app);
-    if (ofs) {
-        ofs << pid;
-    }
-}
-
-void switch_cgroups() {
-    pid_t pid = getpid();
-    switch_cgroup("/acct", pid);
-    switch_cgroup("/dev/cg2_bpf", pid);
-    switch_cgroup("/sys/fs/cgroup", pid);
-
-    auto per_app_memcg = getprop("ro.config.per_app_memcg");
-    if (!per_app_memcg || *per_app_memcg != "false") {
-        switch_cgroup("/dev/memcg/apps", pid);
-    }
-}
-
 void umask(mode_t mask) {
     ::umask(mask);
 }
@@ -326,6 +270,7 @@ ExecResult exec_command(const std::vector<std::string>& args) {
         }
         c_args.push_back(nullptr);
 
+        log_flush();
         execvp(c_args[0], c_args.data());
         _exit(127);
     }
@@ -389,6 +334,7 @@ ExecResult exec_command(const std::vector<std::string>& args, const std::string&
         // Change to working directory if specified
         if (!workdir.empty()) {
             if (chdir(workdir.c_str()) != 0) {
+                log_flush();
                 _exit(127);
             }
         }
@@ -399,6 +345,7 @@ ExecResult exec_command(const std::vector<std::string>& args, const std::string&
         }
         c_args.push_back(nullptr);
 
+        log_flush();
         execvp(c_args[0], c_args.data());
         _exit(127);
     }
@@ -446,6 +393,7 @@ int exec_command_async(const std::vector<std::string>& args) {
         }
         c_args.push_back(nullptr);
 
+        log_flush();
         execvp(c_args[0], c_args.data());
         _exit(127);
     }
@@ -487,7 +435,7 @@ int install(const std::optional<std::string>& magiskboot_path) {
     }
 
     // Extract binary assets
-    if (!ensure_binaries(false)) {
+    if (ensure_binaries(false) != 0) {
         LOGW("Failed to extract binary assets");
     }
 
@@ -5,6 +5,8 @@
 #include <optional>
 #include <string>
 
+#include "core/process.hpp"
+
 namespace ksud {
 
 // File system utilities
@@ -18,9 +20,7 @@ bool ensure_binary(const std::string& path, const uint8_t* data, size_t size,
 std::optional<std::string> getprop(const std::string& prop);
 bool is_safe_mode();
 
-// Process utilities
-bool switch_mnt_ns(pid_t pid);
-void switch_cgroups();
+// Process utilities (switch_mnt_ns/switch_cgroups live in core/process.hpp)
 void umask(mode_t mask);
 
 // Magisk detection
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Builds minimal APKs (stored zip entries, an APK signing block, central
+// directory, EOCD) for the apk_sign test corpus and benchmark
+namespace ksud_test {
+
+struct ApkSpec {
+    std::vector<std::string> entries = {"AndroidManifest.xml", "classes.dex"};
+    std::string cert = std::string(300, 'C');
+    int v2_blocks = 1;
+    bool v3 = false;
+    bool v3_1 = false;
+    bool signing_block = true;
+    // bytes of an unknown ID-value pair, e.g. verity padding
+    size_t padding = 0;
+    std::string comment;
+};
+
+inline void put_u16(std::string& out, uint16_t v) {
+    out += static_cast<char>(v & 0xff);
+    out += static_cast<char>(v >> 8);
+}
+
+inline void put_u32(std::string& out, uint32_t v) {
+    put_u16(out, static_cast<uint16_t>(v & 0xffff));
+    put_u16(out, static_cast<uint16_t>(v >> 16));
+}
+
+inline void put_u64(std::string& out, uint64_t v) {
+    put_u32(out, static_cast<uint32_t>(v));
+    put_u32(out, static_cast<uint32_t>(v >> 32));
+}
+
+inline std::string lp(const std::string& v) {
+    std::string out;
+    put_u32(out, static_cast<uint32_t>(v.size()));
+    return out + v;
+}
+
+inline std::string id_value(uint32_t id, const std::string& value) {
+    std::string out;
+    put_u64(out, value.size() + 4);
+    put_u32(out, id);
+    return out + value;
+}
+
+// signers -> signer -> signed data -> (digests, certificates -> cert)
+inline std::string v2_block_value(const std::string& cert) {
+    std::string signed_data = lp(lp("digest")) + lp(lp(cert)) + lp("");
+    std::string signer = lp(signed_data) + lp(lp("signature")) + lp("public key");
+    return lp(lp(signer));
+}
+
+inline std::string build_apk(const ApkSpec& spec) {
+    std::string apk;
+    std::vector<uint32_t> local_offsets;
+    for (const auto& name : spec.entries) {
+        local_offsets.push_back(static_cast<uint32_t>(apk.size()));
+        put_u32(apk, 0x04034b50);
+        apk.append(22, '\0');
+        put_u16(apk, static_cast<uint16_t>(name.size()));
+        put_u16(apk, 0);
+        apk += name;
+    }
+
+    if (spec.signing_block) {
+        std::string pairs;
+        for (int i = 0; i < spec.v2_blocks; i++) {
+            pairs += id_value(0x7109871a, v2_block_value(spec.cert));
+        }
+        if (spec.v3) {
+            pairs += id_value(0xf05368c0, v2_block_value(spec.cert));
+        }
+        if (spec.v3_1) {
+            pairs += id_value(0x1b93ad61, v2_block_value(spec.cert));
+        }
+        if (spec.padding) {
+            pairs += id_value(0x42726577, std::string(spec.padding, '\0'));
+        }
+        uint64_t block_size = pairs.size() + 24;
+        put_u64(apk, block_size);
+        apk += pairs;
+        put_u64(apk, block_size);
+        apk += "APK Sig Block 42";
+    }
+
+    uint32_t cd_offset = static_cast<uint32_t>(apk.size());
+    for (size_t i = 0; i < spec.entries.size(); i++) {
+        const auto& name = spec.entries[i];
+        put_u32(apk, 0x02014b50);
+        apk.append(24, '\0');
+        put_u16(apk, static_cast<uint16_t>(name.size()));
+        put_u16(apk, 0);  // extra
+        put_u16(apk, 0);  // comment
+        apk.append(8, '\0');
+        put_u32(apk, local_offsets[i]);
+        apk += name;
+    }
+    uint32_t cd_size = static_cast<uint32_t>(apk.size()) - cd_offset;
+
+    put_u32(apk, 0x06054b50);
+    put_u16(apk, 0);
+    put_u16(apk, 0);
+    put_u16(apk, static_cast<uint16_t>(spec.entries.size()));
+    put_u16(apk, static_cast<uint16_t>(spec.entries.size()));
+    put_u32(apk, cd_size);
+    put_u32(apk, cd_offset);
+    put_u16(apk, static_cast<uint16_t>(spec.comment.size()));
+    apk += spec.comment;
+    return apk;
+}
+
+}  // namespace ksud_test
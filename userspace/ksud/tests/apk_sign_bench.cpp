@@ -0,0 +1,132 @@
+// Cost of one manager-APK check, split the way the kernel does it.
+//
+// usage: apk_sign_bench [apk] [rounds]
+//
+// Without an APK a synthetic one with 3000 entries is used. "verify" is
+// get_apk_signature (two bounded preads, parse, SHA-256 of the cert);
+// "parse" is the shared core on buffers already in memory; "cd walk" is the
+// v1 central directory scan the kernel runs after a signer matched.
+
+#include "apk_builder.hpp"
+#include "boot/apk_sign.hpp"
+#include "check.hpp"
+
+#include "apk_sign_core.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using namespace ksud_test;
+
+namespace {
+
+// Results are folded in here so the optimizer can't drop the work
+volatile size_t g_sink;
+
+template <typename Fn>
+void bench(const char* name, int rounds, Fn&& fn) {
+    using clock = std::chrono::steady_clock;
+    fn();  // warm the page cache
+    auto best = clock::duration::max();
+    auto total = clock::duration::zero();
+    for (int i = 0; i < rounds; i++) {
+        auto start = clock::now();
+        fn();
+        auto elapsed = clock::now() - start;
+        total += elapsed;
+        best = std::min(best, elapsed);
+    }
+    auto us = [](clock::duration d) {
+        return std::chrono::duration<double, std::micro>(d).count();
+    };
+    printf("%-8s avg %9.2f us  min %9.2f us  (%d rounds)\n", name, us(total) / rounds, us(best),
+           rounds);
+}
+
+std::string read_all(const std::string& path) {
+    std::string data;
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) {
+        perror(path.c_str());
+        exit(1);
+    }
+    char buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        data.append(buf, n);
+    }
+    fclose(f);
+    return data;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    std::string path;
+    if (argc > 1) {
+        path = argv[1];
+    } else {
+        ApkSpec spec;
+        for (int i = 0; i < 3000; i++) {
+            spec.entries.push_back("res/drawable/icon_" + std::to_string(i) + ".png");
+        }
+        path = write_scratch("bench.apk", build_apk(spec));
+    }
+    int rounds = argc > 2 ? atoi(argv[2]) : 1000;
+    if (rounds <= 0) {
+        rounds = 1000;
+    }
+
+    const std::string apk = read_all(path);
+    const auto* data = reinterpret_cast<const uint8_t*>(apk.data());
+    uint32_t cd_offset;
+    uint32_t cd_size;
+    size_t tail = std::min<size_t>(APK_READ_WINDOW, apk.size());
+    if (!apk_find_cd(data + apk.size() - tail, tail, apk.size(), &cd_offset, &cd_size)) {
+        fprintf(stderr, "%s: no EOCD\n", path.c_str());
+        return 1;
+    }
+    printf("%s: %zu bytes, central directory %u bytes\n", path.c_str(), apk.size(), cd_size);
+
+    bench("verify", rounds, [&] {
+        auto sig = ksud::get_apk_signature(path);
+        if (sig.first == 0) {
+            fprintf(stderr, "no v2 signer\n");
+            exit(1);
+        }
+    });
+
+    bench("parse", rounds, [&] {
+        uint32_t off;
+        uint32_t size;
+        apk_sig_info info;
+        size_t window = std::min<size_t>(APK_READ_WINDOW, cd_offset);
+        if (!apk_find_cd(data + apk.size() - tail, tail, apk.size(), &off, &size) ||
+            !apk_scan_sig_block(data + cd_offset - window, window, &info)) {
+            exit(1);
+        }
+        g_sink = g_sink + info.v2_cert_len;
+    });
+
+    bench("cd walk", rounds, [&] {
+        size_t pos = cd_offset;
+        size_t end = static_cast<size_t>(cd_offset) + cd_size;
+        while (pos < end) {
+            size_t consumed = 0;
+            size_t n = std::min<size_t>(APK_READ_WINDOW, end - pos);
+            if (apk_cd_find(data + pos, n, APK_V1_MANIFEST, sizeof(APK_V1_MANIFEST) - 1,
+                            &consumed) != 0 ||
+                consumed == 0) {
+                break;
+            }
+            pos += consumed;
+        }
+        g_sink = g_sink + pos;
+    });
+    return 0;
+}
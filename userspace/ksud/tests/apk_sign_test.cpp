@@ -0,0 +1,219 @@
+// Corpus test for the APK signature parser shared by the kernel and ksud
+// (kernel/apk_sign_core.h) and ksud's get_apk_signature on top of it.
+//
+// usage: apk_sign_test [dir]
+//
+// The synthetic corpus below always runs. With a directory, every *.apk in
+// it is parsed as well and its signer printed, e.g. to compare against a
+// real manager build.
+
+#include "apk_builder.hpp"
+#include "boot/apk_sign.hpp"
+#include "check.hpp"
+#include "picosha2.h"
+
+#include "apk_sign_core.h"
+
+#include <dirent.h>
+#include <cstring>
+#include <random>
+
+using namespace ksud_test;
+
+namespace {
+
+std::string sha256_hex(const std::string& data) {
+    return picosha2::hash256_hex_string(data);
+}
+
+std::pair<uint32_t, std::string> sign_of(const std::string& name, const std::string& apk) {
+    return ksud::get_apk_signature(write_scratch(name, apk));
+}
+
+// The same chunked walk the kernel and ksud do over the central directory,
+// with an arbitrary chunk size so records straddle chunk boundaries
+bool cd_has(const std::string& apk, const char* name, size_t chunk) {
+    uint32_t cd_offset;
+    uint32_t cd_size;
+    const auto* data = reinterpret_cast<const uint8_t*>(apk.data());
+    if (!apk_find_cd(data, apk.size(), apk.size(), &cd_offset, &cd_size)) {
+        return false;
+    }
+    size_t pos = cd_offset;
+    size_t end = static_cast<size_t>(cd_offset) + cd_size;
+    while (pos < end) {
+        size_t n = std::min(chunk, end - pos);
+        size_t consumed = 0;
+        int ret = apk_cd_find(data + pos, n, name, strlen(name), &consumed);
+        if (ret != 0) {
+            return ret > 0;
+        }
+        if (consumed == 0) {
+            return false;
+        }
+        pos += consumed;
+    }
+    return false;
+}
+
+void test_valid() {
+    ApkSpec spec;
+    auto [size, hash] = sign_of("valid.apk", build_apk(spec));
+    CHECK(size == spec.cert.size());
+    CHECK(hash == sha256_hex(spec.cert));
+}
+
+void test_comment() {
+    for (size_t len : {size_t(1), size_t(1000), size_t(0xffff)}) {
+        ApkSpec spec;
+        spec.comment = std::string(len, 'x');
+        // An EOCD look-alike inside the comment must not be taken
+        memcpy(spec.comment.data(), "PK\x05\x06", std::min<size_t>(4, len));
+        auto [size, hash] = sign_of("comment.apk", build_apk(spec));
+        CHECK(size == spec.cert.size());
+        CHECK(hash == sha256_hex(spec.cert));
+    }
+}
+
+void test_padding() {
+    // The whole block still has to fit the window ending at the CD
+    ApkSpec spec;
+    spec.padding = 4096;
+    CHECK(sign_of("padded.apk", build_apk(spec)).first == spec.cert.size());
+
+    spec.padding = APK_READ_WINDOW;
+    CHECK(sign_of("huge_block.apk", build_apk(spec)).first == 0);
+}
+
+void test_rejected() {
+    ApkSpec spec;
+    spec.v3 = true;
+    CHECK(sign_of("v3.apk", build_apk(spec)).first == 0);
+
+    spec = ApkSpec();
+    spec.v3_1 = true;
+    CHECK(sign_of("v3_1.apk", build_apk(spec)).first == 0);
+
+    spec = ApkSpec();
+    spec.signing_block = false;
+    CHECK(sign_of("unsigned.apk", build_apk(spec)).first == 0);
+
+    spec = ApkSpec();
+    spec.v2_blocks = 0;
+    spec.padding = 64;
+    CHECK(sign_of("no_v2.apk", build_apk(spec)).first == 0);
+
+    std::string apk = build_apk(ApkSpec());
+    CHECK(sign_of("truncated.apk", apk.substr(0, apk.size() - 1)).first == 0);
+    CHECK(sign_of("tiny.apk", apk.substr(0, 21)).first == 0);
+
+    // Central directory pointing past the end of the file
+    std::string bad_cd = apk;
+    bad_cd[bad_cd.size() - 6] = '\x7f';
+    CHECK(sign_of("bad_cd.apk", bad_cd).first == 0);
+}
+
+void test_sig_block_bounds() {
+    std::string apk = build_apk(ApkSpec());
+    uint32_t cd_offset;
+    uint32_t cd_size;
+    const auto* data = reinterpret_cast<const uint8_t*>(apk.data());
+    CHECK(apk_find_cd(data, apk.size(), apk.size(), &cd_offset, &cd_size));
+
+    apk_sig_info info;
+    CHECK(apk_scan_sig_block(data, cd_offset, &info));
+    CHECK(info.v2_blocks == 1 && info.v2_cert && info.v2_cert_len == 300);
+
+    // Windows that start anywhere before or inside the block: a cert is only
+    // ever reported from inside the window
+    for (size_t cut = 1; cut < cd_offset; cut++) {
+        std::vector<uint8_t> win(data + cut, data + cd_offset);
+        if (apk_scan_sig_block(win.data(), win.size(), &info) && info.v2_cert) {
+            CHECK(info.v2_cert >= win.data());
+            CHECK(info.v2_cert + info.v2_cert_len <= win.data() + win.size());
+        }
+    }
+
+    // A length field inside the v2 value that overruns its parent
+    ApkSpec spec;
+    std::string bad = build_apk(spec);
+    size_t cert_at = bad.find(spec.cert);
+    bad[cert_at - 4] = '\xff';
+    CHECK(sign_of("bad_cert_len.apk", bad).first == 0);
+}
+
+void test_central_directory() {
+    ApkSpec spec;
+    for (int i = 0; i < 3000; i++) {
+        spec.entries.push_back("res/drawable/icon_" + std::to_string(i) + ".png");
+    }
+    std::string apk = build_apk(spec);
+    for (size_t chunk : {size_t(128), size_t(1000), size_t(4096), size_t(APK_READ_WINDOW)}) {
+        CHECK(!cd_has(apk, APK_V1_MANIFEST, chunk));
+        CHECK(cd_has(apk, "res/drawable/icon_2999.png", chunk));
+    }
+
+    spec.entries.push_back(APK_V1_MANIFEST);
+    apk = build_apk(spec);
+    for (size_t chunk : {size_t(128), size_t(1000), size_t(4096), size_t(APK_READ_WINDOW)}) {
+        CHECK(cd_has(apk, APK_V1_MANIFEST, chunk));
+    }
+    // ksud still reports the signer of a v1+v2 APK; only the kernel rejects it
+    CHECK(sign_of("v1.apk", apk).first == spec.cert.size());
+
+    // A record whose name does not fit any chunk gives up instead of looping
+    CHECK(!cd_has(apk, APK_V1_MANIFEST, APK_CDFH_SIZE + 1));
+}
+
+// Random byte flips over a valid APK: must never crash or read out of
+// bounds (run under ASan to make the latter visible)
+void test_mutations() {
+    ApkSpec spec;
+    spec.comment = "comment";
+    std::string apk = build_apk(spec);
+    std::mt19937 rng(42);
+    for (int i = 0; i < 2000; i++) {
+        std::string m = apk;
+        int flips = 1 + static_cast<int>(rng() % 4);
+        for (int f = 0; f < flips; f++) {
+            m[rng() % m.size()] = static_cast<char>(rng());
+        }
+        auto [size, hash] = sign_of("mutated.apk", m);
+        CHECK(size == 0 || size <= m.size());
+    }
+}
+
+void run_directory(const char* dir_path) {
+    DIR* dir = opendir(dir_path);
+    if (!dir) {
+        perror(dir_path);
+        g_failures++;
+        return;
+    }
+    while (struct dirent* e = readdir(dir)) {
+        size_t len = strlen(e->d_name);
+        if (len < 4 || strcmp(e->d_name + len - 4, ".apk") != 0) {
+            continue;
+        }
+        std::string path = std::string(dir_path) + "/" + e->d_name;
+        auto [size, hash] = ksud::get_apk_signature(path);
+        printf("%-40s size=%u sha256=%s\n", e->d_name, size, hash.empty() ? "-" : hash.c_str());
+    }
+    closedir(dir);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    test_valid();
+    test_comment();
+    test_padding();
+    test_rejected();
+    test_sig_block_bounds();
+    test_central_directory();
+    test_mutations();
+    if (argc > 1) {
+        run_directory(argv[1]);
+    }
+    return check_result();
+}
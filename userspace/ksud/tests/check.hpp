@@ -0,0 +1,57 @@
+#pragma once
+
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+// Minimal assertions for the host tests: a failed CHECK is reported and
+// counted, and the test's main returns check_result()
+namespace ksud_test {
+
+inline int g_failures = 0;
+
+// Per-process scratch directory under $TMPDIR, left behind for inspection
+inline const std::string& scratch_dir() {
+    static std::string dir = [] {
+        const char* tmp = getenv("TMPDIR");
+        std::string tmpl = std::string(tmp && tmp[0] ? tmp : "/tmp") + "/ksud-test-XXXXXX";
+        if (!mkdtemp(tmpl.data())) {
+            perror("mkdtemp");
+            abort();
+        }
+        return tmpl;
+    }();
+    return dir;
+}
+
+inline std::string write_scratch(const std::string& name, const std::string& data) {
+    std::string path = scratch_dir() + "/" + name;
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f || fwrite(data.data(), 1, data.size(), f) != data.size()) {
+        perror(path.c_str());
+        abort();
+    }
+    fclose(f);
+    return path;
+}
+
+inline int check_result() {
+    if (g_failures > 0) {
+        fprintf(stderr, "%d check(s) failed\n", g_failures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
+
+}  // namespace ksud_test
+
+#define CHECK(cond)                                                         \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, \
+                    #cond);                                                 \
+            ksud_test::g_failures++;                                        \
+        }                                                                   \
+    } while (0)
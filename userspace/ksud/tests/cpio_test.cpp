@@ -0,0 +1,317 @@
+// Round-trip test for the newc cpio editor used on boot ramdisks.
+//
+// usage: cpio_test [ramdisk.cpio...]
+//
+// The synthetic ramdisks below, laid out like an init_boot ramdisk and a
+// multi-fragment vendor_boot ramdisk, always run. Uncompressed ramdisks
+// given on the command line (e.g. from `magiskboot unpack` followed by
+// `magiskboot decompress`) are round-tripped as well.
+
+#include "boot/cpio.hpp"
+#include "check.hpp"
+
+#include <sys/stat.h>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace ksud_test;
+
+namespace {
+
+// An entry as another tool (mkbootfs, GNU cpio) would write it, with the
+// fields the editor does not keep set to something non-default
+struct RawEntry {
+    std::string name;
+    uint32_t mode;
+    std::string data;
+    uint32_t uid = 0;
+    uint32_t gid = 0;
+    uint32_t rdevmajor = 0;
+    uint32_t rdevminor = 0;
+};
+
+void put_entry(std::string& out, uint32_t ino, const RawEntry& e, bool upper_hex = false) {
+    char header[111];
+    const char* fmt = upper_hex ? "070701%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X"
+                                : "070701%08x%08x%08x%08x%08x%08x%08x%08x%08x%08x%08x%08x%08x";
+    snprintf(header, sizeof(header), fmt, ino, e.mode, e.uid, e.gid, 2, 0x5f000000,
+             static_cast<uint32_t>(e.data.size()), 3, 1, e.rdevmajor, e.rdevminor,
+             static_cast<uint32_t>(e.name.size() + 1), 0);
+    out.append(header, 110);
+    out += e.name;
+    out += '\0';
+    out.resize((out.size() + 3) & ~size_t(3), '\0');
+    out += e.data;
+    out.resize((out.size() + 3) & ~size_t(3), '\0');
+}
+
+// One archive with its trailer, optionally padded to a 512-byte block the
+// way GNU cpio and the kernel's gen_init_cpio do
+std::string make_archive(const std::vector<RawEntry>& entries, size_t block = 0,
+                         bool upper_hex = false) {
+    std::string out;
+    uint32_t ino = 1;
+    for (const auto& e : entries) {
+        put_entry(out, ino++, e, upper_hex);
+    }
+    put_entry(out, 0, RawEntry{"TRAILER!!!", 0, ""}, upper_hex);
+    if (block) {
+        out.resize((out.size() + block - 1) / block * block, '\0');
+    }
+    return out;
+}
+
+// Names and sizes chosen so that every name and data padding (0-3 bytes)
+// occurs
+std::vector<RawEntry> init_boot_entries() {
+    return {
+        {".", S_IFDIR | 0755, ""},
+        {"acct", S_IFDIR | 0755, ""},
+        {"dev", S_IFDIR | 0755, ""},
+        {"dev/console", S_IFCHR | 0600, "", 0, 0, 5, 1},
+        {"first_stage_ramdisk", S_IFDIR | 0755, ""},
+        {"first_stage_ramdisk/fstab.qcom", S_IFREG | 0640, "system /system ext4 ro wait\n"},
+        {"init", S_IFREG | 0750, std::string(4097, '\x7f')},
+        {"sbin", S_IFLNK | 0777, "/system/bin"},
+        {"system", S_IFDIR | 0755, ""},
+        {"system/bin", S_IFDIR | 0751, "", 0, 2000},
+        {"system/bin/a", S_IFREG | 0755, "1"},
+        {"system/bin/ab", S_IFREG | 0755, "12"},
+        {"system/bin/abc", S_IFREG | 0755, "123"},
+        {"system/bin/abcd", S_IFREG | 0755, "1234"},
+        {"system/etc", S_IFDIR | 0755, ""},
+        {"system/etc/ramdisk", S_IFDIR | 0755, ""},
+        {"system/etc/ramdisk/build.prop", S_IFREG | 0600, "ro.build.id=AP1A\n"},
+        {"systemfoo", S_IFREG | 0644, ""},
+    };
+}
+
+// What parsing init_boot_entries() should produce: "." dropped, everything
+// else kept with its metadata
+std::map<std::string, ksud::CpioEntry> expected_of(const std::vector<RawEntry>& raw) {
+    std::map<std::string, ksud::CpioEntry> out;
+    for (const auto& e : raw) {
+        if (e.name == ".") {
+            continue;
+        }
+        out[e.name] = ksud::CpioEntry{e.mode, e.uid, e.gid, e.rdevmajor, e.rdevminor, e.data};
+    }
+    return out;
+}
+
+bool same_entry(const ksud::CpioEntry& a, const ksud::CpioEntry& b) {
+    return a.mode == b.mode && a.uid == b.uid && a.gid == b.gid && a.rdevmajor == b.rdevmajor &&
+           a.rdevminor == b.rdevminor && a.data == b.data;
+}
+
+bool same_entries(const std::map<std::string, ksud::CpioEntry>& a,
+                  const std::map<std::string, ksud::CpioEntry>& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (auto ia = a.begin(), ib = b.begin(); ia != a.end(); ++ia, ++ib) {
+        if (ia->first != ib->first || !same_entry(ia->second, ib->second)) {
+            fprintf(stderr, "entry differs: %s / %s\n", ia->first.c_str(), ib->first.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+// dump() then parse() gives back the same entries, and dumping again gives
+// the same bytes
+void check_round_trip(const ksud::Cpio& cpio) {
+    std::string out = cpio.dump();
+    CHECK(out.size() % 4 == 0);
+    CHECK(out.size() >= 124 && out.compare(out.size() - 124 + 110, 11, "TRAILER!!!\0", 11) == 0);
+
+    ksud::Cpio again;
+    CHECK(again.parse(out));
+    CHECK(same_entries(again.entries(), cpio.entries()));
+    CHECK(again.dump() == out);
+}
+
+void test_parse() {
+    auto raw = init_boot_entries();
+    ksud::Cpio cpio;
+    CHECK(cpio.parse(make_archive(raw)));
+    CHECK(same_entries(cpio.entries(), expected_of(raw)));
+    CHECK(cpio.patch_state() == ksud::CPIO_STOCK);
+    check_round_trip(cpio);
+
+    // Block padding after the trailer and upper-case hex fields
+    ksud::Cpio padded;
+    CHECK(padded.parse(make_archive(raw, 512, true)));
+    CHECK(same_entries(padded.entries(), cpio.entries()));
+
+    // "./" and "/" prefixed names are the same entries
+    std::vector<RawEntry> prefixed = raw;
+    for (auto& e : prefixed) {
+        if (e.name != ".") {
+            e.name = (e.mode & S_IFMT) == S_IFDIR ? "./" + e.name : "/" + e.name;
+        }
+    }
+    ksud::Cpio norm;
+    CHECK(norm.parse(make_archive(prefixed)));
+    CHECK(same_entries(norm.entries(), cpio.entries()));
+
+    // No trailer at all
+    std::string archive = make_archive(raw);
+    ksud::Cpio untrailed;
+    CHECK(untrailed.parse(archive.substr(0, archive.size() - 124)));
+    CHECK(same_entries(untrailed.entries(), cpio.entries()));
+}
+
+void test_vendor_boot() {
+    // vendor_boot v4 keeps one cpio per ramdisk fragment, concatenated with
+    // block padding; later fragments override earlier entries
+    std::vector<RawEntry> platform = {
+        {"lib", S_IFDIR | 0755, ""},
+        {"lib/modules", S_IFDIR | 0755, ""},
+        {"lib/modules/modules.load", S_IFREG | 0644, "a.ko\nb.ko\n"},
+        {"lib/modules/a.ko", S_IFREG | 0644, std::string(1021, 'a')},
+    };
+    std::vector<RawEntry> dlkm = {
+        {"lib/modules/b.ko", S_IFREG | 0644, std::string(2047, 'b')},
+        {"lib/modules/modules.load", S_IFREG | 0644, "a.ko\nb.ko\nc.ko\n"},
+    };
+    ksud::Cpio cpio;
+    CHECK(cpio.parse(make_archive(platform, 512) + make_archive(dlkm, 512)));
+    CHECK(cpio.entries().size() == 5);
+    CHECK(cpio.extract("lib/modules/modules.load") == "a.ko\nb.ko\nc.ko\n");
+    CHECK(cpio.extract("lib/modules/b.ko")->size() == 2047);
+    check_round_trip(cpio);
+
+    // Without padding between the fragments
+    ksud::Cpio tight;
+    CHECK(tight.parse(make_archive(platform) + make_archive(dlkm)));
+    CHECK(same_entries(tight.entries(), cpio.entries()));
+}
+
+void test_edits() {
+    auto raw = init_boot_entries();
+    ksud::Cpio cpio;
+    CHECK(cpio.parse(make_archive(raw)));
+    auto expected = expected_of(raw);
+
+    // The boot patch sequence: back up init, add ksuinit and the module
+    CHECK(cpio.mv("init", "init.real"));
+    expected["init.real"] = expected["init"];
+    expected.erase("init");
+    cpio.add_data(0755, "init", "ksuinit");
+    expected["init"] = ksud::CpioEntry{S_IFREG | 0755, 0, 0, 0, 0, "ksuinit"};
+    cpio.add_data(0644, "kernelsu.ko", std::string(3, 'k'));
+    expected["kernelsu.ko"] = ksud::CpioEntry{S_IFREG | 0644, 0, 0, 0, 0, "kkk"};
+    std::string file = write_scratch("added", "from a file\n");
+    CHECK(cpio.add(0600, "/overlay.d/sbin/./added", file));
+    expected["overlay.d/sbin/added"] = ksud::CpioEntry{S_IFREG | 0600, 0, 0, 0, 0, "from a file\n"};
+    CHECK(!cpio.add(0600, "missing", scratch_dir() + "/does-not-exist"));
+    cpio.mkdir(0750, "overlay.d/");
+    expected["overlay.d"] = ksud::CpioEntry{S_IFDIR | 0750, 0, 0, 0, 0, ""};
+    cpio.mkdir(0755, "/");
+    CHECK(same_entries(cpio.entries(), expected));
+
+    // Rename onto an existing entry replaces it; a missing source fails
+    CHECK(cpio.mv("system/bin/a", "system/bin/ab"));
+    expected["system/bin/ab"] = expected["system/bin/a"];
+    expected.erase("system/bin/a");
+    CHECK(!cpio.mv("system/bin/a", "x"));
+
+    // Recursive remove takes the subtree only, not "systemfoo"
+    CHECK(cpio.rm("system/etc", true));
+    for (auto it = expected.begin(); it != expected.end();) {
+        it = it->first.rfind("system/etc", 0) == 0 ? expected.erase(it) : std::next(it);
+    }
+    CHECK(cpio.exists("systemfoo"));
+    CHECK(cpio.rm("./acct"));
+    expected.erase("acct");
+    CHECK(!cpio.rm("acct"));
+    CHECK(!cpio.rm("nothing", true));
+    CHECK(same_entries(cpio.entries(), expected));
+    check_round_trip(cpio);
+
+    cpio.add_data(0644, "init.magisk.rc", "");
+    CHECK(cpio.patch_state() == ksud::CPIO_MAGISK_PATCHED);
+    cpio.add_data(0755, "sbin/su", "");
+    CHECK(cpio.patch_state() == ksud::CPIO_UNSUPPORTED);
+}
+
+void test_save_load() {
+    ksud::Cpio cpio;
+    CHECK(cpio.parse(make_archive(init_boot_entries())));
+    std::string path = scratch_dir() + "/ramdisk.cpio";
+    CHECK(cpio.save(path));
+    ksud::Cpio loaded;
+    CHECK(loaded.load(path));
+    CHECK(same_entries(loaded.entries(), cpio.entries()));
+    CHECK(!loaded.load(scratch_dir() + "/does-not-exist"));
+}
+
+void test_malformed() {
+    std::string archive = make_archive(init_boot_entries());
+    ksud::Cpio cpio;
+
+    // Cut inside the first header or name
+    size_t first = 110 + 2;  // "."
+    for (size_t cut = 1; cut < first; cut++) {
+        CHECK(!cpio.parse(archive.substr(0, cut)));
+    }
+    // Every other cut must fail or succeed cleanly, never read past the end
+    // (run under ASan to make the latter visible)
+    for (size_t cut = first; cut < archive.size(); cut++) {
+        cpio.parse(archive.substr(0, cut));
+    }
+
+    std::string bad = archive;
+    bad[6 + 6 * 8] = 'g';  // filesize of the first entry
+    CHECK(!cpio.parse(bad));
+
+    bad = archive;
+    memcpy(&bad[6 + 11 * 8], "00000000", 8);  // namesize 0
+    CHECK(!cpio.parse(bad));
+
+    bad = archive;
+    memcpy(&bad[6 + 6 * 8], "7fffffff", 8);  // filesize past the end
+    CHECK(!cpio.parse(bad));
+
+    bad = archive;
+    memcpy(&bad[0], "070707", 6);  // odc, not newc
+    CHECK(!cpio.parse(bad));
+    CHECK(!ksud::is_newc_cpio(bad));
+    CHECK(ksud::is_newc_cpio(archive));
+
+    // Garbage (not zero padding) after an entry
+    CHECK(!cpio.parse(archive.substr(0, archive.size() - 124) + "garbage!"));
+
+    // An empty archive is just a trailer
+    CHECK(cpio.parse(make_archive({})));
+    CHECK(cpio.entries().empty());
+    CHECK(cpio.parse(""));
+}
+
+void round_trip_file(const char* path) {
+    ksud::Cpio cpio;
+    if (!cpio.load(path)) {
+        g_failures++;
+        return;
+    }
+    printf("%-40s %zu entries, patch state %d\n", path, cpio.entries().size(),
+           cpio.patch_state());
+    check_round_trip(cpio);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    test_parse();
+    test_vendor_boot();
+    test_edits();
+    test_save_load();
+    test_malformed();
+    for (int i = 1; i < argc; i++) {
+        round_trip_file(argv[i]);
+    }
+    return check_result();
+}
@@ -0,0 +1,114 @@
+/**
+ * ksuinit - ELF symbol patching
+ *
+ * Locates the symbol table of a kernel module image and rewrites its
+ * undefined symbols as absolute kernel addresses.
+ */
+
+#include "elf_patch.hpp"
+
+#include <cstring>
+
+namespace ksuinit {
+
+namespace {
+
+bool in_bounds(uint64_t offset, uint64_t length, size_t size) {
+    return offset <= size && length <= size - offset;
+}
+
+// The image is mapped page aligned, so offset alignment is pointer alignment
+template <typename T>
+bool aligned_for(uint64_t offset) {
+    return offset % alignof(T) == 0;
+}
+
+} // anonymous namespace
+
+std::string_view ElfSymtab::name(size_t i) const {
+    uint32_t off = syms[i].st_name;
+    if (off >= strtab_size) {
+        return {};
+    }
+    return std::string_view(strtab + off, strnlen(strtab + off, strtab_size - off));
+}
+
+bool elf_find_symtab(uint8_t* image, size_t size, ElfSymtab& out) {
+    if (size < sizeof(Elf64_Ehdr)) {
+        return false;
+    }
+
+    auto* ehdr = reinterpret_cast<Elf64_Ehdr*>(image);
+    if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 || ehdr->e_ident[EI_CLASS] != ELFCLASS64 ||
+        ehdr->e_shentsize != sizeof(Elf64_Shdr) || !aligned_for<Elf64_Shdr>(ehdr->e_shoff) ||
+        !in_bounds(ehdr->e_shoff, uint64_t(ehdr->e_shnum) * sizeof(Elf64_Shdr), size)) {
+        return false;
+    }
+
+    auto* shdr_base = reinterpret_cast<Elf64_Shdr*>(image + ehdr->e_shoff);
+    for (int i = 0; i < ehdr->e_shnum; i++) {
+        const Elf64_Shdr& symtab = shdr_base[i];
+        if (symtab.sh_type != SHT_SYMTAB) {
+            continue;
+        }
+
+        // String table is linked in sh_link
+        if (symtab.sh_link >= ehdr->e_shnum) {
+            return false;
+        }
+        const Elf64_Shdr& strtab = shdr_base[symtab.sh_link];
+        if (!aligned_for<Elf64_Sym>(symtab.sh_offset) ||
+            !in_bounds(symtab.sh_offset, symtab.sh_size, size) ||
+            !in_bounds(strtab.sh_offset, strtab.sh_size, size)) {
+            return false;
+        }
+
+        out.syms = reinterpret_cast<Elf64_Sym*>(image + symtab.sh_offset);
+        out.count = symtab.sh_size / sizeof(Elf64_Sym);
+        out.strtab = reinterpret_cast<const char*>(image + strtab.sh_offset);
+        out.strtab_size = strtab.sh_size;
+        return true;
+    }
+
+    return false;
+}
+
+std::vector<std::string_view> elf_undefined_symbols(const ElfSymtab& symtab) {
+    std::vector<std::string_view> names;
+    for (size_t i = 1; i < symtab.count; i++) {
+        if (symtab.syms[i].st_shndx != SHN_UNDEF) {
+            continue;
+        }
+        std::string_view name = symtab.name(i);
+        if (!name.empty()) {
+            names.push_back(name);
+        }
+    }
+    return names;
+}
+
+std::vector<std::string_view> elf_patch_undefined_symbols(
+    ElfSymtab& symtab, const std::function<bool(std::string_view, uint64_t&)>& resolve) {
+    std::vector<std::string_view> missing;
+    for (size_t i = 1; i < symtab.count; i++) {
+        Elf64_Sym& sym = symtab.syms[i];
+        if (sym.st_shndx != SHN_UNDEF) {
+            continue;
+        }
+        std::string_view name = symtab.name(i);
+        if (name.empty()) {
+            continue;
+        }
+
+        uint64_t addr = 0;
+        if (!resolve(name, addr)) {
+            missing.push_back(name);
+            continue;
+        }
+        sym.st_shndx = SHN_ABS;
+        sym.st_value = addr;
+    }
+    return missing;
+}
+
+} // namespace ksuinit
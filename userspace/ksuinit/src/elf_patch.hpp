@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string_view>
+#include <vector>
+
+#include <elf.h>
+
+namespace ksuinit {
+
+/**
+ * Symbol table of a 64-bit ELF relocatable held in memory
+ *
+ * This is pure buffer manipulation with no syscalls, so it can be exercised
+ * on the host against any .ko file.
+ */
+struct ElfSymtab {
+    Elf64_Sym* syms = nullptr;
+    size_t count = 0;
+    const char* strtab = nullptr;
+    size_t strtab_size = 0;
+
+    /**
+     * Name of symbol i, empty if st_name points outside the string table
+     */
+    std::string_view name(size_t i) const;
+};
+
+/**
+ * Validate the ELF header and locate the symbol table and its string table
+ *
+ * Every offset is bounds-checked against size and must be aligned for the
+ * structure read there.
+ *
+ * @param image Module image; symbols are patched in place through the result
+ * @param size Size of the image in bytes
+ * @param out Filled on success
+ * @return true on success, false if the image is not a usable ELF64
+ */
+bool elf_find_symtab(uint8_t* image, size_t size, ElfSymtab& out);
+
+/**
+ * Names of all undefined (SHN_UNDEF) symbols, in table order
+ */
+std::vector<std::string_view> elf_undefined_symbols(const ElfSymtab& symtab);
+
+/**
+ * Turn every undefined symbol that resolve() knows into an absolute one
+ *
+ * Only the symbol entries are written, so on a MAP_PRIVATE mapping just the
+ * symbol table pages are copied.
+ *
+ * @param resolve Returns true and sets the address if the name is known
+ * @return Names that could not be resolved
+ */
+std::vector<std::string_view> elf_patch_undefined_symbols(
+    ElfSymtab& symtab, const std::function<bool(std::string_view, uint64_t&)>& resolve);
+
+} // namespace ksuinit
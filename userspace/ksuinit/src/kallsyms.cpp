@@ -0,0 +1,134 @@
+/**
+ * ksuinit - kallsyms lookup
+ *
+ * Matches kallsyms lines against the symbols a module needs.
+ */
+
+#include "kallsyms.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <unistd.h>
+
+namespace ksuinit {
+
+namespace {
+
+/**
+ * Handle one "<addr> <type> <name>[\t[module]]" line of /proc/kallsyms
+ */
+void match_kallsyms_line(const char* p, const char* end, WantedSymbols& wanted) {
+    uint64_t addr = 0;
+    const char* q = p;
+    for (; q < end; q++) {
+        char c = *q;
+        unsigned digit;
+        if (c >= '0' && c <= '9') {
+            digit = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            digit = c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            digit = c - 'A' + 10;
+        } else {
+            break;
+        }
+        addr = (addr << 4) | digit;
+    }
+    if (q == p) {
+        return;
+    }
+
+    // " <type> "
+    if (end - q < 3 || q[0] != ' ' || q[2] != ' ') {
+        return;
+    }
+    const char* name = q + 3;
+    const char* name_end = name;
+    while (name_end < end && *name_end != ' ' && *name_end != '\t') {
+        name_end++;
+    }
+
+    // Strip version suffixes like "$..." or ".llvm...."
+    std::string_view sym(name, name_end - name);
+    auto pos = sym.find('$');
+    if (pos == std::string_view::npos) {
+        pos = sym.find(".llvm.");
+    }
+    if (pos != std::string_view::npos) {
+        sym = sym.substr(0, pos);
+    }
+    if (sym.empty()) {
+        return;
+    }
+
+    ssize_t idx = wanted.index_of(sym);
+    if (idx < 0 || wanted.found[idx]) {
+        return;
+    }
+    wanted.addrs[idx] = addr;
+    wanted.found[idx] = true;
+    wanted.remaining--;
+}
+
+} // anonymous namespace
+
+void WantedSymbols::finalize() {
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+    addrs.assign(names.size(), 0);
+    found.assign(names.size(), false);
+    remaining = names.size();
+}
+
+ssize_t WantedSymbols::index_of(std::string_view name) const {
+    auto it = std::lower_bound(names.begin(), names.end(), name);
+    if (it == names.end() || *it != name) {
+        return -1;
+    }
+    return it - names.begin();
+}
+
+size_t kallsyms_resolve_fd(int fd, WantedSymbols& wanted) {
+    constexpr size_t kChunk = 256 * 1024;
+    std::vector<char> buf(kChunk);
+    size_t carry = 0;
+    size_t lines = 0;
+
+    while (wanted.remaining > 0) {
+        ssize_t n = read(fd, buf.data() + carry, buf.size() - carry);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            // a final line without '\n'
+            if (carry > 0) {
+                match_kallsyms_line(buf.data(), buf.data() + carry, wanted);
+            }
+            break;
+        }
+
+        const char* p = buf.data();
+        const char* end = p + carry + n;
+        while (wanted.remaining > 0) {
+            auto* nl = static_cast<const char*>(memchr(p, '\n', end - p));
+            if (!nl) {
+                break;
+            }
+            match_kallsyms_line(p, nl, wanted);
+            lines++;
+            p = nl + 1;
+        }
+
+        carry = end - p;
+        if (carry == buf.size()) {
+            // a single line filling the buffer is garbage, drop it
+            carry = 0;
+        }
+        memmove(buf.data(), p, carry);
+    }
+    return lines;
+}
+
+} // namespace ksuinit
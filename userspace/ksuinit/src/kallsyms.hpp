@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include <sys/types.h>
+
+namespace ksuinit {
+
+/**
+ * The module's undefined symbols, sorted and de-duplicated so kallsyms
+ * lines can be matched by binary search. Only these names are ever looked
+ * up, so nothing else from kallsyms is stored.
+ */
+struct WantedSymbols {
+    std::vector<std::string_view> names;
+    std::vector<uint64_t> addrs;
+    std::vector<bool> found;
+    size_t remaining = 0;
+
+    void finalize();
+
+    // Index of name, or -1 when the module does not need it
+    ssize_t index_of(std::string_view name) const;
+};
+
+/**
+ * Resolve the wanted symbols from kallsyms text read from fd
+ *
+ * Reads in large chunks and stops as soon as every name has an address.
+ * Takes any fd, so it can be run on the host against a captured
+ * /proc/kallsyms.
+ *
+ * @param fd Open file with "<addr> <type> <name>[\t[module]]" lines
+ * @param wanted Finalized set; addrs/found/remaining are updated
+ * @return Number of lines scanned
+ */
+size_t kallsyms_resolve_fd(int fd, WantedSymbols& wanted);
+
+} // namespace ksuinit
@@ -5,6 +5,8 @@
  */
 
 #include "loader.hpp"
+#include "elf_patch.hpp"
+#include "kallsyms.hpp"
 #include "log.hpp"
 
 #include <cerrno>
@@ -12,12 +14,13 @@
 #include <cstdio>
 #include <cstring>
 #include <fstream>
-#include <sstream>
 #include <string>
-#include <unordered_map>
+#include <string_view>
 #include <vector>
 
-#include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/syscall.h>
 #include <unistd.h>
 
@@ -59,71 +62,70 @@ private:
 };
 
 /**
- * Parse /proc/kallsyms to get kernel symbol addresses
+ * Resolve the wanted symbols from /proc/kallsyms with real addresses shown
  */
-std::unordered_map<std::string, uint64_t> parse_kallsyms() {
+bool resolve_kallsyms(WantedSymbols& wanted) {
     KptrGuard guard;
-    
-    std::unordered_map<std::string, uint64_t> symbols;
-    
-    std::ifstream ifs("/proc/kallsyms");
-    if (!ifs.is_open()) {
+
+    int fd = open("/proc/kallsyms", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
         KLOGE("Cannot open /proc/kallsyms");
-        return symbols;
-    }
-    
-    std::string line;
-    while (std::getline(ifs, line)) {
-        std::istringstream iss(line);
-        std::string addr_str, type, name;
-        
-        if (!(iss >> addr_str >> type >> name)) {
-            continue;
-        }
-        
-        uint64_t addr = 0;
-        try {
-            addr = std::stoull(addr_str, nullptr, 16);
-        } catch (...) {
-            continue;
-        }
-        
-        // Strip version suffixes like "$..." or ".llvm...."
-        auto pos = name.find('$');
-        if (pos == std::string::npos) {
-            pos = name.find(".llvm.");
-        }
-        if (pos != std::string::npos) {
-            name = name.substr(0, pos);
-        }
-        
-        symbols[name] = addr;
+        return false;
     }
-    
-    return symbols;
+
+    size_t lines = kallsyms_resolve_fd(fd, wanted);
+    close(fd);
+    KLOGI("kallsyms: resolved %zu/%zu symbols after %zu lines", wanted.names.size() - wanted.remaining,
+          wanted.names.size(), lines);
+    return true;
 }
 
 /**
- * Read entire file into a vector
+ * Private writable mapping of the module file
+ *
+ * Pages are shared with the page cache until written, so patching the
+ * symbol table copies only those pages instead of the whole image.
  */
-bool read_file(const char* path, std::vector<uint8_t>& buffer) {
-    std::ifstream ifs(path, std::ios::binary | std::ios::ate);
-    if (!ifs.is_open()) {
-        KLOGE("Cannot open file: %s", path);
-        return false;
+class MappedModule {
+public:
+    explicit MappedModule(const char* path) {
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            KLOGE("Cannot open file: %s", path);
+            return;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* addr = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+            if (addr != MAP_FAILED) {
+                data_ = static_cast<uint8_t*>(addr);
+                size_ = static_cast<size_t>(st.st_size);
+            } else {
+                KLOGE("Cannot map file: %s: %s", path, strerror(errno));
+            }
+        } else {
+            KLOGE("Cannot stat file: %s", path);
+        }
+        close(fd);
     }
-    
-    auto size = ifs.tellg();
-    ifs.seekg(0, std::ios::beg);
-    
-    buffer.resize(static_cast<size_t>(size));
-    if (!ifs.read(reinterpret_cast<char*>(buffer.data()), size)) {
-        KLOGE("Cannot read file: %s", path);
-        return false;
+
+    ~MappedModule() {
+        if (data_) {
+            munmap(data_, size_);
+        }
     }
-    
-    return true;
-}
+
+    MappedModule(const MappedModule&) = delete;
+    MappedModule& operator=(const MappedModule&) = delete;
+
+    uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+};
 
 /**
  * Call init_module syscall
@@ -132,6 +134,47 @@ int init_module_syscall(void* module_image, unsigned long len, const char* param
     return syscall(__NR_init_module, module_image, len, param_values);
 }
 
+/**
+ * Load the patched image through finit_module on a memfd
+ *
+ * Used when init_module itself is refused; costs one copy into the memfd.
+ */
+int finit_module_memfd(const uint8_t* image, size_t len, const char* param_values) {
+#if defined(__NR_memfd_create) && defined(__NR_finit_module)
+    int fd = syscall(__NR_memfd_create, "kernelsu.ko", MFD_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+
+    size_t off = 0;
+    while (off < len) {
+        ssize_t n = write(fd, image + off, len - off);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            int saved = errno;
+            close(fd);
+            errno = saved;
+            return -1;
+        }
+        off += static_cast<size_t>(n);
+    }
+
+    int ret = syscall(__NR_finit_module, fd, param_values, 0);
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return ret;
+#else
+    (void)image;
+    (void)len;
+    (void)param_values;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
 } // anonymous namespace
 
 bool load_module(const char* path) {
@@ -141,99 +184,55 @@ bool load_module(const char* path) {
         return false;
     }
     
-    // Read the module file
-    std::vector<uint8_t> buffer;
-    if (!read_file(path, buffer)) {
-        return false;
-    }
-    
-    // Parse ELF header
-    if (buffer.size() < sizeof(Elf64_Ehdr)) {
-        KLOGE("File too small to be an ELF");
-        return false;
-    }
-    
-    auto* ehdr = reinterpret_cast<Elf64_Ehdr*>(buffer.data());
-    
-    // Verify ELF magic
-    if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0) {
-        KLOGE("Invalid ELF magic");
+    // Map the module file
+    MappedModule module(path);
+    if (!module.data()) {
         return false;
     }
-    
-    // We only support 64-bit ELF
-    if (ehdr->e_ident[EI_CLASS] != ELFCLASS64) {
-        KLOGE("Only 64-bit ELF supported");
+
+    ElfSymtab symtab;
+    if (!elf_find_symtab(module.data(), module.size(), symtab)) {
+        KLOGE("Invalid ELF or cannot find symbol table");
         return false;
     }
-    
-    // Parse kallsyms
-    auto kernel_symbols = parse_kallsyms();
-    if (kernel_symbols.empty()) {
+
+    // Collect the undefined symbols first, then resolve only those
+    WantedSymbols wanted;
+    wanted.names = elf_undefined_symbols(symtab);
+    wanted.finalize();
+
+    if (!resolve_kallsyms(wanted)) {
         KLOGE("Cannot parse kallsyms");
         return false;
     }
-    
-    // Find symbol table section
-    auto* shdr_base = reinterpret_cast<Elf64_Shdr*>(buffer.data() + ehdr->e_shoff);
-    
-    Elf64_Shdr* symtab = nullptr;
-    Elf64_Shdr* strtab = nullptr;
-    
-    for (int i = 0; i < ehdr->e_shnum; i++) {
-        auto* shdr = &shdr_base[i];
-        if (shdr->sh_type == SHT_SYMTAB) {
-            symtab = shdr;
-            // String table is linked in sh_link
-            strtab = &shdr_base[shdr->sh_link];
-            break;
-        }
-    }
-    
-    if (!symtab || !strtab) {
-        KLOGE("Cannot find symbol table");
-        return false;
-    }
-    
-    // Get pointers to symbol and string tables
-    auto* sym_base = reinterpret_cast<Elf64_Sym*>(buffer.data() + symtab->sh_offset);
-    auto* str_base = reinterpret_cast<char*>(buffer.data() + strtab->sh_offset);
-    
-    size_t sym_count = symtab->sh_size / sizeof(Elf64_Sym);
-    
+
     // Resolve undefined symbols
-    for (size_t i = 1; i < sym_count; i++) {
-        auto* sym = &sym_base[i];
-        
-        // Only process undefined symbols
-        if (sym->st_shndx != SHN_UNDEF) {
-            continue;
-        }
-        
-        // Get symbol name
-        const char* name = &str_base[sym->st_name];
-        if (!name || !*name) {
-            continue;
+    auto missing = elf_patch_undefined_symbols(symtab, [&](std::string_view name, uint64_t& addr) {
+        ssize_t idx = wanted.index_of(name);
+        if (idx < 0 || !wanted.found[idx]) {
+            return false;
         }
-        
-        // Look up in kernel symbols
-        auto it = kernel_symbols.find(name);
-        if (it == kernel_symbols.end()) {
-            KLOGW("Cannot find symbol: %s", name);
-            continue;
-        }
-        
-        // Patch the symbol
-        sym->st_shndx = SHN_ABS;
-        sym->st_value = it->second;
+        addr = wanted.addrs[idx];
+        return true;
+    });
+    for (auto name : missing) {
+        KLOGW("Cannot find symbol: %.*s", static_cast<int>(name.size()), name.data());
     }
-    
+
     // Load the module
-    if (init_module_syscall(buffer.data(), buffer.size(), "") != 0) {
-        KLOGE("init_module failed: %s", strerror(errno));
-        return false;
+    if (init_module_syscall(module.data(), module.size(), "") != 0) {
+        int err = errno;
+        if (err != ENOSYS && err != EPERM) {
+            KLOGE("init_module failed: %s", strerror(err));
+            return false;
+        }
+        KLOGW("init_module failed: %s, trying finit_module", strerror(err));
+        if (finit_module_memfd(module.data(), module.size(), "") != 0) {
+            KLOGE("finit_module failed: %s", strerror(errno));
+            return false;
+        }
     }
-    
+
     KLOGI("Module loaded successfully");
     return true;
 }
@@ -0,0 +1,10 @@
+// Compiled as a plain relocatable object for elf_patch_test: a defined
+// function referencing two undefined symbols, like a module against the
+// kernel. Never linked.
+
+extern "C" int ksuinit_fixture_func(int);
+extern "C" int ksuinit_fixture_data;
+
+extern "C" int ksuinit_fixture_entry(int x) {
+    return ksuinit_fixture_func(x) + ksuinit_fixture_data;
+}
@@ -0,0 +1,383 @@
+// Host test for elf_patch: symbol table lookup and bounds checks on
+// hand-built images, and symbol patching on a real relocatable object.
+//
+// usage: elf_patch_test [object.o|module.ko]
+//
+// With an object, its undefined symbols are resolved to fake addresses
+// and checked to be absolute afterwards.
+
+#include "check.hpp"
+
+#include "elf_patch.hpp"
+
+#include <cstring>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace ksuinit_test;
+
+namespace {
+
+// The same name layout the builder below writes into .strtab
+struct TestSym {
+    std::string name;
+    uint16_t shndx;
+    uint64_t value;
+};
+
+const std::vector<TestSym> kSyms = {
+    {"printk", SHN_UNDEF, 0},
+    {"kallsyms_lookup_name", SHN_UNDEF, 0},
+    {"ksu_init", 3, 0x40},
+    {"not_in_kernel", SHN_UNDEF, 0},
+};
+
+// ehdr | .strtab | .symtab | shdrs[null, .strtab, .symtab, .text]
+struct Image {
+    std::vector<uint8_t> data;
+    size_t strtab_off = 0;
+    size_t symtab_off = 0;
+    size_t shdr_off = 0;
+
+    Elf64_Ehdr* ehdr() { return reinterpret_cast<Elf64_Ehdr*>(data.data()); }
+    Elf64_Shdr* shdr(int i) { return reinterpret_cast<Elf64_Shdr*>(data.data() + shdr_off) + i; }
+    Elf64_Sym* sym(int i) { return reinterpret_cast<Elf64_Sym*>(data.data() + symtab_off) + i; }
+};
+
+size_t align8(size_t n) {
+    return (n + 7) & ~size_t(7);
+}
+
+Image build_image() {
+    Image img;
+    std::string strtab(1, '\0');
+    std::vector<Elf64_Sym> syms(1);
+    for (const auto& s : kSyms) {
+        Elf64_Sym sym = {};
+        sym.st_name = static_cast<uint32_t>(strtab.size());
+        sym.st_info = ELF64_ST_INFO(STB_GLOBAL, s.shndx == SHN_UNDEF ? STT_NOTYPE : STT_FUNC);
+        sym.st_shndx = s.shndx;
+        sym.st_value = s.value;
+        syms.push_back(sym);
+        strtab += s.name;
+        strtab += '\0';
+    }
+
+    img.strtab_off = sizeof(Elf64_Ehdr);
+    img.symtab_off = align8(img.strtab_off + strtab.size());
+    img.shdr_off = align8(img.symtab_off + syms.size() * sizeof(Elf64_Sym));
+    img.data.assign(img.shdr_off + 4 * sizeof(Elf64_Shdr), 0);
+
+    Elf64_Ehdr* e = img.ehdr();
+    memcpy(e->e_ident, ELFMAG, SELFMAG);
+    e->e_ident[EI_CLASS] = ELFCLASS64;
+    e->e_ident[EI_DATA] = ELFDATA2LSB;
+    e->e_ident[EI_VERSION] = EV_CURRENT;
+    e->e_type = ET_REL;
+    e->e_version = EV_CURRENT;
+    e->e_ehsize = sizeof(Elf64_Ehdr);
+    e->e_shoff = img.shdr_off;
+    e->e_shentsize = sizeof(Elf64_Shdr);
+    e->e_shnum = 4;
+
+    memcpy(img.data.data() + img.strtab_off, strtab.data(), strtab.size());
+    memcpy(img.data.data() + img.symtab_off, syms.data(), syms.size() * sizeof(Elf64_Sym));
+
+    img.shdr(1)->sh_type = SHT_STRTAB;
+    img.shdr(1)->sh_offset = img.strtab_off;
+    img.shdr(1)->sh_size = strtab.size();
+    img.shdr(2)->sh_type = SHT_SYMTAB;
+    img.shdr(2)->sh_offset = img.symtab_off;
+    img.shdr(2)->sh_size = syms.size() * sizeof(Elf64_Sym);
+    img.shdr(2)->sh_link = 1;
+    img.shdr(2)->sh_entsize = sizeof(Elf64_Sym);
+    img.shdr(3)->sh_type = SHT_PROGBITS;
+    return img;
+}
+
+bool finds(Image& img, size_t size) {
+    ksuinit::ElfSymtab symtab;
+    return ksuinit::elf_find_symtab(img.data.data(), size, symtab);
+}
+
+bool finds(Image& img) {
+    return finds(img, img.data.size());
+}
+
+// A result from a mangled image must still lie inside the image
+void check_inside(const Image& img, size_t size, const ksuinit::ElfSymtab& symtab) {
+    const uint8_t* begin = img.data.data();
+    const uint8_t* end = begin + size;
+    auto* syms = reinterpret_cast<const uint8_t*>(symtab.syms);
+    CHECK(syms >= begin && syms + symtab.count * sizeof(Elf64_Sym) <= end);
+    auto* str = reinterpret_cast<const uint8_t*>(symtab.strtab);
+    CHECK(str >= begin && str + symtab.strtab_size <= end);
+    for (size_t i = 0; i < symtab.count; i++) {
+        std::string_view name = symtab.name(i);
+        if (!name.empty()) {
+            CHECK(reinterpret_cast<const uint8_t*>(name.data()) >= str);
+            CHECK(reinterpret_cast<const uint8_t*>(name.data() + name.size()) <=
+                  str + symtab.strtab_size);
+        }
+    }
+}
+
+void test_valid() {
+    Image img = build_image();
+    ksuinit::ElfSymtab symtab;
+    CHECK(ksuinit::elf_find_symtab(img.data.data(), img.data.size(), symtab));
+    CHECK(symtab.count == kSyms.size() + 1);
+    CHECK(symtab.name(0).empty());
+    for (size_t i = 0; i < kSyms.size(); i++) {
+        CHECK(symtab.name(i + 1) == kSyms[i].name);
+    }
+
+    auto undef = ksuinit::elf_undefined_symbols(symtab);
+    CHECK(undef.size() == 3);
+    CHECK(undef.size() == 3 && undef[0] == "printk" && undef[1] == "kallsyms_lookup_name" &&
+          undef[2] == "not_in_kernel");
+}
+
+void test_patch() {
+    Image img = build_image();
+    ksuinit::ElfSymtab symtab;
+    CHECK(ksuinit::elf_find_symtab(img.data.data(), img.data.size(), symtab));
+
+    const std::map<std::string_view, uint64_t> kernel = {
+        {"printk", 0xffffffc008123450ull},
+        {"kallsyms_lookup_name", 0xffffffc008abcde0ull},
+        {"ksu_init", 0xdead},
+    };
+    std::vector<std::string_view> asked;
+    auto missing = ksuinit::elf_patch_undefined_symbols(
+        symtab, [&](std::string_view name, uint64_t& addr) {
+            asked.push_back(name);
+            auto it = kernel.find(name);
+            if (it == kernel.end()) {
+                return false;
+            }
+            addr = it->second;
+            return true;
+        });
+
+    // Only undefined symbols are looked up, and only unknown ones reported
+    CHECK(asked.size() == 3);
+    CHECK(missing.size() == 1 && missing[0] == "not_in_kernel");
+
+    // The patch writes through to the image
+    CHECK(img.sym(1)->st_shndx == SHN_ABS && img.sym(1)->st_value == 0xffffffc008123450ull);
+    CHECK(img.sym(2)->st_shndx == SHN_ABS && img.sym(2)->st_value == 0xffffffc008abcde0ull);
+    CHECK(img.sym(3)->st_shndx == 3 && img.sym(3)->st_value == 0x40);
+    CHECK(img.sym(4)->st_shndx == SHN_UNDEF && img.sym(4)->st_value == 0);
+    CHECK(ksuinit::elf_undefined_symbols(symtab).size() == 1);
+}
+
+void test_header() {
+    Image img = build_image();
+    CHECK(!finds(img, sizeof(Elf64_Ehdr) - 1));
+    CHECK(!finds(img, 0));
+
+    img = build_image();
+    img.ehdr()->e_ident[EI_MAG1] = 'X';
+    CHECK(!finds(img));
+
+    img = build_image();
+    img.ehdr()->e_ident[EI_CLASS] = ELFCLASS32;
+    CHECK(!finds(img));
+
+    img = build_image();
+    img.ehdr()->e_shentsize = sizeof(Elf64_Shdr) - 1;
+    CHECK(!finds(img));
+
+    // No SHT_SYMTAB at all
+    img = build_image();
+    img.shdr(2)->sh_type = SHT_PROGBITS;
+    CHECK(!finds(img));
+}
+
+void test_truncated_shdrs() {
+    // Section headers sit at the end, so any cut loses part of them
+    Image img = build_image();
+    for (size_t size = sizeof(Elf64_Ehdr); size < img.data.size(); size++) {
+        CHECK(!finds(img, size));
+    }
+
+    img = build_image();
+    img.ehdr()->e_shnum = 5;
+    CHECK(!finds(img));
+
+    img = build_image();
+    img.ehdr()->e_shnum = 0xffff;
+    CHECK(!finds(img));
+
+    img = build_image();
+    img.ehdr()->e_shoff = img.data.size();
+    CHECK(!finds(img));
+
+    // offset + length wrapping around
+    img = build_image();
+    img.ehdr()->e_shoff = ~uint64_t(0) - 8;
+    CHECK(!finds(img));
+
+    // Headers that could only be read through a misaligned pointer
+    img = build_image();
+    img.data.insert(img.data.begin() + img.shdr_off, 4, 0);
+    img.ehdr()->e_shoff += 4;
+    CHECK(!finds(img));
+}
+
+void test_section_bounds() {
+    Image img = build_image();
+    const size_t size = img.data.size();
+
+    img.shdr(2)->sh_link = 4;
+    CHECK(!finds(img));
+
+    img = build_image();
+    img.shdr(2)->sh_offset = size;
+    CHECK(!finds(img));
+
+    img = build_image();
+    img.shdr(2)->sh_size = size - img.symtab_off + 1;
+    CHECK(!finds(img));
+
+    img = build_image();
+    img.shdr(2)->sh_offset = ~uint64_t(0) - 8;
+    img.shdr(2)->sh_size = 16;
+    CHECK(!finds(img));
+
+    img = build_image();
+    img.shdr(2)->sh_offset += 4;
+    img.shdr(2)->sh_size -= sizeof(Elf64_Sym);
+    CHECK(!finds(img));
+
+    img = build_image();
+    img.shdr(1)->sh_offset = size + 1;
+    CHECK(!finds(img));
+
+    img = build_image();
+    img.shdr(1)->sh_size = size - img.strtab_off + 1;
+    CHECK(!finds(img));
+
+    img = build_image();
+    img.shdr(1)->sh_offset = 8;
+    img.shdr(1)->sh_size = ~uint64_t(0);
+    CHECK(!finds(img));
+
+    // A symtab size that is not a whole number of entries is rounded down
+    img = build_image();
+    img.shdr(2)->sh_size -= 1;
+    ksuinit::ElfSymtab symtab;
+    CHECK(ksuinit::elf_find_symtab(img.data.data(), size, symtab));
+    CHECK(symtab.count == kSyms.size());
+}
+
+void test_strtab_bounds() {
+    // st_name past the string table: the symbol has no name and is skipped
+    Image img = build_image();
+    img.sym(1)->st_name = static_cast<uint32_t>(img.shdr(1)->sh_size);
+    ksuinit::ElfSymtab symtab;
+    CHECK(ksuinit::elf_find_symtab(img.data.data(), img.data.size(), symtab));
+    CHECK(symtab.name(1).empty());
+    auto undef = ksuinit::elf_undefined_symbols(symtab);
+    CHECK(undef.size() == 2 && undef[0] == "kallsyms_lookup_name");
+    auto missing = ksuinit::elf_patch_undefined_symbols(
+        symtab, [](std::string_view, uint64_t&) { return false; });
+    CHECK(missing.size() == 2);
+    CHECK(img.sym(1)->st_shndx == SHN_UNDEF);
+
+    img = build_image();
+    img.sym(1)->st_name = 0xffffffff;
+    CHECK(ksuinit::elf_find_symtab(img.data.data(), img.data.size(), symtab));
+    CHECK(symtab.name(1).empty());
+
+    // Last name without its terminator: cut at the table end, not read past
+    img = build_image();
+    img.data[img.strtab_off + img.shdr(1)->sh_size - 1] = 'X';
+    img.shdr(1)->sh_size -= 2;
+    CHECK(ksuinit::elf_find_symtab(img.data.data(), img.data.size(), symtab));
+    CHECK(symtab.name(4) == "not_in_kerne");
+}
+
+// Random byte flips in the headers: never crash, never point outside the
+// image (run under ASan to make stray reads visible)
+void test_mutations() {
+    const Image base = build_image();
+    std::mt19937 rng(42);
+    for (int i = 0; i < 20000; i++) {
+        Image img = base;
+        int flips = 1 + static_cast<int>(rng() % 4);
+        for (int f = 0; f < flips; f++) {
+            // Mostly the ELF and section headers, where the offsets live
+            size_t at = (rng() % 2) ? rng() % sizeof(Elf64_Ehdr)
+                                    : img.shdr_off + rng() % (4 * sizeof(Elf64_Shdr));
+            img.data[at] = static_cast<uint8_t>(rng());
+        }
+        ksuinit::ElfSymtab symtab;
+        if (ksuinit::elf_find_symtab(img.data.data(), img.data.size(), symtab)) {
+            check_inside(img, img.data.size(), symtab);
+            ksuinit::elf_undefined_symbols(symtab);
+        }
+    }
+}
+
+void test_object(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        g_failures++;
+        return;
+    }
+    Image img;
+    uint8_t buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        img.data.insert(img.data.end(), buf, buf + n);
+    }
+    fclose(f);
+
+    ksuinit::ElfSymtab symtab;
+    CHECK(ksuinit::elf_find_symtab(img.data.data(), img.data.size(), symtab));
+    if (g_failures) {
+        return;
+    }
+    check_inside(img, img.data.size(), symtab);
+
+    auto undef = ksuinit::elf_undefined_symbols(symtab);
+    printf("%s: %zu symbols, %zu undefined\n", path, symtab.count, undef.size());
+    CHECK(!undef.empty());
+
+    uint64_t next = 0xffffffc008000000ull;
+    auto missing = ksuinit::elf_patch_undefined_symbols(
+        symtab, [&](std::string_view, uint64_t& addr) {
+            addr = next;
+            next += 0x10;
+            return true;
+        });
+    CHECK(missing.empty());
+    CHECK(ksuinit::elf_undefined_symbols(symtab).empty());
+    for (size_t i = 1; i < symtab.count; i++) {
+        if (symtab.syms[i].st_shndx == SHN_ABS && !symtab.name(i).empty() &&
+            symtab.syms[i].st_value >= 0xffffffc008000000ull) {
+            CHECK(symtab.syms[i].st_value < next);
+        }
+    }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    test_valid();
+    test_patch();
+    test_header();
+    test_truncated_shdrs();
+    test_section_bounds();
+    test_strtab_bounds();
+    test_mutations();
+    if (argc > 1) {
+        test_object(argv[1]);
+    }
+    return check_result();
+}
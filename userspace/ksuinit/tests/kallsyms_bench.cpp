@@ -0,0 +1,157 @@
+// Cost of resolving a module's undefined symbols from kallsyms.
+//
+// usage: kallsyms_bench [kallsyms] [module.ko] [rounds]
+//
+// kallsyms is a captured /proc/kallsyms (cat it as root with kptr_restrict
+// at 1 so the addresses are real); without one a synthetic file with
+// 200000 lines is used. The wanted names are the undefined symbols of
+// module.ko, or else 500 names sampled across the file. "all found" stops
+// at the last wanted line; "one missing" adds a name kallsyms does not have
+// and so reads the whole file, as happens when a symbol is gone.
+
+#include "check.hpp"
+
+#include "elf_patch.hpp"
+#include "kallsyms.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace ksuinit_test;
+
+namespace {
+
+std::string read_all(const std::string& path) {
+    std::string data;
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) {
+        perror(path.c_str());
+        exit(1);
+    }
+    char buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        data.append(buf, n);
+    }
+    fclose(f);
+    return data;
+}
+
+// Same shape as a GKI kallsyms: text and data symbols, some with
+// ".llvm.<hash>" suffixes, the tail belonging to loaded modules
+std::string make_kallsyms(size_t lines) {
+    static const char types[] = "TtDdBbRrWV";
+    std::mt19937 rng(1);
+    std::string out;
+    char line[160];
+    uint64_t addr = 0xffffffc008000000ull;
+    for (size_t i = 0; i < lines; i++) {
+        addr += 16 + rng() % 512;
+        const char* suffix = (rng() % 20 == 0) ? ".llvm.1234567890123456789" : "";
+        const char* module = (i > lines - lines / 10) ? "\t[some_module]" : "";
+        snprintf(line, sizeof(line), "%016llx %c kernel_sym_%zu%s%s\n",
+                 static_cast<unsigned long long>(addr), types[rng() % 10], i, suffix, module);
+        out += line;
+    }
+    return out;
+}
+
+// Every stride-th symbol name of the file, suffix stripped
+std::vector<std::string> sample_names(const std::string& text, size_t count) {
+    std::vector<std::string> all;
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t nl = text.find('\n', pos);
+        if (nl == std::string::npos) {
+            nl = text.size();
+        }
+        size_t name = text.find(' ', text.find(' ', pos) + 1) + 1;
+        size_t end = text.find_first_of(" \t\n$", name);
+        std::string sym = text.substr(name, std::min(end, nl) - name);
+        size_t llvm = sym.find(".llvm.");
+        all.push_back(llvm == std::string::npos ? sym : sym.substr(0, llvm));
+        pos = nl + 1;
+    }
+    std::vector<std::string> names;
+    size_t stride = std::max<size_t>(1, all.size() / count);
+    for (size_t i = stride - 1; i < all.size() && names.size() < count; i += stride) {
+        names.push_back(all[i]);
+    }
+    return names;
+}
+
+void bench(const char* name, const std::string& path, const std::vector<std::string_view>& names,
+           int rounds) {
+    using clock = std::chrono::steady_clock;
+    auto best = clock::duration::max();
+    auto total = clock::duration::zero();
+    size_t lines = 0;
+    size_t resolved = 0;
+    for (int i = 0; i <= rounds; i++) {
+        ksuinit::WantedSymbols wanted;
+        wanted.names = names;
+        wanted.finalize();
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            perror(path.c_str());
+            exit(1);
+        }
+        auto start = clock::now();
+        lines = ksuinit::kallsyms_resolve_fd(fd, wanted);
+        auto elapsed = clock::now() - start;
+        close(fd);
+        resolved = wanted.names.size() - wanted.remaining;
+        if (i == 0) {
+            continue;  // warm the page cache
+        }
+        total += elapsed;
+        best = std::min(best, elapsed);
+    }
+    auto us = [](clock::duration d) {
+        return std::chrono::duration<double, std::micro>(d).count();
+    };
+    double avg = us(total) / rounds;
+    printf("%-12s %zu/%zu resolved, %zu lines  avg %9.1f us  min %9.1f us  %.1f Mlines/s\n",
+           name, resolved, names.size(), lines, avg, us(best), lines / avg);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    std::string path = argc > 1 ? argv[1] : write_scratch("kallsyms", make_kallsyms(200000));
+    int rounds = argc > 3 ? atoi(argv[3]) : 50;
+    if (rounds <= 0) {
+        rounds = 50;
+    }
+    const std::string text = read_all(path);
+
+    // Owns the names the string_views below point into
+    std::string module;
+    std::vector<std::string> sampled;
+    std::vector<std::string_view> names;
+    if (argc > 2) {
+        module = read_all(argv[2]);
+        ksuinit::ElfSymtab symtab;
+        if (!ksuinit::elf_find_symtab(reinterpret_cast<uint8_t*>(module.data()), module.size(),
+                                      symtab)) {
+            fprintf(stderr, "%s: no symbol table\n", argv[2]);
+            return 1;
+        }
+        names = ksuinit::elf_undefined_symbols(symtab);
+    } else {
+        sampled = sample_names(text, 500);
+        names.assign(sampled.begin(), sampled.end());
+    }
+    printf("%s: %zu bytes, %zu wanted symbols\n", path.c_str(), text.size(), names.size());
+
+    bench("all found", path, names, rounds);
+    names.push_back("ksuinit_bench_no_such_symbol");
+    bench("one missing", path, names, rounds);
+    return 0;
+}